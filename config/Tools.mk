@@ -0,0 +1,64 @@
+# Prefix and install folder
+prefix              := /usr/local
+PREFIX              := $(prefix)
+exec_prefix         := ${prefix}
+libdir              := ${exec_prefix}/lib
+LIBDIR              := $(libdir)
+
+# A debug build of tools?
+debug               := y
+
+# Tools path
+BISON               := /usr/bin/bison
+FLEX                := 
+PYTHON              := python
+PYTHON_PATH         := /root/.pyenv/versions/2.7.18/bin/python
+PERL                := /usr/bin/perl
+CURL_CONFIG         := 
+XML2_CONFIG         := 
+BASH                := /bin/bash
+XGETTTEXT           := /tmp/stubs/xgettext
+AS86                := /tmp/stubs/as86
+LD86                := /tmp/stubs/ld86
+BCC                 := /tmp/stubs/bcc
+IASL                := /tmp/stubs/iasl
+FETCHER             := /usr/bin/wget -c -O
+
+# Extra folder for libs/includes
+PREPEND_INCLUDES    := 
+PREPEND_LIB         := 
+APPEND_INCLUDES     := 
+APPEND_LIB          := 
+
+PTHREAD_CFLAGS      := -pthread
+PTHREAD_LDFLAGS     := -pthread
+PTHREAD_LIBS        := 
+
+PTYFUNCS_LIBS       := -lutil
+
+# Download GIT repositories via HTTP or GIT's own protocol?
+# GIT's protocol is faster and more robust, when it works at all (firewalls
+# may block it). We make it the default, but if your GIT repository downloads
+# fail or hang, please specify GIT_HTTP=y in your environment.
+GIT_HTTP            := n
+
+# Optional components
+XENSTAT_XENTOP      := n
+LIBXENAPI_BINDINGS  := n
+OCAML_TOOLS         := n
+FLASK_POLICY        := n
+CONFIG_MINITERM     := n
+CONFIG_LOMOUNT      := n
+CONFIG_OVMF         := n
+CONFIG_ROMBIOS      := n
+CONFIG_SEABIOS      := n
+
+#System options
+CONFIG_SYSTEM_LIBAIO:= n
+ZLIB                :=  -DHAVE_BZLIB -lbz2 -DHAVE_LZMA -llzma
+CONFIG_LIBICONV     := n
+CONFIG_GCRYPT       := y
+EXTFS_LIBS          := 
+CURSES_LIBS         := -lncurses
+
+FILE_OFFSET_BITS    := 
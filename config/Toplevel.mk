@@ -0,0 +1 @@
+SUBSYSTEMS               :=  xen kernels tools
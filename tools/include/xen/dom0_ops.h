@@ -0,0 +1 @@
+/root/repo/tools/include/../../xen/include/public/dom0_ops.h
\ No newline at end of file
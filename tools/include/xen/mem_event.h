@@ -0,0 +1 @@
+/root/repo/tools/include/../../xen/include/public/mem_event.h
\ No newline at end of file
@@ -0,0 +1 @@
+/root/repo/tools/include/../../xen/include/public/xen-compat.h
\ No newline at end of file
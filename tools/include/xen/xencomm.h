@@ -0,0 +1 @@
+/root/repo/tools/include/../../xen/include/public/xencomm.h
\ No newline at end of file
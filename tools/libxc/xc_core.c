@@ -59,6 +59,11 @@
  *  |.shstrtab: section header string table                  |
  *  +--------------------------------------------------------+
  *
+ * When the dump is compressed (XC_DUMPCORE_COMPRESS), .xen_pages is an
+ * ELF compressed section (SHF_COMPRESSED): an Elf64_Chdr followed by one
+ * zlib stream of the pages.  The stream is made of independently
+ * deflated slices, so that several threads can compress it; the
+ * sections after it move to wherever the stream ends.
  */
 
 #include "xg_private.h"
@@ -66,10 +71,33 @@
 #include "xc_dom.h"
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
 
 /* number of pages to write at a time */
 #define DUMP_INCREMENT (4 * 1024)
 
+/* number of pages to map at a time */
+#define DUMP_MAP_BATCH 1024
+
+/* pages deflated independently, and so by different threads */
+#define DUMP_SLICE_PAGES 256
+#define DUMP_SLICES (DUMP_INCREMENT / DUMP_SLICE_PAGES)
+#define DUMP_MAX_THREADS 64
+
+#ifndef SHF_COMPRESSED
+#define SHF_COMPRESSED      (1 << 11)
+#endif
+#define DUMP_ELFCOMPRESS_ZLIB 1
+
+/* Elf64_Chdr */
+struct dump_chdr {
+    Elf64_Word  ch_type;
+    Elf64_Word  ch_reserved;
+    Elf64_Xword ch_size;
+    Elf64_Xword ch_addralign;
+};
+
 /* string table */
 struct xc_core_strtab {
     char       *strings;
@@ -435,11 +463,421 @@ get_guest_width(xc_interface *xch,
     return 0;
 }
 
-int
-xc_domain_dumpcore_via_callback(xc_interface *xch,
-                                uint32_t domid,
-                                void *args,
-                                dumpcore_rtn_t dump_rtn)
+/* A batch of pages of .xen_pages being compressed */
+struct dump_zbatch {
+    char *buf;                  /* DUMP_INCREMENT pages */
+    char *out;                  /* DUMP_SLICES slices of slice_bound bytes */
+    unsigned long len;
+    unsigned int nr_slices;
+    unsigned int next;          /* slice for the next free thread */
+    unsigned int done;
+    int err;
+    unsigned long outlen[DUMP_SLICES];
+    uLong adler[DUMP_SLICES];
+};
+
+struct dump_zctx {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* a batch was handed to the threads */
+    pthread_cond_t done;        /* ... and is compressed */
+    unsigned int nr_threads;
+    pthread_t threads[DUMP_MAX_THREADS];
+    int exit;
+
+    z_stream zs;                /* when compressing without threads */
+    unsigned long slice_bound;
+    struct dump_zbatch batch[2];
+    unsigned int fill;          /* batch being filled with pages */
+    struct dump_zbatch *busy;   /* batch being compressed, or NULL */
+
+    uLong adler;                /* of the whole section */
+    uint64_t out;               /* bytes of the section written so far */
+};
+
+/*
+ * Where the pages of .xen_pages go: to dump_rtn DUMP_INCREMENT pages at
+ * a time, or through the compressor.
+ */
+struct dump_pages {
+    xc_interface *xch;
+    void *args;
+    dumpcore_rtn_t *dump_rtn;
+    char *buf;
+    unsigned long nr;           /* pages in buf */
+    struct dump_zctx *z;
+};
+
+static int
+dump_zslice(z_stream *zs, struct dump_zctx *z, struct dump_zbatch *b,
+            unsigned int i)
+{
+    unsigned long off = (unsigned long)i * DUMP_SLICE_PAGES * PAGE_SIZE;
+    unsigned long len = b->len - off;
+
+    if ( len > DUMP_SLICE_PAGES * PAGE_SIZE )
+        len = DUMP_SLICE_PAGES * PAGE_SIZE;
+
+    /* A sync flush ends each slice on a byte boundary without ending the
+     * stream, so the slices concatenate into one deflate stream. */
+    if ( deflateReset(zs) != Z_OK )
+        return -1;
+    zs->next_in = (Bytef *)b->buf + off;
+    zs->avail_in = len;
+    zs->next_out = (Bytef *)b->out + i * z->slice_bound;
+    zs->avail_out = z->slice_bound;
+    if ( deflate(zs, Z_SYNC_FLUSH) != Z_OK ||
+         zs->avail_in != 0 || zs->avail_out == 0 )
+        return -1;
+
+    b->outlen[i] = z->slice_bound - zs->avail_out;
+    b->adler[i] = adler32(adler32(0L, Z_NULL, 0), (Bytef *)b->buf + off, len);
+    return 0;
+}
+
+static int dump_zstream_init(z_stream *zs)
+{
+    memset(zs, 0, sizeof(*zs));
+    return deflateInit2(zs, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8,
+                        Z_DEFAULT_STRATEGY) == Z_OK ? 0 : -1;
+}
+
+static void *dump_zthread(void *arg)
+{
+    struct dump_zctx *z = arg;
+    struct dump_zbatch *b;
+    z_stream zs;
+    unsigned int i;
+    int ok = !dump_zstream_init(&zs);
+
+    pthread_mutex_lock(&z->lock);
+    for ( ; ; )
+    {
+        while ( !z->exit && (!z->busy || z->busy->next == z->busy->nr_slices) )
+            pthread_cond_wait(&z->work, &z->lock);
+        if ( z->exit )
+            break;
+
+        b = z->busy;
+        i = b->next++;
+        pthread_mutex_unlock(&z->lock);
+
+        if ( !ok || dump_zslice(&zs, z, b, i) )
+            b->err = 1;
+
+        pthread_mutex_lock(&z->lock);
+        if ( ++b->done == b->nr_slices )
+            pthread_cond_signal(&z->done);
+    }
+    pthread_mutex_unlock(&z->lock);
+
+    if ( ok )
+        deflateEnd(&zs);
+    return NULL;
+}
+
+static void dump_zdestroy(struct dump_zctx *z)
+{
+    unsigned int i;
+
+    if ( z == NULL )
+        return;
+
+    pthread_mutex_lock(&z->lock);
+    z->exit = 1;
+    pthread_cond_broadcast(&z->work);
+    pthread_mutex_unlock(&z->lock);
+    for ( i = 0; i < z->nr_threads; i++ )
+        pthread_join(z->threads[i], NULL);
+
+    deflateEnd(&z->zs);
+    for ( i = 0; i < 2; i++ )
+    {
+        free(z->batch[i].buf);
+        free(z->batch[i].out);
+    }
+    pthread_cond_destroy(&z->done);
+    pthread_cond_destroy(&z->work);
+    pthread_mutex_destroy(&z->lock);
+    free(z);
+}
+
+static struct dump_zctx *
+dump_zcreate(xc_interface *xch, unsigned int nr_threads)
+{
+    struct dump_zctx *z;
+    unsigned int i;
+
+    if ( nr_threads > DUMP_MAX_THREADS )
+        nr_threads = DUMP_MAX_THREADS;
+
+    if ( (z = calloc(1, sizeof(*z))) == NULL )
+        return NULL;
+    pthread_mutex_init(&z->lock, NULL);
+    pthread_cond_init(&z->work, NULL);
+    pthread_cond_init(&z->done, NULL);
+    if ( dump_zstream_init(&z->zs) )
+    {
+        ERROR("Could not initialise zlib");
+        free(z);
+        return NULL;
+    }
+
+    /* room for a slice that does not compress, and its sync flush */
+    z->slice_bound = deflateBound(&z->zs, DUMP_SLICE_PAGES * PAGE_SIZE) + 16;
+    for ( i = 0; i < 2; i++ )
+    {
+        z->batch[i].buf = malloc(DUMP_INCREMENT * PAGE_SIZE);
+        z->batch[i].out = malloc(DUMP_SLICES * z->slice_bound);
+        if ( z->batch[i].buf == NULL || z->batch[i].out == NULL )
+        {
+            PERROR("Could not allocate compression buffers");
+            dump_zdestroy(z);
+            return NULL;
+        }
+    }
+    z->adler = adler32(0L, Z_NULL, 0);
+
+    for ( i = 0; i < nr_threads; i++ )
+    {
+        if ( pthread_create(&z->threads[i], NULL, dump_zthread, z) )
+        {
+            /* compress with those we have, or in this thread */
+            PERROR("Could not start compression thread %u", i);
+            break;
+        }
+        z->nr_threads++;
+    }
+
+    return z;
+}
+
+/* Write out the batch being compressed, once it is */
+static int dump_zwrite(struct dump_pages *dp)
+{
+    xc_interface *xch = dp->xch;
+    struct dump_zctx *z = dp->z;
+    struct dump_zbatch *b = z->busy;
+    unsigned int i;
+    int sts;
+
+    if ( b == NULL )
+        return 0;
+
+    pthread_mutex_lock(&z->lock);
+    while ( b->done < b->nr_slices )
+        pthread_cond_wait(&z->done, &z->lock);
+    z->busy = NULL;
+    pthread_mutex_unlock(&z->lock);
+
+    if ( b->err )
+    {
+        ERROR("Could not compress pages");
+        return -1;
+    }
+
+    for ( i = 0; i < b->nr_slices; i++ )
+    {
+        sts = dp->dump_rtn(xch, dp->args, b->out + i * z->slice_bound,
+                           b->outlen[i]);
+        if ( sts != 0 )
+            return sts;
+        z->out += b->outlen[i];
+        z->adler = adler32_combine(z->adler, b->adler[i],
+                                   i < b->nr_slices - 1
+                                   ? DUMP_SLICE_PAGES * PAGE_SIZE
+                                   : b->len - i * DUMP_SLICE_PAGES * PAGE_SIZE);
+    }
+    return 0;
+}
+
+/*
+ * Hand the pages filled so far to the compressor, after writing out the
+ * previous batch: the threads compress one batch while the next is
+ * being mapped and copied.
+ */
+static int dump_zflush(struct dump_pages *dp)
+{
+    struct dump_zctx *z = dp->z;
+    struct dump_zbatch *b = &z->batch[z->fill];
+    unsigned int i;
+    int sts;
+
+    sts = dump_zwrite(dp);
+    if ( sts != 0 || dp->nr == 0 )
+        return sts;
+
+    b->len = dp->nr * PAGE_SIZE;
+    b->nr_slices = (dp->nr + DUMP_SLICE_PAGES - 1) / DUMP_SLICE_PAGES;
+    b->next = b->done = 0;
+    b->err = 0;
+
+    if ( z->nr_threads == 0 )
+    {
+        for ( i = 0; i < b->nr_slices; i++ )
+            if ( dump_zslice(&z->zs, z, b, i) )
+                b->err = 1;
+        b->next = b->done = b->nr_slices;
+        z->busy = b;
+    }
+    else
+    {
+        pthread_mutex_lock(&z->lock);
+        z->busy = b;
+        pthread_cond_broadcast(&z->work);
+        pthread_mutex_unlock(&z->lock);
+    }
+
+    z->fill ^= 1;
+    dp->buf = z->batch[z->fill].buf;
+    return 0;
+}
+
+/* The compression header and the start of the zlib stream */
+static int dump_zstart(struct dump_pages *dp, unsigned long nr_pages)
+{
+    struct dump_chdr chdr = {
+        .ch_type = DUMP_ELFCOMPRESS_ZLIB,
+        .ch_size = (uint64_t)nr_pages * PAGE_SIZE,
+        .ch_addralign = PAGE_SIZE,
+    };
+    /* deflate, 32K window, fastest level */
+    char zhdr[2] = { 0x78, 0x01 };
+    int sts;
+
+    sts = dp->dump_rtn(dp->xch, dp->args, (char *)&chdr, sizeof(chdr));
+    if ( sts == 0 )
+        sts = dp->dump_rtn(dp->xch, dp->args, zhdr, sizeof(zhdr));
+    dp->z->out = sizeof(chdr) + sizeof(zhdr);
+    return sts;
+}
+
+/* Close the zlib stream; returns the size of the whole section */
+static int dump_zfinish(struct dump_pages *dp, uint64_t *size)
+{
+    struct dump_zctx *z = dp->z;
+    /* an empty final block, then the adler32 of the pages */
+    unsigned char trailer[6] = { 0x03, 0x00 };
+    int sts;
+
+    sts = dump_zflush(dp);
+    if ( sts == 0 )
+        sts = dump_zwrite(dp);
+    if ( sts != 0 )
+        return sts;
+
+    trailer[2] = z->adler >> 24;
+    trailer[3] = z->adler >> 16;
+    trailer[4] = z->adler >> 8;
+    trailer[5] = z->adler;
+    sts = dp->dump_rtn(dp->xch, dp->args, (char *)trailer, sizeof(trailer));
+    *size = z->out + sizeof(trailer);
+    return sts;
+}
+
+static int dump_pages_flush(struct dump_pages *dp)
+{
+    int sts = 0;
+
+    if ( dp->z != NULL )
+        sts = dump_zflush(dp);
+    else if ( dp->nr != 0 )
+        sts = dp->dump_rtn(dp->xch, dp->args, dp->buf, dp->nr * PAGE_SIZE);
+    dp->nr = 0;
+    return sts;
+}
+
+/* The next page of the section, to be filled in before dump_pages_put() */
+static char *dump_pages_slot(struct dump_pages *dp)
+{
+    return dp->buf + dp->nr * PAGE_SIZE;
+}
+
+static int dump_pages_put(struct dump_pages *dp)
+{
+    if ( ++dp->nr == DUMP_INCREMENT )
+        return dump_pages_flush(dp);
+    return 0;
+}
+
+/* Pages of the guest to go into .xen_pages, mapped together */
+struct dump_batch {
+    unsigned int nr;
+    xen_pfn_t pfn[DUMP_MAP_BATCH];
+    xen_pfn_t gmfn[DUMP_MAP_BATCH];
+    int err[DUMP_MAP_BATCH];
+};
+
+/*
+ * Copy the pages of a batch that could be mapped into the section and
+ * fill in their p2m/pfn entries from *j onwards.  The others are left
+ * out, as if they were not in the memory map.
+ */
+static int
+dump_page_batch(xc_interface *xch, uint32_t domid, struct dump_pages *dp,
+                struct dump_batch *b, struct xen_dumpcore_p2m *p2m_array,
+                uint64_t *pfn_array, unsigned long *j)
+{
+    char *vaddr, *page;
+    unsigned int k;
+    int sts = 0;
+
+    if ( b->nr == 0 )
+        return 0;
+
+    vaddr = xc_map_foreign_bulk(xch, domid, PROT_READ, b->gmfn, b->err,
+                                b->nr);
+    if ( vaddr == NULL )
+        PERROR("Could not map a batch of %u pages of dom %d, "
+               "mapping them one at a time", b->nr, domid);
+
+    for ( k = 0; k < b->nr; k++ )
+    {
+        if ( vaddr != NULL )
+        {
+            if ( b->err[k] )
+                continue;
+            page = vaddr + k * PAGE_SIZE;
+        }
+        else
+        {
+            /* As for a page the batch could not map: leave it out */
+            page = xc_map_foreign_range(xch, domid, PAGE_SIZE, PROT_READ,
+                                        b->gmfn[k]);
+            if ( page == NULL )
+                continue;
+        }
+
+        if ( p2m_array != NULL )
+        {
+            p2m_array[*j].pfn = b->pfn[k];
+            p2m_array[*j].gmfn = b->gmfn[k];
+        }
+        else
+            pfn_array[*j] = b->pfn[k];
+        (*j)++;
+
+        memcpy(dump_pages_slot(dp), page, PAGE_SIZE);
+        if ( vaddr == NULL )
+            munmap(page, PAGE_SIZE);
+        sts = dump_pages_put(dp);
+        if ( sts != 0 )
+            break;
+    }
+
+    if ( vaddr != NULL )
+        munmap(vaddr, b->nr * PAGE_SIZE);
+    b->nr = 0;
+    return sts;
+}
+
+/*
+ * fd is the file dump_rtn writes to when compressing: the section headers
+ * are written again once the size of the compressed pages is known.
+ */
+static int
+dumpcore(xc_interface *xch, uint32_t domid, void *args,
+         dumpcore_rtn_t dump_rtn, unsigned int flags,
+         unsigned int nr_threads, int fd)
 {
     xc_dominfo_t info;
     shared_info_any_t *live_shinfo = NULL;
@@ -447,7 +885,9 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
     struct domain_info_context *dinfo = &_dinfo;
 
     int nr_vcpus = 0;
-    char *dump_mem, *dump_mem_start = NULL;
+    char *dump_mem_start = NULL;
+    struct dump_pages dp = { .xch = xch, .args = args, .dump_rtn = dump_rtn };
+    struct dump_batch *batch = NULL;
     vcpu_guest_context_any_t *ctxt = NULL;
     struct xc_core_arch_context arch_ctxt;
     char dummy[PAGE_SIZE];
@@ -477,6 +917,8 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
     uint16_t strtab_idx;
     struct xc_core_section_headers *sheaders = NULL;
     Elf64_Shdr *shdr;
+    unsigned int pages_idx, p2m_idx;
+    uint64_t pages_size;
  
     if ( get_guest_width(xch, domid, &dinfo->guest_width) != 0 )
     {
@@ -485,11 +927,27 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
     }
 
     xc_core_arch_context_init(&arch_ctxt);
-    if ( (dump_mem_start = malloc(DUMP_INCREMENT*PAGE_SIZE)) == NULL )
+    if ( flags & XC_DUMPCORE_COMPRESS )
     {
-        PERROR("Could not allocate dump_mem");
+        if ( (dp.z = dump_zcreate(xch, nr_threads)) == NULL )
+            goto out;
+        dp.buf = dp.z->batch[dp.z->fill].buf;
+    }
+    else
+    {
+        if ( (dump_mem_start = malloc(DUMP_INCREMENT*PAGE_SIZE)) == NULL )
+        {
+            PERROR("Could not allocate dump_mem");
+            goto out;
+        }
+        dp.buf = dump_mem_start;
+    }
+    if ( (batch = malloc(sizeof(*batch))) == NULL )
+    {
+        PERROR("Could not allocate page batch");
         goto out;
     }
+    batch->nr = 0;
 
     if ( xc_domain_getinfo(xch, domid, 1, &info) != 1 )
     {
@@ -697,6 +1155,7 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
         PERROR("could not get section headers for .xen_pages");
         goto out;
     }
+    pages_idx = shdr - sheaders->shdrs;
     filesz = (uint64_t)nr_pages * PAGE_SIZE;
     sts = xc_core_shdr_set(xch, shdr, strtab, XEN_DUMPCORE_SEC_PAGES, SHT_PROGBITS,
                            offset, filesz, PAGE_SIZE, PAGE_SIZE);
@@ -711,6 +1170,7 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
         PERROR("Could not get section header for .xen_{p2m, pfn} table");
         goto out;
     }
+    p2m_idx = shdr - sheaders->shdrs;
     if ( !auto_translated_physmap )
     {
         filesz = (uint64_t)nr_pages * sizeof(p2m_array[0]);
@@ -795,8 +1255,14 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
         goto out;
 
     /* dump pages: .xen_pages */
+    if ( dp.z != NULL )
+    {
+        sts = dump_zstart(&dp, nr_pages);
+        if ( sts != 0 )
+            goto out;
+    }
+
     j = 0;
-    dump_mem = dump_mem_start;
     for ( map_idx = 0; map_idx < nr_memory_map; map_idx++ )
     {
         uint64_t pfn_start;
@@ -807,8 +1273,14 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
         for ( i = pfn_start; i < pfn_end; i++ )
         {
             uint64_t gmfn;
-            void *vaddr;
-            
+
+            if ( j + batch->nr >= nr_pages )
+            {
+                sts = dump_page_batch(xch, domid, &dp, batch, p2m_array,
+                                      pfn_array, &j);
+                if ( sts != 0 )
+                    goto out;
+            }
             if ( j >= nr_pages )
             {
                 /*
@@ -836,9 +1308,6 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
                     if ( gmfn == (uint32_t)INVALID_P2M_ENTRY )
                        continue;
                 }
-
-                p2m_array[j].pfn = i;
-                p2m_array[j].gmfn = gmfn;
             }
             else
             {
@@ -846,42 +1315,34 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
                     continue;
 
                 gmfn = i;
-                pfn_array[j] = i;
             }
 
-            vaddr = xc_map_foreign_range(
-                xch, domid, PAGE_SIZE, PROT_READ, gmfn);
-            if ( vaddr == NULL )
-                continue;
-            memcpy(dump_mem, vaddr, PAGE_SIZE);
-            munmap(vaddr, PAGE_SIZE);
-            dump_mem += PAGE_SIZE;
-            if ( (j + 1) % DUMP_INCREMENT == 0 )
+            batch->pfn[batch->nr] = i;
+            batch->gmfn[batch->nr] = gmfn;
+            if ( ++batch->nr == DUMP_MAP_BATCH )
             {
-                sts = dump_rtn(
-                    xch, args, dump_mem_start, dump_mem - dump_mem_start);
+                sts = dump_page_batch(xch, domid, &dp, batch, p2m_array,
+                                      pfn_array, &j);
                 if ( sts != 0 )
                     goto out;
-                dump_mem = dump_mem_start;
             }
-
-            j++;
         }
     }
 
-copy_done:
-    sts = dump_rtn(xch, args, dump_mem_start, dump_mem - dump_mem_start);
+    sts = dump_page_batch(xch, domid, &dp, batch, p2m_array, pfn_array, &j);
     if ( sts != 0 )
         goto out;
+
+copy_done:
     if ( j < nr_pages )
     {
         /* When live dump-mode (-L option) is specified,
          * guest domain may reduce memory. pad with zero pages.
          */
         IPRINTF("j (%ld) != nr_pages (%ld)", j, nr_pages);
-        memset(dump_mem_start, 0, PAGE_SIZE);
         for (; j < nr_pages; j++) {
-            sts = dump_rtn(xch, args, dump_mem_start, PAGE_SIZE);
+            memset(dump_pages_slot(&dp), 0, PAGE_SIZE);
+            sts = dump_pages_put(&dp);
             if ( sts != 0 )
                 goto out;
             if ( !auto_translated_physmap )
@@ -893,6 +1354,33 @@ copy_done:
                 pfn_array[j] = XC_CORE_INVALID_PFN;
         }
     }
+    sts = dump_pages_flush(&dp);
+    if ( sts != 0 )
+        goto out;
+
+    if ( dp.z != NULL )
+    {
+        /*
+         * Now that the size of the compressed pages is known, move the
+         * sections after them, keeping the p2m/pfn table aligned.
+         */
+        sts = dump_zfinish(&dp, &pages_size);
+        if ( sts != 0 )
+            goto out;
+        dummy_len = ROUNDUP(pages_size, 3) - pages_size;
+        sts = dump_rtn(xch, args, dummy, dummy_len);
+        if ( sts != 0 )
+            goto out;
+
+        shdr = &sheaders->shdrs[pages_idx];
+        shdr->sh_flags |= SHF_COMPRESSED;
+        shdr->sh_size = pages_size;
+        shdr->sh_addralign = __alignof__(struct dump_chdr);
+        offset = shdr->sh_offset + pages_size + dummy_len;
+        sheaders->shdrs[p2m_idx].sh_offset = offset;
+        offset += sheaders->shdrs[p2m_idx].sh_size;
+        sheaders->shdrs[strtab_idx].sh_offset = offset;
+    }
 
     /* p2m/pfn table: .xen_p2m/.xen_pfn */
     if ( !auto_translated_physmap )
@@ -909,6 +1397,16 @@ copy_done:
     if ( sts != 0 )
         goto out;
 
+    if ( dp.z != NULL &&
+         pwrite(fd, sheaders->shdrs,
+                sheaders->num * sizeof(sheaders->shdrs[0]),
+                sizeof(ehdr)) != sheaders->num * sizeof(sheaders->shdrs[0]) )
+    {
+        PERROR("Could not rewrite section headers");
+        sts = -errno;
+        goto out;
+    }
+
     sts = 0;
 
 out:
@@ -928,6 +1426,8 @@ out:
         free(ctxt);
     if ( dump_mem_start != NULL )
         free(dump_mem_start);
+    free(batch);
+    dump_zdestroy(dp.z);
     if ( live_shinfo != NULL )
         munmap(live_shinfo, PAGE_SIZE);
     xc_core_arch_context_free(&arch_ctxt);
@@ -935,39 +1435,102 @@ out:
     return sts;
 }
 
+int
+xc_domain_dumpcore_via_callback(xc_interface *xch,
+                                uint32_t domid,
+                                void *args,
+                                dumpcore_rtn_t dump_rtn)
+{
+    return dumpcore(xch, domid, args, dump_rtn, 0, 0, -1);
+}
+
 /* Callback args for writing to a local dump file. */
 struct dump_args {
     int     fd;
+    unsigned int flags;         /* XC_DUMPCORE_* */
+    uint64_t offset;            /* of the next write */
+    uint64_t unflushed;         /* written since the cache was discarded */
 };
 
+static int page_is_zero(const char *page)
+{
+    const unsigned long *p = (const unsigned long *)page;
+    unsigned int i;
+
+    for ( i = 0; i < PAGE_SIZE / sizeof(*p); i++ )
+        if ( p[i] )
+            return 0;
+    return 1;
+}
+
+/* Write a buffer out, leaving its page-aligned pages of zeroes as holes. */
+static int sparse_write(struct dump_args *da, const char *buffer,
+                        unsigned int length)
+{
+    unsigned int pos = 0, start, n;
+
+    while ( pos < length )
+    {
+        for ( start = pos; pos < length; pos += n )
+        {
+            n = PAGE_SIZE - ((da->offset + pos) & (PAGE_SIZE - 1));
+            if ( n > length - pos )
+                n = length - pos;
+            else if ( n == PAGE_SIZE && page_is_zero(buffer + pos) )
+                break;
+        }
+        if ( pos > start && write_exact(da->fd, buffer + start, pos - start) )
+            return -1;
+
+        for ( start = pos;
+              length - pos >= PAGE_SIZE && page_is_zero(buffer + pos);
+              pos += PAGE_SIZE )
+            continue;
+        if ( pos > start && lseek(da->fd, pos - start, SEEK_CUR) == -1 )
+            return -1;
+    }
+
+    return 0;
+}
+
 /* Callback routine for writing to a local dump file. */
 static int local_file_dump(xc_interface *xch,
                            void *args, char *buffer, unsigned int length)
 {
     struct dump_args *da = args;
+    int rc;
 
-    if ( write_exact(da->fd, buffer, length) == -1 )
+    if ( da->flags & XC_DUMPCORE_SPARSE )
+        rc = sparse_write(da, buffer, length);
+    else
+        rc = write_exact(da->fd, buffer, length);
+    if ( rc == -1 )
     {
         PERROR("Failed to write buffer");
         return -errno;
     }
+    da->offset += length;
 
-    if ( length >= (DUMP_INCREMENT * PAGE_SIZE) )
+    da->unflushed += length;
+    if ( da->unflushed >= (DUMP_INCREMENT * PAGE_SIZE) )
     {
         // Now dumping pages -- make sure we discard clean pages from
         // the cache after each write
         discard_file_cache(xch, da->fd, 0 /* no flush */);
+        da->unflushed = 0;
     }
 
     return 0;
 }
 
 int
-xc_domain_dumpcore(xc_interface *xch,
-                   uint32_t domid,
-                   const char *corename)
+xc_domain_dumpcore_flags(xc_interface *xch,
+                         uint32_t domid,
+                         const char *corename,
+                         unsigned int flags,
+                         unsigned int nr_threads)
 {
-    struct dump_args da;
+    struct dump_args da = { .flags = flags };
     int sts;
 
     if ( (da.fd = open(corename, O_CREAT|O_RDWR|O_TRUNC, S_IWUSR|S_IRUSR)) < 0 )
@@ -976,8 +1539,16 @@ xc_domain_dumpcore(xc_interface *xch,
         return -errno;
     }
 
-    sts = xc_domain_dumpcore_via_callback(
-        xch, domid, &da, &local_file_dump);
+    sts = dumpcore(xch, domid, &da, &local_file_dump, flags, nr_threads,
+                   da.fd);
+
+    /* a hole at the end of the file needs the file size set */
+    if ( sts == 0 && (flags & XC_DUMPCORE_SPARSE) &&
+         ftruncate(da.fd, da.offset) )
+    {
+        PERROR("Could not set the size of corefile %s", corename);
+        sts = -errno;
+    }
 
     /* flush and discard any remaining portion of the file from cache */
     discard_file_cache(xch, da.fd, 1/* flush first*/);
@@ -987,6 +1558,14 @@ xc_domain_dumpcore(xc_interface *xch,
     return sts;
 }
 
+int
+xc_domain_dumpcore(xc_interface *xch,
+                   uint32_t domid,
+                   const char *corename)
+{
+    return xc_domain_dumpcore_flags(xch, domid, corename, 0, 0);
+}
+
 /*
  * Local variables:
  * mode: C
@@ -54,6 +54,7 @@ struct xc_dom_image {
     size_t kernel_size;
     void *ramdisk_blob;
     size_t ramdisk_size;
+    int ramdisk_filemap;        /* ramdisk_blob is our mapping of a file */
 
     size_t max_kernel_size;
     size_t max_ramdisk_size;
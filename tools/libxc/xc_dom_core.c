@@ -503,9 +503,9 @@ void *xc_dom_pfn_to_ptr_retcount(struct xc_dom_image *dom, xen_pfn_t pfn,
     return phys->ptr;
 }
 
-int xc_dom_alloc_segment(struct xc_dom_image *dom,
+static int alloc_segment(struct xc_dom_image *dom,
                          struct xc_dom_seg *seg, char *name,
-                         xen_vaddr_t start, xen_vaddr_t size)
+                         xen_vaddr_t start, xen_vaddr_t size, int map)
 {
     unsigned int page_size = XC_DOM_PAGE_SIZE(dom);
     xen_pfn_t pages = (size + page_size - 1) / page_size;
@@ -554,6 +554,9 @@ int xc_dom_alloc_segment(struct xc_dom_image *dom,
               "  (pfn 0x%" PRIpfn " + 0x%" PRIpfn " pages)",
               __FUNCTION__, name, seg->vstart, seg->vend, seg->pfn, pages);
 
+    if ( !map )
+        return 0;
+
     /* map and clear pages */
     ptr = xc_dom_seg_to_ptr(dom, seg);
     if ( ptr == NULL )
@@ -563,6 +566,13 @@ int xc_dom_alloc_segment(struct xc_dom_image *dom,
     return 0;
 }
 
+int xc_dom_alloc_segment(struct xc_dom_image *dom,
+                         struct xc_dom_seg *seg, char *name,
+                         xen_vaddr_t start, xen_vaddr_t size)
+{
+    return alloc_segment(dom, seg, name, start, size, 1);
+}
+
 int xc_dom_alloc_page(struct xc_dom_image *dom, char *name)
 {
     unsigned int page_size = XC_DOM_PAGE_SIZE(dom);
@@ -746,6 +756,7 @@ int xc_dom_ramdisk_file(struct xc_dom_image *dom, const char *filename)
 
     if ( dom->ramdisk_blob == NULL )
         return -1;
+    dom->ramdisk_filemap = 1;
 //    return xc_dom_try_gunzip(dom, &dom->ramdisk_blob, &dom->ramdisk_size);
     return 0;
 }
@@ -764,6 +775,7 @@ int xc_dom_ramdisk_mem(struct xc_dom_image *dom, const void *mem,
     DOMPRINTF_CALLED(dom->xch);
     dom->ramdisk_blob = (void *)mem;
     dom->ramdisk_size = memsize;
+    dom->ramdisk_filemap = 0;
 //    return xc_dom_try_gunzip(dom, &dom->ramdisk_blob, &dom->ramdisk_size);
     return 0;
 }
@@ -872,6 +884,116 @@ int xc_dom_update_guest_p2m(struct xc_dom_image *dom)
     return 0;
 }
 
+/*
+ * Copy, or gunzip, the ramdisk into its segment a few megabytes at a
+ * time.  Only one window of guest memory is mapped at once, and the
+ * part of a ramdisk file already read is dropped from our address
+ * space, so that a large ramdisk does not have to be resident all at
+ * once.  The file itself stays in the page cache for the next domain.
+ */
+#define RAMDISK_CHUNK_PAGES 1024
+
+static int xc_dom_load_ramdisk(struct xc_dom_image *dom, size_t unziplen)
+{
+    unsigned int page_shift = XC_DOM_PAGE_SHIFT(dom);
+    unsigned int page_size = XC_DOM_PAGE_SIZE(dom);
+    xen_pfn_t pfn = dom->ramdisk_seg.pfn;
+    xen_pfn_t end = pfn + ((dom->ramdisk_seg.vend -
+                            dom->ramdisk_seg.vstart) >> page_shift);
+    xen_pfn_t count, chunk = RAMDISK_CHUNK_PAGES;
+    char *blob = dom->ramdisk_blob, *ptr;
+    size_t in = 0, dropped = 0, len, done;
+    z_stream zStream;
+    int rc = Z_OK;
+
+    /* Without a domain the pages are only in our anonymous mapping */
+    if ( !dom->guest_domid )
+        chunk = end - pfn;
+
+    if ( dom->ramdisk_filemap )
+        madvise(blob, dom->ramdisk_size, MADV_SEQUENTIAL);
+
+    if ( unziplen )
+    {
+        memset(&zStream, 0, sizeof(zStream));
+        zStream.next_in = (Bytef *)blob;
+        zStream.avail_in = dom->ramdisk_size;
+        rc = inflateInit2(&zStream, (MAX_WBITS + 32)); /* +32 means "handle gzip" */
+        if ( rc != Z_OK )
+        {
+            xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
+                         "%s: inflateInit2 failed (rc=%d)", __FUNCTION__, rc);
+            return -1;
+        }
+    }
+
+    for ( ; pfn < end; pfn += count )
+    {
+        count = end - pfn < chunk ? end - pfn : chunk;
+        ptr = xc_dom_pfn_to_ptr(dom, pfn, count);
+        if ( ptr == NULL )
+        {
+            DOMPRINTF("%s: xc_dom_pfn_to_ptr(dom, 0x%" PRIpfn ", 0x%" PRIpfn
+                      ") => NULL", __FUNCTION__, pfn, count);
+            goto err;
+        }
+        len = count << page_shift;
+
+        if ( !unziplen )
+        {
+            done = dom->ramdisk_size - in < len ? dom->ramdisk_size - in : len;
+            memcpy(ptr, blob + in, done);
+            in += done;
+        }
+        else if ( rc == Z_STREAM_END )
+            done = 0;
+        else
+        {
+            zStream.next_out = (Bytef *)ptr;
+            zStream.avail_out = len;
+            rc = inflate(&zStream, Z_NO_FLUSH);
+            if ( rc != Z_OK && rc != Z_STREAM_END )
+            {
+                xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
+                             "%s: inflate failed (rc=%d)", __FUNCTION__, rc);
+                goto err;
+            }
+            done = len - zStream.avail_out;
+            in = (char *)zStream.next_in - blob;
+        }
+        memset(ptr + done, 0, len - done);
+
+        if ( dom->guest_domid )
+            xc_dom_unmap_one(dom, pfn);
+        if ( dom->ramdisk_filemap && (in & ~(size_t)(page_size - 1)) > dropped )
+        {
+            madvise(blob + dropped, (in & ~(size_t)(page_size - 1)) - dropped,
+                    MADV_DONTNEED);
+            dropped = in & ~(size_t)(page_size - 1);
+        }
+    }
+
+    if ( unziplen )
+    {
+        inflateEnd(&zStream);
+        if ( rc != Z_STREAM_END )
+        {
+            xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
+                         "%s: ramdisk does not fit in 0x%zx bytes",
+                         __FUNCTION__, unziplen);
+            return -1;
+        }
+        xc_dom_printf(dom->xch, "%s: unzip ok, 0x%zx -> 0x%lx",
+                      __FUNCTION__, dom->ramdisk_size, zStream.total_out);
+    }
+    return 0;
+
+ err:
+    if ( unziplen )
+        inflateEnd(&zStream);
+    return -1;
+}
+
 int xc_dom_build_image(struct xc_dom_image *dom)
 {
     unsigned int page_size;
@@ -900,7 +1022,6 @@ int xc_dom_build_image(struct xc_dom_image *dom)
     if ( dom->ramdisk_blob )
     {
         size_t unziplen, ramdisklen;
-        void *ramdiskmap;
 
         unziplen = xc_dom_check_gzip(dom->xch, dom->ramdisk_blob, dom->ramdisk_size);
         if ( xc_dom_ramdisk_check_size(dom, unziplen) != 0 )
@@ -908,25 +1029,11 @@ int xc_dom_build_image(struct xc_dom_image *dom)
 
         ramdisklen = unziplen ? unziplen : dom->ramdisk_size;
 
-        if ( xc_dom_alloc_segment(dom, &dom->ramdisk_seg, "ramdisk", 0,
-                                  ramdisklen) != 0 )
+        if ( alloc_segment(dom, &dom->ramdisk_seg, "ramdisk", 0,
+                           ramdisklen, 0) != 0 )
             goto err;
-        ramdiskmap = xc_dom_seg_to_ptr(dom, &dom->ramdisk_seg);
-        if ( ramdiskmap == NULL )
-        {
-            DOMPRINTF("%s: xc_dom_seg_to_ptr(dom, &dom->ramdisk_seg) => NULL",
-                      __FUNCTION__);
+        if ( xc_dom_load_ramdisk(dom, unziplen) != 0 )
             goto err;
-        }
-        if ( unziplen )
-        {
-            if ( xc_dom_do_gunzip(dom->xch,
-                                  dom->ramdisk_blob, dom->ramdisk_size,
-                                  ramdiskmap, ramdisklen) == -1 )
-                goto err;
-        }
-        else
-            memcpy(ramdiskmap, dom->ramdisk_blob, dom->ramdisk_size);
     }
 
     /* allocate other pages */
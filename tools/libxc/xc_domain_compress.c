@@ -2,12 +2,16 @@
  * xc_compression.c
  *
  * Checkpoint Compression using Page Delta Algorithm.
- * - A LRU cache of recently dirtied guest pages is maintained.
+ * - A cache of recently dirtied guest pages is maintained (CLOCK
+ *   replacement, see get_cache_page).
  * - For each dirty guest page in the checkpoint, if a previous version of the
  * page exists in the cache, XOR both pages and send the non-zero sections
  * to the receiver. The cache is then updated with the newer copy of guest page.
  * - The receiver will XOR the non-zero sections against its copy of the guest
  * page, thereby bringing the guest page up-to-date with the sender side.
+ * - Pages for which the delta does not pay off (cache misses, pagetables,
+ * heavily rewritten pages) are sent as zero pages, run length encoded or
+ * raw, whichever is shortest.
  *
  * Copyright (c) 2011 Shriram Rajagopalan (rshriram@cs.ubc.ca).
  *
@@ -33,25 +37,62 @@
 #include <sys/types.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <pthread.h>
+#include <zlib.h>
 #include "xc_private.h"
 #include "xenctrl.h"
 #include "xg_save_restore.h"
 #include "xg_private.h"
 #include "xc_dom.h"
 
-/* Page Cache for Delta Compression*/
+/* Default size of the page cache for delta compression */
 #define DELTA_CACHE_SIZE (XC_PAGE_SIZE * 65536)
 
+/* pfn2slot[] value for pfns that are not in the cache */
+#define CACHE_SLOT_NONE (~0U)
+
+/* slot_flags[] bits */
+#define SLOT_REF  (1 << 0) /* referenced since the clock hand last passed */
+#define SLOT_BUSY (1 << 1) /* claimed by the current parallel window */
+
 /* Internal page buffer to hold dirty pages as cache
  */
 #define PAGE_BUFFER_SIZE (XC_PAGE_SIZE * 65536)
 
-struct cache_page
+/* Upper bound on the number of compression worker threads */
+#define MAX_COMPRESS_THREADS 16
+
+/*
+ * Maximum number of pages handed to the worker pool in one go. Each
+ * worker owns an output segment big enough for its share of a window.
+ */
+#define COMPRESS_WINDOW_PAGES 1024
+
+/*
+ * Windows smaller than this (per worker) are not worth the hand-off
+ * and are compressed on the calling thread instead.
+ */
+#define MIN_PAGES_PER_WORKER 16
+
+/* Page record tags, see the stream format notes below */
+#define PAGE_TAG_SAME  0
+#define PAGE_TAG_DELTA 1
+#define PAGE_TAG_ZERO  2
+#define PAGE_TAG_RLE   3
+#define PAGE_TAG_RAW   4
+#define NR_PAGE_TAGS   5
+
+struct compress_worker
 {
-    char *page;
-    xen_pfn_t pfn;
-    struct cache_page *next;
-    struct cache_page *prev;
+    comp_ctx *ctx;
+    pthread_t thread;
+    /* private output segment, joined into compbuf in page order */
+    char *segbuf;
+    unsigned long seglen;
+    /* slice [start, end) of the current window */
+    unsigned int start, end;
+    /* pages encoded with each PAGE_TAG_*, folded into the context's */
+    uint64_t tag_pages[NR_PAGE_TAGS];
 };
 
 struct compression_ctx
@@ -68,13 +109,43 @@ struct compression_ctx
     unsigned int pfns_len;
     unsigned int pfns_index;
 
-    /* Compression Cache (LRU) */
+    /*
+     * Compression Cache (CLOCK). Slot i holds the cached copy of
+     * slot_pfn[i] at cache_base + i * XC_PAGE_SIZE.
+     */
     char *cache_base;
-    struct cache_page **pfn2cache;
-    struct cache_page *cache;
-    struct cache_page *page_list_head;
-    struct cache_page *page_list_tail;
+    uint32_t *pfn2slot;
+    xen_pfn_t *slot_pfn;
+    uint8_t *slot_flags;
+    uint32_t nr_slots;
+    uint32_t clock_hand;
     unsigned long dom_pfnlist_size;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t tag_pages[NR_PAGE_TAGS];
+
+    /* Worker pool (see xc_compression_set_threads) */
+    unsigned int nr_workers;
+    struct compress_worker *workers;
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_work;
+    pthread_cond_t pool_done;
+    unsigned long pool_gen;
+    unsigned int pool_pending;
+    int pool_exit;
+
+    /*
+     * Per-window plan: source page, cache slot (CACHE_SLOT_NONE for
+     * pagetable pages) and whether the page is sent in full.
+     */
+    char **win_src;
+    uint32_t *win_slot;
+    uint8_t *win_raw;
+
+    /* Page whose slot was looked up but which did not fit the window */
+    int carry;
+    uint32_t carry_slot;
+    int carry_raw;
 };
 
 #define RUNFLAG 0
@@ -84,57 +155,161 @@ struct compression_ctx
 
 /*
  * see xg_save_restore.h for details on the compressed stream format.
- * delta size = 4 bytes.
+ *
+ * Every page record starts with a one byte tag naming its encoding, and
+ * the encoder keeps whichever of them is shortest for the page:
+ *
+ *  PAGE_TAG_SAME   page is unchanged from the receiver's copy
+ *  PAGE_TAG_DELTA  runs of changed words against the receiver's copy
+ *  PAGE_TAG_ZERO   page is all zeroes
+ *  PAGE_TAG_RLE    page on its own, as runs of repeated or literal words
+ *  PAGE_TAG_RAW    the whole page
+ *
+ * SAME and DELTA need a cached copy of the page; the others do not.
+ *
+ * Delta runs: delta size = 4 bytes.
  * run header = 1 byte (1 bit for runtype, 7bits for run length).
  *  i.e maximum size of a run = 127 * 4 = 508 bytes.
  * Worst case compression: Entire page has changed.
- * In the worst case, the size of the compressed page is
- *  8 runs of 508 bytes + 1 run of 32 bytes + 9 run headers 
- *  = 4105 bytes.
- * We could detect this worst case and send the entire page with a
- * FULL_PAGE marker, reducing the total size to 4097 bytes. The cost
- * of this size reduction is an additional memcpy, on top of two previous
- * memcpy (to the compressed stream and the cache page in the for loop).
- *
- * We might as well sacrifice an extra 8 bytes instead of a memcpy.
+ * In the worst case, the size of the delta encoded page is
+ *  8 runs of 508 bytes + 1 run of 32 bytes + 9 run headers + the tag
+ *  = 4106 bytes.
+ * The encoder falls back to PAGE_TAG_RAW whenever the delta is no
+ * shorter than the page, but the delta is built in place first, so
+ * the output must have room for the worst case.
  */
  
-#define WORST_COMP_PAGE_SIZE (XC_PAGE_SIZE + 9)
+#define WORST_COMP_PAGE_SIZE (XC_PAGE_SIZE + 10)
 
-/*
- * A zero length skip indicates full page.
- */
-#define EMPTY_PAGE 0
-#define FULL_PAGE SKIPFLAG
 #define FULL_PAGE_SIZE (XC_PAGE_SIZE + 1)
 #define MAX_DELTAS (XC_PAGE_SIZE/sizeof(uint32_t))
 
 /*
- * Add a pagetable page or a new page (uncached)
- * if srcpage is a pagetable page, cache_page is null.
- * if srcpage is a page that was not previously in the cache,
- *  cache_page points to a free page slot in the cache where
- *  this new page can be copied to.
+ * RLE runs: a header byte with RLE_REPEAT set is followed by one word,
+ * repeated (header & RLE_LENMASK) + 1 times; otherwise it is followed
+ * by header + 1 literal words.
+ */
+#define RLE_REPEAT  0x80
+#define RLE_LENMASK 0x7f
+#define RLE_MAXRUN  (RLE_LENMASK + 1)
+
+/*
+ * RLE encode srcpage into dest, or only size it if dest is NULL.
+ * Returns the encoded length, or -1 as soon as it would exceed budget.
  */
-static int add_full_page(comp_ctx *ctx, char *srcpage, char *cache_page)
+static int rle_encode(char *dest, const char *srcpage, int budget)
 {
-    char *dest = (ctx->compbuf + ctx->compbuf_pos);
+    const uint32_t *w = (const uint32_t *)srcpage;
+    unsigned int off = 0, lit = 0, rep;
+    int len = 0;
 
-    if ( (ctx->compbuf_pos + FULL_PAGE_SIZE) > ctx->compbuf_size)
-        return -1;
+    while (off < MAX_DELTAS)
+    {
+        for (rep = 1; (off + rep < MAX_DELTAS) && (rep < RLE_MAXRUN) &&
+                 (w[off + rep] == w[off]); rep++)
+            ;
 
-    if (cache_page)
-        memcpy(cache_page, srcpage, XC_PAGE_SIZE);
-    dest[0] = FULL_PAGE;
-    memcpy(&dest[1], srcpage, XC_PAGE_SIZE);
-    ctx->compbuf_pos += FULL_PAGE_SIZE;
+        /* A repeat of two words already beats carrying them as literals */
+        if (rep < 2)
+        {
+            lit++;
+            off++;
+            if (len + 1 + (int)(lit * sizeof(uint32_t)) > budget)
+                return -1;
+            if ((lit < RLE_MAXRUN) && (off < MAX_DELTAS))
+                continue;
+            rep = 0;
+        }
+
+        if (lit)
+        {
+            if (dest)
+            {
+                dest[len] = lit - 1;
+                memcpy(dest + len + 1, &w[off - lit], lit * sizeof(uint32_t));
+            }
+            len += 1 + lit * sizeof(uint32_t);
+            lit = 0;
+        }
+
+        if (rep)
+        {
+            if (dest)
+            {
+                dest[len] = RLE_REPEAT | (rep - 1);
+                memcpy(dest + len + 1, &w[off], sizeof(uint32_t));
+            }
+            len += 1 + sizeof(uint32_t);
+            off += rep;
+            if (len > budget)
+                return -1;
+        }
+    }
 
-    return FULL_PAGE_SIZE;
+    return len;
 }
 
-static int compress_page(comp_ctx *ctx, char *srcpage, char *cache_page)
+static int rle_decode(const char *src, unsigned long srclen,
+                      unsigned long *srcpos, char *destpage)
+{
+    uint32_t *w = (uint32_t *)destpage, word;
+    unsigned long pos = *srcpos;
+    unsigned int off = 0, n, i;
+
+    while (off < MAX_DELTAS)
+    {
+        if (pos >= srclen)
+            return -1;
+        n = ((unsigned char)src[pos] & RLE_LENMASK) + 1;
+        if (off + n > MAX_DELTAS)
+            return -1;
+
+        if (src[pos++] & RLE_REPEAT)
+        {
+            if (pos + sizeof(uint32_t) > srclen)
+                return -1;
+            memcpy(&word, src + pos, sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+            for (i = 0; i < n; i++)
+                w[off + i] = word;
+        }
+        else
+        {
+            if (pos + n * sizeof(uint32_t) > srclen)
+                return -1;
+            memcpy(&w[off], src + pos, n * sizeof(uint32_t));
+            pos += n * sizeof(uint32_t);
+        }
+        off += n;
+    }
+
+    *srcpos = pos;
+    return 0;
+}
+
+static int page_is_zero(const char *page)
+{
+    const uint64_t *p = (const uint64_t *)page;
+    unsigned int i;
+
+    for (i = 0; i < XC_PAGE_SIZE / sizeof(uint64_t); i++)
+        if (p[i])
+            return 0;
+    return 1;
+}
+
+/*
+ * Delta compress srcpage against cache_page into dest and bring the
+ * cache page up to date. Returns the length of the runs, or 0 if the
+ * page is unchanged. The caller must ensure that dest has room for
+ * WORST_COMP_PAGE_SIZE - 1 bytes.
+ *
+ * This is the portable path, which compares and branches one word at
+ * a time. compress_page_mask() produces the same output from a
+ * difference bitmap built by a vector kernel.
+ */
+static int compress_page_scalar(char *dest, char *srcpage, char *cache_page)
 {
-    char *dest = (ctx->compbuf + ctx->compbuf_pos);
     uint32_t *new, *old;
 
     int off, runptr = 0;
@@ -143,9 +318,6 @@ static int compress_page(comp_ctx *ctx, char *srcpage, char *cache_page)
 
     char runlen = 0;
 
-    if ( (ctx->compbuf_pos + WORST_COMP_PAGE_SIZE) > ctx->compbuf_size)
-        return -1;
-
     /*
      * There are no alignment issues here since srcpage is
      * domU's page passed from xc_domain_save and cache_page is
@@ -196,98 +368,260 @@ static int compress_page(comp_ctx *ctx, char *srcpage, char *cache_page)
      * Check for empty page.
      */
     if (bytes_skipped == XC_PAGE_SIZE)
-    {
-        complen = 1;
-        dest[0] = EMPTY_PAGE;
-    }
-    ctx->compbuf_pos += complen;
+        complen = 0;
 
     return complen;
 }
 
-static
-char *get_cache_page(comp_ctx *ctx, xen_pfn_t pfn,
-                     int *israw)
+/* Difference-mask kernel in use; NULL selects compress_page_scalar(). */
+static compress_diff_fn *diff_kernel;
+static int diff_kernel_selected;
+
+#define MASK_WORDS (MAX_DELTAS / 64)
+
+static inline int mask_test(const uint64_t *mask, unsigned int off)
 {
-    struct cache_page *item = NULL;
+    return (mask[off / 64] >> (off % 64)) & 1;
+}
 
-    item = ctx->pfn2cache[pfn];
+/* First word at or after off whose bit is not equal to state. */
+static inline unsigned int mask_run_end(const uint64_t *mask,
+                                        unsigned int off, int state)
+{
+    unsigned int i = off / 64;
+    uint64_t w = state ? ~mask[i] : mask[i];
 
-    if (!item)
+    w &= ~0ULL << (off % 64);
+    while (!w)
     {
-        *israw = 1;
+        if (++i == MASK_WORDS)
+            return MAX_DELTAS;
+        w = state ? ~mask[i] : mask[i];
+    }
+
+    return i * 64 + __builtin_ctzll(w);
+}
 
-        /* If the list is full, evict a page from the tail end. */
-        item = ctx->page_list_tail;
-        if (item->pfn != INVALID_P2M_ENTRY)
-            ctx->pfn2cache[item->pfn] = NULL;
+static int compress_page_mask(char *dest, char *srcpage, char *cache_page)
+{
+    uint64_t mask[MASK_WORDS];
+    unsigned int off = 0, end, i, runlen, pageoff;
+    int complen = 0, copying;
 
-        item->pfn = pfn;
-        ctx->pfn2cache[pfn] = item;
-    }
-        
-    /* 	if requested item is in cache move to head of list */
-    if (item != ctx->page_list_head)
+    diff_kernel((uint32_t *)cache_page, (uint32_t *)srcpage, mask);
+
+    for (i = 0; i < MASK_WORDS; i++)
+        if (mask[i])
+            break;
+    if (i == MASK_WORDS)
+        return 0;
+
+    while (off < MAX_DELTAS)
     {
-        if (item == ctx->page_list_tail)
+        copying = mask_test(mask, off);
+        end = mask_run_end(mask, off, copying);
+
+        /* Runs longer than LENMASK words are split, as in the scalar path */
+        for (; off < end; off += runlen)
         {
-            /* item at tail of list. */
-            ctx->page_list_tail = item->prev;
-            (ctx->page_list_tail)->next = NULL;
+            runlen = end - off;
+            if (runlen > LENMASK)
+                runlen = LENMASK;
+
+            if (copying)
+            {
+                dest[complen++] = runlen | RUNFLAG;
+                pageoff = off * sizeof(uint32_t);
+                memcpy(dest + complen, srcpage + pageoff,
+                       runlen * sizeof(uint32_t));
+                memcpy(cache_page + pageoff, srcpage + pageoff,
+                       runlen * sizeof(uint32_t));
+                complen += runlen * sizeof(uint32_t);
+            }
+            else
+                dest[complen++] = runlen | SKIPFLAG;
         }
-        else
+    }
+
+    return complen;
+}
+
+static int compress_page(char *dest, char *srcpage, char *cache_page)
+{
+    if (diff_kernel)
+        return compress_page_mask(dest, srcpage, cache_page);
+    return compress_page_scalar(dest, srcpage, cache_page);
+}
+
+/*
+ * Encode srcpage into dest with the shortest of the page encodings and
+ * count it in tags[]. cache_page is the cached copy of the page, or
+ * NULL for a pagetable page; if israw it is a freshly claimed slot and
+ * does not hold the receiver's copy yet. Either way the cache page is
+ * left equal to srcpage. The caller must ensure that dest has room for
+ * WORST_COMP_PAGE_SIZE bytes.
+ */
+static int encode_page(char *dest, char *srcpage, char *cache_page,
+                       int israw, uint64_t *tags)
+{
+    int len = XC_PAGE_SIZE, rle_len, budget;
+
+    if (!israw)
+    {
+        len = compress_page(dest + 1, srcpage, cache_page);
+        if (!len)
         {
-            /* item in middle of list */
-            item->prev->next = item->next;
-            item->next->prev = item->prev;
+            dest[0] = PAGE_TAG_SAME;
+            tags[PAGE_TAG_SAME]++;
+            return 1;
         }
+    }
+    else if (cache_page)
+        memcpy(cache_page, srcpage, XC_PAGE_SIZE);
+
+    if (page_is_zero(srcpage))
+    {
+        dest[0] = PAGE_TAG_ZERO;
+        tags[PAGE_TAG_ZERO]++;
+        return 1;
+    }
+
+    /* RLE has to beat both the delta and the raw page */
+    budget = ((len < XC_PAGE_SIZE) ? len : XC_PAGE_SIZE) - 1;
+    if (rle_encode(NULL, srcpage, budget) >= 0)
+    {
+        rle_len = rle_encode(dest + 1, srcpage, budget);
+        dest[0] = PAGE_TAG_RLE;
+        tags[PAGE_TAG_RLE]++;
+        return 1 + rle_len;
+    }
 
-        item->prev = NULL;
-        item->next = ctx->page_list_head;
-        (ctx->page_list_head)->prev = item;
-        ctx->page_list_head = item;
+    if (len >= XC_PAGE_SIZE)
+    {
+        dest[0] = PAGE_TAG_RAW;
+        memcpy(&dest[1], srcpage, XC_PAGE_SIZE);
+        tags[PAGE_TAG_RAW]++;
+        return FULL_PAGE_SIZE;
     }
 
-    return (ctx->page_list_head)->page;
+    dest[0] = PAGE_TAG_DELTA;
+    tags[PAGE_TAG_DELTA]++;
+    return 1 + len;
 }
 
-/* Remove pagetable pages from cache and move to tail, as free pages */
-static
-void invalidate_cache_page(comp_ctx *ctx, xen_pfn_t pfn)
+int xc_compression_set_kernel(xc_interface *xch, const char *name)
 {
-    struct cache_page *item = NULL;
+    if (name && !strcmp(name, "scalar"))
+    {
+        diff_kernel = NULL;
+        diff_kernel_selected = 1;
+        return 0;
+    }
 
-    item = ctx->pfn2cache[pfn];
-    if (item)
+#if defined(__i386__) || defined(__x86_64__)
     {
-        if (item != ctx->page_list_tail)
-        {
-            /* item at head of list */
-            if (item == ctx->page_list_head)
-            {
-                ctx->page_list_head = (ctx->page_list_head)->next;
-                (ctx->page_list_head)->prev = NULL;
-            }
-            else /* item in middle of list */
-            {            
-                item->prev->next = item->next;
-                item->next->prev = item->prev;
-            }
+        compress_diff_fn *fn = xc_compression_x86_kernel(name);
 
-            item->next = NULL;
-            item->prev = ctx->page_list_tail;
-            (ctx->page_list_tail)->next = item;
-            ctx->page_list_tail = item;
+        if (fn || !name)
+        {
+            diff_kernel = fn;
+            diff_kernel_selected = 1;
+            return 0;
         }
-        ctx->pfn2cache[pfn] = NULL;
-        (ctx->page_list_tail)->pfn = INVALID_P2M_ENTRY;
     }
+#else
+    if (!name)
+    {
+        diff_kernel = NULL;
+        diff_kernel_selected = 1;
+        return 0;
+    }
+#endif
+
+    errno = ENOTSUP;
+    return -1;
+}
+
+const char *xc_compression_get_kernel(xc_interface *xch)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    if (diff_kernel)
+        return xc_compression_x86_kernel_name(diff_kernel);
+#endif
+    return "scalar";
+}
+
+static inline char *slot_page(comp_ctx *ctx, uint32_t slot)
+{
+    return ctx->cache_base + (unsigned long)slot * XC_PAGE_SIZE;
+}
+
+/*
+ * Look up the cache slot of pfn. On a miss, the clock hand sweeps the
+ * slots, clearing reference bits, until it finds one that has not been
+ * referenced since the last sweep; that slot is then reassigned to pfn
+ * and *israw is set, as the page has to be sent in full.
+ */
+static uint32_t get_cache_page(comp_ctx *ctx, xen_pfn_t pfn, int *israw)
+{
+    uint32_t slot = ctx->pfn2slot[pfn];
+
+    if (slot != CACHE_SLOT_NONE)
+    {
+        ctx->cache_hits++;
+        ctx->slot_flags[slot] |= SLOT_REF;
+        return slot;
+    }
+
+    *israw = 1;
+    ctx->cache_misses++;
+
+    for ( ; ; )
+    {
+        slot = ctx->clock_hand;
+        if (++ctx->clock_hand == ctx->nr_slots)
+            ctx->clock_hand = 0;
+        if (!(ctx->slot_flags[slot] & SLOT_REF))
+            break;
+        ctx->slot_flags[slot] &= ~SLOT_REF;
+    }
+
+    if (ctx->slot_pfn[slot] != INVALID_P2M_ENTRY)
+        ctx->pfn2slot[ctx->slot_pfn[slot]] = CACHE_SLOT_NONE;
+    ctx->slot_pfn[slot] = pfn;
+    ctx->pfn2slot[pfn] = slot;
+    ctx->slot_flags[slot] |= SLOT_REF;
+
+    return slot;
+}
+
+/*
+ * Remove pagetable pages from cache. The slot is left unreferenced so
+ * that it is the next one reused.
+ */
+static void invalidate_cache_page(comp_ctx *ctx, xen_pfn_t pfn)
+{
+    uint32_t slot = ctx->pfn2slot[pfn];
+
+    if (slot != CACHE_SLOT_NONE)
+    {
+        ctx->pfn2slot[pfn] = CACHE_SLOT_NONE;
+        ctx->slot_pfn[slot] = INVALID_P2M_ENTRY;
+        ctx->slot_flags[slot] &= ~SLOT_REF;
+    }
+}
+
+void xc_compression_invalidate_page(xc_interface *xch, comp_ctx *ctx,
+                                    xen_pfn_t pfn)
+{
+    if (pfn < ctx->dom_pfnlist_size)
+        invalidate_cache_page(ctx, pfn);
 }
 
 int xc_compression_add_page(xc_interface *xch, comp_ctx *ctx,
                             char *page, xen_pfn_t pfn, int israw)
 {
-    if (pfn > ctx->dom_pfnlist_size)
+    if (pfn >= ctx->dom_pfnlist_size)
     {
         ERROR("Invalid pfn passed into "
               "xc_compression_add_page %" PRIpfn "\n", pfn);
@@ -309,12 +643,196 @@ int xc_compression_add_page(xc_interface *xch, comp_ctx *ctx,
     return 0;
 }
 
+/*
+ * Compress the page at ctx->pfns_index into the current compbuf, on the
+ * calling thread. Returns 0 if compbuf does not have room for it.
+ */
+static int compress_one_page(comp_ctx *ctx)
+{
+    char *cache_copy = NULL, *current_page;
+    char *dest = ctx->compbuf + ctx->compbuf_pos;
+    int israw = 0;
+
+    current_page = ctx->inputbuf + ctx->pfns_index * XC_PAGE_SIZE;
+
+    if (ctx->carry)
+    {
+        /* Looked up by plan_window(), which also made sure it fits */
+        ctx->carry = 0;
+        cache_copy = slot_page(ctx, ctx->carry_slot);
+        israw = ctx->carry_raw;
+    }
+    else if (ctx->sendbuf_pfns[ctx->pfns_index] == INVALID_P2M_ENTRY)
+        israw = 1;
+    else
+    {
+        /* Check for space before touching the cache */
+        if ((ctx->compbuf_pos + WORST_COMP_PAGE_SIZE) > ctx->compbuf_size)
+            return 0;
+        cache_copy = slot_page(ctx,
+                               get_cache_page(ctx,
+                                              ctx->sendbuf_pfns[ctx->pfns_index],
+                                              &israw));
+    }
+
+    /* Without a cached copy the page never takes more than FULL_PAGE_SIZE */
+    if (israw && (ctx->compbuf_pos + FULL_PAGE_SIZE) > ctx->compbuf_size)
+        return 0;
+    ctx->compbuf_pos += encode_page(dest, current_page, cache_copy, israw,
+                                    ctx->tag_pages);
+
+    return 1;
+}
+
+/*
+ * Plan a window of pages for the worker pool, starting at
+ * ctx->pfns_index. Cache slots are looked up here, in page order, so
+ * that the cache ends up exactly as the serial path would leave it.
+ * Workers must not share cache pages, so the window ends at the first
+ * page whose slot is already claimed by the window (repeated pfn, or
+ * the clock hand coming round to a slot claimed earlier). That page has
+ * already been looked up and is carried over to compress_one_page().
+ *
+ * Every planned page, including a carried one, is guaranteed to fit in
+ * compbuf even in the worst case, so the serial path would have accepted
+ * all of them as well.
+ */
+static unsigned int plan_window(comp_ctx *ctx)
+{
+    unsigned long room = ctx->compbuf_size - ctx->compbuf_pos;
+    unsigned int max = room / WORST_COMP_PAGE_SIZE;
+    unsigned int i, n;
+    uint32_t slot;
+    xen_pfn_t pfn;
+    int israw;
+
+    if (max > COMPRESS_WINDOW_PAGES)
+        max = COMPRESS_WINDOW_PAGES;
+    if (max > ctx->pfns_len - ctx->pfns_index)
+        max = ctx->pfns_len - ctx->pfns_index;
+    if (max < ctx->nr_workers * MIN_PAGES_PER_WORKER)
+        return 0;
+
+    for (n = 0; n < max; n++)
+    {
+        i = ctx->pfns_index + n;
+        pfn = ctx->sendbuf_pfns[i];
+        slot = CACHE_SLOT_NONE;
+        israw = 1;
+
+        if (pfn != INVALID_P2M_ENTRY)
+        {
+            israw = 0;
+            slot = get_cache_page(ctx, pfn, &israw);
+            if (ctx->slot_flags[slot] & SLOT_BUSY)
+            {
+                ctx->carry = 1;
+                ctx->carry_slot = slot;
+                ctx->carry_raw = israw;
+                break;
+            }
+            ctx->slot_flags[slot] |= SLOT_BUSY;
+        }
+
+        ctx->win_src[n] = ctx->inputbuf + i * XC_PAGE_SIZE;
+        ctx->win_slot[n] = slot;
+        ctx->win_raw[n] = israw;
+    }
+
+    return n;
+}
+
+static void compress_slice(struct compress_worker *w)
+{
+    comp_ctx *ctx = w->ctx;
+    char *cache_copy;
+    unsigned int n;
+
+    w->seglen = 0;
+    for (n = w->start; n < w->end; n++)
+    {
+        cache_copy = (ctx->win_slot[n] == CACHE_SLOT_NONE) ? NULL :
+            slot_page(ctx, ctx->win_slot[n]);
+        w->seglen += encode_page(w->segbuf + w->seglen, ctx->win_src[n],
+                                 cache_copy, ctx->win_raw[n], w->tag_pages);
+    }
+}
+
+static void *compress_worker_main(void *arg)
+{
+    struct compress_worker *w = arg;
+    comp_ctx *ctx = w->ctx;
+    unsigned long gen = 0;
+
+    pthread_mutex_lock(&ctx->pool_lock);
+    for ( ; ; )
+    {
+        while (!ctx->pool_exit && ctx->pool_gen == gen)
+            pthread_cond_wait(&ctx->pool_work, &ctx->pool_lock);
+        if (ctx->pool_exit)
+            break;
+        gen = ctx->pool_gen;
+        pthread_mutex_unlock(&ctx->pool_lock);
+
+        compress_slice(w);
+
+        pthread_mutex_lock(&ctx->pool_lock);
+        if (--ctx->pool_pending == 0)
+            pthread_cond_signal(&ctx->pool_done);
+    }
+    pthread_mutex_unlock(&ctx->pool_lock);
+
+    return NULL;
+}
+
+/*
+ * Compress a planned window on the worker pool and join the output
+ * segments into compbuf in page order.
+ */
+static void compress_window(comp_ctx *ctx, unsigned int len)
+{
+    unsigned int i, j, per = (len + ctx->nr_workers - 1) / ctx->nr_workers;
+    struct compress_worker *w;
+
+    for (i = 0; i < ctx->nr_workers; i++)
+    {
+        w = &ctx->workers[i];
+        w->start = (i * per < len) ? i * per : len;
+        w->end = (w->start + per < len) ? w->start + per : len;
+    }
+
+    pthread_mutex_lock(&ctx->pool_lock);
+    ctx->pool_pending = ctx->nr_workers;
+    ctx->pool_gen++;
+    pthread_cond_broadcast(&ctx->pool_work);
+    while (ctx->pool_pending)
+        pthread_cond_wait(&ctx->pool_done, &ctx->pool_lock);
+    pthread_mutex_unlock(&ctx->pool_lock);
+
+    for (i = 0; i < ctx->nr_workers; i++)
+    {
+        w = &ctx->workers[i];
+        memcpy(ctx->compbuf + ctx->compbuf_pos, w->segbuf, w->seglen);
+        ctx->compbuf_pos += w->seglen;
+        for (j = 0; j < NR_PAGE_TAGS; j++)
+        {
+            ctx->tag_pages[j] += w->tag_pages[j];
+            w->tag_pages[j] = 0;
+        }
+    }
+
+    for (i = 0; i < len; i++)
+        if (ctx->win_slot[i] != CACHE_SLOT_NONE)
+            ctx->slot_flags[ctx->win_slot[i]] &= ~SLOT_BUSY;
+    ctx->pfns_index += len;
+}
+
 int xc_compression_compress_pages(xc_interface *xch, comp_ctx *ctx,
                                   char *compbuf, unsigned long compbuf_size,
                                   unsigned long *compbuf_len)
 {
-    char *cache_copy = NULL, *current_page = NULL;
-    int israw, rc = 1;
+    unsigned int len;
+    int rc = 1;
 
     if (!ctx->pfns_len || (ctx->pfns_index == ctx->pfns_len)) {
         ctx->pfns_len = ctx->pfns_index = 0;
@@ -325,30 +843,22 @@ int xc_compression_compress_pages(xc_interface *xch, comp_ctx *ctx,
     ctx->compbuf = compbuf;
     ctx->compbuf_size = compbuf_size;
 
-    for (; ctx->pfns_index < ctx->pfns_len; ctx->pfns_index++)
+    while (ctx->pfns_index < ctx->pfns_len)
     {
-        israw = 0;
-        cache_copy = NULL;
-        current_page = ctx->inputbuf + ctx->pfns_index * XC_PAGE_SIZE;
-
-        if (ctx->sendbuf_pfns[ctx->pfns_index] == INVALID_P2M_ENTRY)
-            israw = 1;
-        else
-            cache_copy = get_cache_page(ctx,
-                                        ctx->sendbuf_pfns[ctx->pfns_index],
-                                        &israw);
-
-        if (israw)
-            rc = (add_full_page(ctx, current_page, cache_copy) >= 0);
-        else
-            rc = (compress_page(ctx, current_page, cache_copy) >= 0);
+        if (ctx->nr_workers && (len = plan_window(ctx)) != 0)
+        {
+            compress_window(ctx, len);
+            if (!ctx->carry)
+                continue;
+        }
 
-        if ( !rc )
+        if (!compress_one_page(ctx))
         {
             /* Out of space in outbuf! flush and come back */
             rc = -1;
             break;
         }
+        ctx->pfns_index++;
     }
     if (compbuf_len)
         *compbuf_len = ctx->compbuf_pos;
@@ -356,6 +866,103 @@ int xc_compression_compress_pages(xc_interface *xch, comp_ctx *ctx,
     return rc;
 }
 
+static void stop_workers(comp_ctx *ctx)
+{
+    unsigned int i;
+
+    if (!ctx->workers)
+    {
+        free(ctx->win_src);
+        free(ctx->win_slot);
+        free(ctx->win_raw);
+        ctx->win_src = NULL;
+        ctx->win_slot = NULL;
+        ctx->win_raw = NULL;
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->pool_lock);
+    ctx->pool_exit = 1;
+    pthread_cond_broadcast(&ctx->pool_work);
+    pthread_mutex_unlock(&ctx->pool_lock);
+
+    for (i = 0; i < ctx->nr_workers; i++)
+    {
+        pthread_join(ctx->workers[i].thread, NULL);
+        free(ctx->workers[i].segbuf);
+    }
+
+    free(ctx->workers);
+    free(ctx->win_src);
+    free(ctx->win_slot);
+    free(ctx->win_raw);
+    ctx->workers = NULL;
+    ctx->win_src = NULL;
+    ctx->win_slot = NULL;
+    ctx->win_raw = NULL;
+    ctx->nr_workers = 0;
+    ctx->pool_exit = 0;
+}
+
+int xc_compression_set_threads(xc_interface *xch, comp_ctx *ctx,
+                               unsigned int nr_threads)
+{
+    unsigned int i, per;
+    struct compress_worker *w;
+
+    stop_workers(ctx);
+
+    if (nr_threads > MAX_COMPRESS_THREADS)
+        nr_threads = MAX_COMPRESS_THREADS;
+    if (nr_threads <= 1)
+        return 0;
+
+    ctx->win_src = malloc(COMPRESS_WINDOW_PAGES * sizeof(char *));
+    ctx->win_slot = malloc(COMPRESS_WINDOW_PAGES * sizeof(uint32_t));
+    ctx->win_raw = malloc(COMPRESS_WINDOW_PAGES);
+    ctx->workers = calloc(nr_threads, sizeof(struct compress_worker));
+    if (!ctx->win_src || !ctx->win_slot || !ctx->win_raw || !ctx->workers)
+    {
+        ERROR("Could not alloc compression worker pool\n");
+        goto error;
+    }
+
+    per = (COMPRESS_WINDOW_PAGES + nr_threads - 1) / nr_threads;
+    for (i = 0; i < nr_threads; i++)
+    {
+        w = &ctx->workers[i];
+        w->ctx = ctx;
+        w->segbuf = malloc(per * WORST_COMP_PAGE_SIZE);
+        if (!w->segbuf ||
+            pthread_create(&w->thread, NULL, compress_worker_main, w))
+        {
+            free(w->segbuf);
+            ERROR("Could not start compression worker %u\n", i);
+            goto error;
+        }
+        ctx->nr_workers++;
+    }
+
+    return 0;
+
+error:
+    stop_workers(ctx);
+    return -1;
+}
+
+void xc_compression_get_stats(xc_interface *xch, comp_ctx *ctx,
+                              xc_compression_stats_t *stats)
+{
+    stats->cache_pages = ctx->nr_slots;
+    stats->cache_hits = ctx->cache_hits;
+    stats->cache_misses = ctx->cache_misses;
+    stats->same_pages = ctx->tag_pages[PAGE_TAG_SAME];
+    stats->delta_pages = ctx->tag_pages[PAGE_TAG_DELTA];
+    stats->zero_pages = ctx->tag_pages[PAGE_TAG_ZERO];
+    stats->rle_pages = ctx->tag_pages[PAGE_TAG_RLE];
+    stats->raw_pages = ctx->tag_pages[PAGE_TAG_RAW];
+}
+
 inline
 void xc_compression_reset_pagebuf(xc_interface *xch, comp_ctx *ctx)
 {
@@ -379,36 +986,49 @@ int xc_compression_uncompress_page(xc_interface *xch, char *compbuf,
         return -1;
     }
 
-    switch (compbuf[pos])
+    switch (compbuf[pos++])
     {
-    case EMPTY_PAGE:
-        pos++;
+    case PAGE_TAG_SAME:
         break;
 
-    case FULL_PAGE:
+    case PAGE_TAG_ZERO:
+        memset(destpage, 0, XC_PAGE_SIZE);
+        break;
+
+    case PAGE_TAG_RAW:
         {
             /* Check if the input buffer has 4KB of data */
-            if ((pos + FULL_PAGE_SIZE) > compbuf_size)
+            if ((pos + XC_PAGE_SIZE) > compbuf_size)
             {
                 ERROR("Out of bounds exception in compression buffer (b):"
                       "read ptr = %lu, bufsize = %lu\n",
                       *compbuf_pos, compbuf_size);
                 return -1;
             }
-            memcpy(destpage, &compbuf[pos + 1], XC_PAGE_SIZE);
-            pos += FULL_PAGE_SIZE;
+            memcpy(destpage, &compbuf[pos], XC_PAGE_SIZE);
+            pos += XC_PAGE_SIZE;
         }
         break;
 
-    default: /* Normal page with one or more runs */
+    case PAGE_TAG_RLE:
+        if (rle_decode(compbuf, compbuf_size, &pos, destpage))
+        {
+            ERROR("Invalid RLE page in compression buffer:"
+                  "read ptr = %lu, bufsize = %lu\n",
+                  *compbuf_pos, compbuf_size);
+            return -1;
+        }
+        break;
+
+    case PAGE_TAG_DELTA: /* Normal page with one or more runs */
         {
             do
             {
+                if (pos >= compbuf_size)
+                    break;
                 flag = compbuf[pos] & FLAGMASK;
                 len = (compbuf[pos] & LENMASK) * sizeof(uint32_t);
-                /* Sanity Check: Zero-length runs are allowed only for
-                 * FULL_PAGE and EMPTY_PAGE.
-                 */
+                /* Sanity Check: Zero-length runs are never sent */
                 if (!len)
                 {
                     ERROR("Zero length run encountered for normal page: "
@@ -437,7 +1057,7 @@ int xc_compression_uncompress_page(xc_interface *xch, char *compbuf,
                     pos += len;
                 }
                 pagepos += len;
-            } while ((pagepos < XC_PAGE_SIZE) && (pos < compbuf_size));
+            } while (pagepos < XC_PAGE_SIZE);
 
             /* Make sure we have copied/skipped 4KB worth of data */
             if (pagepos != XC_PAGE_SIZE)
@@ -448,34 +1068,159 @@ int xc_compression_uncompress_page(xc_interface *xch, char *compbuf,
                 return -1;
             }
         }
+        break;
+
+    default:
+        ERROR("Unknown page tag %u in compression buffer:"
+              "read ptr = %lu, bufsize = %lu\n",
+              (unsigned char)compbuf[pos - 1], *compbuf_pos, compbuf_size);
+        return -1;
     }
     *compbuf_pos = pos;
     return 0;
 }
 
+/*
+ * Second stage coders. The delta encoder leaves full pages (cache misses)
+ * and the literal runs of dirty pages untouched, so a general purpose
+ * coder over the whole chunk still pays off for text and zero heavy
+ * guests. encode() returns 0 only if the output fit in *dstlen bytes.
+ */
+struct chunk_codec {
+    const char *name;
+    int (*encode)(const char *src, unsigned long srclen,
+                  char *dst, unsigned long *dstlen);
+    int (*decode)(const char *src, unsigned long srclen,
+                  char *dst, unsigned long dstlen);
+};
+
+static int zlib_encode(const char *src, unsigned long srclen,
+                       char *dst, unsigned long *dstlen)
+{
+    uLongf len = *dstlen;
+
+    if (compress2((Bytef *)dst, &len, (const Bytef *)src, srclen,
+                  Z_BEST_SPEED) != Z_OK)
+        return -1;
+    *dstlen = len;
+    return 0;
+}
+
+static int zlib_decode(const char *src, unsigned long srclen,
+                       char *dst, unsigned long dstlen)
+{
+    uLongf len = dstlen;
+
+    if (uncompress((Bytef *)dst, &len, (const Bytef *)src, srclen) != Z_OK ||
+        len != dstlen)
+        return -1;
+    return 0;
+}
+
+static const struct chunk_codec chunk_codecs[] = {
+    [XC_COMPRESSION_CODEC_NONE] = { "none", NULL, NULL },
+    [XC_COMPRESSION_CODEC_ZLIB] = { "zlib", zlib_encode, zlib_decode },
+};
+
+#define NR_CHUNK_CODECS (sizeof(chunk_codecs) / sizeof(chunk_codecs[0]))
+
+int xc_compression_codec_id(const char *name)
+{
+    int i;
+
+    for (i = 0; i < NR_CHUNK_CODECS; i++)
+        if (!strcmp(chunk_codecs[i].name, name))
+            return i;
+    return -1;
+}
+
+int xc_compression_encode_chunk(xc_interface *xch, int codec,
+                                const char *src, unsigned long srclen,
+                                char *dst, unsigned long *dstlen)
+{
+    if (codec < 0 || codec >= NR_CHUNK_CODECS)
+    {
+        ERROR("Unknown compression codec %d", codec);
+        return -1;
+    }
+
+    /* Leave at least one byte of gain, so that a stored chunk is
+     * recognisable by its length alone.
+     */
+    *dstlen = srclen - 1;
+    if (!chunk_codecs[codec].encode || srclen < 2 ||
+        chunk_codecs[codec].encode(src, srclen, dst, dstlen))
+    {
+        memcpy(dst, src, srclen);
+        *dstlen = srclen;
+    }
+    return 0;
+}
+
+int xc_compression_decode_chunk(xc_interface *xch, int codec,
+                                const char *src, unsigned long srclen,
+                                char *dst, unsigned long dstlen)
+{
+    if (codec < 0 || codec >= NR_CHUNK_CODECS)
+    {
+        ERROR("Unknown compression codec %d", codec);
+        return -1;
+    }
+
+    if (srclen == dstlen)
+    {
+        memcpy(dst, src, srclen);
+        return 0;
+    }
+
+    if (srclen > dstlen || !chunk_codecs[codec].decode ||
+        chunk_codecs[codec].decode(src, srclen, dst, dstlen))
+    {
+        ERROR("Corrupt %s chunk: %lu bytes, expected %lu after decoding",
+              chunk_codecs[codec].name, srclen, dstlen);
+        return -1;
+    }
+    return 0;
+}
+
 void xc_compression_free_context(xc_interface *xch, comp_ctx *ctx)
 {
     if (!ctx) return;
 
+    stop_workers(ctx);
+    pthread_mutex_destroy(&ctx->pool_lock);
+    pthread_cond_destroy(&ctx->pool_work);
+    pthread_cond_destroy(&ctx->pool_done);
+
     if (ctx->inputbuf)
         free(ctx->inputbuf);
     if (ctx->sendbuf_pfns)
         free(ctx->sendbuf_pfns);
     if (ctx->cache_base)
         free(ctx->cache_base);
-    if (ctx->pfn2cache)
-        free(ctx->pfn2cache);
-    if (ctx->cache)
-        free(ctx->cache);
+    free(ctx->pfn2slot);
+    free(ctx->slot_pfn);
+    free(ctx->slot_flags);
     free(ctx);
 }
 
 comp_ctx *xc_compression_create_context(xc_interface *xch,
-                                        unsigned long p2m_size)
+                                        unsigned long p2m_size,
+                                        unsigned long cache_size)
 {
     unsigned long i;
     comp_ctx *ctx = NULL;
-    unsigned long num_cache_pages = DELTA_CACHE_SIZE/XC_PAGE_SIZE;
+    unsigned long num_cache_pages;
+
+    if (!cache_size)
+        cache_size = DELTA_CACHE_SIZE;
+    num_cache_pages = cache_size / XC_PAGE_SIZE;
+    if (!num_cache_pages || num_cache_pages >= CACHE_SLOT_NONE)
+    {
+        ERROR("Invalid delta cache size %lu\n", cache_size);
+        errno = EINVAL;
+        return NULL;
+    }
 
     ctx = (comp_ctx *)malloc(sizeof(comp_ctx));
     if (!ctx)
@@ -484,6 +1229,9 @@ comp_ctx *xc_compression_create_context(xc_interface *xch,
         goto error;
     }
     memset(ctx, 0, sizeof(comp_ctx));
+    pthread_mutex_init(&ctx->pool_lock, NULL);
+    pthread_cond_init(&ctx->pool_work, NULL);
+    pthread_cond_init(&ctx->pool_done, NULL);
 
     ctx->inputbuf = xc_memalign(xch, XC_PAGE_SIZE, PAGE_BUFFER_SIZE);
     if (!ctx->inputbuf)
@@ -492,7 +1240,8 @@ comp_ctx *xc_compression_create_context(xc_interface *xch,
         goto error;
     }
 
-    ctx->cache_base = xc_memalign(xch, XC_PAGE_SIZE, DELTA_CACHE_SIZE);
+    ctx->cache_base = xc_memalign(xch, XC_PAGE_SIZE,
+                                  num_cache_pages * XC_PAGE_SIZE);
     if (!ctx->cache_base)
     {
         ERROR("Failed to allocate delta cache\n");
@@ -509,32 +1258,31 @@ comp_ctx *xc_compression_create_context(xc_interface *xch,
     memset(ctx->sendbuf_pfns, -1,
            NRPAGES(PAGE_BUFFER_SIZE) * sizeof(xen_pfn_t));
 
-    ctx->pfn2cache = calloc(p2m_size, sizeof(struct cache_page *));
-    if (!ctx->pfn2cache)
+    ctx->pfn2slot = malloc(p2m_size * sizeof(uint32_t));
+    if (!ctx->pfn2slot)
     {
-        ERROR("Could not alloc pfn2cache map\n");
+        ERROR("Could not alloc pfn2slot map\n");
         goto error;
     }
+    memset(ctx->pfn2slot, 0xff, p2m_size * sizeof(uint32_t));
 
-    ctx->cache = malloc(num_cache_pages * sizeof(struct cache_page));
-    if (!ctx->cache)
+    ctx->slot_pfn = malloc(num_cache_pages * sizeof(xen_pfn_t));
+    ctx->slot_flags = calloc(num_cache_pages, sizeof(uint8_t));
+    if (!ctx->slot_pfn || !ctx->slot_flags)
     {
         ERROR("Could not alloc compression cache\n");
         goto error;
     }
 
     for (i = 0; i < num_cache_pages; i++)
-    {
-        ctx->cache[i].pfn = INVALID_P2M_ENTRY;
-        ctx->cache[i].page = ctx->cache_base + i * XC_PAGE_SIZE;
-        ctx->cache[i].prev = (i == 0) ? NULL : &(ctx->cache[i - 1]);
-        ctx->cache[i].next = ((i+1) == num_cache_pages)? NULL :
-            &(ctx->cache[i + 1]);
-    }
-    ctx->page_list_head = &(ctx->cache[0]);
-    ctx->page_list_tail = &(ctx->cache[num_cache_pages -1]);
+        ctx->slot_pfn[i] = INVALID_P2M_ENTRY;
+    ctx->nr_slots = num_cache_pages;
     ctx->dom_pfnlist_size = p2m_size;
 
+    /* Pick the fastest difference kernel for this cpu, unless chosen. */
+    if (!diff_kernel_selected)
+        xc_compression_set_kernel(xch, NULL);
+
     return ctx;
 error:
     xc_compression_free_context(xch, ctx);
@@ -0,0 +1,166 @@
+/******************************************************************************
+ * xc_domain_compress_x86.c
+ *
+ * SSE2/AVX2 kernels for checkpoint delta compression.
+ *
+ * compress_page() needs to know which 32-bit words of a page differ from
+ * the cached copy. The kernels below compare 32 or 64 bytes per step and
+ * produce a bitmap with one bit per word (set = word differs), from which
+ * the SKIP/RUN runs are then found by bit scans.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <immintrin.h>
+
+#include "xg_private.h"
+
+#define WORDS_PER_PAGE (XC_PAGE_SIZE / sizeof(uint32_t))
+
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int *regs)
+{
+#ifdef __i386__
+    /* Use the stack to avoid reg constraint failures with some gcc flags */
+    asm (
+        "push %%ebx; push %%edx\n\t"
+        "cpuid\n\t"
+        "mov %%ebx,4(%4)\n\t"
+        "mov %%edx,12(%4)\n\t"
+        "pop %%edx; pop %%ebx\n\t"
+        : "=a" (regs[0]), "=c" (regs[2])
+        : "0" (leaf), "1" (subleaf), "S" (regs)
+        : "memory" );
+#else
+    asm (
+        "cpuid"
+        : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+        : "0" (leaf), "2" (subleaf) );
+#endif
+}
+
+static int cpu_has_sse2(void)
+{
+    unsigned int regs[4];
+
+    cpuid(1, 0, regs);
+    return !!(regs[3] & (1u << 26));
+}
+
+static int cpu_has_avx2(void)
+{
+    unsigned int regs[4], lo, hi;
+
+    cpuid(0, 0, regs);
+    if ( regs[0] < 7 )
+        return 0;
+
+    /* The OS must have enabled YMM state via XSAVE. */
+    cpuid(1, 0, regs);
+    if ( !(regs[2] & (1u << 27)) || !(regs[2] & (1u << 28)) )
+        return 0;
+    asm volatile ( "xgetbv" : "=a" (lo), "=d" (hi) : "c" (0) );
+    if ( (lo & 0x6) != 0x6 )
+        return 0;
+
+    cpuid(7, 0, regs);
+    return !!(regs[1] & (1u << 5));
+}
+
+/* 16 bytes (4 words) per compare, 64 bytes per step. */
+__attribute__((target("sse2")))
+static void diff_mask_sse2(const uint32_t *old, const uint32_t *new,
+                           uint64_t *mask)
+{
+    const __m128i *o = (const __m128i *)old, *n = (const __m128i *)new;
+    unsigned int i, j, eq;
+    uint64_t m;
+
+    for ( i = 0; i < WORDS_PER_PAGE / 64; i++ )
+    {
+        m = 0;
+        for ( j = 0; j < 64; j += 16 )
+        {
+            eq = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+                     _mm_loadu_si128(o + 0), _mm_loadu_si128(n + 0))));
+            eq |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+                     _mm_loadu_si128(o + 1), _mm_loadu_si128(n + 1)))) << 4;
+            eq |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+                     _mm_loadu_si128(o + 2), _mm_loadu_si128(n + 2)))) << 8;
+            eq |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+                     _mm_loadu_si128(o + 3), _mm_loadu_si128(n + 3)))) << 12;
+            m |= (uint64_t)(~eq & 0xffff) << j;
+            o += 4;
+            n += 4;
+        }
+        mask[i] = m;
+    }
+}
+
+/* 32 bytes (8 words) per compare, 64 bytes per step. */
+__attribute__((target("avx2")))
+static void diff_mask_avx2(const uint32_t *old, const uint32_t *new,
+                           uint64_t *mask)
+{
+    const __m256i *o = (const __m256i *)old, *n = (const __m256i *)new;
+    unsigned int i, j, eq;
+    uint64_t m;
+
+    for ( i = 0; i < WORDS_PER_PAGE / 64; i++ )
+    {
+        m = 0;
+        for ( j = 0; j < 64; j += 16 )
+        {
+            eq = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+                     _mm256_loadu_si256(o + 0), _mm256_loadu_si256(n + 0))));
+            eq |= _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+                     _mm256_loadu_si256(o + 1), _mm256_loadu_si256(n + 1))))
+                  << 8;
+            m |= (uint64_t)(~eq & 0xffff) << j;
+            o += 2;
+            n += 2;
+        }
+        mask[i] = m;
+    }
+    _mm256_zeroupper();
+}
+
+compress_diff_fn *xc_compression_x86_kernel(const char *name)
+{
+    if ( (!name || !strcmp(name, "avx2")) && cpu_has_avx2() )
+        return diff_mask_avx2;
+    if ( (!name || !strcmp(name, "sse2")) && cpu_has_sse2() )
+        return diff_mask_sse2;
+    return NULL;
+}
+
+const char *xc_compression_x86_kernel_name(compress_diff_fn *fn)
+{
+    if ( fn == diff_mask_avx2 )
+        return "avx2";
+    if ( fn == diff_mask_sse2 )
+        return "sse2";
+    return NULL;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -27,26 +27,35 @@
  * The superpages flag in restore has two different meanings depending on
  * the type of domain.
  *
- * For an HVM domain, the flag means to look for properly aligned contiguous
- * pages and try to allocate a superpage to satisfy it.  If that fails,
- * fall back to small pages.
+ * For an HVM domain, the flag means to allocate each properly aligned 1GB
+ * or 2MB range as a superpage when the first page of it arrives, before
+ * the rest of the range has been seen.  Pages in the range that the stream
+ * then reports absent, or never sends, are freed again.  If the allocation
+ * fails, fall back to smaller pages.
  *
  * For a PV domain, the flag means allocate all memory as superpages.  If that
  * fails, the restore fails.  This behavior is required for PV guests who
  * want to use superpages.
  */
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <sys/time.h>
  #include <stdio.h>
 #include "xg_private.h"
 #include "xg_save_restore.h"
 #include "xc_dom.h"
+#include "xc_bitops.h"
 
 #include <xen/hvm/ioreq.h>
 #include <xen/hvm/params.h>
 
+struct stripe_frame;
+struct restore_stripes;
+
 struct restore_ctx {
     unsigned long max_mfn; /* max mfn of the current host machine */
     unsigned long hvirt_start; /* virtual starting address of the hypervisor */
@@ -61,26 +70,294 @@ struct restore_ctx {
     int completed; /* Set when a consistent image is available */
     int last_checkpoint; /* Set when we should commit to the current checkpoint when it completes. */
     int compressing; /* Set when sender signals that pages would be sent compressed (for Remus) */
+    int codec; /* XC_COMPRESSION_CODEC_* applied to compressed chunks by the sender */
+    struct xc_restore_stats stats; /* reported through restore_callbacks */
+    const int *data_fds; /* batches may be striped over these, see XC_SAVE_ID_STRIPES */
+    unsigned int nr_data_fds;
+    struct restore_stripes *stripes; /* reader threads, once the stream asks for them */
+    struct stripe_frame *frame; /* batch being read from a data fd, else NULL */
+    size_t frame_pos;
+    int postcopy; /* Set when the caller takes post-copy pfns */
+    xen_pfn_t *postcopy_pfns; /* see XC_SAVE_ID_POSTCOPY */
+    unsigned long nr_postcopy;
+    uint64_t *postcopy_buf; /* one record, as read */
+    unsigned long *spec_pending; /* HVM: allocated in a superpage, not yet sent */
+    xen_pfn_t *spec_frees; /* batch of those to give back */
+    xc_map_cache_t *map_cache; /* guest pages, kept mapped across batches */
     struct domain_info_context dinfo;
 };
 
-void logprintf(const char*, ...);
-
-FILE* logFile;
-
-void logprintf(const char *fmt, ...)
+static uint64_t llgettimeofday(void)
 {
-    va_list argz;
-    logFile = fopen("/home/roshan/restorelog.txt","ab+");
-    va_start(argz, fmt);
-    vfprintf(logFile, fmt, argz);
-    fclose(logFile);
-    va_end(argz);
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return ((uint64_t)now.tv_sec * 1000000) + now.tv_usec;
 }
 
 #define HEARTBEAT_MS 10000
 
 #ifndef __MINIOS__
+/*
+ * Striped batches, see xg_save_restore.h.
+ *
+ * One reader thread per data fd collects frames, and the main loop takes
+ * them in the order their markers arrive on the primary stream. Frames
+ * on one data fd arrive in sequence order, so a reader that already
+ * holds STRIPE_READAHEAD frames can stop reading without holding up the
+ * frame the main loop waits for: that one is ahead of them on its fd.
+ */
+#define STRIPE_READAHEAD 4
+/* Sanity limit; a frame holds a single batch */
+#define STRIPE_FRAME_MAX (2 * MAX_BATCH_SIZE * PAGE_SIZE)
+
+struct stripe_reader;
+
+struct stripe_frame {
+    uint32_t seq, len;
+    struct stripe_reader *reader;
+    struct stripe_frame *next;
+    char data[];
+};
+
+struct stripe_reader {
+    struct restore_stripes *s;
+    int fd;
+    pthread_t thread;
+    unsigned int held;              /* frames not taken yet */
+    int done;                       /* end frame or error */
+    struct stripe_frame *partial;   /* being read */
+};
+
+struct restore_stripes {
+    xc_interface *xch;
+    struct stripe_reader *readers;
+    unsigned int nr, nr_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct stripe_frame *frames;    /* received, not taken yet */
+    int err, exit;
+};
+
+/* read_exact(), but the thread may be cancelled while it waits */
+static int stripe_read(int fd, void *buf, size_t size)
+{
+    size_t offset = 0;
+    ssize_t len;
+    int old;
+
+    while ( offset < size )
+    {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old);
+        len = read(fd, (char *)buf + offset, size - offset);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+        if ( (len == -1) && ((errno == EINTR) || (errno == EAGAIN)) )
+            continue;
+        if ( len == 0 )
+            errno = 0;
+        if ( len <= 0 )
+            return -1;
+        offset += len;
+    }
+
+    return 0;
+}
+
+static void *stripe_reader_main(void *arg)
+{
+    struct stripe_reader *r = arg;
+    struct restore_stripes *s = r->s;
+    xc_interface *xch = s->xch;
+    struct stripe_frame *f;
+    uint32_t hdr[2];
+    int old, stop;
+
+    /* Cancellation is only enabled in stripe_read() */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+
+    for ( ; ; )
+    {
+        pthread_mutex_lock(&s->lock);
+        while ( r->held >= STRIPE_READAHEAD && !s->exit )
+            pthread_cond_wait(&s->cond, &s->lock);
+        stop = s->exit;
+        pthread_mutex_unlock(&s->lock);
+        if ( stop )
+            break;
+
+        if ( stripe_read(r->fd, hdr, sizeof(hdr)) )
+        {
+            PERROR("Error when reading frame header from data fd %d", r->fd);
+            goto err;
+        }
+        if ( hdr[0] == XC_STRIPE_END )
+            break;
+        if ( hdr[1] > STRIPE_FRAME_MAX )
+        {
+            ERROR("Frame %u too large (%u bytes)", hdr[0], hdr[1]);
+            goto err;
+        }
+        if ( !(f = r->partial = malloc(sizeof(*f) + hdr[1])) )
+        {
+            ERROR("Could not allocate %u bytes for frame %u", hdr[1], hdr[0]);
+            goto err;
+        }
+        if ( stripe_read(r->fd, f->data, hdr[1]) )
+        {
+            PERROR("Error when reading frame %u from data fd %d",
+                   hdr[0], r->fd);
+            goto err;
+        }
+        r->partial = NULL;
+        f->seq = hdr[0];
+        f->len = hdr[1];
+        f->reader = r;
+
+        pthread_mutex_lock(&s->lock);
+        f->next = s->frames;
+        s->frames = f;
+        r->held++;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    r->done = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+
+ err:
+    pthread_mutex_lock(&s->lock);
+    s->err = 1;
+    r->done = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static void restore_stripes_destroy(struct restore_stripes *s)
+{
+    struct stripe_frame *f;
+    unsigned int i;
+
+    if ( !s )
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    s->exit = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    /* Readers still waiting for data are stuck in read() */
+    for ( i = 0; i < s->nr_threads; i++ )
+        pthread_cancel(s->readers[i].thread);
+    for ( i = 0; i < s->nr_threads; i++ )
+    {
+        pthread_join(s->readers[i].thread, NULL);
+        free(s->readers[i].partial);
+    }
+
+    while ( (f = s->frames) )
+    {
+        s->frames = f->next;
+        free(f);
+    }
+    free(s->readers);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+static struct restore_stripes *restore_stripes_create(
+    xc_interface *xch, const int *fds, unsigned int nr)
+{
+    struct restore_stripes *s;
+    unsigned int i;
+
+    if ( !(s = calloc(1, sizeof(*s))) ||
+         !(s->readers = calloc(nr, sizeof(*s->readers))) )
+    {
+        ERROR("Could not allocate data fd readers");
+        free(s);
+        return NULL;
+    }
+
+    s->xch = xch;
+    s->nr = nr;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        s->readers[i].s = s;
+        s->readers[i].fd = fds[i];
+        if ( pthread_create(&s->readers[i].thread, NULL,
+                            stripe_reader_main, &s->readers[i]) )
+        {
+            ERROR("Could not start reader for data fd %d", fds[i]);
+            restore_stripes_destroy(s);
+            return NULL;
+        }
+        s->nr_threads++;
+    }
+
+    return s;
+}
+
+/* Wait for frame seq; NULL if it cannot arrive any more. */
+static struct stripe_frame *restore_stripes_take(struct restore_stripes *s,
+                                                 uint32_t seq)
+{
+    struct stripe_frame **pf, *f;
+    unsigned int i, done;
+
+    pthread_mutex_lock(&s->lock);
+    for ( ; ; )
+    {
+        for ( pf = &s->frames; *pf; pf = &(*pf)->next )
+            if ( (*pf)->seq == seq )
+                break;
+        if ( (f = *pf) )
+        {
+            *pf = f->next;
+            f->reader->held--;
+            pthread_cond_broadcast(&s->cond);
+            break;
+        }
+
+        for ( done = i = 0; i < s->nr; i++ )
+            done += s->readers[i].done;
+        if ( s->err || done == s->nr )
+            break;
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return f;
+}
+
+/* Wait for the end frame on every data fd. */
+static int restore_stripes_finish(struct restore_stripes *s)
+{
+    unsigned int i, done;
+    int rc;
+
+    pthread_mutex_lock(&s->lock);
+    for ( ; ; )
+    {
+        for ( done = i = 0; i < s->nr; i++ )
+            done += s->readers[i].done;
+        if ( s->err || done == s->nr )
+            break;
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    rc = (s->err || s->frames) ? -1 : 0;
+    pthread_mutex_unlock(&s->lock);
+
+    return rc;
+}
+
 static ssize_t rdexact(xc_interface *xch, struct restore_ctx *ctx,
                        int fd, void* buf, size_t size)
 {
@@ -88,6 +365,21 @@ static ssize_t rdexact(xc_interface *xch, struct restore_ctx *ctx,
     ssize_t len;
     struct timeval tv;
     fd_set rfds;
+    uint64_t start = llgettimeofday();
+
+    if ( ctx->frame )
+    {
+        /* The rest of the batch is in the frame */
+        if ( size > ctx->frame->len - ctx->frame_pos )
+        {
+            ERROR("Batch runs past the end of frame %u", ctx->frame->seq);
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(buf, ctx->frame->data + ctx->frame_pos, size);
+        ctx->frame_pos += size;
+        return 0;
+    }
 
     while ( offset < size )
     {
@@ -122,6 +414,7 @@ static ssize_t rdexact(xc_interface *xch, struct restore_ctx *ctx,
         offset += len;
     }
 
+    ctx->stats.read_us += llgettimeofday() - start;
     return 0;
 }
 
@@ -172,6 +465,139 @@ static int alloc_superpage_mfns(
     }
     return 0;
 }
+/* Guest memory kept mapped by the map cache during the restore */
+#define MAP_CACHE_PAGES (1UL << 18)
+
+/*
+** What the map cache maps for a pfn.  For HVM guests that is the pfn, once
+** populated: the p2m entry changing (to or from INVALID_P2M_ENTRY) has the
+** cache map the page again.
+*/
+static xen_pfn_t map_cache_frame(void *data, xen_pfn_t pfn)
+{
+    struct restore_ctx *ctx = data;
+
+    if ( pfn >= ctx->dinfo.p2m_size || ctx->p2m[pfn] >= INVALID_P2M_ENTRY - 2 )
+        return INVALID_MFN;
+    return ctx->hvm ? pfn : ctx->p2m[pfn];
+}
+
+#define SUPERPAGE_1GB_SHIFT  18
+#define SUPERPAGE_1GB_NR_PFNS (1UL << SUPERPAGE_1GB_SHIFT)
+
+/*
+** HVM guests are built with 1GB and 2MB extents where they can be.  To keep
+** them, when a pfn arrives at the start of an aligned range none of which
+** has been allocated, allocate the whole range and mark the rest of it
+** pending.  Returns 0 if pfn is now allocated, else it needs a 4K page.
+*/
+static int alloc_hvm_superpage(xc_interface *xch, uint32_t dom,
+                               struct restore_ctx *ctx, unsigned long pfn)
+{
+    static const unsigned int orders[] = {
+        SUPERPAGE_1GB_SHIFT, SUPERPAGE_PFN_SHIFT
+    };
+    struct domain_info_context *dinfo = &ctx->dinfo;
+    unsigned long k, nr;
+    xen_pfn_t base;
+    int i;
+
+    for ( i = 0; i < sizeof(orders) / sizeof(orders[0]); i++ )
+    {
+        nr = 1UL << orders[i];
+        if ( (pfn & (nr - 1)) || (pfn + nr > dinfo->p2m_size) )
+            continue;
+
+        for ( k = 0; k < nr; k++ )
+            if ( ctx->p2m[pfn + k] != INVALID_P2M_ENTRY )
+                break;
+        if ( k != nr )
+            continue;
+
+        base = pfn;
+        if ( xc_domain_populate_physmap_exact(xch, dom, 1, orders[i],
+                                              0, &base) != 0 )
+        {
+            DPRINTF("No order %u page available for pfn 0x%lx\n",
+                    orders[i], pfn);
+            continue;
+        }
+
+        for ( k = 0; k < nr; k++ )
+        {
+            ctx->p2m[pfn + k] = base + k;
+            if ( k )
+                set_bit(pfn + k, ctx->spec_pending);
+        }
+        ctx->nr_pfns += nr;
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+** Give back pages allocated by alloc_hvm_superpage() that the guest turned
+** out not to have.  This just splits the superpage in the guest's p2m.
+*/
+static int free_hvm_pending(xc_interface *xch, uint32_t dom,
+                            struct restore_ctx *ctx, unsigned int nr)
+{
+    unsigned int i;
+
+    if ( nr == 0 )
+        return 0;
+
+    /* Our mappings would keep the pages allocated */
+    for ( i = 0; i < nr; i++ )
+        xc_map_cache_invalidate(ctx->map_cache, ctx->spec_frees[i], 1);
+
+    DPRINTF("Freeing %u unpopulated pfns from pfn 0x%lx\n",
+            nr, (unsigned long)ctx->spec_frees[0]);
+    if ( xc_domain_decrease_reservation_exact(xch, dom, nr, 0,
+                                              ctx->spec_frees) != 0 )
+    {
+        PERROR("Failed to free unpopulated pfns");
+        return -1;
+    }
+    ctx->nr_pfns -= nr;
+    return 0;
+}
+
+/* At the end of the stream, free what is still pending. */
+static int finish_hvm_pending(xc_interface *xch, uint32_t dom,
+                              struct restore_ctx *ctx)
+{
+    struct domain_info_context *dinfo = &ctx->dinfo;
+    unsigned long pfn;
+    unsigned int nr = 0;
+
+    if ( ctx->spec_pending == NULL )
+        return 0;
+
+    for ( pfn = 0; pfn < dinfo->p2m_size; pfn++ )
+    {
+        if ( !ctx->spec_pending[pfn / BITS_PER_LONG] )
+        {
+            pfn |= BITS_PER_LONG - 1;
+            continue;
+        }
+        if ( !test_and_clear_bit(pfn, ctx->spec_pending) )
+            continue;
+
+        ctx->p2m[pfn] = INVALID_P2M_ENTRY;
+        ctx->spec_frees[nr++] = pfn;
+        if ( nr == MAX_BATCH_SIZE )
+        {
+            if ( free_hvm_pending(xch, dom, ctx, nr) )
+                return -1;
+            nr = 0;
+        }
+    }
+
+    return free_hvm_pending(xch, dom, ctx, nr);
+}
+
 /*
 ** In the state file (or during transfer), all page-table pages are
 ** converted into a 'canonical' form where references to actual mfns
@@ -430,13 +856,11 @@ static int compat_buffer_qemu(xc_interface *xch, struct restore_ctx *ctx,
     }
 
     while( (rc = read(fd, qbuf+dlen, blen-dlen)) > 0 ) {
-        //DPRINTF("Read %d bytes of QEMU data\n", rc);
-        logprintf("Read %d bytes of QEMU data\n", rc);
+        DPRINTF("Read %d bytes of QEMU data\n", rc);
         dlen += rc;
 
         if (dlen == blen) {
-            //DPRINTF("%d-byte QEMU buffer full, reallocating...\n", dlen);
-            logprintf("%d-byte QEMU buffer full, reallocating...\n", dlen);
+            DPRINTF("%d-byte QEMU buffer full, reallocating...\n", dlen);
             blen += 4096;
             tmp = realloc(qbuf, blen);
             if ( !tmp ) {
@@ -515,8 +939,7 @@ static int dump_qemu(xc_interface *xch, uint32_t dom, struct tailbuf_hvm *buf)
     if ( !fp )
         return -1;
 
-    //DPRINTF("Writing %d bytes of QEMU data\n", buf->qemubufsize);
-    logprintf("Writing %d bytes of QEMU data\n", buf->qemubufsize);
+    DPRINTF("Writing %d bytes of QEMU data\n", buf->qemubufsize);
     if ( fwrite(buf->qemubuf, 1, buf->qemubufsize, fp) != buf->qemubufsize) {
         saved_errno = errno;
         fclose(fp);
@@ -653,7 +1076,6 @@ static int buffer_tail_pv(xc_interface *xch, struct restore_ctx *ctx,
         }
     }
     // DPRINTF("Reading VCPUS: %d bytes\n", vcpulen);
-    logprintf("Reading VCPUS: %d bytes\n", vcpulen);
     if ( RDEXACT(fd, buf->vcpubuf, vcpulen) ) {
         PERROR("Error when reading ctxt");
         goto free_vcpus;
@@ -661,7 +1083,7 @@ static int buffer_tail_pv(xc_interface *xch, struct restore_ctx *ctx,
 
     /* load shared_info_page */
     // DPRINTF("Reading shared info: %lu bytes\n", PAGE_SIZE);
-    logprintf("Reading shared info: %lu bytes\n", PAGE_SIZE);
+    DPRINTF("Reading shared info: %lu bytes\n", PAGE_SIZE);
     if ( RDEXACT(fd, buf->shared_info_page, PAGE_SIZE) ) {
         PERROR("Error when reading shared info page");
         goto free_vcpus;
@@ -744,6 +1166,22 @@ typedef struct {
     int compressing;
     unsigned long compbuf_pos, compbuf_size;
 
+    /*
+     * Pages sent by reference (XC_SAVE_ID_PAGE_REFS), with index into
+     * pfn_types and sorted by it. next_refs holds the references for the
+     * batch that has not been read yet.
+     */
+    struct xc_page_ref *refs, *next_refs;
+    unsigned int nr_refs, nr_next_refs;
+
+    /*
+     * With defer_decode set, a coded chunk is left in wire for a
+     * restore_pipe worker to decode into pages + wire_off.
+     */
+    int defer_decode;
+    char *wire;
+    unsigned long wire_len, wire_off, wire_raw_len;
+
     /* Types of the pfns in the current region */
     unsigned long* pfn_types;
 
@@ -785,6 +1223,12 @@ static void pagebuf_free(pagebuf_t* buf)
         free(buf->pfn_types);
         buf->pfn_types = NULL;
     }
+    free(buf->refs);
+    buf->refs = NULL;
+    free(buf->next_refs);
+    buf->next_refs = NULL;
+    free(buf->wire);
+    buf->wire = NULL;
 }
 
 static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
@@ -792,7 +1236,14 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
 {
     int count, countpages, oldcount, i;
     void* ptmp;
-    unsigned long compbuf_size;
+    unsigned long compbuf_size, wire_size;
+    uint32_t codec, nr_refs, nr_pfns;
+#ifndef __MINIOS__
+    struct stripe_frame *frame;
+    uint32_t seq;
+    uint64_t start;
+    int rc;
+#endif
 
     if ( RDEXACT(fd, &count, sizeof(count)) )
     {
@@ -800,19 +1251,16 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
         return -1;
     }
 
-    //DPRINTF("reading batch of %d pages\n", count);
-    logprintf("reading batch of %d pages\n", count);
+    // DPRINTF("reading batch of %d pages\n", count);
 
     switch ( count )
     {
     case 0:
-        //DPRINTF("Last batch read\n");
-        logprintf("Last batch read\n");
+        // DPRINTF("Last batch read\n");
         return 0;
 
     case XC_SAVE_ID_ENABLE_VERIFY_MODE:
-        //DPRINTF("Entering page verify mode\n");
-        logprintf("Entering page verify mode\n");
+        DPRINTF("Entering page verify mode\n");
         buf->verify = 1;
         return pagebuf_get_one(xch, ctx, buf, fd, dom);
 
@@ -883,8 +1331,7 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
         return pagebuf_get_one(xch, ctx, buf, fd, dom);
 
     case XC_SAVE_ID_TMEM:
-        //DPRINTF("xc_domain_restore start tmem\n");
-        logprintf("xc_domain_restore start tmem\n");
+        DPRINTF("xc_domain_restore start tmem\n");
         if ( xc_tmem_restore(xch, dom, fd) ) {
             PERROR("error reading/restoring tmem");
             return -1;
@@ -926,8 +1373,7 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
 
     case XC_SAVE_ID_LAST_CHECKPOINT:
         ctx->last_checkpoint = 1;
-        //DPRINTF("last checkpoint indication received");
-        logprintf("last checkpoint indication received");
+        DPRINTF("last checkpoint indication received");
         return pagebuf_get_one(xch, ctx, buf, fd, dom);
 
     case XC_SAVE_ID_HVM_ACPI_IOPORTS_LOCATION:
@@ -964,6 +1410,13 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
         }
 
     case XC_SAVE_ID_ENABLE_COMPRESSION:
+        /* The sender encodes pages in the older untagged format. */
+        ERROR("Sender uses the untagged compressed page format, "
+              "which this receiver no longer decodes");
+        errno = EPROTO;
+        return -1;
+
+    case XC_SAVE_ID_ENABLE_TAGGED_COMPRESSION:
         /* We cannot set compression flag directly in pagebuf structure,
          * since this pagebuf still has uncompressed pages that are yet to
          * be applied. We enable the compression field in pagebuf structure
@@ -971,23 +1424,115 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
          */
         ctx->compressing = 1;
         buf->compressing = 1;
-        logprintf("compression flag received\n");
+        DPRINTF("compression flag received\n");
+        return pagebuf_get_one(xch, ctx, buf, fd, dom);
+
+    case XC_SAVE_ID_COMPRESSION_CODEC:
+        if ( RDEXACT(fd, &codec, sizeof(codec)) )
+        {
+            PERROR("Error when reading compression codec");
+            return -1;
+        }
+        ctx->codec = codec;
+        DPRINTF("compression codec %u\n", codec);
+        return pagebuf_get_one(xch, ctx, buf, fd, dom);
+
+    case XC_SAVE_ID_PAGE_REFS:
+        if ( RDEXACT(fd, &nr_refs, sizeof(nr_refs)) )
+        {
+            PERROR("Error when reading number of page references");
+            return -1;
+        }
+        if ( buf->nr_next_refs || nr_refs > MAX_BATCH_SIZE )
+        {
+            ERROR("Bad page references chunk (%u entries)", nr_refs);
+            return -1;
+        }
+        if ( !buf->next_refs &&
+             !(buf->next_refs = malloc(MAX_BATCH_SIZE *
+                                       sizeof(*buf->next_refs))) )
+        {
+            ERROR("Could not allocate page references");
+            return -1;
+        }
+        if ( RDEXACT(fd, buf->next_refs, nr_refs * sizeof(*buf->next_refs)) )
+        {
+            PERROR("Error when reading page references");
+            return -1;
+        }
+        buf->nr_next_refs = nr_refs;
+        return pagebuf_get_one(xch, ctx, buf, fd, dom);
+
+    case XC_SAVE_ID_POSTCOPY:
+        if ( RDEXACT(fd, &nr_pfns, sizeof(nr_pfns)) )
+        {
+            PERROR("Error when reading number of post-copy pfns");
+            return -1;
+        }
+        if ( !ctx->postcopy || !ctx->last_checkpoint ||
+             nr_pfns > MAX_BATCH_SIZE )
+        {
+            ERROR("Unexpected post-copy pfns (%u entries)", nr_pfns);
+            errno = EINVAL;
+            return -1;
+        }
+        ptmp = realloc(ctx->postcopy_pfns, (ctx->nr_postcopy + nr_pfns) *
+                       sizeof(*ctx->postcopy_pfns));
+        if ( !ptmp )
+        {
+            ERROR("Could not allocate post-copy pfns");
+            return -1;
+        }
+        ctx->postcopy_pfns = ptmp;
+        if ( !ctx->postcopy_buf &&
+             !(ctx->postcopy_buf = malloc(MAX_BATCH_SIZE *
+                                          sizeof(*ctx->postcopy_buf))) )
+        {
+            ERROR("Could not allocate post-copy pfns");
+            return -1;
+        }
+        if ( RDEXACT(fd, ctx->postcopy_buf,
+                     nr_pfns * sizeof(*ctx->postcopy_buf)) )
+        {
+            PERROR("Error when reading post-copy pfns");
+            return -1;
+        }
+        for ( i = 0; i < nr_pfns; i++ )
+        {
+            if ( ctx->postcopy_buf[i] >= ctx->dinfo.p2m_size )
+            {
+                ERROR("Post-copy pfn %#"PRIx64" out of range",
+                      ctx->postcopy_buf[i]);
+                errno = EINVAL;
+                return -1;
+            }
+            ctx->postcopy_pfns[ctx->nr_postcopy++] = ctx->postcopy_buf[i];
+        }
         return pagebuf_get_one(xch, ctx, buf, fd, dom);
 
     case XC_SAVE_ID_COMPRESSED_DATA:
 
         /* read the length of compressed chunk coming in */
-        logprintf("compressed data received\n");
-        if ( RDEXACT(fd, &compbuf_size, sizeof(unsigned long)) )
+        if ( RDEXACT(fd, &wire_size, sizeof(unsigned long)) )
         {
             PERROR("Error when reading compbuf_size");
             return -1;
         }
-        if (!compbuf_size) {
-            logprintf("compressed data end-marker\n");
+        if (!wire_size) {
+            // DPRINTF("compressed data end-marker\n");
             return 1;
         }
-            
+
+        /* With a second stage codec, the delta stream length follows */
+        compbuf_size = wire_size;
+        if ( ctx->codec != XC_COMPRESSION_CODEC_NONE &&
+             RDEXACT(fd, &compbuf_size, sizeof(unsigned long)) )
+        {
+            PERROR("Error when reading decoded chunk size");
+            return -1;
+        }
+        ctx->stats.wire_bytes += wire_size;
+        ctx->stats.raw_bytes += compbuf_size;
 
         buf->compbuf_size += compbuf_size;
         if (!(ptmp = realloc(buf->pages, buf->compbuf_size))) {
@@ -995,14 +1540,125 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
             return -1;
         }
         buf->pages = ptmp;
+        ptmp = buf->pages + (buf->compbuf_size - compbuf_size);
 
-        if ( RDEXACT(fd, buf->pages + (buf->compbuf_size - compbuf_size),
-                     compbuf_size) ) {
-            PERROR("Error when reading compression buffer");
+        if ( ctx->codec == XC_COMPRESSION_CODEC_NONE ||
+             wire_size == compbuf_size )
+        {
+            if ( RDEXACT(fd, ptmp, compbuf_size) ) {
+                PERROR("Error when reading compression buffer");
+                return -1;
+            }
+            return compbuf_size;
+        }
+
+        if ( wire_size > compbuf_size )
+        {
+            ERROR("Coded chunk larger than its contents (%lu > %lu)",
+                  wire_size, compbuf_size);
             return -1;
         }
+
+        if ( buf->defer_decode && !buf->wire_len )
+        {
+            if ( !(ptmp = realloc(buf->wire, wire_size)) )
+            {
+                ERROR("Could not allocate %lu bytes for coded chunk",
+                      wire_size);
+                return -1;
+            }
+            buf->wire = ptmp;
+            if ( RDEXACT(fd, buf->wire, wire_size) ) {
+                PERROR("Error when reading compression buffer");
+                return -1;
+            }
+            buf->wire_len = wire_size;
+            buf->wire_off = buf->compbuf_size - compbuf_size;
+            buf->wire_raw_len = compbuf_size;
+            return compbuf_size;
+        }
+
+        {
+            char *wire_buf;
+            uint64_t start;
+
+            if ( !(wire_buf = malloc(wire_size)) )
+            {
+                ERROR("Could not allocate %lu bytes for coded chunk",
+                      wire_size);
+                return -1;
+            }
+            if ( RDEXACT(fd, wire_buf, wire_size) ) {
+                PERROR("Error when reading compression buffer");
+                free(wire_buf);
+                return -1;
+            }
+            start = llgettimeofday();
+            if ( xc_compression_decode_chunk(xch, ctx->codec, wire_buf,
+                                             wire_size, ptmp,
+                                             compbuf_size) )
+            {
+                free(wire_buf);
+                return -1;
+            }
+            ctx->stats.decode_us += llgettimeofday() - start;
+            free(wire_buf);
+        }
         return compbuf_size;
 
+#ifndef __MINIOS__
+    case XC_SAVE_ID_STRIPES:
+        if ( RDEXACT(fd, &seq, sizeof(seq)) )
+        {
+            PERROR("Error when reading number of data fds");
+            return -1;
+        }
+        if ( ctx->stripes || seq != ctx->nr_data_fds )
+        {
+            ERROR("Stream is striped over %u data fds, %u given",
+                  seq, ctx->nr_data_fds);
+            errno = EINVAL;
+            return -1;
+        }
+        if ( !(ctx->stripes = restore_stripes_create(xch, ctx->data_fds,
+                                                     ctx->nr_data_fds)) )
+            return -1;
+        DPRINTF("batches striped over %u data fds\n", seq);
+        return pagebuf_get_one(xch, ctx, buf, fd, dom);
+
+    case XC_SAVE_ID_STRIPED_BATCH:
+        if ( RDEXACT(fd, &seq, sizeof(seq)) )
+        {
+            PERROR("Error when reading frame sequence number");
+            return -1;
+        }
+        if ( !ctx->stripes || ctx->frame )
+        {
+            ERROR("Unexpected striped batch %u", seq);
+            errno = EINVAL;
+            return -1;
+        }
+        start = llgettimeofday();
+        if ( !(frame = restore_stripes_take(ctx->stripes, seq)) )
+        {
+            ERROR("Frame %u did not arrive on the data fds", seq);
+            return -1;
+        }
+        ctx->stats.read_us += llgettimeofday() - start;
+
+        ctx->frame = frame;
+        ctx->frame_pos = 0;
+        rc = pagebuf_get_one(xch, ctx, buf, fd, dom);
+        if ( rc >= 0 && ctx->frame_pos != frame->len )
+        {
+            ERROR("Frame %u holds more than one batch", seq);
+            rc = -1;
+        }
+        ctx->frame = NULL;
+        free(frame);
+        return rc;
+#endif
+
     case XC_SAVE_ID_HVM_GENERATION_ID_ADDR:
         /* Skip padding 4 bytes then read the generation id buffer location. */
         if ( RDEXACT(fd, &buf->vm_generationid_addr, sizeof(uint32_t)) ||
@@ -1011,7 +1667,7 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
             PERROR("error read the generation id buffer location");
             return -1;
         }
-        logprintf("read generation id buffer address\n");
+        DPRINTF("read generation id buffer address\n");
         return pagebuf_get_one(xch, ctx, buf, fd, dom);
 
     default:
@@ -1054,6 +1710,40 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
             --countpages;
     }
 
+    /* Pages sent by reference have no data in this batch either */
+    if ( buf->nr_next_refs )
+    {
+        struct xc_page_ref *ref;
+
+        if ( !(ptmp = realloc(buf->refs, (buf->nr_refs + buf->nr_next_refs) *
+                                         sizeof(*buf->refs))) )
+        {
+            ERROR("Could not reallocate page references");
+            return -1;
+        }
+        buf->refs = ptmp;
+
+        for ( i = 0; i < buf->nr_next_refs; i++ )
+        {
+            ref = &buf->next_refs[i];
+            if ( ref->index >= count ||
+                 (i && ref->index <= buf->next_refs[i - 1].index) ||
+                 (buf->pfn_types[oldcount + ref->index] &
+                  XEN_DOMCTL_PFINFO_LTAB_MASK) != XEN_DOMCTL_PFINFO_NOTAB ||
+                 (ref->src != XC_PAGE_REF_ZERO &&
+                  ref->src >= ctx->dinfo.p2m_size) )
+            {
+                ERROR("Bad page reference %u -> %"PRIx64, ref->index,
+                      ref->src);
+                return -1;
+            }
+            buf->refs[buf->nr_refs] = *ref;
+            buf->refs[buf->nr_refs++].index += oldcount;
+        }
+        countpages -= buf->nr_next_refs;
+        buf->nr_next_refs = 0;
+    }
+
     if (!countpages)
         return count;
 
@@ -1082,6 +1772,8 @@ static int pagebuf_get_one(xc_interface *xch, struct restore_ctx *ctx,
         PERROR("Error when reading pages");
         return -1;
     }
+    ctx->stats.wire_bytes += countpages * PAGE_SIZE;
+    ctx->stats.raw_bytes += countpages * PAGE_SIZE;
 
     return count;
 }
@@ -1093,6 +1785,7 @@ static int pagebuf_get(xc_interface *xch, struct restore_ctx *ctx,
 
     buf->nr_physpages = buf->nr_pages = 0;
     buf->compbuf_pos = buf->compbuf_size = 0;
+    buf->nr_refs = 0;
 
     do {
         rc = pagebuf_get_one(xch, ctx, buf, fd, dom);
@@ -1104,134 +1797,98 @@ static int pagebuf_get(xc_interface *xch, struct restore_ctx *ctx,
     return rc;
 }
 
-static int apply_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
-                       xen_pfn_t* region_mfn, unsigned long* pfn_type, int pae_extended_cr3,
-                       struct xc_mmu* mmu,
-                       pagebuf_t* pagebuf, int curbatch)
+/*
+ * Fill in a page sent by reference: zero it, or copy the contents of the
+ * source pfn, which has been restored already.
+ */
+static int apply_page_ref(xc_interface *xch, uint32_t dom,
+                          struct restore_ctx *ctx,
+                          const struct xc_page_ref *ref, void *page)
 {
-    int i, j, curpage, nr_mfns;
-    int k, scount;
-    unsigned long superpage_start=INVALID_P2M_ENTRY;
-    /* used by debug verify code */
-    unsigned long buf[PAGE_SIZE/sizeof(unsigned long)];
-    /* Our mapping of the current region (batch) */
-    char *region_base;
-    /* A temporary mapping, and a copy, of one frame of guest memory. */
-    unsigned long *page = NULL;
-    int nraces = 0;
-    struct domain_info_context *dinfo = &ctx->dinfo;
-    int* pfn_err = NULL;
-    int rc = -1;
+    void *src;
 
-    unsigned long mfn, pfn, pagetype;
+    if ( ref->src == XC_PAGE_REF_ZERO )
+    {
+        memset(page, 0, PAGE_SIZE);
+        return 0;
+    }
+
+    if ( ctx->p2m[ref->src] == INVALID_P2M_ENTRY )
+    {
+        ERROR("Page reference to pfn %"PRIx64" which was never sent",
+              ref->src);
+        return -1;
+    }
+
+    src = xc_map_foreign_range(xch, dom, PAGE_SIZE, PROT_READ,
+                               ctx->hvm ? ref->src : ctx->p2m[ref->src]);
+    if ( src == NULL )
+    {
+        PERROR("Failed to map source pfn %"PRIx64" of page reference",
+               ref->src);
+        return -1;
+    }
+    memcpy(page, src, PAGE_SIZE);
+    munmap(src, PAGE_SIZE);
+    return 0;
+}
+
+/*
+ * Allocate the frames of the pages from curbatch on that have none yet,
+ * and fill in region_mfn[] for them.
+ */
+static int alloc_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
+                       xen_pfn_t *region_mfn, pagebuf_t *pagebuf, int curbatch)
+{
+    int i, j, nr_mfns, nr_frees, rc;
+    struct domain_info_context *dinfo = &ctx->dinfo;
 
     j = pagebuf->nr_pages - curbatch;
     if (j > MAX_BATCH_SIZE)
         j = MAX_BATCH_SIZE;
 
-    /* First pass for this batch: work out how much memory to alloc, and detect superpages */
-    nr_mfns = scount = 0;
+    /* First pass for this batch: work out how much memory to alloc */
+    nr_mfns = nr_frees = 0;
     for ( i = 0; i < j; i++ )
     {
         unsigned long pfn, pagetype;
         pfn      = pagebuf->pfn_types[i + curbatch] & ~XEN_DOMCTL_PFINFO_LTAB_MASK;
         pagetype = pagebuf->pfn_types[i + curbatch] &  XEN_DOMCTL_PFINFO_LTAB_MASK;
 
+        /* Allocated with a superpage: keep it, unless it isn't there */
+        if ( ctx->spec_pending && pfn < dinfo->p2m_size &&
+             test_and_clear_bit(pfn, ctx->spec_pending) )
+        {
+            if ( pagetype == XEN_DOMCTL_PFINFO_XTAB )
+            {
+                ctx->p2m[pfn] = INVALID_P2M_ENTRY;
+                ctx->spec_frees[nr_frees++] = pfn;
+            }
+            continue;
+        }
+
         /* For allocation purposes, treat XEN_DOMCTL_PFINFO_XALLOC as a normal page */
         if ( (pagetype != XEN_DOMCTL_PFINFO_XTAB) && 
              (ctx->p2m[pfn] == INVALID_P2M_ENTRY) )
         {
             /* Have a live PFN which hasn't had an MFN allocated */
+            if ( ctx->spec_pending &&
+                 alloc_hvm_superpage(xch, dom, ctx, pfn) == 0 )
+                continue;
 
-            /* Logic if we're in the middle of detecting a candidate superpage */
-            if ( superpage_start != INVALID_P2M_ENTRY )
-            {
-                /* Is this the next expected continuation? */
-                if ( pfn == superpage_start + scount )
-                {
-                    if ( !ctx->superpages )
-                    {
-                        ERROR("Unexpexted codepath with no superpages");
-                        return -1;
-                    }
-
-                    scount++;
-
-                    /* If we've found a whole superpage, allocate it and update p2m */
-                    if ( scount  == SUPERPAGE_NR_PFNS )
-                    {
-                        unsigned long supermfn;
-
-
-                        supermfn=superpage_start;
-                        if ( xc_domain_populate_physmap_exact(xch, dom, 1,
-                                         SUPERPAGE_PFN_SHIFT, 0, &supermfn) != 0 )
-                        {
-                            logprintf("No 2M page available for pfn 0x%lx, fall back to 4K page.\n",
-                                    superpage_start);
-                            /* If we're falling back from a failed allocation, subtract one
-                             * from count, since the last page == pfn, which will behandled
-                             * anyway. */
-                            scount--;
-                            goto fallback;
-                        }
-
-                        logprintf("Mapping superpage (%d) pfn %lx, mfn %lx\n", scount, superpage_start, supermfn);
-                        for (k=0; k<scount; k++)
-                        {
-                            /* We just allocated a new mfn above; update p2m */
-                            ctx->p2m[superpage_start+k] = supermfn+k;
-                            ctx->nr_pfns++;
-                            /* region_map[] will be set below */
-                        }
-                        superpage_start=INVALID_P2M_ENTRY;
-                        scount=0;
-                    }
-                    continue;
-                }
-                
-            fallback:
-                logprintf("Falling back %d pages pfn %lx\n", scount, superpage_start);
-                for (k=0; k<scount; k++)
-                {
-                    ctx->p2m_batch[nr_mfns++] = superpage_start+k; 
-                    ctx->p2m[superpage_start+k]--;
-                }
-                superpage_start = INVALID_P2M_ENTRY;
-                scount=0;
-            }
-
-            /* Are we ready to start a new superpage candidate? */
-            if ( ctx->hvm && ctx->superpages && SUPER_PAGE_START(pfn) )
-            {
-                superpage_start=pfn;
-                scount++;
-            }
-            else
-            {
-                /* Add the current pfn to pfn_batch */
-                ctx->p2m_batch[nr_mfns++] = pfn;
-                ctx->p2m[pfn]--;
-            }
+            /* Add the current pfn to pfn_batch */
+            ctx->p2m_batch[nr_mfns++] = pfn;
+            ctx->p2m[pfn]--;
         }
     }
 
-    /* Clean up any partial superpage candidates */
-    if ( superpage_start != INVALID_P2M_ENTRY )
-    {
-        logprintf("Falling back %d pages pfn %lx\n", scount, superpage_start);
-        for (k=0; k<scount; k++)
-        {
-            ctx->p2m_batch[nr_mfns++] = superpage_start+k; 
-            ctx->p2m[superpage_start+k]--;
-        }
-        superpage_start = INVALID_P2M_ENTRY;
-    }
+    if ( free_hvm_pending(xch, dom, ctx, nr_frees) )
+        return -1;
 
     /* Now allocate a bunch of mfns for this batch */
     if ( nr_mfns )
     {
-        logprintf("Mapping order 0,  %d; first pfn %lx\n", nr_mfns, ctx->p2m_batch[0]);
+        DPRINTF("Mapping order 0,  %d; first pfn %lx\n", nr_mfns, ctx->p2m_batch[0]);
     
         if (!ctx->hvm && ctx->superpages)
             rc = alloc_superpage_mfns(xch, dom, ctx, nr_mfns);
@@ -1272,22 +1929,70 @@ static int apply_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
             region_mfn[i] = ctx->hvm ? pfn : ctx->p2m[pfn];
     }
 
-    /* Map relevant mfns */
-    pfn_err = calloc(j, sizeof(*pfn_err));
-    if ( pfn_err == NULL )
-    {
-        PERROR("allocation for pfn_err failed");
+    return 0;
+}
+
+/*
+ * Apply the pages from curbatch on. When batches are applied by several
+ * threads at once (see restore_pipe), lock serializes their changes to
+ * the p2m and to mmu; it is NULL otherwise.
+ */
+static int apply_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
+                       xen_pfn_t* region_mfn, unsigned long* pfn_type, int pae_extended_cr3,
+                       struct xc_mmu* mmu,
+                       pagebuf_t* pagebuf, int curbatch, pthread_mutex_t *lock)
+{
+    int i, j, curpage;
+    unsigned int r, is_ref;
+    /* used by debug verify code */
+    unsigned long buf[PAGE_SIZE/sizeof(unsigned long)];
+    /* Our mappings of the pages of the current region (batch) */
+    char **region_pages = NULL;
+    /* A temporary mapping, and a copy, of one frame of guest memory. */
+    unsigned long *page = NULL;
+    int nraces = 0;
+    struct domain_info_context *dinfo = &ctx->dinfo;
+    int* pfn_err = NULL;
+    int rc = -1, ok;
+
+    unsigned long mfn, pfn, pagetype;
+
+    j = pagebuf->nr_pages - curbatch;
+    if (j > MAX_BATCH_SIZE)
+        j = MAX_BATCH_SIZE;
+
+    if ( lock )
+        pthread_mutex_lock(lock);
+    rc = alloc_batch(xch, dom, ctx, region_mfn, pagebuf, curbatch);
+    if ( lock )
+        pthread_mutex_unlock(lock);
+    if ( rc )
         return -1;
-    }
-    region_base = xc_map_foreign_bulk(
-        xch, dom, PROT_WRITE, region_mfn, pfn_err, j);
+    rc = -1;
 
-    if ( region_base == NULL )
+    /* Map relevant mfns, through the cache */
+    pfn_err = calloc(MAX_BATCH_SIZE, sizeof(*pfn_err));
+    region_pages = calloc(MAX_BATCH_SIZE, sizeof(*region_pages));
+    if ( pfn_err == NULL || region_pages == NULL )
     {
-        PERROR("map batch failed");
+        PERROR("allocation for pfn_err failed");
         free(pfn_err);
+        free(region_pages);
         return -1;
     }
+    for ( i = 0; i < j; i++ )
+    {
+        if ( region_mfn[i] == ~0UL )
+            continue;
+        pfn = pagebuf->pfn_types[i + curbatch] & ~XEN_DOMCTL_PFINFO_LTAB_MASK;
+        region_pages[i] = xc_map_foreign_cached(ctx->map_cache, pfn);
+        if ( region_pages[i] == NULL )
+            pfn_err[i] = -errno;
+    }
+
+    /* First page reference for this batch */
+    for ( r = 0; r < pagebuf->nr_refs && pagebuf->refs[r].index < curbatch; r++ )
+        continue;
 
     for ( i = 0, curpage = -1; i < j; i++ )
     {
@@ -1317,7 +2022,10 @@ static int apply_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
             goto err_mapped;
         }
 
-        ++curpage;
+        is_ref = (r < pagebuf->nr_refs) &&
+                 (pagebuf->refs[r].index == i + curbatch);
+        if ( !is_ref )
+            ++curpage;
 
         if ( pfn > dinfo->p2m_size )
         {
@@ -1330,12 +2038,16 @@ static int apply_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
         mfn = ctx->p2m[pfn];
 
         /* In verify mode, we use a copy; otherwise we work in place */
-        page = pagebuf->verify ? (void *)buf : (region_base + i*PAGE_SIZE);
+        page = pagebuf->verify ? (void *)buf : (void *)region_pages[i];
 
+        if ( is_ref )
+        {
+            if ( apply_page_ref(xch, dom, ctx, &pagebuf->refs[r++], page) )
+                goto err_mapped;
+        }
         /* Remus - page decompression */
-        if (pagebuf->compressing)
+        else if (pagebuf->compressing)
         {
-            logprintf("Uncompressing page (pfn=%lx)\n", pfn);
             if (xc_compression_uncompress_page(xch, pagebuf->pages,
                                                pagebuf->compbuf_size,
                                                &pagebuf->compbuf_pos,
@@ -1367,13 +2079,18 @@ static int apply_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
                 pae_extended_cr3 ||
                 (pagetype != XEN_DOMCTL_PFINFO_L1TAB)) {
 
-                if (!uncanonicalize_pagetable(xch, dom, ctx, page)) {
+                if ( lock )
+                    pthread_mutex_lock(lock);
+                ok = uncanonicalize_pagetable(xch, dom, ctx, page);
+                if ( lock )
+                    pthread_mutex_unlock(lock);
+                if (!ok) {
                     /*
                     ** Failing to uncanonicalize a page table can be ok
                     ** under live migration since the pages type may have
                     ** changed by now (and we'll get an update later).
                     */
-                    logprintf("PT L%ld race on pfn=%08lx mfn=%08lx\n",
+                    DPRINTF("PT L%ld race on pfn=%08lx mfn=%08lx\n",
                             pagetype >> 28, pfn, mfn);
                     nraces++;
                     continue;
@@ -1389,45 +2106,378 @@ static int apply_batch(xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
 
         if ( pagebuf->verify )
         {
-            int res = memcmp(buf, (region_base + i*PAGE_SIZE), PAGE_SIZE);
+            int res = memcmp(buf, region_pages[i], PAGE_SIZE);
             if ( res )
             {
                 int v;
 
-                logprintf("************** pfn=%lx type=%lx gotcs=%08lx "
+                DPRINTF("************** pfn=%lx type=%lx gotcs=%08lx "
                         "actualcs=%08lx\n", pfn, pagebuf->pfn_types[pfn],
-                        csum_page(region_base + (i + curbatch)*PAGE_SIZE),
+                        csum_page(region_pages[i]),
                         csum_page(buf));
 
                 for ( v = 0; v < 4; v++ )
                 {
-                    unsigned long *p = (unsigned long *)
-                        (region_base + i*PAGE_SIZE);
+                    unsigned long *p = (unsigned long *)region_pages[i];
                     if ( buf[v] != p[v] )
                         DPRINTF("    %d: %08lx %08lx\n", v, buf[v], p[v]);
                 }
             }
         }
 
-        if ( !ctx->hvm &&
-             xc_add_mmu_update(xch, mmu,
-                               (((unsigned long long)mfn) << PAGE_SHIFT)
-                               | MMU_MACHPHYS_UPDATE, pfn) )
+        if ( !ctx->hvm )
         {
-            PERROR("failed machpys update mfn=%lx pfn=%lx", mfn, pfn);
-            goto err_mapped;
+            if ( lock )
+                pthread_mutex_lock(lock);
+            ok = !xc_add_mmu_update(xch, mmu,
+                                    (((unsigned long long)mfn) << PAGE_SHIFT)
+                                    | MMU_MACHPHYS_UPDATE, pfn);
+            if ( lock )
+                pthread_mutex_unlock(lock);
+            if ( !ok )
+            {
+                PERROR("failed machpys update mfn=%lx pfn=%lx", mfn, pfn);
+                goto err_mapped;
+            }
         }
     } /* end of 'batch' for loop */
 
     rc = nraces;
 
   err_mapped:
-    munmap(region_base, j*PAGE_SIZE);
+    for ( i = 0; i < j; i++ )
+        if ( region_pages[i] )
+            xc_unmap_foreign_cached(
+                ctx->map_cache,
+                pagebuf->pfn_types[i + curbatch] & ~XEN_DOMCTL_PFINFO_LTAB_MASK,
+                region_pages[i]);
+    free(region_pages);
     free(pfn_err);
 
     return rc;
 }
 
+/*
+ * Parallel restore of the page batches.
+ *
+ * The receive thread only reads: once a batch (pfn types, page
+ * references and page data or a compressed chunk) is in, it swaps the
+ * batch buffers into a free slot of a ring and goes back to the socket.
+ * Worker threads take slots in stream order, decode the chunk and then
+ * apply the batch to the guest. Batches start applying in the order they
+ * were received, and a batch waits for those still being applied only if
+ * it shares a pfn with them: it rewrites the pfn, or its page decodes
+ * against the pfn's current contents or copies it (XC_SAVE_ID_PAGE_REFS).
+ * Batches with disjoint pfns are applied concurrently; apply_batch()
+ * serializes their allocations and mmu updates. The ring is drained
+ * before anything else looks at guest memory.
+ */
+#define DEF_RESTORE_THREADS 4
+#define RESTORE_PIPE_SLOTS  (DEF_RESTORE_THREADS + 2)
+
+struct restore_pipe {
+    xc_interface *xch;
+    uint32_t dom;
+    struct restore_ctx *ctx;
+    unsigned long *pfn_type;
+    int pae_extended_cr3;
+    struct xc_mmu *mmu;
+
+    pthread_t threads[DEF_RESTORE_THREADS];
+    int nr_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_mutex_t apply_lock; /* see apply_batch() */
+
+    /* region_mfn[] of each worker, MAX_BATCH_SIZE entries apiece */
+    xen_pfn_t *region_mfns;
+    int nr_workers;
+
+    /*
+     * Slot seq % RESTORE_PIPE_SLOTS holds batch seq. Batches in
+     * [applied, filled) are queued, those below taken have a worker and
+     * those below started are being applied, or done if done[] is set.
+     */
+    pagebuf_t slots[RESTORE_PIPE_SLOTS];
+    int done[RESTORE_PIPE_SLOTS];
+    unsigned long filled, taken, started, applied;
+
+    /* pfns of the batches being applied */
+    unsigned long *busy;
+
+    int nraces;
+    uint64_t decode_us, apply_us;
+    int err, exit;
+};
+
+/* Move the batch in buf to slot, and the slot's buffers to buf. */
+static void pagebuf_swap_batch(pagebuf_t *buf, pagebuf_t *slot)
+{
+    pagebuf_t tmp = *slot;
+
+    slot->pages = buf->pages;
+    slot->pfn_types = buf->pfn_types;
+    slot->refs = buf->refs;
+    slot->wire = buf->wire;
+    slot->nr_physpages = buf->nr_physpages;
+    slot->nr_pages = buf->nr_pages;
+    slot->nr_refs = buf->nr_refs;
+    slot->compbuf_pos = buf->compbuf_pos;
+    slot->compbuf_size = buf->compbuf_size;
+    slot->wire_len = buf->wire_len;
+    slot->wire_off = buf->wire_off;
+    slot->wire_raw_len = buf->wire_raw_len;
+    slot->compressing = buf->compressing;
+    slot->verify = buf->verify;
+
+    buf->pages = tmp.pages;
+    buf->pfn_types = tmp.pfn_types;
+    buf->refs = tmp.refs;
+    buf->wire = tmp.wire;
+    buf->nr_physpages = buf->nr_pages = buf->nr_refs = 0;
+    buf->compbuf_pos = buf->compbuf_size = 0;
+    buf->wire_len = 0;
+}
+
+/*
+ * The i-th pfn buf touches: the pfns it writes, then the sources of its
+ * page references. XC_PAGE_REF_ZERO is past the end of the p2m.
+ */
+static unsigned long batch_pfn(const pagebuf_t *buf, unsigned int i)
+{
+    if ( i < buf->nr_pages )
+        return buf->pfn_types[i] & ~XEN_DOMCTL_PFINFO_LTAB_MASK;
+    return buf->refs[i - buf->nr_pages].src;
+}
+
+/* Does buf touch a pfn of a batch being applied? Called with p->lock. */
+static int batch_busy(struct restore_pipe *p, const pagebuf_t *buf)
+{
+    unsigned long pfn, p2m_size = p->ctx->dinfo.p2m_size;
+    unsigned int i;
+
+    for ( i = 0; i < buf->nr_pages + buf->nr_refs; i++ )
+    {
+        pfn = batch_pfn(buf, i);
+        if ( pfn < p2m_size && test_bit(pfn, p->busy) )
+            return 1;
+    }
+    return 0;
+}
+
+/* Mark the pfns buf touches as busy, or no longer. Called with p->lock. */
+static void batch_set_busy(struct restore_pipe *p, const pagebuf_t *buf,
+                           int busy)
+{
+    unsigned long pfn, p2m_size = p->ctx->dinfo.p2m_size;
+    unsigned int i;
+
+    for ( i = 0; i < buf->nr_pages + buf->nr_refs; i++ )
+    {
+        pfn = batch_pfn(buf, i);
+        if ( pfn >= p2m_size )
+            continue;
+        if ( busy )
+            set_bit(pfn, p->busy);
+        else
+            clear_bit(pfn, p->busy);
+    }
+}
+
+static void *restore_pipe_worker(void *arg)
+{
+    struct restore_pipe *p = arg;
+    xc_interface *xch = p->xch;
+    pagebuf_t *buf;
+    xen_pfn_t *region_mfn;
+    unsigned long seq;
+    int rc, brc, skip, curbatch, nraces;
+    uint64_t start, decode_us, apply_us;
+
+    pthread_mutex_lock(&p->lock);
+    region_mfn = p->region_mfns + p->nr_workers++ * MAX_BATCH_SIZE;
+    for ( ; ; )
+    {
+        while ( p->taken == p->filled && !p->exit )
+            pthread_cond_wait(&p->cond, &p->lock);
+        if ( p->taken == p->filled )
+            break;
+
+        seq = p->taken++;
+        buf = &p->slots[seq % RESTORE_PIPE_SLOTS];
+        skip = p->err;
+        pthread_mutex_unlock(&p->lock);
+
+        rc = 0;
+        start = llgettimeofday();
+        if ( !skip && buf->wire_len )
+            rc = xc_compression_decode_chunk(xch, p->ctx->codec, buf->wire,
+                                             buf->wire_len,
+                                             buf->pages + buf->wire_off,
+                                             buf->wire_raw_len);
+        buf->wire_len = 0;
+        decode_us = llgettimeofday() - start;
+
+        pthread_mutex_lock(&p->lock);
+        while ( p->started != seq || (!p->err && batch_busy(p, buf)) )
+            pthread_cond_wait(&p->cond, &p->lock);
+        skip = skip || rc || p->err;
+        if ( !skip )
+            batch_set_busy(p, buf, 1);
+        p->started++;
+        p->decode_us += decode_us;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+
+        nraces = 0;
+        start = llgettimeofday();
+        for ( curbatch = 0; !skip && curbatch < buf->nr_pages;
+              curbatch += MAX_BATCH_SIZE )
+        {
+            brc = apply_batch(xch, p->dom, p->ctx, region_mfn,
+                              p->pfn_type, p->pae_extended_cr3, p->mmu,
+                              buf, curbatch, &p->apply_lock);
+            if ( brc < 0 )
+            {
+                rc = -1;
+                break;
+            }
+            nraces += brc;
+        }
+        apply_us = llgettimeofday() - start;
+
+        pthread_mutex_lock(&p->lock);
+        if ( !skip )
+            batch_set_busy(p, buf, 0);
+        if ( rc )
+            p->err = 1;
+        p->nraces += nraces;
+        p->apply_us += apply_us;
+        /* Hand back the slots of the oldest batches once they are done */
+        p->done[seq % RESTORE_PIPE_SLOTS] = 1;
+        while ( p->applied != p->started &&
+                p->done[p->applied % RESTORE_PIPE_SLOTS] )
+        {
+            p->done[p->applied % RESTORE_PIPE_SLOTS] = 0;
+            p->applied++;
+        }
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+static void restore_pipe_destroy(struct restore_pipe *p)
+{
+    int i;
+
+    if ( !p )
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->exit = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    for ( i = 0; i < p->nr_threads; i++ )
+        pthread_join(p->threads[i], NULL);
+
+    for ( i = 0; i < RESTORE_PIPE_SLOTS; i++ )
+        pagebuf_free(&p->slots[i]);
+    free(p->region_mfns);
+    free(p->busy);
+    pthread_mutex_destroy(&p->apply_lock);
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
+
+static struct restore_pipe *restore_pipe_create(
+    xc_interface *xch, uint32_t dom, struct restore_ctx *ctx,
+    unsigned long *pfn_type, int pae_extended_cr3, struct xc_mmu *mmu,
+    int nr_threads)
+{
+    struct restore_pipe *p;
+    int i;
+
+    if ( !(p = calloc(1, sizeof(*p))) )
+        return NULL;
+
+    p->xch = xch;
+    p->dom = dom;
+    p->ctx = ctx;
+    p->pfn_type = pfn_type;
+    p->pae_extended_cr3 = pae_extended_cr3;
+    p->mmu = mmu;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    pthread_mutex_init(&p->apply_lock, NULL);
+    for ( i = 0; i < RESTORE_PIPE_SLOTS; i++ )
+        pagebuf_init(&p->slots[i]);
+
+    if ( nr_threads > DEF_RESTORE_THREADS )
+        nr_threads = DEF_RESTORE_THREADS;
+    p->region_mfns = malloc(nr_threads * MAX_BATCH_SIZE *
+                            sizeof(*p->region_mfns));
+    p->busy = bitmap_alloc(ctx->dinfo.p2m_size);
+    if ( !p->region_mfns || !p->busy )
+    {
+        restore_pipe_destroy(p);
+        return NULL;
+    }
+    for ( i = 0; i < nr_threads; i++ )
+    {
+        if ( pthread_create(&p->threads[i], NULL, restore_pipe_worker, p) )
+            break;
+        p->nr_threads++;
+    }
+    if ( !p->nr_threads )
+    {
+        restore_pipe_destroy(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+/* Queue the batch in buf, which is left empty. */
+static int restore_pipe_queue(struct restore_pipe *p, pagebuf_t *buf)
+{
+    pagebuf_t *slot;
+    int rc;
+
+    pthread_mutex_lock(&p->lock);
+    while ( p->filled - p->applied == RESTORE_PIPE_SLOTS )
+        pthread_cond_wait(&p->cond, &p->lock);
+    slot = &p->slots[p->filled % RESTORE_PIPE_SLOTS];
+    pthread_mutex_unlock(&p->lock);
+
+    /* The slot is ours until filled is bumped */
+    pagebuf_swap_batch(buf, slot);
+
+    pthread_mutex_lock(&p->lock);
+    p->filled++;
+    pthread_cond_broadcast(&p->cond);
+    rc = p->err ? -1 : 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return rc;
+}
+
+/* Wait until every queued batch has been applied. */
+static int restore_pipe_drain(struct restore_pipe *p)
+{
+    int rc;
+
+    pthread_mutex_lock(&p->lock);
+    while ( p->applied != p->filled )
+        pthread_cond_wait(&p->cond, &p->lock);
+    rc = p->err ? -1 : 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return rc;
+}
+
 int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                       unsigned int store_evtchn, unsigned long *store_mfn,
                       domid_t store_domid, unsigned int console_evtchn,
@@ -1435,7 +2485,8 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                       unsigned int hvm, unsigned int pae, int superpages,
                       int no_incr_generationid, int checkpointed_stream,
                       unsigned long *vm_generationid_addr,
-                      struct restore_callbacks *callbacks)
+                      struct restore_callbacks *callbacks,
+                      const int *data_fds, unsigned int nr_data_fds)
 {
     DECLARE_DOMCTL;
     int rc = 1, frc, i, j, n, m, pae_extended_cr3 = 0, ext_vcpucontext = 0;
@@ -1473,6 +2524,11 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
 
     struct xc_mmu *mmu = NULL;
 
+    /* Applies page batches off the receive thread, see restore_pipe */
+    struct restore_pipe *pipe = NULL;
+    long nr_cpus;
+    uint64_t start;
+
     struct mmuext_op pin[MAX_PIN_BATCH];
     unsigned int nr_pins;
 
@@ -1492,7 +2548,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
     struct restore_ctx *ctx = &_ctx;
     struct domain_info_context *dinfo = &ctx->dinfo;
 
-    logprintf("%s: starting restore of new domid %u\n", __func__, dom);
+    DPRINTF("%s: starting restore of new domid %u\n", __func__, dom);
 
     pagebuf_init(&pagebuf);
     memset(&tailbuf, 0, sizeof(tailbuf));
@@ -1504,6 +2560,9 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
     ctx->superpages = superpages;
     ctx->hvm = hvm;
     ctx->last_checkpoint = !checkpointed_stream;
+    ctx->data_fds = data_fds;
+    ctx->nr_data_fds = nr_data_fds;
+    ctx->postcopy = hvm && callbacks && callbacks->postcopy_pfns;
 
     ctxt = xc_hypercall_buffer_alloc(xch, ctxt, sizeof(*ctxt));
 
@@ -1524,7 +2583,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         PERROR("read: p2m_size");
         goto out;
     }
-    logprintf("%s: p2m_size = %lx\n", __func__, dinfo->p2m_size);
+    DPRINTF("%s: p2m_size = %lx\n", __func__, dinfo->p2m_size);
 
     if ( !get_platform_info(xch, dom,
                             &ctx->max_mfn, &ctx->hvirt_start, &ctx->pt_levels, &dinfo->guest_width) )
@@ -1579,6 +2638,17 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
             goto out;
         }
     }
+    if ( ctx->hvm && ctx->superpages )
+    {
+        ctx->spec_pending = bitmap_alloc(dinfo->p2m_size);
+        ctx->spec_frees = malloc(MAX_BATCH_SIZE * sizeof(xen_pfn_t));
+        if ( ctx->spec_pending == NULL || ctx->spec_frees == NULL )
+        {
+            ERROR("superpage bitmap alloc failed");
+            errno = ENOMEM;
+            goto out;
+        }
+    }
 
     if ( (ctx->p2m == NULL) || (pfn_type == NULL) ||
          (region_mfn == NULL) || (ctx->p2m_batch == NULL) )
@@ -1607,6 +2677,15 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
     for ( pfn = 0; pfn < dinfo->p2m_size; pfn++ )
         ctx->p2m[pfn] = INVALID_P2M_ENTRY;
 
+    ctx->map_cache = xc_map_cache_create(xch, dom, PROT_WRITE,
+                                         MAP_CACHE_PAGES, map_cache_frame,
+                                         ctx);
+    if ( ctx->map_cache == NULL )
+    {
+        PERROR("Could not create map cache");
+        goto out;
+    }
+
     mmu = xc_alloc_mmu_updates(xch, dom);
     if ( mmu == NULL )
     {
@@ -1614,6 +2693,12 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         goto out;
     }
 
+    nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( (nr_cpus > 1) &&
+         !(pipe = restore_pipe_create(xch, dom, ctx, pfn_type,
+                                      pae_extended_cr3, mmu, nr_cpus)) )
+        DPRINTF("Applying pages on the receive thread\n");
+
     xc_report_progress_start(xch, "Reloading memory pages", dinfo->p2m_size);
 
     /*
@@ -1622,7 +2707,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
      */
 
     n = m = 0;
-// loadpages:
+  loadpages:
     for ( ; ; )
     {
         int j, curbatch;
@@ -1632,7 +2717,11 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         if ( !ctx->completed ) {
             pagebuf.nr_physpages = pagebuf.nr_pages = 0;
             pagebuf.compbuf_pos = pagebuf.compbuf_size = 0;
-            if ( pagebuf_get_one(xch, ctx, &pagebuf, io_fd, dom) < 0 ) {
+            pagebuf.nr_refs = 0;
+            pagebuf.defer_decode = !!pipe;
+            frc = pagebuf_get_one(xch, ctx, &pagebuf, io_fd, dom);
+            pagebuf.defer_decode = 0;
+            if ( frc < 0 ) {
                 PERROR("Error when reading batch");
                 goto out;
             }
@@ -1640,8 +2729,45 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         j = pagebuf.nr_pages;
 
         DBGPRINTF("batch %d\n",j);
-        logprintf("batch %d\n",j);
         if ( j == 0 ) {
+            /* Everything below and after the loop needs the pages in */
+            if ( pipe )
+            {
+                frc = restore_pipe_drain(pipe);
+                nraces += pipe->nraces;
+                ctx->stats.decode_us += pipe->decode_us;
+                ctx->stats.apply_us += pipe->apply_us;
+                restore_pipe_destroy(pipe);
+                pipe = NULL;
+                if ( frc )
+                {
+                    ERROR("Error when applying batches");
+                    goto out;
+                }
+            }
+#ifndef __MINIOS__
+            if ( ctx->stripes )
+            {
+                frc = restore_stripes_finish(ctx->stripes);
+                restore_stripes_destroy(ctx->stripes);
+                ctx->stripes = NULL;
+                if ( frc )
+                {
+                    ERROR("Error when reading the data fds");
+                    goto out;
+                }
+            }
+#endif
+
+            DPRINTF("Loaded %lu pages in %lu batches, %"PRIu64" bytes received, "
+                    "%"PRIu64" decoded; read %"PRIu64"us, decode %"PRIu64"us, "
+                    "apply %"PRIu64"us\n", ctx->stats.pages, ctx->stats.batches,
+                    ctx->stats.wire_bytes, ctx->stats.raw_bytes,
+                    ctx->stats.read_us, ctx->stats.decode_us,
+                    ctx->stats.apply_us);
+            if ( callbacks && callbacks->telemetry )
+                callbacks->telemetry(&ctx->stats, callbacks->data);
+
             /* catch vcpu updates */
             if (pagebuf.new_ctxt_format) {
                 max_vcpu_id = pagebuf.max_vcpu_id;
@@ -1702,13 +2828,28 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
             break;  /* our work here is done */
         }
 
+        ctx->stats.batches++;
+        ctx->stats.pages += j;
+        start = llgettimeofday();
+        if ( pipe )
+        {
+            if ( restore_pipe_queue(pipe, &pagebuf) )
+            {
+                ERROR("Error when applying batches");
+                goto out;
+            }
+            curbatch = j;
+        }
+        else
+            curbatch = 0;
+
         /* break pagebuf into batches */
-        curbatch = 0;
         while ( curbatch < j ) {
             int brc;
 
             brc = apply_batch(xch, dom, ctx, region_mfn, pfn_type,
-                              pae_extended_cr3, mmu, &pagebuf, curbatch);
+                              pae_extended_cr3, mmu, &pagebuf, curbatch,
+                              NULL);
             if ( brc < 0 )
                 goto out;
 
@@ -1716,14 +2857,17 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
 
             curbatch += MAX_BATCH_SIZE;
         }
+        if ( !pipe )
+            ctx->stats.apply_us += llgettimeofday() - start;
         /*
         if (ctx->compressing){
             pagebuf.compressing = 1;
-            logprintf("Pagebuffer compression enabled: Batch: %d\n");
+            DPRINTF("Pagebuffer compression enabled: Batch: %d\n");
         }
         */
         pagebuf.nr_physpages = pagebuf.nr_pages = 0;
         pagebuf.compbuf_pos = pagebuf.compbuf_size = 0;
+        pagebuf.nr_refs = 0;
 
         n += j; /* crude stats */
 
@@ -1749,7 +2893,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         goto out;
     }
 
-    logprintf("Received all pages (%d races)\n", nraces);
+    DPRINTF("Received all pages (%d races)\n", nraces);
 
     if ( !ctx->completed ) {
 
@@ -1799,11 +2943,11 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
 
     if ( ctx->last_checkpoint )
     {
-        logprintf("Last checkpoint, finishing\n");
+        DPRINTF("Last checkpoint, finishing\n");
         goto finish;
     }
 
-    logprintf("Buffered checkpoint\n");
+    DPRINTF("Buffered checkpoint\n");
 
     if ( pagebuf_get(xch, ctx, &pagebuf, io_fd, dom) ) {
         PERROR("error when buffering batch, finishing");
@@ -1819,9 +2963,21 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
     tailbuf_free(&tailbuf);
     memcpy(&tailbuf, &tmptail, sizeof(tailbuf));
 
-    //goto loadpages;
+    goto loadpages;
 
   finish:
+    /* Page tables can't be pinned, nor pages freed, while we map them */
+    if ( ctx->map_cache )
+    {
+        xc_map_cache_stats_t map_stats;
+
+        xc_map_cache_stats(ctx->map_cache, &map_stats);
+        DPRINTF("Map cache: %"PRIu64" hits, %"PRIu64" misses\n",
+                map_stats.hits, map_stats.misses);
+        xc_map_cache_destroy(ctx->map_cache);
+        ctx->map_cache = NULL;
+    }
+
     if ( hvm )
         goto finish_hvm;
 
@@ -1998,7 +3154,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         goto out;
     }
 
-    logprintf("Memory reloaded (%ld pages)\n", ctx->nr_pfns);
+    DPRINTF("Memory reloaded (%ld pages)\n", ctx->nr_pfns);
 
     /* Get the list of PFNs that are not in the psuedo-phys map */
     {
@@ -2025,7 +3181,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                 goto out;
             }
             else
-               logprintf("Decreased reservation by %d pages\n", tailbuf.u.pv.pfncount);
+               DPRINTF("Decreased reservation by %d pages\n", tailbuf.u.pv.pfncount);
         }
     }
 
@@ -2039,7 +3195,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                               : sizeof(ctxt->x32)));
         vcpup += (dinfo->guest_width == 8) ? sizeof(ctxt->x64) : sizeof(ctxt->x32);
 
-        logprintf("read VCPU %d\n", i);
+        DPRINTF("read VCPU %d\n", i);
 
         if ( !new_ctxt_format )
             SET_FIELD(ctxt, flags, GET_FIELD(ctxt, flags) | VGCF_online);
@@ -2215,7 +3371,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
 
     memcpy(shared_info_page, tailbuf.u.pv.shared_info_page, PAGE_SIZE);
 
-    logprintf("Completed checkpoint load\n");
+    DPRINTF("Completed checkpoint load\n");
 
     /* Restore contents of shared-info page. No checking needed. */
     new_shared_info = xc_map_foreign_range(
@@ -2281,11 +3437,14 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         goto out;
     }
 
-    logprintf("Domain ready to be built.\n");
+    DPRINTF("Domain ready to be built.\n");
     rc = 0;
     goto out;
 
   finish_hvm:
+    if ( finish_hvm_pending(xch, dom, ctx) < 0 )
+        goto out;
+
     if ( tdata.data != NULL )
     {
         if ( callbacks != NULL && callbacks->toolstack_restore != NULL )
@@ -2367,10 +3526,28 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         goto out;
     }
 
+    /* The caller pages these in before the domain runs */
+    if ( ctx->nr_postcopy )
+    {
+        DPRINTF("%lu pages follow in the post-copy phase\n", ctx->nr_postcopy);
+        frc = callbacks->postcopy_pfns(ctx->postcopy_pfns, ctx->nr_postcopy,
+                                       callbacks->data);
+        ctx->postcopy_pfns = NULL;
+        if ( frc < 0 )
+        {
+            ERROR("error handing over post-copy pfns");
+            goto out;
+        }
+    }
+
     /* HVM success! */
     rc = 0;
 
  out:
+    restore_pipe_destroy(pipe);
+#ifndef __MINIOS__
+    restore_stripes_destroy(ctx->stripes);
+#endif
     if ( (rc != 0) && (dom != 0) )
         xc_domain_destroy(xch, dom);
     xc_hypercall_buffer_free(xch, ctxt);
@@ -2379,6 +3556,11 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
     free(pfn_type);
     free(region_mfn);
     free(ctx->p2m_batch);
+    free(ctx->postcopy_pfns);
+    free(ctx->postcopy_buf);
+    free(ctx->spec_pending);
+    free(ctx->spec_frees);
+    xc_map_cache_destroy(ctx->map_cache);
     pagebuf_free(&pagebuf);
     tailbuf_free(&tailbuf);
 
@@ -2387,7 +3569,7 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
 
     fcntl(io_fd, F_SETFL, orig_io_fd_flags);
 
-    logprintf("Restore exit of domid %u with rc=%d\n", dom, rc);
+    DPRINTF("Restore exit of domid %u with rc=%d\n", dom, rc);
 
     return rc;
 }
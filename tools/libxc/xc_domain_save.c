@@ -25,12 +25,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "xc_private.h"
 #include "xc_bitops.h"
 #include "xc_dom.h"
 #include "xg_private.h"
 #include "xg_save_restore.h"
+#include "xc_save_policy.h"
 
 #include <xen/hvm/params.h>
 
@@ -43,6 +45,8 @@
 */
 #define DEF_MAX_ITERS   29   /* limit us to 30 times round loop   */
 #define DEF_MAX_FACTOR   3   /* never send more than 3x p2m_size  */
+#define DEF_COMPRESS_THREADS 4 /* compression workers, capped by #cpus */
+#define DEF_STREAM_CODEC XC_COMPRESSION_CODEC_ZLIB /* XCFLAGS_STREAM_CODEC */
 
 struct save_ctx {
     unsigned long hvirt_start; /* virtual starting address of the hypervisor */
@@ -54,12 +58,16 @@ struct save_ctx {
     struct domain_info_context dinfo;
 };
 
+struct save_pipe;
+
 /* buffer for output */
 struct outbuf {
     void* buf;
     size_t size;
     size_t pos;
     int write_count;
+    struct save_pipe *pipe;     /* flushes hand the buffer to the writer */
+    struct xc_save_stats *stats;    /* write and compression accounting */
 };
 
 #define OUTBUF_SIZE (16384 * 1024)
@@ -106,25 +114,6 @@ static uint64_t tv_delta(struct timeval *new, struct timeval *old)
             (new->tv_usec - old->tv_usec));
 }
 
-static int noncached_write(xc_interface *xch,
-                           struct outbuf* ob,
-                           int fd, void *buffer, int len) 
-{
-    int rc = (write_exact(fd, buffer, len) == 0) ? len : -1;
-
-    ob->write_count += len;
-    if ( ob->write_count >= (MAX_PAGECACHE_USAGE * PAGE_SIZE) )
-    {
-        /* Time to discard cache - dont care if this fails */
-        int saved_errno = errno;
-        discard_file_cache(xch, fd, 0 /* no flush */);
-        errno = saved_errno;
-        ob->write_count = 0;
-    }
-
-    return rc;
-}
-
 static int outbuf_init(xc_interface *xch, struct outbuf* ob, size_t size)
 {
     memset(ob, 0, sizeof(*ob));
@@ -160,15 +149,22 @@ static inline int outbuf_write(xc_interface *xch,
     return 0;
 }
 
+static int pipe_flush(struct save_pipe *p);
+
 /* prep for nonblocking I/O */
 static int outbuf_flush(xc_interface *xch, struct outbuf* ob, int fd)
 {
     int rc;
     int cur = 0;
+    uint64_t start;
 
     if ( !ob->pos )
         return 0;
 
+    if ( ob->pipe )
+        return pipe_flush(ob->pipe);
+
+    start = llgettimeofday();
     rc = write(fd, ob->buf, ob->pos);
     while (rc < 0 || cur + rc < ob->pos) {
         if (rc < 0 && errno != EAGAIN && errno != EINTR) {
@@ -181,6 +177,15 @@ static int outbuf_flush(xc_interface *xch, struct outbuf* ob, int fd)
         rc = write(fd, ob->buf + cur, ob->pos - cur);
     }
 
+    ob->stats->write_us += llgettimeofday() - start;
+
+    ob->write_count += ob->pos;
+    if ( ob->write_count >= (MAX_PAGECACHE_USAGE * PAGE_SIZE) )
+    {
+        /* Time to discard cache - dont care if this fails */
+        discard_file_cache(xch, fd, 0 /* no flush */);
+        ob->write_count = 0;
+    }
     ob->pos = 0;
 
     return 0;
@@ -208,35 +213,50 @@ static inline int write_buffer(xc_interface *xch,
                                int dobuf, struct outbuf* ob, int fd, void* buf,
                                size_t len)
 {
+    uint64_t start;
+    int rc;
+
     if ( dobuf )
         return outbuf_hardwrite(xch, ob, fd, buf, len);
-    else
-        return write_exact(fd, buf, len);
-}
 
-/* like write_buffer for noncached, which returns number of bytes written */
-static inline int write_uncached(xc_interface *xch,
-                                   int dobuf, struct outbuf* ob, int fd,
-                                   void* buf, size_t len)
-{
-    if ( dobuf )
-        return outbuf_hardwrite(xch, ob, fd, buf, len) ? -1 : len;
-    else
-        return noncached_write(xch, ob, fd, buf, len);
+    start = llgettimeofday();
+    rc = write_exact(fd, buf, len);
+    ob->stats->write_us += llgettimeofday() - start;
+
+    return rc;
 }
 
+/*
+ * Room for the compressed data of a full batch: no page encodes to more
+ * than PAGE_SIZE + 10 bytes (see xc_domain_compress.c).
+ */
+#define BATCH_CHUNK_MAX (MAX_BATCH_SIZE * (PAGE_SIZE + 16))
+
+/*
+ * With a second stage codec the delta stream is compressed into
+ * codec_buf first and then coded into the output buffer. Coding never
+ * grows a chunk (see xc_compression_encode_chunk), so the space check
+ * is the same either way. The receiver takes the compressed data of a
+ * batch as a single chunk, so the check leaves room for a whole batch.
+ */
 static int write_compressed(xc_interface *xch, comp_ctx *compress_ctx,
+                            int codec, char *codec_buf,
                             int dobuf, struct outbuf* ob, int fd)
 {
     int rc = 0;
     int header = sizeof(int) + sizeof(unsigned long);
     int marker = XC_SAVE_ID_COMPRESSED_DATA;
-    unsigned long compbuf_len = 0;
+    unsigned long compbuf_len = 0, wire_len;
+    char *dest;
+    uint64_t start;
+
+    if (codec != XC_COMPRESSION_CODEC_NONE)
+        header += sizeof(unsigned long);
 
     do
     {
-        /* check for available space (atleast 8k) */
-        if ((ob->pos + header + XC_PAGE_SIZE * 2) > ob->size)
+        /* check for available space */
+        if ((ob->pos + header + BATCH_CHUNK_MAX) > ob->size)
         {
             if (outbuf_flush(xch, ob, fd) < 0)
             {
@@ -245,12 +265,29 @@ static int write_compressed(xc_interface *xch, comp_ctx *compress_ctx,
             }
         }
 
+        dest = ob->buf + ob->pos + header;
+        start = llgettimeofday();
         rc = xc_compression_compress_pages(xch, compress_ctx,
-                                           ob->buf + ob->pos + header,
+                                           (codec != XC_COMPRESSION_CODEC_NONE) ?
+                                           codec_buf : dest,
                                            ob->size - ob->pos - header,
                                            &compbuf_len);
         if (!rc)
+        {
+            ob->stats->compress_us += llgettimeofday() - start;
             return 0;
+        }
+
+        wire_len = compbuf_len;
+        if (codec != XC_COMPRESSION_CODEC_NONE &&
+            xc_compression_encode_chunk(xch, codec, codec_buf, compbuf_len,
+                                        dest, &wire_len) < 0)
+        {
+            ERROR("Error when coding compressed chunk");
+            return -1;
+        }
+        ob->stats->compress_us += llgettimeofday() - start;
+        ob->stats->compressed_bytes += header + wire_len;
 
         if (outbuf_hardwrite(xch, ob, fd, &marker, sizeof(marker)) < 0)
         {
@@ -258,13 +295,21 @@ static int write_compressed(xc_interface *xch, comp_ctx *compress_ctx,
             return -1;
         }
 
-        if (outbuf_hardwrite(xch, ob, fd, &compbuf_len, sizeof(compbuf_len)) < 0)
+        if (outbuf_hardwrite(xch, ob, fd, &wire_len, sizeof(wire_len)) < 0)
         {
             PERROR("Error when writing compbuf_len (errno %d)", errno);
             return -1;
         }
 
-        ob->pos += (size_t) compbuf_len;
+        if (codec != XC_COMPRESSION_CODEC_NONE &&
+            outbuf_hardwrite(xch, ob, fd, &compbuf_len,
+                             sizeof(compbuf_len)) < 0)
+        {
+            PERROR("Error when writing decoded length (errno %d)", errno);
+            return -1;
+        }
+
+        ob->pos += (size_t) wire_len;
         if (!dobuf && outbuf_flush(xch, ob, fd) < 0)
         {
             ERROR("Error when writing compressed chunk");
@@ -275,11 +320,895 @@ static int write_compressed(xc_interface *xch, comp_ctx *compress_ctx,
     return 0;
 }
 
+/*
+ * Striped output, see "Striped batches" in xg_save_restore.h.
+ *
+ * A page batch is built in a frame instead of the primary stream. Filled
+ * frames are queued in sequence order, and one writer thread per data fd
+ * takes the oldest, so a slower connection simply carries fewer of them.
+ * The frame pool bounds the data in flight. The receiver only takes a
+ * frame once it has read its marker, so whoever waits for a free frame
+ * flushes the primary stream first.
+ */
+#define STRIPE_FRAMES_PER_FD 2
+
+/* Frame header, batch header and the compressed data of a full batch */
+#define STRIPE_FRAME_SIZE                                               \
+    (2 * sizeof(uint32_t) + 3 * sizeof(int) + sizeof(uint32_t) +       \
+     MAX_BATCH_SIZE * (sizeof(struct xc_page_ref) + sizeof(unsigned long)) + \
+     2 * sizeof(unsigned long) + BATCH_CHUNK_MAX)
+
+struct stripe_frame {
+    struct outbuf ob;           /* starts with the frame header */
+    struct stripe_frame *next;
+};
+
+struct save_stripes;
+
+struct stripe_writer {
+    struct save_stripes *s;
+    int fd;
+    pthread_t thread;
+};
+
+struct save_stripes {
+    xc_interface *xch;
+    struct stripe_writer *writers;
+    unsigned int nr, nr_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    struct stripe_frame *frames;
+    unsigned int nr_frames;
+    struct stripe_frame *free;
+    struct stripe_frame *head, *tail;   /* queued, oldest first */
+    unsigned int busy;                  /* being written */
+    uint32_t seq;
+
+    uint64_t write_us;
+    int err, closing;
+};
+
+static void *stripe_writer_main(void *arg)
+{
+    struct stripe_writer *w = arg;
+    struct save_stripes *s = w->s;
+    xc_interface *xch = s->xch;
+    struct stripe_frame *f;
+    uint32_t end[2] = { XC_STRIPE_END, 0 };
+    uint64_t start, write_us;
+    int rc, skip;
+
+    pthread_mutex_lock(&s->lock);
+    for ( ; ; )
+    {
+        while ( !s->head && !s->closing )
+            pthread_cond_wait(&s->cond, &s->lock);
+        if ( !(f = s->head) )
+            break;
+        if ( !(s->head = f->next) )
+            s->tail = NULL;
+        s->busy++;
+        skip = s->err;
+        pthread_mutex_unlock(&s->lock);
+
+        /* After an error frames are just recycled */
+        rc = 0;
+        write_us = 0;
+        if ( !skip )
+        {
+            start = llgettimeofday();
+            rc = write_exact(w->fd, f->ob.buf, f->ob.pos);
+            write_us = llgettimeofday() - start;
+            if ( rc )
+                PERROR("Error when writing to data fd %d", w->fd);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        if ( rc )
+            s->err = 1;
+        s->write_us += write_us;
+        f->next = s->free;
+        s->free = f;
+        s->busy--;
+        pthread_cond_broadcast(&s->cond);
+    }
+    skip = s->err;
+    pthread_mutex_unlock(&s->lock);
+
+    /* Nothing more will be queued: close the stripe */
+    if ( !skip && write_exact(w->fd, end, sizeof(end)) )
+    {
+        PERROR("Error when closing data fd %d", w->fd);
+        pthread_mutex_lock(&s->lock);
+        s->err = 1;
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    return NULL;
+}
+
+static void stripes_destroy(struct save_stripes *s)
+{
+    unsigned int i;
+
+    if ( !s )
+        return;
+
+    /* Queued frames are dropped and the data fds left unterminated */
+    pthread_mutex_lock(&s->lock);
+    s->err = 1;
+    s->closing = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    for ( i = 0; i < s->nr_threads; i++ )
+        pthread_join(s->writers[i].thread, NULL);
+
+    for ( i = 0; i < s->nr_frames; i++ )
+        outbuf_free(&s->frames[i].ob);
+    free(s->frames);
+    free(s->writers);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+static struct save_stripes *stripes_create(xc_interface *xch,
+                                           const int *fds, unsigned int nr,
+                                           unsigned int nr_frames,
+                                           struct xc_save_stats *stats)
+{
+    struct save_stripes *s;
+    unsigned int i;
+
+    if ( !(s = calloc(1, sizeof(*s))) )
+        return NULL;
+
+    s->xch = xch;
+    s->nr = nr;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    if ( !(s->writers = calloc(nr, sizeof(*s->writers))) ||
+         !(s->frames = calloc(nr_frames, sizeof(*s->frames))) )
+        goto err;
+    for ( ; s->nr_frames < nr_frames; s->nr_frames++ )
+    {
+        struct stripe_frame *f = &s->frames[s->nr_frames];
+
+        if ( outbuf_init(xch, &f->ob, STRIPE_FRAME_SIZE) )
+            goto err;
+        f->ob.stats = stats;
+        f->next = s->free;
+        s->free = f;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        s->writers[i].s = s;
+        s->writers[i].fd = fds[i];
+        if ( pthread_create(&s->writers[i].thread, NULL,
+                            stripe_writer_main, &s->writers[i]) )
+            goto err;
+        s->nr_threads++;
+    }
+
+    return s;
+
+ err:
+    stripes_destroy(s);
+    return NULL;
+}
+
+/*
+ * Take a free frame, first flushing ob to fd if we have to wait for one.
+ * NULL after an error.
+ */
+static struct stripe_frame *stripes_get_frame(struct save_stripes *s,
+                                              struct outbuf *ob, int fd)
+{
+    struct stripe_frame *f = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    if ( !s->free && ob )
+    {
+        pthread_mutex_unlock(&s->lock);
+        if ( outbuf_flush(s->xch, ob, fd) < 0 )
+            return NULL;
+        pthread_mutex_lock(&s->lock);
+    }
+    while ( !s->free && !s->err )
+        pthread_cond_wait(&s->cond, &s->lock);
+    if ( !s->err )
+    {
+        f = s->free;
+        s->free = f->next;
+        f->ob.pos = 2 * sizeof(uint32_t);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return f;
+}
+
+/* Give back a frame that was not sent. */
+static void stripes_put_frame(struct save_stripes *s, struct stripe_frame *f)
+{
+    pthread_mutex_lock(&s->lock);
+    f->next = s->free;
+    s->free = f;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Queue a filled frame and write its marker to the primary stream. */
+static int stripes_send(struct save_stripes *s, struct stripe_frame *f,
+                        int dobuf, struct outbuf *ob, int fd)
+{
+    struct {
+        int id;
+        uint32_t seq;
+    } marker = { XC_SAVE_ID_STRIPED_BATCH };
+    uint32_t hdr[2];
+    int rc;
+
+    pthread_mutex_lock(&s->lock);
+    marker.seq = hdr[0] = s->seq++;
+    hdr[1] = f->ob.pos - sizeof(hdr);
+    memcpy(f->ob.buf, hdr, sizeof(hdr));
+    f->next = NULL;
+    if ( s->tail )
+        s->tail->next = f;
+    else
+        s->head = f;
+    s->tail = f;
+    pthread_cond_broadcast(&s->cond);
+    rc = s->err ? -1 : 0;
+    pthread_mutex_unlock(&s->lock);
+
+    if ( rc )
+        return rc;
+
+    return write_buffer(s->xch, dobuf, ob, fd, &marker, sizeof(marker));
+}
+
+/* Wait until every queued frame has been written. */
+static int stripes_drain(struct save_stripes *s, struct xc_save_stats *stats)
+{
+    int rc;
+
+    pthread_mutex_lock(&s->lock);
+    while ( (s->head || s->busy) && !s->err )
+        pthread_cond_wait(&s->cond, &s->lock);
+    stats->write_us += s->write_us;
+    s->write_us = 0;
+    rc = s->err ? -1 : 0;
+    pthread_mutex_unlock(&s->lock);
+
+    return rc;
+}
+
+/* Write the remaining frames and close each data fd. */
+static int stripes_finish(struct save_stripes *s, struct xc_save_stats *stats)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&s->lock);
+    s->closing = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    for ( i = 0; i < s->nr_threads; i++ )
+        pthread_join(s->writers[i].thread, NULL);
+    s->nr_threads = 0;
+
+    return stripes_drain(s, stats);
+}
+
+/*
+ * Pipelined output for the live iterations.
+ *
+ * The save loop maps and classifies a batch, then queues it. A compress
+ * thread turns queued batches into compressed chunks and a writer thread
+ * sends the filled output buffers, so mapping batch N+1, compressing
+ * batch N and writing batch N-1 overlap. Both queues are bounded: at most
+ * PIPE_BATCHES mappings and PIPE_OUTBUFS output buffers are in flight.
+ *
+ * Everything the save loop writes while the pipe is in use goes through
+ * the queue, which keeps the stream in order. The receiver expects the
+ * compressed data of a batch in one chunk, so the buffer is handed over
+ * after each chunk and is large enough for a batch of full pages. When
+ * batches are striped, the save loop writes the batch header into the
+ * batch's frame and the compress thread completes and sends it.
+ *
+ * The pipe is drained at the end of each iteration, so its statistics
+ * are complete, and so before the domain is suspended. The last
+ * iteration runs synchronously, except in checkpoint capture (below).
+ *
+ * Checkpoint capture (XCFLAGS_CHECKPOINT_COMPRESS): the last iteration
+ * of each checkpoint also goes through the pipe, but the save loop
+ * copies every page of a batch into the batch and unmaps the guest
+ * right away. The domain is resumed as soon as the epoch is captured,
+ * and the pipe compresses and sends it while the guest runs the next
+ * epoch. Capture may use up to PIPE_CAPTURE_BATCHES batches, so that it
+ * rarely has to wait for the compress thread with the domain suspended.
+ * Each batch has a ptbuf of MAX_BATCH_SIZE pages (4MB), and batches are
+ * kept until the pipe is destroyed, so capture pins up to 256MB.
+ */
+#define PIPE_BATCHES     2
+#define PIPE_CAPTURE_BATCHES 64
+#define PIPE_ITEMS       512
+#define PIPE_OUTBUFS     3
+#define PIPE_OUTBUF_SIZE (OUTBUF_SIZE / 2)
+
+enum { PIPE_PAGE_DATA, PIPE_PAGE_TABLE, PIPE_PAGE_REF };
+
+struct pipe_page {
+    xen_pfn_t pfn;
+    int kind;
+    const char *page;           /* guest page, or in ptbuf for page tables */
+};
+
+/*
+ * The guest pages of a batch: one bulk mapping, or pages from the map
+ * cache for PV guests (whose p2m we can see change, see map_cache_frame()).
+ */
+struct batch_pages {
+    xc_map_cache_t *cache;
+    char *region;
+    unsigned int nr;
+    char *page[MAX_BATCH_SIZE];
+    xen_pfn_t pfn[MAX_BATCH_SIZE];
+};
+
+static int map_batch(xc_interface *xch, uint32_t dom, struct batch_pages *m,
+                     const xen_pfn_t *pfns, const xen_pfn_t *frames,
+                     int *err, unsigned int nr)
+{
+    unsigned int j;
+
+    m->nr = nr;
+    if ( m->cache )
+    {
+        for ( j = 0; j < nr; j++ )
+        {
+            m->pfn[j] = pfns[j];
+            m->page[j] = xc_map_foreign_cached(m->cache, pfns[j]);
+            err[j] = m->page[j] ? 0 : -errno;
+        }
+        return 0;
+    }
+
+    m->region = xc_map_foreign_bulk(xch, dom, PROT_READ, frames, err, nr);
+    if ( m->region == NULL )
+    {
+        m->nr = 0;
+        return -1;
+    }
+    for ( j = 0; j < nr; j++ )
+        m->page[j] = m->region + PAGE_SIZE * j;
+    return 0;
+}
+
+static void unmap_batch(struct batch_pages *m)
+{
+    unsigned int j;
+
+    if ( m->region )
+        munmap(m->region, m->nr * PAGE_SIZE);
+    else if ( m->cache )
+        for ( j = 0; j < m->nr; j++ )
+            if ( m->page[j] )
+                xc_unmap_foreign_cached(m->cache, m->pfn[j], m->page[j]);
+    m->region = NULL;
+    m->nr = 0;
+}
+
+/* Pages kept mapped across batches and iterations of a PV save */
+#define SAVE_MAP_CACHE_PAGES (1UL << 18)
+
+/*
+ * A PV guest's p2m is mapped, so a frame that changed under a cached
+ * window is noticed and the window mapped again.  An HVM guest's p2m is
+ * not visible to us and its batches keep mapping through the gpfns.
+ */
+static xen_pfn_t map_cache_frame(void *data, xen_pfn_t pfn)
+{
+    struct save_ctx *ctx = data;
+    struct domain_info_context *dinfo = &ctx->dinfo;
+
+    if ( pfn >= dinfo->p2m_size )
+        return INVALID_MFN;
+    return pfn_to_mfn(pfn);
+}
+
+struct pipe_batch {
+    struct batch_pages map;     /* unmapped by the compress thread */
+    unsigned int nr;
+    struct pipe_page pages[MAX_BATCH_SIZE];
+    char *ptbuf;                /* canonicalised page tables, or copies */
+    unsigned int nr_pt;
+    struct stripe_frame *frame; /* with the batch header, when striping */
+    int busy;
+};
+
+struct pipe_item {
+    struct pipe_batch *batch;   /* NULL for plain data */
+    void *data;
+    size_t len;
+};
+
+struct save_pipe {
+    xc_interface *xch;
+    int fd;
+    comp_ctx *compress_ctx;
+    int codec;
+    char *codec_buf;
+    struct save_stripes *stripes;
+
+    pthread_t compressor, writer;
+    int nr_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* save loop -> compress thread */
+    struct pipe_item items[PIPE_ITEMS];
+    unsigned int item_head, nr_items;
+    int compressing;
+    struct pipe_batch *batches[PIPE_CAPTURE_BATCHES];
+    unsigned int nr_batches;
+
+    /* compress thread -> writer thread; ob.buf is bufs[fill] */
+    struct outbuf ob;
+    char *bufs[PIPE_OUTBUFS];
+    size_t buf_len[PIPE_OUTBUFS];   /* 0 when free */
+    unsigned int fill, drain;
+    int write_count;
+
+    int err;
+    int exit, writer_exit;
+};
+
+/* Hand the compress thread's buffer to the writer and take the next one. */
+static int pipe_flush(struct save_pipe *p)
+{
+    int rc;
+
+    pthread_mutex_lock(&p->lock);
+    p->buf_len[p->fill] = p->ob.pos;
+    p->fill = (p->fill + 1) % PIPE_OUTBUFS;
+    pthread_cond_broadcast(&p->cond);
+    while ( p->buf_len[p->fill] )
+        pthread_cond_wait(&p->cond, &p->lock);
+    p->ob.buf = p->bufs[p->fill];
+    p->ob.pos = 0;
+    rc = p->err ? -1 : 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return rc;
+}
+
+static void *pipe_writer(void *arg)
+{
+    struct save_pipe *p = arg;
+    xc_interface *xch = p->xch;
+    unsigned int i;
+    size_t len;
+    uint64_t start;
+    int rc;
+
+    pthread_mutex_lock(&p->lock);
+    for ( ; ; )
+    {
+        i = p->drain;
+        while ( !p->buf_len[i] && !p->writer_exit )
+            pthread_cond_wait(&p->cond, &p->lock);
+        if ( !(len = p->buf_len[i]) )
+            break;
+
+        /* After an error buffers are just recycled */
+        if ( !p->err && !p->exit )
+        {
+            pthread_mutex_unlock(&p->lock);
+            start = llgettimeofday();
+            rc = write_exact(p->fd, p->bufs[i], len);
+            p->ob.stats->write_us += llgettimeofday() - start;
+            if ( !rc )
+            {
+                p->write_count += len;
+                if ( p->write_count >= (MAX_PAGECACHE_USAGE * PAGE_SIZE) )
+                {
+                    /* Time to discard cache - dont care if this fails */
+                    discard_file_cache(xch, p->fd, 0 /* no flush */);
+                    p->write_count = 0;
+                }
+            }
+            else
+                PERROR("Error when writing to state file (pipe)");
+            pthread_mutex_lock(&p->lock);
+            if ( rc )
+                p->err = 1;
+        }
+
+        p->buf_len[i] = 0;
+        p->drain = (i + 1) % PIPE_OUTBUFS;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+static int pipe_do_batch(struct save_pipe *p, struct pipe_batch *b)
+{
+    xc_interface *xch = p->xch;
+    struct pipe_page *pg;
+    struct outbuf *ob = b->frame ? &b->frame->ob : &p->ob;
+    int fd = b->frame ? -1 : p->fd;
+    unsigned int j;
+    char *src;
+    int c_err;
+
+    for ( j = 0; j < b->nr; j++ )
+    {
+        pg = &b->pages[j];
+        if ( pg->kind == PIPE_PAGE_REF )
+        {
+            /* The receiver's copy no longer matches the delta cache */
+            xc_compression_invalidate_page(xch, p->compress_ctx, pg->pfn);
+            continue;
+        }
+
+        src = (char *)pg->page;
+        /* Page tables are never delta encoded */
+        c_err = xc_compression_add_page(xch, p->compress_ctx, src, pg->pfn,
+                                        pg->kind == PIPE_PAGE_TABLE);
+        if ( c_err == -2 )
+        {
+            ERROR("Could not add page (pfn:%" PRIpfn ") to page buffer",
+                  pg->pfn);
+            return -1;
+        }
+        if ( (c_err == -1) &&
+             (write_compressed(xch, p->compress_ctx, p->codec, p->codec_buf,
+                               !!b->frame, ob, fd) < 0) )
+            return -1;
+    }
+
+    if ( write_compressed(xch, p->compress_ctx, p->codec, p->codec_buf,
+                          !!b->frame, ob, fd) < 0 )
+        return -1;
+
+    if ( b->frame )
+    {
+        struct stripe_frame *f = b->frame;
+
+        b->frame = NULL;
+        if ( stripes_send(p->stripes, f, 1, &p->ob, p->fd) < 0 )
+            return -1;
+    }
+
+    return 0;
+}
+
+static void *pipe_compressor(void *arg)
+{
+    struct save_pipe *p = arg;
+    struct pipe_item *item;
+    int skip, rc;
+
+    pthread_mutex_lock(&p->lock);
+    for ( ; ; )
+    {
+        while ( !p->nr_items && !p->exit )
+            pthread_cond_wait(&p->cond, &p->lock);
+        if ( !p->nr_items )
+            break;
+
+        item = &p->items[p->item_head];
+        p->compressing = 1;
+        skip = p->err || p->exit;
+        pthread_mutex_unlock(&p->lock);
+
+        rc = 0;
+        if ( item->batch )
+        {
+            if ( !skip )
+                rc = pipe_do_batch(p, item->batch);
+            unmap_batch(&item->batch->map);
+            if ( item->batch->frame )
+            {
+                stripes_put_frame(p->stripes, item->batch->frame);
+                item->batch->frame = NULL;
+            }
+        }
+        else
+        {
+            if ( !skip )
+                rc = outbuf_hardwrite(p->xch, &p->ob, p->fd,
+                                      item->data, item->len);
+            free(item->data);
+        }
+
+        pthread_mutex_lock(&p->lock);
+        if ( rc )
+            p->err = 1;
+        if ( item->batch )
+            item->batch->busy = 0;
+        p->item_head = (p->item_head + 1) % PIPE_ITEMS;
+        p->nr_items--;
+
+        /* Nothing else queued: give the writer what we have so far */
+        if ( !p->nr_items && p->ob.pos && !p->err && !p->exit )
+        {
+            pthread_mutex_unlock(&p->lock);
+            pipe_flush(p);
+            pthread_mutex_lock(&p->lock);
+        }
+        p->compressing = 0;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+static void pipe_destroy(struct save_pipe *p)
+{
+    unsigned int i;
+
+    if ( !p )
+        return;
+
+    /* Queued batches are unmapped, but no longer sent */
+    pthread_mutex_lock(&p->lock);
+    p->exit = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    if ( p->nr_threads > 1 )
+        pthread_join(p->compressor, NULL);
+
+    pthread_mutex_lock(&p->lock);
+    p->writer_exit = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    if ( p->nr_threads > 0 )
+        pthread_join(p->writer, NULL);
+
+    for ( i = 0; i < PIPE_OUTBUFS; i++ )
+        free(p->bufs[i]);
+    for ( i = 0; i < p->nr_batches; i++ )
+    {
+        free(p->batches[i]->ptbuf);
+        free(p->batches[i]);
+    }
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
+
+static int pipe_add_batch(struct save_pipe *p)
+{
+    struct pipe_batch *b;
+
+    if ( !(b = calloc(1, sizeof(*b))) )
+        return -1;
+    if ( !(b->ptbuf = malloc(MAX_BATCH_SIZE * PAGE_SIZE)) )
+    {
+        free(b);
+        return -1;
+    }
+    p->batches[p->nr_batches++] = b;
+
+    return 0;
+}
+
+static struct save_pipe *pipe_create(xc_interface *xch, int fd,
+                                     comp_ctx *compress_ctx, int codec,
+                                     char *codec_buf,
+                                     struct save_stripes *stripes,
+                                     struct xc_save_stats *stats)
+{
+    struct save_pipe *p;
+    unsigned int i;
+
+    if ( !(p = calloc(1, sizeof(*p))) )
+        return NULL;
+
+    p->xch = xch;
+    p->fd = fd;
+    p->compress_ctx = compress_ctx;
+    p->codec = codec;
+    p->codec_buf = codec_buf;
+    p->stripes = stripes;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+
+    for ( i = 0; i < PIPE_OUTBUFS; i++ )
+        if ( !(p->bufs[i] = malloc(PIPE_OUTBUF_SIZE)) )
+            goto err;
+    for ( i = 0; i < PIPE_BATCHES; i++ )
+        if ( pipe_add_batch(p) )
+            goto err;
+
+    p->ob.buf = p->bufs[0];
+    p->ob.size = PIPE_OUTBUF_SIZE;
+    p->ob.pipe = p;
+    p->ob.stats = stats;
+
+    if ( pthread_create(&p->writer, NULL, pipe_writer, p) )
+        goto err;
+    p->nr_threads++;
+    if ( pthread_create(&p->compressor, NULL, pipe_compressor, p) )
+        goto err;
+    p->nr_threads++;
+
+    return p;
+
+ err:
+    pipe_destroy(p);
+    return NULL;
+}
+
+/*
+ * Take a free batch, waiting for the compress thread if need be. A
+ * checkpoint capture adds batches rather than wait, up to
+ * PIPE_CAPTURE_BATCHES.
+ */
+static struct pipe_batch *pipe_get_batch(struct save_pipe *p, int capture)
+{
+    struct pipe_batch *b = NULL;
+    unsigned int i;
+
+    pthread_mutex_lock(&p->lock);
+    while ( !b )
+    {
+        for ( i = 0; i < p->nr_batches; i++ )
+            if ( !p->batches[i]->busy )
+            {
+                b = p->batches[i];
+                break;
+            }
+        if ( !b && capture && (p->nr_batches < PIPE_CAPTURE_BATCHES) &&
+             !pipe_add_batch(p) )
+            b = p->batches[p->nr_batches - 1];
+        if ( !b )
+            pthread_cond_wait(&p->cond, &p->lock);
+    }
+    b->busy = 1;
+    pthread_mutex_unlock(&p->lock);
+
+    b->nr = 0;
+    b->nr_pt = 0;
+    b->frame = NULL;
+
+    return b;
+}
+
+/* The item is queued even on failure, so batches are always unmapped. */
+static int pipe_queue(struct save_pipe *p, struct pipe_batch *batch,
+                      void *data, size_t len)
+{
+    struct pipe_item *item;
+    int rc;
+
+    pthread_mutex_lock(&p->lock);
+    while ( p->nr_items == PIPE_ITEMS )
+        pthread_cond_wait(&p->cond, &p->lock);
+    item = &p->items[(p->item_head + p->nr_items) % PIPE_ITEMS];
+    item->batch = batch;
+    item->data = data;
+    item->len = len;
+    p->nr_items++;
+    pthread_cond_broadcast(&p->cond);
+    rc = p->err ? -1 : 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return rc;
+}
+
+static int pipe_write(struct save_pipe *p, void *buf, size_t len)
+{
+    void *data;
+
+    if ( !len )
+        return 0;
+    if ( !(data = malloc(len)) )
+        return -1;
+    memcpy(data, buf, len);
+
+    return pipe_queue(p, NULL, data, len);
+}
+
+/* Wait until everything queued so far has been written. */
+static int pipe_drain(struct save_pipe *p)
+{
+    int rc;
+
+    pthread_mutex_lock(&p->lock);
+    while ( p->nr_items || p->compressing || p->buf_len[p->drain] )
+        pthread_cond_wait(&p->cond, &p->lock);
+    rc = p->err ? -1 : 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return rc;
+}
+
+/* Entries in the content hash table used for XCFLAGS_DEDUP_PAGES */
+#define DEDUP_TABLE_SIZE 65536
+
+struct dedup_entry {
+    uint64_t hash;
+    xen_pfn_t pfn;      /* INVALID_P2M_ENTRY when empty */
+};
+
+static int page_is_zero(const void *page)
+{
+    const unsigned long *p = page;
+    unsigned int i;
+
+    for ( i = 0; i < PAGE_SIZE / sizeof(*p); i++ )
+        if ( p[i] )
+            return 0;
+    return 1;
+}
+
+static uint64_t hash_page(const void *page)
+{
+    const uint64_t *p = page;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    unsigned int i;
+
+    for ( i = 0; i < PAGE_SIZE / sizeof(*p); i++ )
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h ^ (h >> 29);
+}
+
+/*
+ * Return the pfn of an earlier page whose contents may equal page (the
+ * caller must compare them), or INVALID_P2M_ENTRY. A page that is not
+ * found is remembered as pfn. The table is emptied at the start of each
+ * final iteration (every checkpoint, with Remus), so it only holds pages
+ * sent since the domain was last suspended: their contents in the guest
+ * are still the ones the receiver has.
+ */
+static xen_pfn_t dedup_lookup(struct dedup_entry *table, const void *page,
+                              xen_pfn_t pfn)
+{
+    uint64_t hash = hash_page(page);
+    struct dedup_entry *e = &table[hash & (DEDUP_TABLE_SIZE - 1)];
+
+    if ( e->pfn != INVALID_P2M_ENTRY && e->hash == hash )
+        return e->pfn;
+    e->hash = hash;
+    e->pfn = pfn;
+    return INVALID_P2M_ENTRY;
+}
+
 struct time_stats {
     struct timeval wall;
     long long d0_cpu, d1_cpu;
 };
 
+/*
+ * Count the pages dirtied in the last iteration (dirty), those also
+ * dirtied in the one before (hot), and those dirtied in any of the last
+ * three (any).
+ */
+static void count_dirty(const unsigned long *cur, const unsigned long *prev,
+                        const unsigned long *prev2, unsigned long nr_bits,
+                        unsigned long *dirty, unsigned long *hot,
+                        unsigned long *any)
+{
+    unsigned long i;
+
+    *dirty = *hot = *any = 0;
+    for ( i = 0; i < (nr_bits + BITS_PER_LONG - 1) / BITS_PER_LONG; i++ )
+    {
+        *dirty += __builtin_popcountl(cur[i]);
+        *hot += __builtin_popcountl(cur[i] & prev[i]);
+        *any += __builtin_popcountl(cur[i] | prev[i] | prev2[i]);
+    }
+}
+
 static int print_stats(xc_interface *xch, uint32_t domid, int pages_sent,
                        struct time_stats *last,
                        xc_shadow_op_stats_t *stats, int print)
@@ -322,6 +1251,117 @@ static int print_stats(xc_interface *xch, uint32_t domid, int pages_sent,
     return 0;
 }
 
+/*
+ * Hand the statistics of an iteration to the caller and reset them. The
+ * delta cache counters of the compression context are cumulative; *cache
+ * holds their values at the previous report.
+ */
+static void report_stats(xc_interface *xch, struct save_callbacks *callbacks,
+                         comp_ctx *compress_ctx, xc_compression_stats_t *cache,
+                         struct xc_save_stats *stats)
+{
+    xc_compression_stats_t now;
+
+    if ( compress_ctx )
+    {
+        xc_compression_get_stats(xch, compress_ctx, &now);
+        stats->cache_hits = now.cache_hits - cache->cache_hits;
+        stats->cache_misses = now.cache_misses - cache->cache_misses;
+        *cache = now;
+    }
+
+    DPRINTF("iter %u: sent %lu skipped %lu, %"PRIu64" -> %"PRIu64" bytes, "
+            "cache %"PRIu64"/%"PRIu64" hits; map %"PRIu64"us compress %"
+            PRIu64"us write %"PRIu64"us peek %"PRIu64"us clean %"PRIu64"us\n",
+            stats->iter, stats->pages_sent, stats->pages_skipped,
+            stats->raw_bytes, stats->compressed_bytes, stats->cache_hits,
+            stats->cache_hits + stats->cache_misses, stats->map_us,
+            stats->compress_us, stats->write_us, stats->peek_us,
+            stats->clean_us);
+
+    if ( callbacks->telemetry )
+        callbacks->telemetry(stats, callbacks->data);
+
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*
+ * Dirty pfn ring.  Once few pages are being dirtied Xen can give us their
+ * pfns (XEN_DOMCTL_SHADOW_OP_PEEK_RING/CLEAN_RING) instead of a bitmap of
+ * the whole guest.  When it can't we fall back to the bitmap operations.
+ */
+#define DIRTY_RING_ENTRIES 16384
+
+struct dirty_ring {
+    int enabled;            /* cleared for good if Xen doesn't support it */
+    uint64_t *pfns;         /* hypercall buffer of DIRTY_RING_ENTRIES */
+    xc_hypercall_buffer_t *pfns_buf;
+    unsigned long nr_skip;  /* pfns[] holds what the last PEEK set... */
+    int skip_full;          /* ...unless the bitmap may have anything set */
+    unsigned long hits, misses;
+};
+
+/*
+ * Read the dirty log into bitmap as XEN_DOMCTL_SHADOW_OP_CLEAN or PEEK
+ * (op) would, going through the ring when it can.  Returns as
+ * xc_shadow_control().
+ */
+static int read_dirty_log(xc_interface *xch, uint32_t dom, unsigned int op,
+                          struct dirty_ring *ring,
+                          xc_hypercall_buffer_t *bitmap_buf,
+                          unsigned long *bitmap, unsigned long p2m_size,
+                          xc_shadow_op_stats_t *stats)
+{
+    int clean = (op == XEN_DOMCTL_SHADOW_OP_CLEAN);
+    unsigned long i;
+    int frc;
+
+    if ( ring->enabled )
+    {
+        /* Take out what the last PEEK put in, before pfns[] is reused. */
+        if ( clean || ring->skip_full )
+            ring->skip_full = 1;
+        else
+            for ( i = 0; i < ring->nr_skip; i++ )
+                clear_bit(ring->pfns[i], bitmap);
+        ring->nr_skip = 0;
+
+        frc = xc_shadow_control(xch, dom,
+                                clean ? XEN_DOMCTL_SHADOW_OP_CLEAN_RING
+                                      : XEN_DOMCTL_SHADOW_OP_PEEK_RING,
+                                ring->pfns_buf, DIRTY_RING_ENTRIES,
+                                NULL, 0, stats);
+        if ( frc >= 0 )
+        {
+            if ( clean || ring->skip_full )
+                memset(bitmap, 0, bitmap_size(p2m_size));
+            for ( i = 0; i < frc; i++ )
+                if ( ring->pfns[i] < p2m_size )
+                    set_bit(ring->pfns[i], bitmap);
+            if ( !clean )
+            {
+                ring->nr_skip = frc;
+                ring->skip_full = 0;
+            }
+            ring->hits++;
+            return p2m_size;
+        }
+
+        /* ENOBUFS: too many pages were dirtied, try again next time */
+        if ( errno != ENOBUFS )
+        {
+            DPRINTF("Dirty pfn ring unavailable (errno %d)\n", errno);
+            ring->enabled = 0;
+        }
+        ring->misses++;
+    }
+
+    frc = xc_shadow_control(xch, dom, op, bitmap_buf, p2m_size,
+                            NULL, 0, stats);
+    if ( !clean )
+        ring->skip_full = 1;
+    return frc;
+}
 
 static int analysis_phase(xc_interface *xch, uint32_t domid, struct save_ctx *ctx,
                           xc_hypercall_buffer_t *arr, int runs)
@@ -561,8 +1601,8 @@ xen_pfn_t *xc_map_m2p(xc_interface *xch,
         entries[i].mfn = extent_start[i];
 
     m2p = xc_map_foreign_ranges(xch, DOMID_XEN,
-			m2p_size, prot, M2P_CHUNK_SIZE,
-			entries, m2p_chunks);
+            m2p_size, prot, M2P_CHUNK_SIZE,
+            entries, m2p_chunks);
     if (m2p == NULL)
     {
         PERROR("xc_mmap_foreign_ranges failed");
@@ -803,12 +1843,22 @@ static int save_tsc_info(xc_interface *xch, uint32_t dom, int io_fd)
 int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iters,
                    uint32_t max_factor, uint32_t flags,
                    struct save_callbacks* callbacks, int hvm,
-                   unsigned long vm_generationid_addr)
+                   unsigned long vm_generationid_addr, uint32_t downtime_ms,
+                   const int *data_fds, unsigned int nr_data_fds)
 {
     xc_dominfo_t info;
     DECLARE_DOMCTL;
 
-    int rc = 1, frc, i, j, last_iter = 0, iter = 0;
+    int rc = 1, frc, i, j, last_iter = 0, last_iter_prev, iter = 0;
+
+    /*
+     * Iteration policy. While hold_hot is set, live iterations after the
+     * first only send pages that have stayed clean for the last two
+     * iterations; held pages go out once holding stops (flush_held).
+     */
+    struct save_policy policy;
+    int hold_hot = 0, held = 0, flush_held;
+    unsigned long nr_dirty, nr_hot, nr_any;
     int live  = (flags & XCFLAGS_LIVE);
     int debug = (flags & XCFLAGS_DEBUG);
     int superpages = !!hvm;
@@ -827,14 +1877,27 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
     unsigned long *pfn_batch = NULL;
     int *pfn_err = NULL;
 
+    /* Zero and duplicate pages of the current batch, sent by reference */
+    struct xc_page_ref *page_refs = NULL;
+    uint32_t nr_refs;
+    struct dedup_entry *dedup = NULL;
+    unsigned long zero_pages = 0, dup_pages = 0;
+
+    /* XCFLAGS_POSTCOPY: pages whose contents are left for the receiver to
+     * pull once it has resumed the domain */
+    int postcopy;
+    unsigned long *to_postcopy = NULL;
+    unsigned long nr_postcopy = 0;
+
     /* A copy of one frame of guest memory. */
     char page[PAGE_SIZE];
 
     /* Live mapping of shared info structure */
     shared_info_any_t *live_shinfo = NULL;
 
-    /* base of the region in which domain memory is mapped */
-    unsigned char *region_base = NULL;
+    /* the guest pages of the current batch */
+    struct batch_pages *bmap = NULL;
+    xc_map_cache_t *map_cache = NULL;
 
     /* A copy of the CPU eXtended States of the guest. */
     DECLARE_HYPERCALL_BUFFER(void, buffer);
@@ -847,6 +1910,14 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
     DECLARE_HYPERCALL_BUFFER(unsigned long, to_send);
     unsigned long *to_fix = NULL;
 
+    DECLARE_HYPERCALL_BUFFER(unsigned long, to_send_prev);
+    DECLARE_HYPERCALL_BUFFER(unsigned long, to_send_prev2);
+    DECLARE_HYPERCALL_BUFFER(unsigned long, to_send_phase2);
+
+    /* pfns from the dirty log ring, see read_dirty_log() */
+    DECLARE_HYPERCALL_BUFFER(uint64_t, dirty_pfns);
+    struct dirty_ring ring;
+
     struct time_stats time_stats;
     xc_shadow_op_stats_t shadow_stats;
 
@@ -869,16 +1940,12 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
      * directly to outbuf. All of this is done while the domain is
      * suspended.
      *
-     * When checkpoint compression is enabled, the dirty pages are
-     * buffered, compressed "after" the domain is resumed and then
-     * written to outbuf. Since tailbuf data are collected while a
-     * domain is suspended, they cannot be directly written to the
-     * outbuf as there is no dirty page data preceeding tailbuf.
-     *
-     * So,two output buffers are maintained. Tailbuf data goes into
-     * ob_tailbuf. The dirty pages are compressed after resuming the
-     * domain and written to ob_pagebuf. ob_tailbuf is then appended
-     * to ob_pagebuf and finally flushed out.
+     * When checkpoint compression is enabled, each checkpoint is
+     * captured into the output pipeline instead: the dirty pages are
+     * copied while the domain is suspended, and compressed and sent
+     * behind it once it has been resumed. The tailbuf data is queued
+     * after the pages, so it is still sent in order (see "Checkpoint
+     * capture" above pipe_create()).
      */
     struct outbuf ob_pagebuf, ob_tailbuf, *ob = NULL;
     struct save_ctx _ctx;
@@ -887,14 +1954,34 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
 
     /* Compression context */
     comp_ctx *compress_ctx= NULL;
-    /* Even if XCFLAGS_CHECKPOINT_COMPRESS is set, we enable compression only
-     * after sending XC_SAVE_ID_ENABLE_COMPRESSION and the tailbuf for
-     * first time.
-     */
-    int compressing = 0;
+    /* Second stage coder announced with XC_SAVE_ID_COMPRESSION_CODEC */
+    int codec = (flags & XCFLAGS_STREAM_CODEC) ? DEF_STREAM_CODEC :
+                                                 XC_COMPRESSION_CODEC_NONE;
+    char *codec_buf = NULL;
+
+    /* Output pipeline for the live iterations, see pipe_create() */
+    struct save_pipe *pipe = NULL;
+    struct pipe_batch *pb;
+    /* Checkpoints are captured into the pipe and sent once resumed */
+    int capture = 0;
+    /* Stream data goes through the pipe (wrexact), set for each iteration */
+    int piped = 0;
+
+    /* Page batches go to the data fds when striping, see stripes_send() */
+    struct save_stripes *stripes = NULL;
+    struct stripe_frame *frame = NULL;
+
+    /* Reported through callbacks->telemetry, see report_stats() */
+    struct xc_save_stats stats;
+    xc_compression_stats_t cache_stats;
+    uint64_t start;
 
     int completed = 0;
 
+    memset(&stats, 0, sizeof(stats));
+    memset(&cache_stats, 0, sizeof(cache_stats));
+    memset(&ring, 0, sizeof(ring));
+
     DPRINTF("%s: starting save of domid %u", __func__, dom);
 
     if ( hvm && !callbacks->switch_qemu_logdirty )
@@ -904,7 +1991,13 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
         return 1;
     }
 
+    postcopy = (flags & XCFLAGS_POSTCOPY) && live && hvm &&
+               !callbacks->checkpoint;
+    if ( (flags & XCFLAGS_POSTCOPY) && !postcopy )
+        DPRINTF("Post-copy needs a live, non-checkpointed HVM save\n");
+
     outbuf_init(xch, &ob_pagebuf, OUTBUF_SIZE);
+    ob_pagebuf.stats = &stats;
 
     memset(ctx, 0, sizeof(*ctx));
 
@@ -992,17 +2085,58 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
         }
     }
 
+    /* ----Changed
     if ( flags & XCFLAGS_CHECKPOINT_COMPRESS )
     {
-        if (!(compress_ctx = xc_compression_create_context(xch, dinfo->p2m_size)))
+        if (!(compress_ctx = xc_compression_create_context(xch, dinfo->p2m_size, 0)))
         {
             ERROR("Failed to create compression context");
-            goto out;
-        }
+                goto out;
+           }
         outbuf_init(xch, &ob_tailbuf, OUTBUF_SIZE/4);
     }
+    */
+
+    if (!(compress_ctx = xc_compression_create_context(xch, dinfo->p2m_size, 0)))
+    {
+        ERROR("Failed to create compression context");
+        goto out;
+    }
+    {
+        long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if ( nr_cpus > DEF_COMPRESS_THREADS )
+            nr_cpus = DEF_COMPRESS_THREADS;
+        if ( (nr_cpus > 1) &&
+             xc_compression_set_threads(xch, compress_ctx, nr_cpus) )
+            DPRINTF("Falling back to single-threaded compression\n");
+    }
+    if ( (codec != XC_COMPRESSION_CODEC_NONE) &&
+         !(codec_buf = malloc(OUTBUF_SIZE)) )
+    {
+        DPRINTF("No memory for chunk coding, sending plain deltas\n");
+        codec = XC_COMPRESSION_CODEC_NONE;
+    }
+    if ( nr_data_fds && callbacks->checkpoint )
+        DPRINTF("Not striping a checkpointed stream\n");
+    else if ( nr_data_fds &&
+              !(stripes = stripes_create(xch, data_fds, nr_data_fds,
+                                         nr_data_fds * STRIPE_FRAMES_PER_FD +
+                                         PIPE_BATCHES, &stats)) )
+        DPRINTF("Sending all batches on the primary stream\n");
+    if ( live &&
+         !(pipe = pipe_create(xch, io_fd, compress_ctx, codec, codec_buf,
+                              stripes, &stats)) )
+        DPRINTF("Running the save loop without an output pipeline\n");
+    outbuf_init(xch, &ob_tailbuf, OUTBUF_SIZE/4);
+    ob_tailbuf.stats = &stats;
 
     last_iter = !live;
+    piped = pipe && !last_iter;
+    /* Post-copy suspends the domain as soon as the first round is sent */
+    last_iter_prev = postcopy;
+    save_policy_init(&policy, downtime_ms, max_iters,
+                     dinfo->p2m_size * max_factor);
 
     /* pretend we sent all the pages last iteration */
     sent_last_iter = dinfo->p2m_size;
@@ -1011,6 +2145,15 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
     to_send = xc_hypercall_buffer_alloc_pages(xch, to_send, NRPAGES(bitmap_size(dinfo->p2m_size)));
     to_skip = xc_hypercall_buffer_alloc_pages(xch, to_skip, NRPAGES(bitmap_size(dinfo->p2m_size)));
     to_fix  = calloc(1, bitmap_size(dinfo->p2m_size));
+    if ( postcopy && !(to_postcopy = calloc(1, bitmap_size(dinfo->p2m_size))) )
+    {
+        ERROR("Couldn't allocate post-copy bitmap");
+        goto out;
+    }
+
+    to_send_prev = xc_hypercall_buffer_alloc_pages(xch, to_send_prev, NRPAGES(bitmap_size(dinfo->p2m_size)));
+    to_send_prev2 = xc_hypercall_buffer_alloc_pages(xch, to_send_prev2, NRPAGES(bitmap_size(dinfo->p2m_size)));
+    to_send_phase2 = xc_hypercall_buffer_alloc_pages(xch, to_send_phase2, NRPAGES(bitmap_size(dinfo->p2m_size)));
 
     if ( !to_send || !to_fix || !to_skip )
     {
@@ -1018,7 +2161,26 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
         goto out;
     }
 
+    if ( !to_send_prev || !to_send_prev2 || !to_send_phase2 )
+    {
+        ERROR("Couldn't allocate to_send_prev array");
+        goto out;
+    }
+
+    if ( live )
+    {
+        dirty_pfns = xc_hypercall_buffer_alloc_pages(
+            xch, dirty_pfns, NRPAGES(DIRTY_RING_ENTRIES * sizeof(uint64_t)));
+        ring.enabled = (dirty_pfns != NULL);
+        ring.pfns = dirty_pfns;
+        ring.pfns_buf = HYPERCALL_BUFFER(dirty_pfns);
+        ring.skip_full = 1;
+    }
+
     memset(to_send, 0xff, bitmap_size(dinfo->p2m_size));
+    memset(to_send_prev, 0x00, bitmap_size(dinfo->p2m_size));
+    memset(to_send_prev2, 0x00, bitmap_size(dinfo->p2m_size));
+    memset(to_send_phase2, 0x00, bitmap_size(dinfo->p2m_size));
 
     if ( hvm )
     {
@@ -1042,7 +2204,10 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
     pfn_type   = malloc(ROUNDUP(MAX_BATCH_SIZE * sizeof(*pfn_type), PAGE_SHIFT));
     pfn_batch  = calloc(MAX_BATCH_SIZE, sizeof(*pfn_batch));
     pfn_err    = malloc(MAX_BATCH_SIZE * sizeof(*pfn_err));
-    if ( (pfn_type == NULL) || (pfn_batch == NULL) || (pfn_err == NULL) )
+    page_refs  = malloc(MAX_BATCH_SIZE * sizeof(*page_refs));
+    bmap       = calloc(1, sizeof(*bmap));
+    if ( (pfn_type == NULL) || (pfn_batch == NULL) || (pfn_err == NULL) ||
+         (page_refs == NULL) || (bmap == NULL) )
     {
         ERROR("failed to alloc memory for pfn_type and/or pfn_batch arrays");
         errno = ENOMEM;
@@ -1092,6 +2257,16 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
             }
         }
         DPRINTF("Had %d unexplained entries in p2m table\n", err);
+
+        if ( live )
+        {
+            map_cache = xc_map_cache_create(xch, dom, PROT_READ,
+                                            SAVE_MAP_CACHE_PAGES,
+                                            map_cache_frame, ctx);
+            if ( map_cache == NULL )
+                DPRINTF("No map cache, mapping each batch\n");
+            bmap->cache = map_cache;
+        }
     }
 
     print_stats(xch, dom, 0, &time_stats, &shadow_stats, 0);
@@ -1109,28 +2284,97 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
         goto out;
     }
 
-  copypages:
-#define wrexact(fd, buf, len) write_buffer(xch, last_iter, ob, (fd), (buf), (len))
-#define wruncached(fd, live, buf, len) write_uncached(xch, last_iter, ob, (fd), (buf), (len))
-#define wrcompressed(fd) write_compressed(xch, compress_ctx, last_iter, ob, (fd))
+#define wrexact(fd, buf, len) (piped ?                                   \
+        pipe_write(pipe, (buf), (len)) :                                 \
+        write_buffer(xch, last_iter, ob, (fd), (buf), (len)))
+#define wrcompressed(fd) write_compressed(xch, compress_ctx, codec, codec_buf, last_iter, ob, (fd))
+/* Parts of a page batch, which go into its frame when striping */
+#define wrbatch(fd, buf, len) (frame ?                                   \
+        outbuf_write(xch, &frame->ob, (buf), (len)) :                    \
+        wrexact((fd), (buf), (len)))
+#define wrbatchdata(fd) (frame ?                                         \
+        write_compressed(xch, compress_ctx, codec, codec_buf, 1,         \
+                         &frame->ob, -1) :                               \
+        wrcompressed(fd))
 
     ob = &ob_pagebuf; /* Holds pfn_types, pages/compressed pages */
+
+    /*
+     * Every page goes through the compressor, which picks an encoding per
+     * page (see xc_domain_compress.c): cache misses in the first iteration
+     * are sent zero, run length encoded or raw, and fill the delta cache
+     * for the iterations after it.
+     */
+    i = XC_SAVE_ID_ENABLE_TAGGED_COMPRESSION;
+    if ( wrexact(io_fd, &i, sizeof(int)) )
+    {
+        PERROR("Error when writing enable_compression marker");
+        goto out;
+    }
+    if ( codec != XC_COMPRESSION_CODEC_NONE )
+    {
+        uint32_t id = codec;
+
+        i = XC_SAVE_ID_COMPRESSION_CODEC;
+        if ( wrexact(io_fd, &i, sizeof(int)) ||
+             wrexact(io_fd, &id, sizeof(id)) )
+        {
+            PERROR("Error when writing compression codec marker");
+            goto out;
+        }
+    }
+    if ( stripes )
+    {
+        uint32_t nr = nr_data_fds;
+
+        i = XC_SAVE_ID_STRIPES;
+        if ( wrexact(io_fd, &i, sizeof(int)) ||
+             wrexact(io_fd, &nr, sizeof(nr)) )
+        {
+            PERROR("Error when writing data fds marker");
+            goto out;
+        }
+    }
+
+ copypages:
     /* Now write out each data page, canonicalising page tables as we go... */
     for ( ; ; )
     {
         unsigned int N, batch, run;
         char reportbuf[80];
 
+        piped = pipe && (!last_iter || capture);
+
         snprintf(reportbuf, sizeof(reportbuf),
                  "Saving memory: iter %d (last sent %u skipped %u)",
                  iter, sent_this_iter, skip_this_iter);
 
+        DPRINTF("Saving memory: iter %d (last sent %u skipped %u)",
+                 iter, sent_this_iter, skip_this_iter);
+
         xc_report_progress_start(xch, reportbuf, dinfo->p2m_size);
 
         iter++;
         sent_this_iter = 0;
         skip_this_iter = 0;
         N = 0;
+        stats.iter = iter;
+        save_policy_iter_start(&policy);
+
+        hold_hot = hold_hot && (iter > 1) && !last_iter_prev && !last_iter;
+        flush_held = held && !hold_hot;
+        held = hold_hot;
+
+        if ( last_iter && (flags & XCFLAGS_DEDUP_PAGES) )
+        {
+            if ( !dedup &&
+                 !(dedup = malloc(DEDUP_TABLE_SIZE * sizeof(*dedup))) )
+                DPRINTF("No memory for dedup table, sending duplicates\n");
+            /* Forget the last checkpoint's pages: they may have changed */
+            if ( dedup )
+                for ( j = 0; j < DEDUP_TABLE_SIZE; j++ )
+                    dedup[j].pfn = INVALID_P2M_ENTRY;
+        }
 
         while ( N < dinfo->p2m_size )
         {
@@ -1138,11 +2382,12 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
 
             if ( !last_iter )
             {
-                /* Slightly wasteful to peek the whole array every time,
-                   but this is fast enough for the moment. */
-                frc = xc_shadow_control(
-                    xch, dom, XEN_DOMCTL_SHADOW_OP_PEEK, HYPERCALL_BUFFER(to_skip),
-                    dinfo->p2m_size, NULL, 0, NULL);
+                /* Only the dirty pfns, if Xen still has them all. */
+                start = llgettimeofday();
+                frc = read_dirty_log(
+                    xch, dom, XEN_DOMCTL_SHADOW_OP_PEEK, &ring,
+                    HYPERCALL_BUFFER(to_skip), to_skip, dinfo->p2m_size, NULL);
+                stats.peek_us += llgettimeofday() - start;
                 if ( frc != dinfo->p2m_size )
                 {
                     ERROR("Error peeking shadow bitmap");
@@ -1158,24 +2403,16 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
             {
                 int n = N;
 
-                if ( debug )
-                {
-                    DPRINTF("%d pfn= %08lx mfn= %08lx %d",
-                            iter, (unsigned long)n,
-                            hvm ? 0 : pfn_to_mfn(n),
-                            test_bit(n, to_send));
-                    if ( !hvm && is_mapped(pfn_to_mfn(n)) )
-                        DPRINTF("  [mfn]= %08lx",
-                                mfn_to_pfn(pfn_to_mfn(n)&0xFFFFF));
-                    DPRINTF("\n");
-                }
 
+
+                /*
+                //this if block is never executed in RLE compression
                 if ( completed )
                 {
-                    /* for sparse bitmaps, word-by-word may save time */
+                    // for sparse bitmaps, word-by-word may save time 
                     if ( !to_send[N >> ORDER_LONG] )
                     {
-                        /* incremented again in for loop! */
+                        // incremented again in for loop! 
                         N += BITS_PER_LONG - 1;
                         continue;
                     }
@@ -1191,23 +2428,54 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                 }
                 else
                 {
+                    */
+                    
                     int dont_skip = (last_iter || (superpages && iter==1));
 
-                    if ( !dont_skip &&
-                         test_bit(n, to_send) &&
-                         test_bit(n, to_skip) )
-                        skip_this_iter++; /* stats keeping */
+                    //Phase 1
+                    //if(true)
+                    if ( flush_held ){
+                        if(test_bit(n,to_send_prev) || test_bit(n,to_send_prev2))
+                            set_bit(n,to_send);
+                    }
 
-                    if ( !((test_bit(n, to_send) && !test_bit(n, to_skip)) ||
-                           (test_bit(n, to_send) && dont_skip) ||
-                           (test_bit(n, to_fix)  && last_iter)) )
-                        continue;
+                    if( !hold_hot )
+                    {
+
+                        if ( !dont_skip &&
+                             test_bit(n, to_send) &&
+                             test_bit(n, to_skip) )
+                            skip_this_iter++; /* stats keeping */
+
+                        if ( !((test_bit(n, to_send) && !test_bit(n, to_skip)) ||
+                               (test_bit(n, to_send) && dont_skip) ||
+                               (test_bit(n, to_fix)  && last_iter)) )
+                            continue;
+
+                    }
+                    else{
+
+                        if ((!test_bit(n, to_send_prev)) && (!test_bit(n, to_send)) && test_bit(n, to_send_prev2)){
+                            set_bit(n, to_send_phase2);
+                        }
+                        
+                        if ( !dont_skip &&
+                             test_bit(n, to_send_phase2) &&
+                             test_bit(n, to_skip) )
+                            skip_this_iter++; /* stats keeping */
+
+                        if ( !((test_bit(n, to_send_phase2) && !test_bit(n, to_skip)) ||
+                               (test_bit(n, to_send_phase2) && dont_skip) ||
+                               (test_bit(n, to_fix)  && last_iter)) )
+                            continue;
+
+                    }
 
                     /* First time through, try to keep superpages in the same batch */
-                    if ( superpages && iter == 1
-                         && SUPER_PAGE_START(n)
-                         && batch + SUPERPAGE_NR_PFNS > MAX_BATCH_SIZE )
-                        break;
+                        if ( superpages && iter == 1
+                             && SUPER_PAGE_START(n)
+                             && batch + SUPERPAGE_NR_PFNS > MAX_BATCH_SIZE )
+                            break;
 
                     /*
                     ** we get here if:
@@ -1247,17 +2515,20 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                     }
 
                     clear_bit(n, to_fix);
-                }
                 
+                //}
                 batch++;
             }
+            
 
             if ( batch == 0 )
                 goto skip; /* vanishingly unlikely... */
 
-            region_base = xc_map_foreign_bulk(
-                xch, dom, PROT_READ, pfn_type, pfn_err, batch);
-            if ( region_base == NULL )
+            start = llgettimeofday();
+            frc = map_batch(xch, dom, bmap, pfn_batch, pfn_type, pfn_err,
+                            batch);
+            stats.map_us += llgettimeofday() - start;
+            if ( frc )
             {
                 PERROR("map batch failed");
                 goto out;
@@ -1304,6 +2575,15 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                 if ( superpages && iter==1 && test_bit(gmfn, to_skip))
                     pfn_type[j] = XEN_DOMCTL_PFINFO_XALLOC;
 
+                /* Zero pages still go by reference, the rest comes later */
+                if ( postcopy && last_iter &&
+                     pfn_type[j] == XEN_DOMCTL_PFINFO_NOTAB &&
+                     !page_is_zero(bmap->page[j]) )
+                {
+                    pfn_type[j] = XEN_DOMCTL_PFINFO_XALLOC;
+                    set_bit(pfn_batch[j], to_postcopy);
+                }
+
                 /* canonicalise mfn->pfn */
                 pfn_type[j] |= pfn_batch[j];
                 ++run;
@@ -1314,7 +2594,7 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                         DPRINTF("%d pfn=%08lx sum=%08lx\n",
                                 iter,
                                 pfn_type[j],
-                                csum_page(region_base + (PAGE_SIZE*j)));
+                                csum_page(bmap->page[j]));
                     else
                         DPRINTF("%d pfn= %08lx mfn= %08lx [mfn]= %08lx"
                                 " sum= %08lx\n",
@@ -1322,17 +2602,85 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                                 pfn_type[j],
                                 gmfn,
                                 mfn_to_pfn(gmfn),
-                                csum_page(region_base + (PAGE_SIZE*j)));
+                                csum_page(bmap->page[j]));
                 }
             }
 
             if ( !run )
             {
-                munmap(region_base, batch*PAGE_SIZE);
+                unmap_batch(bmap);
                 continue; /* bail on this batch: no valid pages */
             }
 
-            if ( wrexact(io_fd, &batch, sizeof(unsigned int)) )
+            /*
+             * With XCFLAGS_DEDUP_PAGES, find the pages of this batch that
+             * can go by reference. Without it no PAGE_REFS record is sent.
+             */
+            nr_refs = 0;
+            for ( j = 0; (flags & XCFLAGS_DEDUP_PAGES) && (j < batch); j++ )
+            {
+                void *spage = bmap->page[j];
+                xen_pfn_t src;
+                void *src_page;
+                int same;
+
+                if ( (pfn_type[j] & XEN_DOMCTL_PFINFO_LTAB_MASK) !=
+                     XEN_DOMCTL_PFINFO_NOTAB )
+                    continue;
+
+                if ( page_is_zero(spage) )
+                {
+                    page_refs[nr_refs].src = XC_PAGE_REF_ZERO;
+                    zero_pages++;
+                }
+                else if ( last_iter && dedup &&
+                          (src = dedup_lookup(dedup, spage, pfn_batch[j])) !=
+                          INVALID_P2M_ENTRY )
+                {
+                    src_page = xc_map_foreign_range(
+                        xch, dom, PAGE_SIZE, PROT_READ,
+                        hvm ? src : pfn_to_mfn(src));
+                    same = src_page && !memcmp(src_page, spage, PAGE_SIZE);
+                    if ( src_page )
+                        munmap(src_page, PAGE_SIZE);
+                    if ( !same )
+                        continue;
+                    page_refs[nr_refs].src = src;
+                    dup_pages++;
+                }
+                else
+                    continue;
+
+                page_refs[nr_refs].index = j;
+                page_refs[nr_refs].pad = 0;
+                nr_refs++;
+            }
+
+            /* The pipe's compress thread flushes the stream when idle */
+            if ( stripes &&
+                 !(frame = stripes_get_frame(stripes,
+                                             piped ? NULL : ob,
+                                             io_fd)) )
+            {
+                ERROR("Error when writing to the data fds, iter %d", iter);
+                unmap_batch(bmap);
+                goto out;
+            }
+
+            if ( nr_refs )
+            {
+                i = XC_SAVE_ID_PAGE_REFS;
+                if ( wrbatch(io_fd, &i, sizeof(int)) ||
+                     wrbatch(io_fd, &nr_refs, sizeof(nr_refs)) ||
+                     wrbatch(io_fd, page_refs,
+                             nr_refs * sizeof(*page_refs)) )
+                {
+                    PERROR("Error when writing page references");
+                    goto out;
+                }
+            }
+
+            if ( wrbatch(io_fd, &batch, sizeof(unsigned int)) )
             {
                 PERROR("Error when writing to state file (2)");
                 goto out;
@@ -1341,7 +2689,7 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
             if ( sizeof(unsigned long) < sizeof(*pfn_type) )
                 for ( j = 0; j < batch; j++ )
                     ((unsigned long *)pfn_type)[j] = pfn_type[j];
-            if ( wrexact(io_fd, pfn_type, sizeof(unsigned long)*batch) )
+            if ( wrbatch(io_fd, pfn_type, sizeof(unsigned long)*batch) )
             {
                 PERROR("Error when writing to state file (3)");
                 goto out;
@@ -1350,33 +2698,84 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                 while ( --j >= 0 )
                     pfn_type[j] = ((unsigned long *)pfn_type)[j];
 
-            /* entering this loop, pfn_type is now in pfns (Not mfns) */
-            run = 0;
-            for ( j = 0; j < batch; j++ )
+            if ( piped )
             {
-                unsigned long pfn, pagetype;
-                void *spage = (char *)region_base + (PAGE_SIZE*j);
+                /*
+                 * Queue the batch; the compress thread unmaps it, unless
+                 * this is a checkpoint capture, see "Checkpoint capture".
+                 */
+                pb = pipe_get_batch(pipe, capture);
+                pb->map = *bmap;
+                bmap->region = NULL;
+                bmap->nr = 0;
+                pb->frame = frame;
+                frame = NULL;
+                for ( j = 0, i = 0; j < batch; j++ )
+                {
+                    struct pipe_page *pg = &pb->pages[pb->nr];
+                    unsigned long pfn, pagetype;
 
-                pfn      = pfn_type[j] & ~XEN_DOMCTL_PFINFO_LTAB_MASK;
-                pagetype = pfn_type[j] &  XEN_DOMCTL_PFINFO_LTAB_MASK;
+                    pfn      = pfn_type[j] & ~XEN_DOMCTL_PFINFO_LTAB_MASK;
+                    pagetype = pfn_type[j] &  XEN_DOMCTL_PFINFO_LTAB_MASK;
 
-                if ( pagetype != 0 )
-                {
-                    /* If the page is not a normal data page, write out any
-                       run of pages we may have previously acumulated */
-                    if ( !compressing && run )
+                    if ( pagetype == XEN_DOMCTL_PFINFO_XTAB
+                        || pagetype == XEN_DOMCTL_PFINFO_BROKEN
+                        || pagetype == XEN_DOMCTL_PFINFO_XALLOC )
+                        continue;
+
+                    pg->pfn = pfn;
+                    pg->kind = PIPE_PAGE_DATA;
+                    pg->page = pb->map.page[j];
+                    pagetype &= XEN_DOMCTL_PFINFO_LTABTYPE_MASK;
+
+                    if ( (i < nr_refs) && (page_refs[i].index == j) )
+                    {
+                        pg->kind = PIPE_PAGE_REF;
+                        i++;
+                    }
+                    else
+                        stats.raw_bytes += PAGE_SIZE;
+
+                    if ( (pagetype >= XEN_DOMCTL_PFINFO_L1TAB) &&
+                              (pagetype <= XEN_DOMCTL_PFINFO_L4TAB) )
+                    {
+                        char *dst = pb->ptbuf + PAGE_SIZE * pb->nr_pt++;
+
+                        pg->kind = PIPE_PAGE_TABLE;
+                        pg->page = dst;
+                        race = canonicalize_pagetable(
+                            ctx, pagetype, pfn, pb->map.page[j], dst);
+                    }
+                    else if ( last_iter && (pg->kind == PIPE_PAGE_DATA) )
                     {
-                        if ( wruncached(io_fd, live,
-                                       (char*)region_base+(PAGE_SIZE*(j-run)), 
-                                       PAGE_SIZE*run) != PAGE_SIZE*run )
-                        {
-                            PERROR("Error when writing to state file (4a)"
-                                  " (errno %d)", errno);
-                            goto out;
-                        }                        
-                        run = 0;
+                        char *dst = pb->ptbuf + PAGE_SIZE * pb->nr_pt++;
+
+                        memcpy(dst, pb->map.page[j], PAGE_SIZE);
+                        pg->page = dst;
                     }
+                    pb->nr++;
+                }
+                if ( last_iter )
+                    unmap_batch(&pb->map);
+
+                sent_this_iter += batch;
+                if ( pipe_queue(pipe, pb, NULL, 0) )
+                {
+                    ERROR("Error in the save pipeline, iter %d", iter);
+                    goto out;
                 }
+                continue;
+            }
+
+            /* entering this loop, pfn_type is now in pfns (Not mfns) */
+            for ( j = 0, i = 0; j < batch; j++ )
+            {
+                unsigned long pfn, pagetype;
+                void *spage = bmap->page[j];
+                int c_err;
+
+                pfn      = pfn_type[j] & ~XEN_DOMCTL_PFINFO_LTAB_MASK;
+                pagetype = pfn_type[j] &  XEN_DOMCTL_PFINFO_LTAB_MASK;
 
                 /*
                  * skip pages that aren't present,
@@ -1387,6 +2786,15 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                     || pagetype == XEN_DOMCTL_PFINFO_XALLOC )
                     continue;
 
+                if ( (i < nr_refs) && (page_refs[i].index == j) )
+                {
+                    /* The receiver's copy no longer matches the delta cache */
+                    xc_compression_invalidate_page(xch, compress_ctx, pfn);
+                    i++;
+                    continue;
+                }
+
+                stats.raw_bytes += PAGE_SIZE;
                 pagetype &= XEN_DOMCTL_PFINFO_LTABTYPE_MASK;
 
                 if ( (pagetype >= XEN_DOMCTL_PFINFO_L1TAB) &&
@@ -1396,104 +2804,73 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                     race = 
                         canonicalize_pagetable(ctx, pagetype, pfn, spage, page); 
 
+                    /*
                     if ( race && !live )
                     {
                         ERROR("Fatal PT race (pfn %lx, type %08lx)", pfn,
                               pagetype);
                         goto out;
                     }
+                    */
 
-                    if (compressing)
-                    {
-                        int c_err;
-                        /* Mark pagetable page to be sent uncompressed */
-                        c_err = xc_compression_add_page(xch, compress_ctx, page,
-                                                        pfn, 1 /* raw page */);
-                        if (c_err == -2) /* OOB PFN */
-                        {
-                            ERROR("Could not add pagetable page "
-                                  "(pfn:%" PRIpfn "to page buffer\n", pfn);
-                            goto out;
-                        }
-
-                        if (c_err == -1)
-                        {
-                            /*
-                             * We are out of buffer space to hold dirty
-                             * pages. Compress and flush the current buffer
-                             * to make space. This is a corner case, that
-                             * slows down checkpointing as the compression
-                             * happens while domain is suspended. Happens
-                             * seldom and if you find this occuring
-                             * frequently, increase the PAGE_BUFFER_SIZE
-                             * in xc_compression.c.
-                             */
-                            if (wrcompressed(io_fd) < 0)
-                            {
-                                ERROR("Error when writing compressed"
-                                      " data (4b)\n");
-                                goto out;
-                            }
-                        }
-                    }
-                    else if ( wruncached(io_fd, live, page,
-                                         PAGE_SIZE) != PAGE_SIZE )
-                    {
-                        PERROR("Error when writing to state file (4b)"
-                              " (errno %d)", errno);
-                        goto out;
-                    }
+                    /* Pagetable pages are never delta encoded */
+                    c_err = xc_compression_add_page(xch, compress_ctx, page,
+                                                    pfn, 1 /* raw page */);
                 }
                 else
+                    c_err = xc_compression_add_page(xch, compress_ctx, spage,
+                                                    pfn, 0 /* not raw page */);
+
+                if (c_err == -2) /* OOB PFN */
                 {
-                    /* We have a normal page: accumulate it for writing. */
-                    if (compressing)
-                    {
-                        int c_err;
-                        /* For checkpoint compression, accumulate the page in the
-                         * page buffer, to be compressed later.
-                         */
-                        c_err = xc_compression_add_page(xch, compress_ctx, spage,
-                                                        pfn, 0 /* not raw page */);
-
-                        if (c_err == -2) /* OOB PFN */
-                        {
-                            ERROR("Could not add page "
-                                  "(pfn:%" PRIpfn "to page buffer\n", pfn);
-                            goto out;
-                        }
+                    ERROR("Could not add page "
+                          "(pfn:%" PRIpfn "to page buffer\n", pfn);
+                    goto out;
+                }
 
-                        if (c_err == -1)
-                        {
-                            if (wrcompressed(io_fd) < 0)
-                            {
-                                ERROR("Error when writing compressed"
-                                      " data (4c)\n");
-                                goto out;
-                            }
-                        }
+                if (c_err == -1)
+                {
+                    /*
+                     * We are out of buffer space to hold dirty
+                     * pages. Compress and flush the current buffer
+                     * to make space. This is a corner case, that
+                     * slows down checkpointing as the compression
+                     * happens while domain is suspended. Happens
+                     * seldom and if you find this occuring
+                     * frequently, increase the PAGE_BUFFER_SIZE
+                     * in xc_domain_compress.c.
+                     */
+                    if (wrbatchdata(io_fd) < 0)
+                    {
+                        ERROR("Error when writing compressed"
+                              " data (4b)\n");
+                        goto out;
                     }
-                    else
-                        run++;
                 }
             } /* end of the write out for this batch */
 
-            if ( run )
+            if (wrbatchdata(io_fd) < 0)
             {
-                /* write out the last accumulated run of pages */
-                if ( wruncached(io_fd, live,
-                               (char*)region_base+(PAGE_SIZE*(j-run)), 
-                               PAGE_SIZE*run) != PAGE_SIZE*run )
+                ERROR("Error when writing compressed data"
+                      " iter %d\n", iter);
+                rc = 1;
+                goto out;
+            }
+
+            if ( frame )
+            {
+                frc = stripes_send(stripes, frame, last_iter, ob, io_fd);
+                frame = NULL;
+                if ( frc < 0 )
                 {
-                    PERROR("Error when writing to state file (4c)"
-                          " (errno %d)", errno);
+                    ERROR("Error when writing to the data fds, iter %d", iter);
                     goto out;
-                }                        
+                }
             }
 
             sent_this_iter += batch;
 
-            munmap(region_base, batch*PAGE_SIZE);
+            unmap_batch(bmap);
 
         } /* end of this while loop for this iteration */
 
@@ -1502,16 +2879,35 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
         xc_report_progress_step(xch, dinfo->p2m_size, dinfo->p2m_size);
 
         total_sent += sent_this_iter;
+        stats.pages_sent = sent_this_iter;
+        stats.pages_skipped = skip_this_iter;
+
+        /* The statistics of the iteration are complete once it is written */
+        if ( pipe && !last_iter && pipe_drain(pipe) )
+        {
+            ERROR("Error in the save pipeline, iter %d", iter);
+            goto out;
+        }
+        if ( stripes && !last_iter && stripes_drain(stripes, &stats) )
+        {
+            ERROR("Error when writing to the data fds, iter %d", iter);
+            goto out;
+        }
 
         if ( last_iter )
         {
             print_stats( xch, dom, sent_this_iter, &time_stats, &shadow_stats, 1);
-
+            DPRINTF("Saving memory: iter %d (last sent %u skipped %u)",
+                 iter, sent_this_iter, skip_this_iter);
             DPRINTF("Total pages sent= %ld (%.2fx)\n",
                     total_sent, ((float)total_sent)/dinfo->p2m_size );
             DPRINTF("(of which %ld were fixups)\n", needed_to_fix  );
+            DPRINTF("Sent by reference: %lu zero, %lu duplicate pages\n",
+                    zero_pages, dup_pages);
+            report_stats(xch, callbacks, compress_ctx, &cache_stats, &stats);
         }
 
+        /*
         if ( last_iter && debug )
         {
             int id = XC_SAVE_ID_ENABLE_VERIFY_MODE;
@@ -1519,7 +2915,7 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
             debug = 0;
             DPRINTF("Entering debug resend-all mode\n");
 
-            /* send "-1" to put receiver into debug mode */
+            // send "-1" to put receiver into debug mode 
             if ( wrexact(io_fd, &id, sizeof(int)) )
             {
                 PERROR("Error when writing to state file (6)");
@@ -1528,18 +2924,22 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
 
             continue;
         }
+        */
+        
 
         if ( last_iter )
             break;
 
+        
+
         if ( live )
         {
-            if ( (iter >= max_iters) ||
-                 (sent_this_iter+skip_this_iter < 50) ||
-                 (total_sent > dinfo->p2m_size*max_factor) )
+            if ( last_iter_prev )
             {
                 DPRINTF("Start last iteration\n");
                 last_iter = 1;
+                capture = pipe && callbacks->checkpoint &&
+                          (flags & XCFLAGS_CHECKPOINT_COMPRESS);
 
                 if ( suspend_and_state(callbacks->suspend, callbacks->data,
                                        xch, io_fd, dom, &info) )
@@ -1547,6 +2947,7 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
                     ERROR("Domain appears not to have suspended");
                     goto out;
                 }
+                save_policy_suspended(&policy);
 
                 DPRINTF("SUSPEND shinfo %08lx\n", info.shared_info_frame);
                 if ( (tmem_saved > 0) &&
@@ -1565,32 +2966,100 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
 
             }
 
-            if ( xc_shadow_control(xch, dom,
-                                   XEN_DOMCTL_SHADOW_OP_CLEAN, HYPERCALL_BUFFER(to_send),
-                                   dinfo->p2m_size, NULL, 0, &shadow_stats) != dinfo->p2m_size )
+            if( iter > 1){
+                memcpy(to_send_prev2, to_send_prev, bitmap_size(dinfo->p2m_size));
+                memcpy(to_send_prev, to_send, bitmap_size(dinfo->p2m_size));
+            }
+
+            start = llgettimeofday();
+            if ( read_dirty_log(xch, dom, XEN_DOMCTL_SHADOW_OP_CLEAN, &ring,
+                                HYPERCALL_BUFFER(to_send), to_send,
+                                dinfo->p2m_size, &shadow_stats) != dinfo->p2m_size )
             {
                 PERROR("Error flushing shadow PT");
                 goto out;
             }
+            stats.clean_us += llgettimeofday() - start;
+            report_stats(xch, callbacks, compress_ctx, &cache_stats, &stats);
 
             sent_last_iter = sent_this_iter;
 
             print_stats(xch, dom, sent_this_iter, &time_stats, &shadow_stats, 1);
 
+            if ( !last_iter )
+            {
+                /*
+                 * If we stop now, the next iteration sends to_send and,
+                 * if pages were held back, to_send_prev/prev2 as well.
+                 */
+                count_dirty(to_send, to_send_prev, to_send_prev2,
+                            dinfo->p2m_size, &nr_dirty, &nr_hot, &nr_any);
+                if ( save_policy_iter_end(xch, &policy, iter, sent_this_iter,
+                                          nr_dirty, nr_hot,
+                                          held ? nr_any : nr_dirty,
+                                          &hold_hot) )
+                {
+                    last_iter_prev = 1;
+                    DPRINTF("Start previous to last iteration\n");
+                }
+            }
         }
+
+        memset(to_send_phase2, 0x00, bitmap_size(dinfo->p2m_size));
+
+
     } /* end of infinite for loop */
 
     DPRINTF("All memory is saved\n");
+    save_policy_done(xch, &policy);
+
+    /* The receiver reads the markers before it takes the frames */
+    if ( stripes &&
+         ((outbuf_flush(xch, ob, io_fd) < 0) ||
+          stripes_finish(stripes, &stats)) )
+    {
+        PERROR("Error when closing the data fds");
+        goto out;
+    }
+
+    if ( postcopy )
+    {
+        uint64_t pfns[MAX_BATCH_SIZE];
+        uint32_t nr;
+        unsigned long n = 0;
+
+        while ( n < dinfo->p2m_size )
+        {
+            for ( nr = 0; (nr < MAX_BATCH_SIZE) && (n < dinfo->p2m_size); n++ )
+                if ( test_bit(n, to_postcopy) )
+                    pfns[nr++] = n;
+            if ( !nr )
+                break;
+
+            i = XC_SAVE_ID_POSTCOPY;
+            if ( wrexact(io_fd, &i, sizeof(int)) ||
+                 wrexact(io_fd, &nr, sizeof(nr)) ||
+                 wrexact(io_fd, pfns, nr * sizeof(*pfns)) )
+            {
+                PERROR("Error when writing post-copy pfns");
+                goto out;
+            }
+            nr_postcopy += nr;
+        }
+        DPRINTF("%lu pages left for the post-copy phase\n", nr_postcopy);
+    }
 
     /* After last_iter, buffer the rest of pagebuf & tailbuf data into a
      * separate output buffer and flush it after the compressed page chunks.
      */
+    /*
     if (compressing)
     {
         ob = &ob_tailbuf;
         ob->pos = 0;
+        DPRINTF("Changed buffer to ob_tailbuf\n");
     }
-
+    */
     {
         struct chunk {
             int id;
@@ -1734,7 +3203,7 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
             goto out;
         }
     }
-
+    
     if ( callbacks != NULL && callbacks->toolstack_save != NULL )
     {
         int id = XC_SAVE_ID_TOOLSTACK;
@@ -1775,15 +3244,7 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
      * to enable it after the last_iter, when the XC_SAVE_ID_*
      * elements are sent.
      */
-    if (!compressing && (flags & XCFLAGS_CHECKPOINT_COMPRESS))
-    {
-        i = XC_SAVE_ID_ENABLE_COMPRESSION;
-        if ( wrexact(io_fd, &i, sizeof(int)) )
-        {
-            PERROR("Error when writing enable_compression marker");
-            goto out;
-        }
-    }
+    
 
     /* Zero terminate */
     i = 0;
@@ -2031,32 +3492,75 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
     /* Success! */
     rc = 0;
 
- out:
-    completed = 1;
-
-    if ( !rc && callbacks->postcopy )
-        callbacks->postcopy(callbacks->data);
-
-    /* guest has been resumed. Now we can compress data
-     * at our own pace.
-     */
-    if (!rc && compressing)
+    if ( callbacks->checkpoint )
     {
-        ob = &ob_pagebuf;
-        if (wrcompressed(io_fd) < 0)
+        /*
+         * Resume the guest, then finish sending the checkpoint: a captured
+         * one is compressed and sent by the pipe while the guest runs.
+         * The checkpoint callback is only made once all of it is out, as
+         * it releases the guest's network output for this epoch.
+         */
+        rc = 1;
+        if ( callbacks->postcopy )
+            callbacks->postcopy(callbacks->data);
+
+        if ( capture ? pipe_drain(pipe) : outbuf_flush(xch, ob, io_fd) )
         {
-            ERROR("Error when writing compressed data, after postcopy\n");
-            rc = 1;
+            PERROR("Error when sending checkpoint");
             goto out;
         }
-        /* Append the tailbuf data to the main outbuf */
-        if ( wrexact(io_fd, ob_tailbuf.buf, ob_tailbuf.pos) )
+        report_stats(xch, callbacks, compress_ctx, &cache_stats, &stats);
+
+        /* checkpoint_cb can spend arbitrarily long in between rounds */
+        if ( callbacks->checkpoint(callbacks->data) > 0 )
         {
-            rc = 1;
-            PERROR("Error when copying tailbuf into outbuf");
-            goto out;
+            /* reset stats timer */
+            print_stats(xch, dom, 0, &time_stats, &shadow_stats, 0);
+
+            if ( suspend_and_state(callbacks->suspend, callbacks->data, xch,
+                                   io_fd, dom, &info) )
+            {
+                ERROR("Domain appears not to have suspended");
+                goto out;
+            }
+            save_policy_suspended(&policy);
+            DPRINTF("SUSPEND shinfo %08lx\n", info.shared_info_frame);
+            print_stats(xch, dom, 0, &time_stats, &shadow_stats, 1);
+
+            start = llgettimeofday();
+            if ( read_dirty_log(xch, dom, XEN_DOMCTL_SHADOW_OP_CLEAN, &ring,
+                                HYPERCALL_BUFFER(to_send), to_send,
+                                dinfo->p2m_size, &shadow_stats) !=
+                 dinfo->p2m_size )
+            {
+                PERROR("Error flushing shadow PT");
+                goto out;
+            }
+            stats.clean_us += llgettimeofday() - start;
+
+            ob = &ob_pagebuf;
+            goto copypages;
         }
+        rc = 0;
+    }
+
+ out:
+    pipe_destroy(pipe);
+    stripes_destroy(stripes);
+    if ( bmap )
+        unmap_batch(bmap);
+    if ( map_cache )
+    {
+        xc_map_cache_stats_t map_stats;
+
+        xc_map_cache_stats(map_cache, &map_stats);
+        DPRINTF("Map cache: %"PRIu64" hits, %"PRIu64" misses\n",
+                map_stats.hits, map_stats.misses);
+        xc_map_cache_destroy(map_cache);
     }
+    free(bmap);
+    DPRINTF("Completed\n");
+    completed = 1;
 
     /* Flush last write and discard cache for file. */
     if ( ob && outbuf_flush(xch, ob, io_fd) < 0 ) {
@@ -2066,37 +3570,6 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
 
     discard_file_cache(xch, io_fd, 1 /* flush */);
 
-    /* Enable compression now, finally */
-    compressing = (flags & XCFLAGS_CHECKPOINT_COMPRESS);
-
-    /* checkpoint_cb can spend arbitrarily long in between rounds */
-    if (!rc && callbacks->checkpoint &&
-        callbacks->checkpoint(callbacks->data) > 0)
-    {
-        /* reset stats timer */
-        print_stats(xch, dom, 0, &time_stats, &shadow_stats, 0);
-
-        rc = 1;
-        /* last_iter = 1; */
-        if ( suspend_and_state(callbacks->suspend, callbacks->data, xch,
-                               io_fd, dom, &info) )
-        {
-            ERROR("Domain appears not to have suspended");
-            goto out;
-        }
-        DPRINTF("SUSPEND shinfo %08lx\n", info.shared_info_frame);
-        print_stats(xch, dom, 0, &time_stats, &shadow_stats, 1);
-
-        if ( xc_shadow_control(xch, dom,
-                               XEN_DOMCTL_SHADOW_OP_CLEAN, HYPERCALL_BUFFER(to_send),
-                               dinfo->p2m_size, NULL, 0, &shadow_stats) != dinfo->p2m_size )
-        {
-            PERROR("Error flushing shadow PT");
-        }
-
-        goto copypages;
-    }
-
     if ( tmem_saved != 0 && live )
         xc_tmem_save_done(xch, dom);
 
@@ -2111,7 +3584,14 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
     }
 
     if (compress_ctx)
+    {
+        xc_compression_stats_t cstats;
+
+        xc_compression_get_stats(xch, compress_ctx, &cstats);
+        DPRINTF("Delta cache: %lu pages, %"PRIu64" hits, %"PRIu64" misses\n",
+                cstats.cache_pages, cstats.cache_hits, cstats.cache_misses);
         xc_compression_free_context(xch, compress_ctx);
+    }
 
     if ( live_shinfo )
         munmap(live_shinfo, PAGE_SIZE);
@@ -2124,12 +3604,22 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iter
 
     xc_hypercall_buffer_free_pages(xch, to_send, NRPAGES(bitmap_size(dinfo->p2m_size)));
     xc_hypercall_buffer_free_pages(xch, to_skip, NRPAGES(bitmap_size(dinfo->p2m_size)));
-
+    xc_hypercall_buffer_free_pages(xch, to_send_prev, NRPAGES(bitmap_size(dinfo->p2m_size)));
+    xc_hypercall_buffer_free_pages(xch, to_send_prev2, NRPAGES(bitmap_size(dinfo->p2m_size)));
+    xc_hypercall_buffer_free_pages(xch, to_send_phase2, NRPAGES(bitmap_size(dinfo->p2m_size)));
+    xc_hypercall_buffer_free_pages(xch, dirty_pfns, NRPAGES(DIRTY_RING_ENTRIES * sizeof(uint64_t)));
+    if ( ring.hits || ring.misses )
+        DPRINTF("Dirty log read through the pfn ring %lu times out of %lu\n",
+                ring.hits, ring.hits + ring.misses);
     free(pfn_type);
     free(pfn_batch);
     free(pfn_err);
+    free(page_refs);
+    free(dedup);
     free(to_fix);
+    free(to_postcopy);
     free(hvm_buf);
+    free(codec_buf);
     outbuf_free(&ob_pagebuf);
 
     DPRINTF("Save exit of domid %u with rc=%d\n", dom, rc);
@@ -29,98 +29,221 @@ xc_hypercall_buffer_t XC__HYPERCALL_BUFFER_NAME(HYPERCALL_BUFFER_NULL) = {
     HYPERCALL_BUFFER_INIT_NO_BOUNCE
 };
 
-pthread_mutex_t hypercall_buffer_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Each thread is handed a number on its first hypercall buffer and uses
+ * the shard of that number in every interface it allocates from.
+ */
+static pthread_key_t hypercall_buffer_shard_pkey;
+static pthread_once_t hypercall_buffer_shard_pkey_once = PTHREAD_ONCE_INIT;
+static unsigned long hypercall_buffer_next_thread;
 
-static void hypercall_buffer_cache_lock(xc_interface *xch)
+static void hypercall_buffer_shard_init(void)
+{
+    pthread_key_create(&hypercall_buffer_shard_pkey, NULL);
+}
+
+static struct xc_hypercall_buffer_shard *
+hypercall_buffer_shard(xc_interface *xch)
+{
+    unsigned long idx;
+
+    if ( xch->flags & XC_OPENFLAG_NON_REENTRANT )
+        return &xch->hypercall_buffer_shard[0];
+
+    pthread_once(&hypercall_buffer_shard_pkey_once,
+                 hypercall_buffer_shard_init);
+
+    idx = (unsigned long)pthread_getspecific(hypercall_buffer_shard_pkey);
+    if ( idx == 0 )
+    {
+        /* Stored plus one, as NULL is an unset key */
+        idx = __sync_add_and_fetch(&hypercall_buffer_next_thread, 1);
+        pthread_setspecific(hypercall_buffer_shard_pkey, (void *)idx);
+    }
+
+    return &xch->hypercall_buffer_shard[(idx - 1) % HYPERCALL_BUFFER_SHARDS];
+}
+
+static void hypercall_buffer_cache_lock(xc_interface *xch,
+                                        struct xc_hypercall_buffer_shard *s)
 {
     if ( xch->flags & XC_OPENFLAG_NON_REENTRANT )
         return;
-    pthread_mutex_lock(&hypercall_buffer_cache_mutex);
+    pthread_mutex_lock(&s->lock);
 }
 
-static void hypercall_buffer_cache_unlock(xc_interface *xch)
+static void hypercall_buffer_cache_unlock(xc_interface *xch,
+                                          struct xc_hypercall_buffer_shard *s)
 {
     if ( xch->flags & XC_OPENFLAG_NON_REENTRANT )
         return;
-    pthread_mutex_unlock(&hypercall_buffer_cache_mutex);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * The size class of an allocation, or -1 if it is too big to pool.
+ * Pooled allocations are rounded up to the size of their class.
+ */
+static int hypercall_buffer_class(int nr_pages)
+{
+    int class = 0;
+
+    while ( (1 << class) < nr_pages )
+        if ( ++class == HYPERCALL_BUFFER_CLASSES )
+            return -1;
+    return class;
+}
+
+static int hypercall_buffer_class_pages(int nr_pages)
+{
+    int class = hypercall_buffer_class(nr_pages);
+
+    return class < 0 ? nr_pages : 1 << class;
+}
+
+/* Buffers cached per class, so that each class holds about as many pages */
+#define hypercall_buffer_class_depth(class) \
+    (HYPERCALL_BUFFER_CLASS_PAGES >> (class))
+
+static void hypercall_buffer_account_alloc(xc_interface *xch)
+{
+    unsigned long cur, max;
+
+    cur = __sync_add_and_fetch(&xch->hypercall_buffer_current_allocations, 1);
+    while ( cur > (max = xch->hypercall_buffer_maximum_allocations) &&
+            !__sync_bool_compare_and_swap(
+                &xch->hypercall_buffer_maximum_allocations, max, cur) )
+        continue;
 }
 
 static void *hypercall_buffer_cache_alloc(xc_interface *xch, int nr_pages)
 {
+    struct xc_hypercall_buffer_shard *s = hypercall_buffer_shard(xch);
+    int class = hypercall_buffer_class(nr_pages);
     void *p = NULL;
 
-    hypercall_buffer_cache_lock(xch);
+    hypercall_buffer_account_alloc(xch);
+
+    hypercall_buffer_cache_lock(xch, s);
 
-    xch->hypercall_buffer_total_allocations++;
-    xch->hypercall_buffer_current_allocations++;
-    if ( xch->hypercall_buffer_current_allocations > xch->hypercall_buffer_maximum_allocations )
-        xch->hypercall_buffer_maximum_allocations = xch->hypercall_buffer_current_allocations;
+    s->total_allocations++;
 
-    if ( nr_pages > 1 )
+    if ( class < 0 )
     {
-        xch->hypercall_buffer_cache_toobig++;
+        s->cache_toobig++;
     }
-    else if ( xch->hypercall_buffer_cache_nr > 0 )
+    else if ( s->nr[class] > 0 )
     {
-        p = xch->hypercall_buffer_cache[--xch->hypercall_buffer_cache_nr];
-        xch->hypercall_buffer_cache_hits++;
+        p = s->cache[class][--s->nr[class]];
+        s->cache_hits++;
     }
     else
     {
-        xch->hypercall_buffer_cache_misses++;
+        s->cache_misses++;
     }
 
-    hypercall_buffer_cache_unlock(xch);
+    hypercall_buffer_cache_unlock(xch, s);
 
     return p;
 }
 
 static int hypercall_buffer_cache_free(xc_interface *xch, void *p, int nr_pages)
 {
+    struct xc_hypercall_buffer_shard *s = hypercall_buffer_shard(xch);
+    int class = hypercall_buffer_class(nr_pages);
     int rc = 0;
 
-    hypercall_buffer_cache_lock(xch);
+    __sync_sub_and_fetch(&xch->hypercall_buffer_current_allocations, 1);
 
-    xch->hypercall_buffer_total_releases++;
-    xch->hypercall_buffer_current_allocations--;
+    hypercall_buffer_cache_lock(xch, s);
 
-    if ( nr_pages == 1 && xch->hypercall_buffer_cache_nr < HYPERCALL_BUFFER_CACHE_SIZE )
+    s->total_releases++;
+
+    if ( class >= 0 && s->nr[class] < hypercall_buffer_class_depth(class) )
     {
-        xch->hypercall_buffer_cache[xch->hypercall_buffer_cache_nr++] = p;
+        s->cache[class][s->nr[class]++] = p;
         rc = 1;
     }
 
-    hypercall_buffer_cache_unlock(xch);
+    hypercall_buffer_cache_unlock(xch, s);
 
     return rc;
 }
 
+void xc__hypercall_buffer_cache_init(xc_interface *xch)
+{
+    int i;
+
+    memset(xch->hypercall_buffer_shard, 0, sizeof(xch->hypercall_buffer_shard));
+    for ( i = 0; i < HYPERCALL_BUFFER_SHARDS; i++ )
+        pthread_mutex_init(&xch->hypercall_buffer_shard[i].lock, NULL);
+    xch->hypercall_buffer_current_allocations = 0;
+    xch->hypercall_buffer_maximum_allocations = 0;
+}
+
+int xc_hypercall_buffer_stats(xc_interface *xch,
+                              xc_hypercall_buffer_stats_t *stats)
+{
+    struct xc_hypercall_buffer_shard *s;
+    int i, class;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for ( i = 0; i < HYPERCALL_BUFFER_SHARDS; i++ )
+    {
+        s = &xch->hypercall_buffer_shard[i];
+
+        hypercall_buffer_cache_lock(xch, s);
+        stats->total_allocations += s->total_allocations;
+        stats->total_releases += s->total_releases;
+        stats->cache_hits += s->cache_hits;
+        stats->cache_misses += s->cache_misses;
+        stats->cache_toobig += s->cache_toobig;
+        for ( class = 0; class < HYPERCALL_BUFFER_CLASSES; class++ )
+            stats->cache_pages += s->nr[class] << class;
+        hypercall_buffer_cache_unlock(xch, s);
+    }
+
+    stats->current_allocations = xch->hypercall_buffer_current_allocations;
+    stats->maximum_allocations = xch->hypercall_buffer_maximum_allocations;
+
+    return 0;
+}
+
 void xc__hypercall_buffer_cache_release(xc_interface *xch)
 {
+    xc_hypercall_buffer_stats_t stats;
+    struct xc_hypercall_buffer_shard *s;
+    int i, class;
     void *p;
 
-    hypercall_buffer_cache_lock(xch);
-
-    DBGPRINTF("hypercall buffer: total allocations:%d total releases:%d",
-              xch->hypercall_buffer_total_allocations,
-              xch->hypercall_buffer_total_releases);
-    DBGPRINTF("hypercall buffer: current allocations:%d maximum allocations:%d",
-              xch->hypercall_buffer_current_allocations,
-              xch->hypercall_buffer_maximum_allocations);
-    DBGPRINTF("hypercall buffer: cache current size:%d",
-              xch->hypercall_buffer_cache_nr);
-    DBGPRINTF("hypercall buffer: cache hits:%d misses:%d toobig:%d",
-              xch->hypercall_buffer_cache_hits,
-              xch->hypercall_buffer_cache_misses,
-              xch->hypercall_buffer_cache_toobig);
-
-    while ( xch->hypercall_buffer_cache_nr > 0 )
+    xc_hypercall_buffer_stats(xch, &stats);
+
+    DBGPRINTF("hypercall buffer: total allocations:%lu total releases:%lu",
+              stats.total_allocations, stats.total_releases);
+    DBGPRINTF("hypercall buffer: current allocations:%lu maximum allocations:%lu",
+              stats.current_allocations, stats.maximum_allocations);
+    DBGPRINTF("hypercall buffer: cache current size:%lu pages",
+              stats.cache_pages);
+    DBGPRINTF("hypercall buffer: cache hits:%lu misses:%lu toobig:%lu",
+              stats.cache_hits, stats.cache_misses, stats.cache_toobig);
+
+    for ( i = 0; i < HYPERCALL_BUFFER_SHARDS; i++ )
     {
-        p = xch->hypercall_buffer_cache[--xch->hypercall_buffer_cache_nr];
-        xch->ops->u.privcmd.free_hypercall_buffer(xch, xch->ops_handle, p, 1);
+        s = &xch->hypercall_buffer_shard[i];
+
+        hypercall_buffer_cache_lock(xch, s);
+        for ( class = 0; class < HYPERCALL_BUFFER_CLASSES; class++ )
+            while ( s->nr[class] > 0 )
+            {
+                p = s->cache[class][--s->nr[class]];
+                xch->ops->u.privcmd.free_hypercall_buffer(xch, xch->ops_handle,
+                                                          p, 1 << class);
+            }
+        hypercall_buffer_cache_unlock(xch, s);
+
+        pthread_mutex_destroy(&s->lock);
     }
-
-    hypercall_buffer_cache_unlock(xch);
 }
 
 void *xc__hypercall_buffer_alloc_pages(xc_interface *xch, xc_hypercall_buffer_t *b, int nr_pages)
@@ -128,7 +251,8 @@ void *xc__hypercall_buffer_alloc_pages(xc_interface *xch, xc_hypercall_buffer_t
     void *p = hypercall_buffer_cache_alloc(xch, nr_pages);
 
     if ( !p )
-        p = xch->ops->u.privcmd.alloc_hypercall_buffer(xch, xch->ops_handle, nr_pages);
+        p = xch->ops->u.privcmd.alloc_hypercall_buffer(
+            xch, xch->ops_handle, hypercall_buffer_class_pages(nr_pages));
 
     if (!p)
         return NULL;
@@ -146,7 +270,9 @@ void xc__hypercall_buffer_free_pages(xc_interface *xch, xc_hypercall_buffer_t *b
         return;
 
     if ( !hypercall_buffer_cache_free(xch, b->hbuf, nr_pages) )
-        xch->ops->u.privcmd.free_hypercall_buffer(xch, xch->ops_handle, b->hbuf, nr_pages);
+        xch->ops->u.privcmd.free_hypercall_buffer(
+            xch, xch->ops_handle, b->hbuf,
+            hypercall_buffer_class_pages(nr_pages));
 }
 
 struct allocation_header {
@@ -0,0 +1,378 @@
+/******************************************************************************
+ * xc_map_cache.c
+ *
+ * Cache of foreign mappings: aligned windows of a domain's pfn space are
+ * kept mapped between uses, so that callers visiting the same pages over
+ * and over do not pay for a map and an unmap (and the TLB flush that goes
+ * with it) each time.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <pthread.h>
+
+#include "xc_private.h"
+
+#define WINDOW_SHIFT 9
+#define WINDOW_PAGES (1UL << WINDOW_SHIFT)
+
+struct map_window {
+    xen_pfn_t base;             /* first pfn */
+    char *addr;
+    unsigned int refs;          /* pages handed out and not yet put back */
+    int stale;                  /* invalidated while in use */
+    struct map_window *next;    /* hash chain, or the stale list */
+    struct map_window *lru_prev, *lru_next; /* when refs == 0 */
+    xen_pfn_t frames[WINDOW_PAGES];
+    int err[WINDOW_PAGES];
+};
+
+struct xc_map_cache {
+    xc_interface *xch;
+    uint32_t dom;
+    int prot;
+    xen_pfn_t (*frame)(void *data, xen_pfn_t pfn);
+    void *data;
+
+    pthread_mutex_t lock;
+    struct map_window **hash;
+    unsigned int hash_mask;
+    unsigned int nr_windows, max_windows;
+    struct map_window *lru_head, *lru_tail; /* least recently used first */
+    struct map_window *stale;
+    xc_map_cache_stats_t stats;
+};
+
+static struct map_window **hash_slot(xc_map_cache_t *c, xen_pfn_t base)
+{
+    return &c->hash[(base >> WINDOW_SHIFT) & c->hash_mask];
+}
+
+static struct map_window *hash_find(xc_map_cache_t *c, xen_pfn_t base)
+{
+    struct map_window *w;
+
+    for ( w = *hash_slot(c, base); w != NULL; w = w->next )
+        if ( w->base == base )
+            return w;
+    return NULL;
+}
+
+static void hash_remove(xc_map_cache_t *c, struct map_window *w)
+{
+    struct map_window **pw;
+
+    for ( pw = hash_slot(c, w->base); *pw != w; pw = &(*pw)->next )
+        continue;
+    *pw = w->next;
+    w->next = NULL;
+}
+
+static void lru_remove(xc_map_cache_t *c, struct map_window *w)
+{
+    if ( w->lru_prev )
+        w->lru_prev->lru_next = w->lru_next;
+    else
+        c->lru_head = w->lru_next;
+    if ( w->lru_next )
+        w->lru_next->lru_prev = w->lru_prev;
+    else
+        c->lru_tail = w->lru_prev;
+    w->lru_prev = w->lru_next = NULL;
+}
+
+static void lru_add(xc_map_cache_t *c, struct map_window *w)
+{
+    w->lru_prev = c->lru_tail;
+    w->lru_next = NULL;
+    if ( c->lru_tail )
+        c->lru_tail->lru_next = w;
+    else
+        c->lru_head = w;
+    c->lru_tail = w;
+}
+
+static void window_unmap(xc_map_cache_t *c, struct map_window *w)
+{
+    munmap(w->addr, WINDOW_PAGES * PAGE_SIZE);
+    free(w);
+    c->nr_windows--;
+    c->stats.unmaps++;
+}
+
+/* Take a window out of the cache; it goes once nobody is using it. */
+static void window_retire(xc_map_cache_t *c, struct map_window *w)
+{
+    hash_remove(c, w);
+    if ( w->refs == 0 )
+    {
+        lru_remove(c, w);
+        window_unmap(c, w);
+    }
+    else
+    {
+        w->stale = 1;
+        w->next = c->stale;
+        c->stale = w;
+    }
+}
+
+static struct map_window *window_map(xc_map_cache_t *c, xen_pfn_t base)
+{
+    xc_interface *xch = c->xch;
+    struct map_window *w;
+    unsigned long i;
+
+    /* Make room, if there is a window nobody is using */
+    while ( c->nr_windows >= c->max_windows && c->lru_head )
+    {
+        w = c->lru_head;
+        hash_remove(c, w);
+        lru_remove(c, w);
+        window_unmap(c, w);
+    }
+
+    w = calloc(1, sizeof(*w));
+    if ( w == NULL )
+        return NULL;
+
+    w->base = base;
+    for ( i = 0; i < WINDOW_PAGES; i++ )
+        w->frames[i] = c->frame ? c->frame(c->data, base + i) : base + i;
+
+    w->addr = xc_map_foreign_bulk(xch, c->dom, c->prot, w->frames, w->err,
+                                  WINDOW_PAGES);
+    if ( w->addr == NULL )
+    {
+        PERROR("Could not map pfns 0x%lx-0x%lx of dom %u", (unsigned long)base,
+               (unsigned long)(base + WINDOW_PAGES - 1), c->dom);
+        free(w);
+        return NULL;
+    }
+
+    w->next = *hash_slot(c, base);
+    *hash_slot(c, base) = w;
+    lru_add(c, w);
+    c->nr_windows++;
+    c->stats.maps++;
+
+    return w;
+}
+
+xc_map_cache_t *xc_map_cache_create(xc_interface *xch, uint32_t dom, int prot,
+                                    unsigned long max_pages,
+                                    xen_pfn_t (*frame)(void *data,
+                                                       xen_pfn_t pfn),
+                                    void *data)
+{
+    xc_map_cache_t *c;
+    unsigned int nr_hash = 1;
+
+    c = calloc(1, sizeof(*c));
+    if ( c == NULL )
+        return NULL;
+
+    c->xch = xch;
+    c->dom = dom;
+    c->prot = prot;
+    c->frame = frame;
+    c->data = data;
+    c->max_windows = (max_pages + WINDOW_PAGES - 1) >> WINDOW_SHIFT;
+    if ( c->max_windows == 0 )
+        c->max_windows = 1;
+
+    while ( nr_hash < 2 * c->max_windows )
+        nr_hash <<= 1;
+    c->hash_mask = nr_hash - 1;
+    c->hash = calloc(nr_hash, sizeof(*c->hash));
+    if ( c->hash == NULL )
+    {
+        free(c);
+        return NULL;
+    }
+
+    pthread_mutex_init(&c->lock, NULL);
+
+    return c;
+}
+
+void xc_map_cache_destroy(xc_map_cache_t *c)
+{
+    struct map_window *w;
+    unsigned int i;
+
+    if ( c == NULL )
+        return;
+
+    for ( i = 0; i <= c->hash_mask; i++ )
+        while ( (w = c->hash[i]) != NULL )
+        {
+            c->hash[i] = w->next;
+            window_unmap(c, w);
+        }
+    while ( (w = c->stale) != NULL )
+    {
+        c->stale = w->next;
+        window_unmap(c, w);
+    }
+
+    pthread_mutex_destroy(&c->lock);
+    free(c->hash);
+    free(c);
+}
+
+void *xc_map_foreign_cached(xc_map_cache_t *c, xen_pfn_t pfn)
+{
+    xen_pfn_t base = pfn & ~(WINDOW_PAGES - 1);
+    unsigned long off = pfn - base;
+    struct map_window *w;
+    void *page = NULL;
+    int err;
+
+    pthread_mutex_lock(&c->lock);
+
+    w = hash_find(c, base);
+    /* The p2m changed since the window was mapped, or the page was
+     * paged out: try again with a fresh window. */
+    if ( w != NULL &&
+         ((c->frame && w->frames[off] != c->frame(c->data, pfn)) ||
+          w->err[off] == -ENOENT) )
+    {
+        window_retire(c, w);
+        w = NULL;
+    }
+
+    if ( w != NULL )
+        c->stats.hits++;
+    else if ( (w = window_map(c, base)) == NULL )
+    {
+        err = errno;
+        pthread_mutex_unlock(&c->lock);
+        errno = err;
+        return NULL;
+    }
+    else
+        c->stats.misses++;
+
+    if ( w->err[off] )
+    {
+        err = -w->err[off];
+        if ( w->refs == 0 )
+        {
+            lru_remove(c, w);
+            lru_add(c, w);
+        }
+        pthread_mutex_unlock(&c->lock);
+        errno = err;
+        return NULL;
+    }
+
+    if ( w->refs++ == 0 )
+        lru_remove(c, w);
+    page = w->addr + off * PAGE_SIZE;
+
+    pthread_mutex_unlock(&c->lock);
+
+    return page;
+}
+
+void xc_unmap_foreign_cached(xc_map_cache_t *c, xen_pfn_t pfn, void *page)
+{
+    xen_pfn_t base = pfn & ~(WINDOW_PAGES - 1);
+    struct map_window *w, **pw;
+
+    pthread_mutex_lock(&c->lock);
+
+    w = hash_find(c, base);
+    if ( w == NULL || (char *)page != w->addr + (pfn - base) * PAGE_SIZE )
+    {
+        /* Invalidated since it was handed out */
+        for ( pw = &c->stale; (w = *pw) != NULL; pw = &w->next )
+            if ( w->base == base &&
+                 (char *)page == w->addr + (pfn - base) * PAGE_SIZE )
+                break;
+        if ( w == NULL )
+        {
+            xc_interface *xch = c->xch;
+
+            ERROR("%s: pfn 0x%lx at %p is not from the cache", __func__,
+                  (unsigned long)pfn, page);
+            pthread_mutex_unlock(&c->lock);
+            return;
+        }
+        if ( --w->refs == 0 )
+        {
+            *pw = w->next;
+            window_unmap(c, w);
+        }
+    }
+    else if ( --w->refs == 0 )
+        lru_add(c, w);
+
+    pthread_mutex_unlock(&c->lock);
+}
+
+void xc_map_cache_invalidate(xc_map_cache_t *c, xen_pfn_t pfn,
+                             unsigned long nr)
+{
+    struct map_window *w, *next;
+    xen_pfn_t base, end = pfn + nr;
+    unsigned int i;
+
+    if ( nr == 0 )
+        return;
+    if ( end < pfn )
+        end = ~(xen_pfn_t)0;
+
+    pthread_mutex_lock(&c->lock);
+
+    if ( (end - pfn) >> WINDOW_SHIFT > c->hash_mask )
+    {
+        for ( i = 0; i <= c->hash_mask; i++ )
+            for ( w = c->hash[i]; w != NULL; w = next )
+            {
+                next = w->next;
+                if ( w->base + WINDOW_PAGES > pfn && w->base < end )
+                    window_retire(c, w);
+            }
+    }
+    else
+    {
+        for ( base = pfn & ~(WINDOW_PAGES - 1); base < end;
+              base += WINDOW_PAGES )
+            if ( (w = hash_find(c, base)) != NULL )
+                window_retire(c, w);
+    }
+
+    pthread_mutex_unlock(&c->lock);
+}
+
+void xc_map_cache_stats(xc_map_cache_t *c, xc_map_cache_stats_t *stats)
+{
+    pthread_mutex_lock(&c->lock);
+    *stats = c->stats;
+    stats->mapped_pages = (uint64_t)c->nr_windows * WINDOW_PAGES;
+    pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -24,7 +24,8 @@
 int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iters,
                    uint32_t max_factor, uint32_t flags,
                    struct save_callbacks* callbacks, int hvm,
-                   unsigned long vm_generationid_addr)
+                   unsigned long vm_generationid_addr, uint32_t downtime_ms,
+                   const int *data_fds, unsigned int nr_data_fds)
 {
     errno = ENOSYS;
     return -1;
@@ -37,7 +38,24 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                       unsigned int hvm, unsigned int pae, int superpages,
                       int no_incr_generationid, int checkpointed_stream,
                       unsigned long *vm_generationid_addr,
-                      struct restore_callbacks *callbacks)
+                      struct restore_callbacks *callbacks,
+                      const int *data_fds, unsigned int nr_data_fds)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int xc_domain_postcopy_save(xc_interface *xch, int io_fd, int req_fd,
+                            uint32_t dom)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int xc_domain_postcopy_restore(xc_interface *xch, int io_fd, int req_fd,
+                               uint32_t dom, const xen_pfn_t *pfns,
+                               unsigned long nr,
+                               struct postcopy_callbacks *callbacks)
 {
     errno = ENOSYS;
     return -1;
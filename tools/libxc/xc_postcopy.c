@@ -0,0 +1,690 @@
+/******************************************************************************
+ * xc_postcopy.c
+ *
+ * Post-copy phase of a live migration (XCFLAGS_POSTCOPY).
+ *
+ * The sender suspends the domain after one pre-copy round and leaves the
+ * pages dirtied during it out of the stream (see xg_save_restore.h), so
+ * the downtime is bounded by sending the vcpu and device state. The
+ * receiver pages those pfns out through mem_paging, the same way
+ * tools/xenpaging does, and lets the domain run: faults on them are
+ * served by pulling the page from the sender, while the remaining pages
+ * are pulled in the background.
+ *
+ * The sender side is stateless: it answers page requests from the domain
+ * it saved, which stays suspended, until the receiver has all it needs.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#include "xc_private.h"
+#include "xc_bitops.h"
+#include "xg_private.h"
+#include "xg_save_restore.h"
+
+#include <xen/hvm/params.h>
+#include <xen/mem_event.h>
+
+/*
+ * Background pages the receiver keeps requested at once, and the most
+ * unpageable ones it asks for before taking any in. Requests are
+ * answered in order, so this bounds how much data can be queued ahead
+ * of the page a faulting vcpu waits for.
+ */
+#define POSTCOPY_PREFETCH 128
+
+/* Send one record of pages, see xg_save_restore.h */
+static int send_pages(xc_interface *xch, int io_fd, uint32_t dom,
+                      xen_pfn_t *pfns, uint64_t *wire, int *errs,
+                      unsigned int nr)
+{
+    uint32_t hdr[2] = { nr, 0 };
+    void *region;
+    unsigned int i;
+    int rc = -1;
+
+    if ( !nr )
+        return 0;
+
+    region = xc_map_foreign_bulk(xch, dom, PROT_READ, pfns, errs, nr);
+    if ( !region )
+    {
+        PERROR("Could not map post-copy pages");
+        return -1;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( errs[i] )
+        {
+            ERROR("Could not map post-copy pfn %#lx (err %d)",
+                  (unsigned long)pfns[i], errs[i]);
+            goto out;
+        }
+        wire[i] = pfns[i];
+    }
+
+    if ( write_exact(io_fd, hdr, sizeof(hdr)) ||
+         write_exact(io_fd, wire, nr * sizeof(*wire)) ||
+         write_exact(io_fd, region, nr * PAGE_SIZE) )
+    {
+        PERROR("Error when writing post-copy pages");
+        goto out;
+    }
+    rc = 0;
+
+ out:
+    munmap(region, nr * PAGE_SIZE);
+    return rc;
+}
+
+int xc_domain_postcopy_save(xc_interface *xch, int io_fd, int req_fd,
+                            uint32_t dom)
+{
+    struct pollfd pfd = { .fd = req_fd, .events = POLLIN };
+    uint64_t *reqs = NULL, *wire = NULL;
+    xen_pfn_t *pfns = NULL;
+    int *errs = NULL;
+    unsigned int nr, nr_demand, i, j;
+    unsigned long sent = 0, demand = 0;
+    long max_gpfn;
+    int end = 0, rc = -1;
+
+    if ( (max_gpfn = xc_domain_maximum_gpfn(xch, dom)) < 0 )
+    {
+        PERROR("Could not get maximum gpfn");
+        return -1;
+    }
+
+    reqs = malloc(MAX_BATCH_SIZE * sizeof(*reqs));
+    wire = malloc(MAX_BATCH_SIZE * sizeof(*wire));
+    pfns = malloc(MAX_BATCH_SIZE * sizeof(*pfns));
+    errs = malloc(MAX_BATCH_SIZE * sizeof(*errs));
+    if ( !reqs || !wire || !pfns || !errs )
+    {
+        ERROR("Could not allocate post-copy buffers");
+        goto out;
+    }
+
+    while ( !end )
+    {
+        /* Wait for a request, then take whatever else has come in */
+        nr = 0;
+        do {
+            if ( read_exact(req_fd, &reqs[nr], sizeof(*reqs)) )
+            {
+                PERROR("Error when reading post-copy requests");
+                goto out;
+            }
+            if ( reqs[nr] == XC_POSTCOPY_END )
+            {
+                end = 1;
+                break;
+            }
+            if ( (reqs[nr] & ~XC_POSTCOPY_DEMAND) > max_gpfn )
+            {
+                ERROR("Post-copy request for pfn %#"PRIx64" out of range",
+                      reqs[nr] & ~XC_POSTCOPY_DEMAND);
+                goto out;
+            }
+            nr++;
+        } while ( (nr < MAX_BATCH_SIZE) && (poll(&pfd, 1, 0) > 0) );
+
+        /* What the domain waits for goes in a record of its own, first */
+        for ( i = j = 0; i < nr; i++ )
+            if ( reqs[i] & XC_POSTCOPY_DEMAND )
+                pfns[j++] = reqs[i] & ~XC_POSTCOPY_DEMAND;
+        nr_demand = j;
+        for ( i = 0; i < nr; i++ )
+            if ( !(reqs[i] & XC_POSTCOPY_DEMAND) )
+                pfns[j++] = reqs[i];
+
+        if ( send_pages(xch, io_fd, dom, pfns, wire, errs, nr_demand) ||
+             send_pages(xch, io_fd, dom, pfns + nr_demand, wire, errs,
+                        nr - nr_demand) )
+            goto out;
+
+        sent += nr;
+        demand += nr_demand;
+    }
+
+    DPRINTF("Post-copy: sent %lu pages, %lu on demand\n", sent, demand);
+    rc = 0;
+
+ out:
+    free(reqs);
+    free(wire);
+    free(pfns);
+    free(errs);
+    return rc;
+}
+
+struct postcopy_pager {
+    xc_interface *xch;
+    uint32_t dom;
+    int io_fd, req_fd;
+
+    /* mem_event ring, set up the way xenpaging does */
+    xc_evtchn *xce_handle;
+    int port;
+    uint32_t evtchn_port;
+    void *ring_page;
+    mem_event_back_ring_t back_ring;
+    int enabled;
+
+    unsigned long max_pfn;
+    unsigned long *absent;      /* paged out and not loaded yet */
+    unsigned long *direct;      /* could not be paged out, written in place */
+    unsigned long *requested;   /* asked of the sender, not yet received */
+    unsigned long nr_absent, nr_direct, inflight;
+
+    /* Faults waiting for their page */
+    mem_event_request_t *waiting;
+    unsigned int nr_waiting, max_waiting;
+
+    /* The record being received */
+    uint64_t *wire;
+    void *pages;
+
+    unsigned long faults, loaded;
+};
+
+static int pager_ring_init(struct postcopy_pager *p)
+{
+    xc_interface *xch = p->xch;
+    unsigned long ring_pfn, mmap_pfn;
+    int rc;
+
+    if ( xc_get_hvm_param(xch, p->dom, HVM_PARAM_PAGING_RING_PFN, &ring_pfn) )
+    {
+        PERROR("Failed to get paging ring pfn");
+        return -1;
+    }
+
+    mmap_pfn = ring_pfn;
+    p->ring_page = xc_map_foreign_batch(xch, p->dom, PROT_READ | PROT_WRITE,
+                                        &mmap_pfn, 1);
+    if ( mmap_pfn & XEN_DOMCTL_PFINFO_XTAB )
+    {
+        /* Map failed, populate ring page */
+        if ( p->ring_page )
+            munmap(p->ring_page, PAGE_SIZE);
+        p->ring_page = NULL;
+        if ( xc_domain_populate_physmap_exact(xch, p->dom, 1, 0, 0,
+                                              &ring_pfn) )
+        {
+            PERROR("Failed to populate ring gfn");
+            return -1;
+        }
+        mmap_pfn = ring_pfn;
+        p->ring_page = xc_map_foreign_batch(xch, p->dom,
+                                            PROT_READ | PROT_WRITE,
+                                            &mmap_pfn, 1);
+        if ( mmap_pfn & XEN_DOMCTL_PFINFO_XTAB )
+        {
+            PERROR("Could not map the ring page");
+            return -1;
+        }
+    }
+
+    if ( xc_mem_paging_enable(xch, p->dom, &p->evtchn_port) )
+    {
+        PERROR("Could not enable paging for post-copy");
+        return -1;
+    }
+    p->enabled = 1;
+
+    p->xce_handle = xc_evtchn_open(NULL, 0);
+    if ( !p->xce_handle )
+    {
+        PERROR("Failed to open event channel");
+        return -1;
+    }
+
+    rc = xc_evtchn_bind_interdomain(p->xce_handle, p->dom, p->evtchn_port);
+    if ( rc < 0 )
+    {
+        PERROR("Failed to bind event channel");
+        return -1;
+    }
+    p->port = rc;
+
+    SHARED_RING_INIT((mem_event_sring_t *)p->ring_page);
+    BACK_RING_INIT(&p->back_ring, (mem_event_sring_t *)p->ring_page,
+                   PAGE_SIZE);
+
+    /* Now that the ring is set, remove it from the guest's physmap */
+    if ( xc_domain_decrease_reservation_exact(xch, p->dom, 1, 0, &ring_pfn) )
+        PERROR("Failed to remove ring from guest physmap");
+
+    return 0;
+}
+
+static void pager_ring_fini(struct postcopy_pager *p)
+{
+    xc_interface *xch = p->xch;
+
+    if ( p->ring_page )
+        munmap(p->ring_page, PAGE_SIZE);
+    if ( p->enabled && xc_mem_paging_disable(xch, p->dom) )
+        PERROR("Error tearing down domain paging in xen");
+    if ( p->xce_handle )
+    {
+        if ( p->port >= 0 )
+            xc_evtchn_unbind(p->xce_handle, p->port);
+        xc_evtchn_close(p->xce_handle);
+    }
+}
+
+static int pager_request(struct postcopy_pager *p, unsigned long pfn,
+                         uint64_t flags)
+{
+    xc_interface *xch = p->xch;
+    uint64_t req = pfn | flags;
+
+    if ( write_exact(p->req_fd, &req, sizeof(req)) )
+    {
+        PERROR("Error when requesting post-copy pfn %#lx", pfn);
+        return -1;
+    }
+    set_bit(pfn, p->requested);
+    p->inflight++;
+    return 0;
+}
+
+static int pager_resume(struct postcopy_pager *p,
+                        const mem_event_request_t *req)
+{
+    mem_event_response_t rsp;
+    RING_IDX rsp_prod = p->back_ring.rsp_prod_pvt;
+
+    memset(&rsp, 0, sizeof(rsp));
+    rsp.gfn = req->gfn;
+    rsp.vcpu_id = req->vcpu_id;
+    rsp.flags = req->flags;
+
+    memcpy(RING_GET_RESPONSE(&p->back_ring, rsp_prod), &rsp, sizeof(rsp));
+    p->back_ring.rsp_prod_pvt = rsp_prod + 1;
+    RING_PUSH_RESPONSES(&p->back_ring);
+
+    return xc_evtchn_notify(p->xce_handle, p->port);
+}
+
+/* Take the domain's faults off the ring */
+static int pager_faults(struct postcopy_pager *p)
+{
+    xc_interface *xch = p->xch;
+    mem_event_request_t req;
+    RING_IDX req_cons;
+    void *tmp;
+
+    while ( RING_HAS_UNCONSUMED_REQUESTS(&p->back_ring) )
+    {
+        req_cons = p->back_ring.req_cons;
+        memcpy(&req, RING_GET_REQUEST(&p->back_ring, req_cons), sizeof(req));
+        p->back_ring.req_cons = ++req_cons;
+        p->back_ring.sring->req_event = req_cons + 1;
+
+        if ( (req.gfn > p->max_pfn) || !test_bit(req.gfn, p->absent) )
+        {
+            /* Loaded meanwhile, or never paged out */
+            if ( (req.flags & (MEM_EVENT_FLAG_VCPU_PAUSED |
+                               MEM_EVENT_FLAG_EVICT_FAIL)) &&
+                 pager_resume(p, &req) < 0 )
+                return -1;
+            continue;
+        }
+
+        if ( req.flags & MEM_EVENT_FLAG_DROP_PAGE )
+        {
+            /* Ballooned out: whatever the sender has is not wanted */
+            clear_bit(req.gfn, p->absent);
+            p->nr_absent--;
+            if ( pager_resume(p, &req) < 0 )
+                return -1;
+            continue;
+        }
+
+        p->faults++;
+        if ( p->nr_waiting == p->max_waiting )
+        {
+            tmp = realloc(p->waiting, (p->max_waiting + 16) *
+                          sizeof(*p->waiting));
+            if ( !tmp )
+            {
+                ERROR("Could not allocate post-copy fault list");
+                return -1;
+            }
+            p->waiting = tmp;
+            p->max_waiting += 16;
+        }
+        p->waiting[p->nr_waiting++] = req;
+
+        if ( !test_bit(req.gfn, p->requested) &&
+             pager_request(p, req.gfn, XC_POSTCOPY_DEMAND) )
+            return -1;
+    }
+
+    return 0;
+}
+
+static int pager_load(struct postcopy_pager *p, unsigned long pfn, void *page)
+{
+    xc_interface *xch = p->xch;
+    unsigned int i, oom = 0;
+
+    while ( xc_mem_paging_load(xch, p->dom, pfn, page) )
+    {
+        /* Dropped before we saw the request */
+        if ( errno == ENOENT )
+            break;
+        if ( errno != ENOMEM )
+        {
+            PERROR("Error loading post-copy pfn %#lx", pfn);
+            return -1;
+        }
+        if ( oom++ == 0 )
+            DPRINTF("ENOMEM while loading post-copy pfn %#lx\n", pfn);
+        sleep(1);
+    }
+    p->loaded++;
+
+    /* Resume whoever faulted on it */
+    for ( i = 0; i < p->nr_waiting; )
+    {
+        if ( p->waiting[i].gfn != pfn )
+        {
+            i++;
+            continue;
+        }
+        if ( pager_resume(p, &p->waiting[i]) < 0 )
+            return -1;
+        p->waiting[i] = p->waiting[--p->nr_waiting];
+    }
+
+    return 0;
+}
+
+static int pager_write_direct(struct postcopy_pager *p, unsigned long pfn,
+                              const void *data)
+{
+    xc_interface *xch = p->xch;
+    void *page;
+
+    page = xc_map_foreign_range(xch, p->dom, PAGE_SIZE, PROT_WRITE, pfn);
+    if ( !page )
+    {
+        PERROR("Could not map post-copy pfn %#lx", pfn);
+        return -1;
+    }
+    memcpy(page, data, PAGE_SIZE);
+    munmap(page, PAGE_SIZE);
+    return 0;
+}
+
+/* Read one record of pages from the sender and put them in place */
+static int pager_receive(struct postcopy_pager *p)
+{
+    xc_interface *xch = p->xch;
+    uint32_t hdr[2];
+    unsigned long pfn;
+    char *page;
+    unsigned int i;
+
+    if ( read_exact(p->io_fd, hdr, sizeof(hdr)) )
+    {
+        PERROR("Error when reading post-copy record");
+        return -1;
+    }
+    if ( !hdr[0] || (hdr[0] > MAX_BATCH_SIZE) )
+    {
+        ERROR("Bad post-copy record of %u pages", hdr[0]);
+        errno = EINVAL;
+        return -1;
+    }
+    if ( read_exact(p->io_fd, p->wire, hdr[0] * sizeof(*p->wire)) ||
+         read_exact(p->io_fd, p->pages, hdr[0] * PAGE_SIZE) )
+    {
+        PERROR("Error when reading post-copy pages");
+        return -1;
+    }
+
+    for ( i = 0; i < hdr[0]; i++ )
+    {
+        pfn = p->wire[i];
+        page = (char *)p->pages + i * PAGE_SIZE;
+
+        if ( (p->wire[i] > p->max_pfn) ||
+             !test_and_clear_bit(pfn, p->requested) )
+        {
+            ERROR("Post-copy pfn %#"PRIx64" was not requested", p->wire[i]);
+            errno = EINVAL;
+            return -1;
+        }
+        p->inflight--;
+
+        if ( test_and_clear_bit(pfn, p->absent) )
+        {
+            p->nr_absent--;
+            if ( pager_load(p, pfn, page) )
+                return -1;
+        }
+        else if ( test_and_clear_bit(pfn, p->direct) )
+        {
+            p->nr_direct--;
+            if ( pager_write_direct(p, pfn, page) )
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Wait for the sender or the domain, and deal with what came in */
+static int pager_wait(struct postcopy_pager *p)
+{
+    xc_interface *xch = p->xch;
+    struct pollfd fds[2];
+    int port;
+
+    fds[0].fd = xc_evtchn_fd(p->xce_handle);
+    fds[0].events = POLLIN;
+    fds[1].fd = p->io_fd;
+    fds[1].events = POLLIN;
+
+    if ( poll(fds, 2, -1) < 0 )
+    {
+        if ( errno == EINTR )
+            return 0;
+        PERROR("Poll exited with an error");
+        return -1;
+    }
+
+    if ( fds[0].revents & POLLIN )
+    {
+        port = xc_evtchn_pending(p->xce_handle);
+        if ( port < 0 || xc_evtchn_unmask(p->xce_handle, port) < 0 )
+        {
+            PERROR("Failed to read port from event channel");
+            return -1;
+        }
+    }
+    if ( pager_faults(p) )
+        return -1;
+
+    if ( (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && pager_receive(p) )
+        return -1;
+
+    return 0;
+}
+
+/* Pfns the restore zeroes or owns; their old contents are not wanted */
+static int pager_skip_pfn(xc_interface *xch, uint32_t dom, unsigned long pfn)
+{
+    static const int params[] = {
+        HVM_PARAM_IOREQ_PFN, HVM_PARAM_BUFIOREQ_PFN, HVM_PARAM_STORE_PFN,
+        HVM_PARAM_CONSOLE_PFN, HVM_PARAM_PAGING_RING_PFN,
+        HVM_PARAM_ACCESS_RING_PFN, HVM_PARAM_SHARING_RING_PFN,
+    };
+    unsigned long value;
+    unsigned int i;
+
+    for ( i = 0; i < sizeof(params) / sizeof(params[0]); i++ )
+        if ( !xc_get_hvm_param(xch, dom, params[i], &value) && value == pfn )
+            return 1;
+    return 0;
+}
+
+int xc_domain_postcopy_restore(xc_interface *xch, int io_fd, int req_fd,
+                               uint32_t dom, const xen_pfn_t *pfns,
+                               unsigned long nr,
+                               struct postcopy_callbacks *callbacks)
+{
+    struct postcopy_pager _p, *p = &_p;
+    unsigned long i, next = 0, nr_skipped = 0, nr_direct = 0;
+    uint64_t end = XC_POSTCOPY_END;
+    int rc = -1;
+
+    memset(p, 0, sizeof(*p));
+    p->xch = xch;
+    p->dom = dom;
+    p->io_fd = io_fd;
+    p->req_fd = req_fd;
+    p->port = -1;
+
+    for ( i = 0; i < nr; i++ )
+        if ( pfns[i] > p->max_pfn )
+            p->max_pfn = pfns[i];
+
+    p->absent = bitmap_alloc(p->max_pfn + 1);
+    p->direct = bitmap_alloc(p->max_pfn + 1);
+    p->requested = bitmap_alloc(p->max_pfn + 1);
+    p->wire = malloc(MAX_BATCH_SIZE * sizeof(*p->wire));
+    p->pages = xc_memalign(xch, PAGE_SIZE, MAX_BATCH_SIZE * PAGE_SIZE);
+    if ( !p->absent || !p->direct || !p->requested || !p->wire || !p->pages )
+    {
+        ERROR("Could not allocate post-copy state");
+        goto out;
+    }
+
+    if ( pager_ring_init(p) )
+        goto out;
+
+    /* Page out what the sender still has */
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( pager_skip_pfn(xch, dom, pfns[i]) )
+        {
+            nr_skipped++;
+            continue;
+        }
+
+        if ( !xc_mem_paging_nominate(xch, dom, pfns[i]) &&
+             !xc_mem_paging_evict(xch, dom, pfns[i]) )
+        {
+            set_bit(pfns[i], p->absent);
+            p->nr_absent++;
+            continue;
+        }
+
+        /* An unpageable or busy gfn is indicated by EBUSY */
+        if ( errno != EBUSY )
+        {
+            PERROR("Error paging out post-copy pfn %#lx",
+                   (unsigned long)pfns[i]);
+            goto out;
+        }
+        /*
+         * Take some of the pages in before asking for more, or the sender
+         * blocks writing them while we block writing requests.
+         */
+        while ( p->inflight >= POSTCOPY_PREFETCH )
+            if ( pager_receive(p) )
+                goto out;
+
+        set_bit(pfns[i], p->direct);
+        p->nr_direct++;
+        nr_direct++;
+        if ( pager_request(p, pfns[i], XC_POSTCOPY_DEMAND) )
+            goto out;
+    }
+
+    /* Pages that stay mapped must be in before the domain runs */
+    while ( p->nr_direct )
+        if ( pager_receive(p) )
+            goto out;
+
+    DPRINTF("Post-copy: %lu pages paged out, %lu written in place, "
+            "%lu skipped\n", p->nr_absent, nr_direct, nr_skipped);
+
+    if ( callbacks && callbacks->ready && callbacks->ready(callbacks->data) )
+    {
+        ERROR("Post-copy ready callback failed");
+        goto out;
+    }
+
+    while ( p->nr_absent || p->inflight )
+    {
+        /* Keep the background pulls going */
+        for ( ; (next < nr) && (p->inflight < POSTCOPY_PREFETCH); next++ )
+            if ( test_bit(pfns[next], p->absent) &&
+                 !test_bit(pfns[next], p->requested) &&
+                 pager_request(p, pfns[next], 0) )
+                goto out;
+
+        if ( pager_wait(p) )
+            goto out;
+    }
+
+    if ( write_exact(req_fd, &end, sizeof(end)) )
+    {
+        PERROR("Error when ending the post-copy phase");
+        goto out;
+    }
+
+    /* Answer anything that raced with the last pages */
+    if ( pager_faults(p) )
+        goto out;
+
+    DPRINTF("Post-copy: %lu pages loaded, %lu faults\n",
+            p->loaded, p->faults);
+    rc = 0;
+
+ out:
+    pager_ring_fini(p);
+    free(p->absent);
+    free(p->direct);
+    free(p->requested);
+    free(p->wire);
+    free(p->pages);
+    free(p->waiting);
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <pthread.h>
 
 #include "xenctrl.h"
 #include "xenctrlosdep.h"
@@ -78,25 +79,31 @@ struct xc_interface_core {
     const char *currently_progress_reporting;
 
     /*
-     * A simple cache of unused, single page, hypercall buffers
+     * Pools of unused hypercall buffers in size classes of 1, 2, 4 and 8
+     * pages, holding at most HYPERCALL_BUFFER_CLASS_PAGES pages per class.
+     * A thread always uses the same shard, so threads sharing an
+     * interface seldom meet on a shard lock.
      *
-     * Protected by a global lock.
+     * Statistics are kept per shard, under its lock, except for the
+     * current and maximum number of allocations which are updated
+     * atomically.
      */
-#define HYPERCALL_BUFFER_CACHE_SIZE 4
-    int hypercall_buffer_cache_nr;
-    void *hypercall_buffer_cache[HYPERCALL_BUFFER_CACHE_SIZE];
-
-    /*
-     * Hypercall buffer statistics. All protected by the global
-     * hypercall_buffer_cache lock.
-     */
-    int hypercall_buffer_total_allocations;
-    int hypercall_buffer_total_releases;
-    int hypercall_buffer_current_allocations;
-    int hypercall_buffer_maximum_allocations;
-    int hypercall_buffer_cache_hits;
-    int hypercall_buffer_cache_misses;
-    int hypercall_buffer_cache_toobig;
+#define HYPERCALL_BUFFER_SHARDS      4
+#define HYPERCALL_BUFFER_CLASSES     4
+#define HYPERCALL_BUFFER_CLASS_PAGES 8
+    struct xc_hypercall_buffer_shard {
+        pthread_mutex_t lock;
+        int nr[HYPERCALL_BUFFER_CLASSES];
+        void *cache[HYPERCALL_BUFFER_CLASSES][HYPERCALL_BUFFER_CLASS_PAGES];
+
+        unsigned long total_allocations;
+        unsigned long total_releases;
+        unsigned long cache_hits;
+        unsigned long cache_misses;
+        unsigned long cache_toobig;
+    } hypercall_buffer_shard[HYPERCALL_BUFFER_SHARDS];
+    unsigned long hypercall_buffer_current_allocations;
+    unsigned long hypercall_buffer_maximum_allocations;
 
     /* Low lovel OS interface */
     xc_osdep_info_t  osdep;
@@ -184,6 +191,7 @@ void xc__hypercall_bounce_post(xc_interface *xch, xc_hypercall_buffer_t *bounce)
 /*
  * Release hypercall buffer cache
  */
+void xc__hypercall_buffer_cache_init(xc_interface *xch);
 void xc__hypercall_buffer_cache_release(xc_interface *xch);
 
 /*
@@ -0,0 +1,153 @@
+/******************************************************************************
+ * xc_save_policy.c
+ *
+ * Iteration policy for live migration.
+ *
+ * Instead of a fixed number of iterations, estimate the link bandwidth
+ * and the guest's dirty rate from each pre-copy iteration and stop as
+ * soon as the expected downtime falls within the target:
+ *
+ *  - the last live iteration sends the pages still pending, taking
+ *    pending / bandwidth seconds;
+ *  - the guest keeps dirtying pages meanwhile, and those are what is
+ *    left to send with the domain suspended, taking
+ *    dirty_rate * (pending / bandwidth) / bandwidth seconds.
+ *
+ * If the guest dirties memory at least as fast as we can send it, more
+ * iterations will not help and we stop early rather than burning
+ * bandwidth up to max_iters.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "xc_private.h"
+#include "xc_save_policy.h"
+
+/* Rounds without catching up on the dirty rate before we give up */
+#define MAX_STALLED_ITERS 3
+
+/*
+ * Hold back hot pages when at least 1/HOT_HOLD_RATIO of the pages
+ * dirtied in an iteration were also dirtied in the one before: sending
+ * them now is likely wasted, they will only be dirty again.
+ */
+#define HOT_HOLD_RATIO 4
+
+static uint64_t now_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+void save_policy_init(struct save_policy *p, unsigned int downtime_ms,
+                      unsigned int max_iters, unsigned long max_pages)
+{
+    memset(p, 0, sizeof(*p));
+    p->downtime_ms = downtime_ms ? : DEF_DOWNTIME_MS;
+    p->max_iters = max_iters;
+    p->max_pages = max_pages;
+}
+
+void save_policy_iter_start(struct save_policy *p)
+{
+    p->iter_start = now_us();
+}
+
+/* Exponentially weighted average, new samples count for half. */
+static uint64_t smooth(uint64_t avg, uint64_t sample)
+{
+    return avg ? (avg + sample) / 2 : sample;
+}
+
+int save_policy_iter_end(xc_interface *xch, struct save_policy *p,
+                         unsigned int iter, unsigned long sent,
+                         unsigned long dirtied, unsigned long hot,
+                         unsigned long pending, int *hold_hot)
+{
+    uint64_t elapsed = now_us() - p->iter_start;
+    uint64_t live_us, final_pages, downtime_ms = UINT64_MAX;
+
+    if ( !elapsed )
+        elapsed = 1;
+
+    p->total_sent += sent;
+    if ( sent )
+        p->bandwidth = smooth(p->bandwidth, sent * 1000000ULL / elapsed);
+    p->dirty_rate = smooth(p->dirty_rate, dirtied * 1000000ULL / elapsed);
+
+    *hold_hot = hot && (hot * HOT_HOLD_RATIO >= dirtied);
+
+    if ( p->bandwidth )
+    {
+        live_us = pending * 1000000ULL / p->bandwidth;
+        final_pages = p->dirty_rate * live_us / 1000000ULL;
+        downtime_ms = final_pages * 1000ULL / p->bandwidth;
+    }
+
+    DPRINTF("Iter %u: %"PRIu64" pages/s sent, %"PRIu64" pages/s dirtied, "
+            "%lu pending (%lu hot), expected downtime %"PRIu64"ms\n",
+            iter, p->bandwidth, p->dirty_rate, pending, hot, downtime_ms);
+
+    if ( downtime_ms <= p->downtime_ms )
+        return 1;
+
+    if ( p->dirty_rate >= p->bandwidth )
+    {
+        if ( ++p->stalled >= MAX_STALLED_ITERS )
+        {
+            DPRINTF("Dirty rate exceeds bandwidth, downtime target of %ums "
+                    "cannot be met\n", p->downtime_ms);
+            return 1;
+        }
+    }
+    else
+        p->stalled = 0;
+
+    if ( iter >= p->max_iters || p->total_sent > p->max_pages )
+    {
+        DPRINTF("Iteration limit reached, downtime target of %ums "
+                "not met\n", p->downtime_ms);
+        return 1;
+    }
+
+    return 0;
+}
+
+void save_policy_suspended(struct save_policy *p)
+{
+    p->suspend_start = now_us();
+}
+
+void save_policy_done(xc_interface *xch, struct save_policy *p)
+{
+    if ( p->suspend_start )
+        DPRINTF("Memory downtime %"PRIu64"ms (target %ums)\n",
+                (now_us() - p->suspend_start) / 1000, p->downtime_ms);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,74 @@
+/******************************************************************************
+ * xc_save_policy.h
+ *
+ * Iteration policy for live migration: when to stop pre-copying and
+ * suspend the domain, and whether to hold back pages that keep getting
+ * dirtied.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef XC_SAVE_POLICY_H
+#define XC_SAVE_POLICY_H
+
+#include "xenctrl.h"
+
+/* Downtime target used when the caller passes 0 */
+#define DEF_DOWNTIME_MS 300
+
+struct save_policy {
+    /* Limits */
+    unsigned int downtime_ms;
+    unsigned int max_iters;
+    unsigned long max_pages;    /* give up after sending this many pages */
+
+    /* Smoothed estimates, in pages per second */
+    uint64_t bandwidth;
+    uint64_t dirty_rate;
+
+    unsigned long total_sent;
+    unsigned int stalled;       /* rounds in which we did not catch up */
+    uint64_t iter_start;        /* us */
+    uint64_t suspend_start;     /* us, 0 until the domain is suspended */
+};
+
+void save_policy_init(struct save_policy *p, unsigned int downtime_ms,
+                      unsigned int max_iters, unsigned long max_pages);
+
+/* Called as each pre-copy iteration starts. */
+void save_policy_iter_start(struct save_policy *p);
+
+/*
+ * Called after the dirty bitmap has been collected at the end of a
+ * pre-copy iteration.
+ *  sent    - pages sent during the iteration
+ *  dirtied - pages dirtied while it ran
+ *  hot     - pages dirtied in each of the last two iterations
+ *  pending - pages that must still be sent before suspending
+ *
+ * Sets *hold_hot to whether the next iteration should hold back pages
+ * that are still being dirtied, and returns 1 if the next iteration
+ * should be the last one before suspending the domain.
+ */
+int save_policy_iter_end(xc_interface *xch, struct save_policy *p,
+                         unsigned int iter, unsigned long sent,
+                         unsigned long dirtied, unsigned long hot,
+                         unsigned long pending, int *hold_hot);
+
+/* Bracket the stop-and-copy phase, to report the downtime achieved. */
+void save_policy_suspended(struct save_policy *p);
+void save_policy_done(xc_interface *xch, struct save_policy *p);
+
+#endif /* XC_SAVE_POLICY_H */
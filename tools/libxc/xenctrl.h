@@ -320,6 +320,24 @@ void *xc__hypercall_buffer_alloc_pages(xc_interface *xch, xc_hypercall_buffer_t
 void xc__hypercall_buffer_free_pages(xc_interface *xch, xc_hypercall_buffer_t *b, int nr_pages);
 #define xc_hypercall_buffer_free_pages(_xch, _name, _nr) xc__hypercall_buffer_free_pages(_xch, HYPERCALL_BUFFER(_name), _nr)
 
+/*
+ * Hypercall buffer allocation statistics, summed over all threads using
+ * the interface.  Requests larger than the largest pooled size count as
+ * cache_toobig and always go to the OS.
+ */
+typedef struct xc_hypercall_buffer_stats {
+    unsigned long total_allocations;
+    unsigned long total_releases;
+    unsigned long current_allocations;
+    unsigned long maximum_allocations;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    unsigned long cache_toobig;
+    unsigned long cache_pages;      /* held in the pools right now */
+} xc_hypercall_buffer_stats_t;
+int xc_hypercall_buffer_stats(xc_interface *xch,
+                              xc_hypercall_buffer_stats_t *stats);
+
 /*
  * CPUMAP handling
  */
@@ -434,6 +452,21 @@ int xc_domain_dumpcore(xc_interface *xch,
                        uint32_t domid,
                        const char *corename);
 
+/* Flags for xc_domain_dumpcore_flags
+ *  XC_DUMPCORE_SPARSE   - pages of zeroes are left as holes in the file
+ *  XC_DUMPCORE_COMPRESS - .xen_pages is written as a zlib compressed ELF
+ *                         section (SHF_COMPRESSED), by nr_threads threads
+ *                         or by the caller if nr_threads is 0
+ */
+#define XC_DUMPCORE_SPARSE   (1U << 0)
+#define XC_DUMPCORE_COMPRESS (1U << 1)
+
+int xc_domain_dumpcore_flags(xc_interface *xch,
+                             uint32_t domid,
+                             const char *corename,
+                             unsigned int flags,
+                             unsigned int nr_threads);
+
 /* Define the callback function type for xc_domain_dumpcore_via_callback.
  *
  * This function is called by the coredump code for every "write",
@@ -1287,6 +1320,51 @@ void *xc_map_foreign_batch(xc_interface *xch, uint32_t dom, int prot,
 void *xc_map_foreign_bulk(xc_interface *xch, uint32_t dom, int prot,
                           const xen_pfn_t *arr, int *err, unsigned int num);
 
+/**
+ * Foreign mapping cache.  Keeps aligned windows of a domain's pfn space
+ * mapped between calls, for code that visits the same pages over and over
+ * and would otherwise map and unmap them each time.
+ *
+ * @frame gives the frame to map for a pfn (an mfn for PV guests, or
+ * INVALID_MFN if there is none); NULL means the pfn itself, as for HVM
+ * guests.  A window is mapped again when @frame is found to have changed
+ * for the pfn looked up.  Changes that @frame cannot show, such as to an
+ * HVM guest's p2m, must be passed to xc_map_cache_invalidate().
+ *
+ * At most @max_pages are kept mapped, except while more than that are in
+ * use.
+ */
+typedef struct xc_map_cache xc_map_cache_t;
+
+typedef struct xc_map_cache_stats {
+    uint64_t hits;          /* lookups served from a mapped window */
+    uint64_t misses;        /* lookups that mapped a window */
+    uint64_t maps, unmaps;  /* windows */
+    uint64_t mapped_pages;  /* currently */
+} xc_map_cache_stats_t;
+
+xc_map_cache_t *xc_map_cache_create(xc_interface *xch, uint32_t dom, int prot,
+                                    unsigned long max_pages,
+                                    xen_pfn_t (*frame)(void *data,
+                                                       xen_pfn_t pfn),
+                                    void *data);
+void xc_map_cache_destroy(xc_map_cache_t *cache);
+
+/**
+ * Returns the address of a pfn's page, which stays mapped until it is given
+ * back with xc_unmap_foreign_cached(), or NULL with errno set as for
+ * xc_map_foreign_bulk().
+ */
+void *xc_map_foreign_cached(xc_map_cache_t *cache, xen_pfn_t pfn);
+void xc_unmap_foreign_cached(xc_map_cache_t *cache, xen_pfn_t pfn,
+                             void *page);
+
+/* Drop the cached mappings of nr pfns from pfn, once they are given back. */
+void xc_map_cache_invalidate(xc_map_cache_t *cache, xen_pfn_t pfn,
+                             unsigned long nr);
+
+void xc_map_cache_stats(xc_map_cache_t *cache, xc_map_cache_stats_t *stats);
+
 /**
  * Translates a virtual address in the context of a given domain and
  * vcpu returning the GFN containing the address (that is, an MFN for 
@@ -2233,10 +2311,63 @@ void xc_elf_set_logfile(xc_interface *xch, struct elf_binary *elf,
  * Checkpoint Compression
  */
 typedef struct compression_ctx comp_ctx;
+
+/**
+ * Create a compression context for a guest with p2m_size pfns.
+ * cache_size is the size in bytes of the page cache that deltas are
+ * computed against (rounded down to whole pages); 0 selects the default
+ * of 256MB.
+ */
 comp_ctx *xc_compression_create_context(xc_interface *xch,
-					unsigned long p2m_size);
+					unsigned long p2m_size,
+					unsigned long cache_size);
 void xc_compression_free_context(xc_interface *xch, comp_ctx *ctx);
 
+typedef struct xc_compression_stats {
+    unsigned long cache_pages;  /* number of pages in the delta cache */
+    uint64_t cache_hits;        /* pages delta compressed against the cache */
+    uint64_t cache_misses;      /* pages not in the cache, added to it */
+    /* pages sent with each encoding, whichever was shortest for the page */
+    uint64_t same_pages;        /* unchanged from the cached copy */
+    uint64_t delta_pages;       /* changed words against the cached copy */
+    uint64_t zero_pages;
+    uint64_t rle_pages;         /* run length encoded on their own */
+    uint64_t raw_pages;
+} xc_compression_stats_t;
+
+/**
+ * Report delta cache and encoding statistics accumulated since the
+ * context was created.
+ */
+void xc_compression_get_stats(xc_interface *xch, comp_ctx *ctx,
+                              xc_compression_stats_t *stats);
+
+/**
+ * Use a pool of nr_threads worker threads in xc_compression_compress_pages.
+ * The page buffer is split into windows whose pages are compressed in
+ * parallel into per-thread segments, which are then joined in page
+ * order. The compressed output is byte-identical to the single-threaded
+ * path. nr_threads <= 1 stops the pool.
+ *
+ * returns 0 on success, -1 if the pool could not be started (the context
+ *  then falls back to single-threaded compression).
+ */
+int xc_compression_set_threads(xc_interface *xch, comp_ctx *ctx,
+                               unsigned int nr_threads);
+
+/**
+ * Select the kernel used to find changed words when delta compressing
+ * a page: "scalar", "sse2" or "avx2". NULL picks the fastest kernel
+ * supported by the cpu, which is what the first
+ * xc_compression_create_context does. The choice is process-wide and
+ * does not change the compressed output.
+ *
+ * returns 0 on success, -1 (errno ENOTSUP) if the kernel is unknown or
+ *  not supported by this cpu.
+ */
+int xc_compression_set_kernel(xc_interface *xch, const char *name);
+const char *xc_compression_get_kernel(xc_interface *xch);
+
 /**
  * Add a page to compression page buffer, to be compressed later.
  *
@@ -2253,6 +2384,15 @@ void xc_compression_free_context(xc_interface *xch, comp_ctx *ctx);
 int xc_compression_add_page(xc_interface *xch, comp_ctx *ctx, char *page,
 			    unsigned long pfn, int israw);
 
+/**
+ * Drop pfn from the delta cache, for a page whose contents reached the
+ * receiver by other means (e.g. as a zero page), so that the next copy
+ * of it is sent in full. Must not be called while pfn is in the page
+ * buffer.
+ */
+void xc_compression_invalidate_page(xc_interface *xch, comp_ctx *ctx,
+                                    unsigned long pfn);
+
 /**
  * Delta compress pages in the compression buffer and inserts the
  * compressed data into the supplied compression buffer compbuf, whose
@@ -2289,4 +2429,36 @@ int xc_compression_uncompress_page(xc_interface *xch, char *compbuf,
 				   unsigned long compbuf_size,
 				   unsigned long *compbuf_pos, char *dest);
 
+/**
+ * Second stage coders, applied to a whole compressed chunk (the output
+ * of xc_compression_compress_pages) before it goes on the wire. The ids
+ * are part of the save format (see XC_SAVE_ID_COMPRESSION_CODEC).
+ */
+#define XC_COMPRESSION_CODEC_NONE  0
+#define XC_COMPRESSION_CODEC_ZLIB  1 /* deflate, fastest level */
+
+/* Returns the codec id for name ("none", "zlib"), or -1 if unknown. */
+int xc_compression_codec_id(const char *name);
+
+/**
+ * Encode srclen bytes at src into dst, which must have room for srclen
+ * bytes. If the coder cannot shrink the chunk it is copied verbatim, so
+ * *dstlen == srclen always means a stored chunk.
+ *
+ * returns 0 on success, -1 if the codec is unknown or failed.
+ */
+int xc_compression_encode_chunk(xc_interface *xch, int codec,
+                                const char *src, unsigned long srclen,
+                                char *dst, unsigned long *dstlen);
+
+/**
+ * Decode a chunk produced by xc_compression_encode_chunk. dstlen is the
+ * size of the original chunk and must be matched exactly.
+ *
+ * returns 0 on success, -1 if the codec is unknown or the data is corrupt.
+ */
+int xc_compression_decode_chunk(xc_interface *xch, int codec,
+                                const char *src, unsigned long srclen,
+                                char *dst, unsigned long dstlen);
+
 #endif /* XENCTRL_H */
@@ -27,11 +27,31 @@
 #define XCFLAGS_DEBUG     (1 << 1)
 #define XCFLAGS_HVM       (1 << 2)
 #define XCFLAGS_STDVGA    (1 << 3)
-#define XCFLAGS_CHECKPOINT_COMPRESS    (1 << 4)
+#define XCFLAGS_CHECKPOINT_COMPRESS    (1 << 4) /* compress checkpoints after resuming */
+#define XCFLAGS_DEDUP_PAGES            (1 << 5) /* send zero and duplicate pages by reference */
+#define XCFLAGS_POSTCOPY               (1 << 6) /* live HVM only, see xc_domain_postcopy_save */
+#define XCFLAGS_STREAM_CODEC           (1 << 7) /* zlib code compressed chunks */
 
 #define X86_64_B_SIZE   64 
 #define X86_32_B_SIZE   32
 
+/* Statistics for one iteration of xc_domain_save */
+struct xc_save_stats {
+    unsigned int iter;
+    unsigned long pages_sent;
+    unsigned long pages_skipped;    /* dirtied again before being sent */
+    uint64_t raw_bytes;             /* page data before compression */
+    uint64_t compressed_bytes;      /* compressed chunks, as written */
+    uint64_t cache_hits;            /* delta cache lookups */
+    uint64_t cache_misses;
+    /* Time spent, in us, summed over threads */
+    uint64_t map_us;                /* mapping guest memory */
+    uint64_t compress_us;
+    uint64_t write_us;
+    uint64_t peek_us;               /* dirty bitmap peeks */
+    uint64_t clean_us;              /* dirty bitmap clean ending the iteration */
+};
+
 /* callbacks provided by xc_domain_save */
 struct save_callbacks {
     /* Called after expiration of checkpoint interval,
@@ -72,6 +92,9 @@ struct save_callbacks {
      */
     int (*toolstack_save)(uint32_t domid, uint8_t **buf, uint32_t *len, void *data);
 
+    /* Called with the statistics of each iteration, as it ends (optional) */
+    void (*telemetry)(const struct xc_save_stats *stats, void *data);
+
     /* to be provided as the last argument to each callback function */
     void* data;
 };
@@ -82,13 +105,34 @@ struct save_callbacks {
  * @parm xch a handle to an open hypervisor interface
  * @parm fd the file descriptor to save a domain to
  * @parm dom the id of the domain
+ * @parm max_iters, max_factor hard limits on the live phase (0 = default)
+ * @parm downtime_ms target for the time the domain stays suspended while
+ *       the remaining memory is sent; live iterations stop as soon as
+ *       it is expected to be met (0 = default)
+ * @parm data_fds, nr_data_fds additional connections to the receiver;
+ *       page batches are striped across them and everything else stays
+ *       on io_fd. The receiver must be given as many. Ignored for
+ *       checkpointed (Remus) streams. NULL, 0 for none.
  * @return 0 on success, -1 on failure
  */
 int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom, uint32_t max_iters,
                    uint32_t max_factor, uint32_t flags /* XCFLAGS_xxx */,
                    struct save_callbacks* callbacks, int hvm,
-                   unsigned long vm_generationid_addr);
-
+                   unsigned long vm_generationid_addr, uint32_t downtime_ms,
+                   const int *data_fds, unsigned int nr_data_fds);
+
+
+/* Statistics for the memory image loaded by xc_domain_restore */
+struct xc_restore_stats {
+    unsigned long batches;
+    unsigned long pages;
+    uint64_t wire_bytes;            /* page data as received */
+    uint64_t raw_bytes;             /* page data after chunk decoding */
+    /* Time spent, in us, summed over threads */
+    uint64_t read_us;               /* waiting for the stream */
+    uint64_t decode_us;
+    uint64_t apply_us;              /* mapping and filling guest pages */
+};
 
 /* callbacks provided by xc_domain_restore */
 struct restore_callbacks {
@@ -96,6 +140,17 @@ struct restore_callbacks {
     int (*toolstack_restore)(uint32_t domid, const uint8_t *buf,
             uint32_t size, void* data);
 
+    /* Called once all pages of the image are in (optional) */
+    void (*telemetry)(const struct xc_restore_stats *stats, void *data);
+
+    /* Called, once the image is restored, with the pfns the sender left
+     * for the post-copy phase (XCFLAGS_POSTCOPY). They are allocated but
+     * hold no data: the caller must run xc_domain_postcopy_restore with
+     * them before unpausing the domain. The callee takes ownership of
+     * pfns (free'able). A stream with post-copy pages fails to restore
+     * without this callback. */
+    int (*postcopy_pfns)(xen_pfn_t *pfns, unsigned long nr, void *data);
+
     /* to be provided as the last argument to each callback function */
     void* data;
 };
@@ -118,6 +173,8 @@ struct restore_callbacks {
  * @parm vm_generationid_addr returned with the address of the generation id buffer
  * @parm callbacks non-NULL to receive a callback to restore toolstack
  *       specific data
+ * @parm data_fds, nr_data_fds the receiving ends of the sender's data fds,
+ *       in any order (NULL, 0 for none)
  * @return 0 on success, -1 on failure
  */
 int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
@@ -127,7 +184,8 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                       unsigned int hvm, unsigned int pae, int superpages,
                       int no_incr_generationid, int checkpointed_stream,
                       unsigned long *vm_generationid_addr,
-                      struct restore_callbacks *callbacks);
+                      struct restore_callbacks *callbacks,
+                      const int *data_fds, unsigned int nr_data_fds);
 /**
  * xc_domain_restore writes a file to disk that contains the device
  * model saved state.
@@ -137,6 +195,50 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
  */
 #define XC_DEVICE_MODEL_RESTORE_FILE "/var/lib/xen/qemu-resume"
 
+/**
+ * Serve the post-copy phase of a save made with XCFLAGS_POSTCOPY, once
+ * xc_domain_save has returned and the device model record has been sent.
+ * The domain must stay suspended until this returns.
+ *
+ * @parm xch a handle to an open hypervisor interface
+ * @parm io_fd the file descriptor the domain was saved to
+ * @parm req_fd the receiver's requests come in on this (may be io_fd)
+ * @parm dom the id of the domain
+ * @return 0 on success, -1 on failure
+ */
+int xc_domain_postcopy_save(xc_interface *xch, int io_fd, int req_fd,
+                            uint32_t dom);
+
+/* callbacks provided by xc_domain_postcopy_restore */
+struct postcopy_callbacks {
+    /* Called once the pages still on the sender are paged out; the domain
+     * may be unpaused from then on, and faults on them are served. */
+    int (*ready)(void *data);
+
+    /* to be provided as the last argument to each callback function */
+    void *data;
+};
+
+/**
+ * Bring in the pages left for the post-copy phase of a migration, from
+ * the sender's xc_domain_postcopy_save, while the domain runs. The pages
+ * are paged out through mem_paging; the domain's faults on them are
+ * served first and the rest are pulled in the background. Returns once
+ * all pages are in and paging is disabled again.
+ *
+ * @parm xch a handle to an open hypervisor interface
+ * @parm io_fd the file descriptor the domain was restored from
+ * @parm req_fd requests go back to the sender on this (may be io_fd)
+ * @parm dom the id of the restored domain, still paused
+ * @parm pfns, nr the pfns from restore_callbacks.postcopy_pfns
+ * @parm callbacks non-NULL to be told when the domain may be unpaused
+ * @return 0 on success, -1 on failure
+ */
+int xc_domain_postcopy_restore(xc_interface *xch, int io_fd, int req_fd,
+                               uint32_t dom, const xen_pfn_t *pfns,
+                               unsigned long nr,
+                               struct postcopy_callbacks *callbacks);
+
 /**
  * This function will create a domain for a paravirtualized Linux
  * using file names pointing to kernel and ramdisk
@@ -164,4 +164,16 @@ struct domain_info_context {
 int pin_table(xc_interface *xch, unsigned int type, unsigned long mfn,
               domid_t dom);
 
+/*
+ * Checkpoint compression: fill mask (one bit per 32-bit word of a page,
+ * XC_PAGE_SIZE/256 uint64_t's) with the words in which old and new differ.
+ */
+typedef void compress_diff_fn(const uint32_t *old, const uint32_t *new,
+                              uint64_t *mask);
+#if defined(__i386__) || defined(__x86_64__)
+/* Best (name == NULL) or named kernel usable on this cpu, or NULL. */
+compress_diff_fn *xc_compression_x86_kernel(const char *name);
+const char *xc_compression_x86_kernel_name(compress_diff_fn *fn);
+#endif
+
 #endif /* XG_PRIVATE_H */
@@ -115,19 +115,33 @@
  *                            output buffer.
  *
  * Format of compressed data:
- *   compressed_data = <deltas>*
- *   delta           = <marker, run*>
+ *   compressed_data = <page>*
+ *   page            = <tag, body>
+ *   tag             = 1 byte, the encoding of the page:
+ *     0 SAME        no body, the receiver's copy is unchanged
+ *     1 DELTA       body = <marker, run>* covering the whole page
+ *     2 ZERO        no body, the page is all zeroes
+ *     3 RLE         body = <rle_marker, rle_run>* covering the whole page
+ *     4 RAW         body = the 4096 bytes of the page
  *   marker          = (RUNFLAG|SKIPFLAG) bitwise-or RUNLEN [1 byte marker]
  *   RUNFLAG         = 0
  *   SKIPFLAG        = 1 << 7
  *   RUNLEN          = 7-bit unsigned value indicating number of WORDS in the run
  *   run             = string of bytes of length sizeof(WORD) * RUNLEN
+ *   rle_marker      = (LITERAL|REPEAT) bitwise-or (RLELEN - 1)  [1 byte]
+ *   LITERAL         = 0
+ *   REPEAT          = 1 << 7
+ *   RLELEN          = 1 to 128 WORDS
+ *   rle_run         = sizeof(WORD) * RLELEN bytes for LITERAL, copied to the
+ *                     page; sizeof(WORD) bytes for REPEAT, stored RLELEN times
  *
  *    If marker contains RUNFLAG, then RUNLEN * sizeof(WORD) bytes of data following
  *   the marker is copied into the target page at the appropriate offset indicated by
  *   the offset_ptr
  *    If marker contains SKIPFLAG, then the offset_ptr is advanced
  *   by RUNLEN * sizeof(WORD).
+ *    SAME and DELTA pages are relative to the copy of the page the receiver
+ *   already holds; the sender only uses them for pages it has sent before.
  *
  * If chunk type is 0 then body phase is complete.
  *
@@ -140,11 +154,15 @@
  * At the sender side, compressed pages are inserted into the output stream
  * in the same order as they would have been if compression logic was absent.
  *
- * Until last iteration, the BODY is sent in Format A, to maintain live
- * migration compatibility with receivers of older Xen versions.
- * At the last iteration, if Remus compression was enabled, the sender sends
- * a trigger, XC_SAVE_ID_ENABLE_COMPRESSION to tell the receiver to parse the
- * BODY in Format B from the next iteration onwards.
+ * The sender sends XC_SAVE_ID_ENABLE_TAGGED_COMPRESSION before the first
+ * PFN array, so the whole BODY is in Format B and every page is encoded
+ * with whichever page encoding is shortest for it.
+ *
+ * XC_SAVE_ID_ENABLE_COMPRESSION announced the older untagged format, in
+ * which every page was a bare delta. The tagged format has its own marker
+ * so that a receiver which only knows the older format rejects the stream
+ * as an unknown chunk instead of misparsing it. This receiver no longer
+ * decodes the untagged format and rejects XC_SAVE_ID_ENABLE_COMPRESSION.
  *
  * An example sequence of chunks received in Format B:
  *     +16                              +ve chunk
@@ -203,6 +221,79 @@
  *   always holds true until the end of BODY PHASE:
  *    num(PFN entries +ve chunks) >= num(pages received in compressed form)
  *
+ * Second stage coder:
+ *     After XC_SAVE_ID_ENABLE_TAGGED_COMPRESSION, and only when saving
+ *   with XCFLAGS_STREAM_CODEC, the sender sends
+ *
+ *     XC_SAVE_ID_COMPRESSION_CODEC  TAG
+ *      uint32_t                     XC_COMPRESSION_CODEC_* id
+ *
+ *   From then on every XC_SAVE_ID_COMPRESSED_DATA chunk carries a second
+ *   length and its data is the delta stream run through that coder:
+ *
+ *     XC_SAVE_ID_COMPRESSED_DATA  TAG
+ *      N                          Length of the data on the wire
+ *      R                          Length of the delta stream once decoded
+ *      N bytes of DATA            Coded delta stream; stored as is if N == R
+ *
+ *   A receiver that does not know the codec must fail the restore.
+ *
+ * Pages sent by reference:
+ *     With XCFLAGS_DEDUP_PAGES, all-zero pages and pages whose contents
+ *   equal a page already sent in the final iteration carry no data. The
+ *   +ve chunk they belong to is preceded by
+ *
+ *     XC_SAVE_ID_PAGE_REFS        TAG
+ *      uint32_t                   Number of references, N
+ *      struct xc_page_ref[N]      Sorted by index
+ *
+ *   where index is the position of the page in the following PFN array
+ *   and src is XC_PAGE_REF_ZERO or the pfn whose contents to copy. The
+ *   PFN array keeps the page's type (always NOTAB), but the page is left
+ *   out of the page data (or compressed stream) of that chunk. src is
+ *   always a page the receiver has already been sent, earlier in the same
+ *   PFN array or in an earlier chunk.
+ *
+ * Striped batches:
+ *     When xc_domain_save is given data fds, the pages move off the
+ *   primary stream. Before the first batch the sender sends
+ *
+ *     XC_SAVE_ID_STRIPES          TAG
+ *      uint32_t                   Number of data fds
+ *
+ *   and the receiver must have been given the same number. Every batch
+ *   that would have been sent inline, from its XC_SAVE_ID_PAGE_REFS to
+ *   the end of its XC_SAVE_ID_COMPRESSED_DATA chunk, is then sent as a
+ *   frame on whichever data fd is free:
+ *
+ *     uint32_t                    Sequence number
+ *     uint32_t                    Length of the batch, N
+ *     N bytes                     The batch, exactly as it would be inline
+ *
+ *   and the primary stream carries, in its place,
+ *
+ *     XC_SAVE_ID_STRIPED_BATCH    TAG
+ *      uint32_t                   Sequence number of the frame
+ *
+ *   Sequence numbers start at 0 and increase by one per frame, so frames
+ *   on any one data fd arrive in increasing order. After the last batch
+ *   each data fd is closed by a frame with sequence number
+ *   XC_STRIPE_END and length 0. Everything other than page batches
+ *   stays on the primary stream.
+ *
+ * Post-copy pages:
+ *     With XCFLAGS_POSTCOPY (live HVM saves only) the domain is suspended
+ *   after the first iteration, and the final iteration sends the pages
+ *   dirtied since as XEN_DOMCTL_PFINFO_XALLOC: the receiver allocates
+ *   them but gets no data. After the final iteration they are listed in
+ *   one or more
+ *
+ *     XC_SAVE_ID_POSTCOPY         TAG
+ *      uint32_t                   Number of pfns, N (at most MAX_BATCH_SIZE)
+ *      uint64_t[N]                pfns
+ *
+ *   and their contents follow in the POST-COPY PHASE, below.
+ *
  * TAIL PHASE
  * ----------
  *
@@ -238,6 +329,28 @@
  *                        present in extended-info header)
  *
  *  Shared Info Page    : 4096 bytes of shared info page
+ *
+ * POST-COPY PHASE
+ * ---------------
+ *
+ * Follows the tail (including the device model record, which must be
+ * length-prefixed) of a stream carrying XC_SAVE_ID_POSTCOPY, once the
+ * receiver has resumed the domain. The receiver pulls the listed pages
+ * on its own channel back to the sender, which may be io_fd itself:
+ *
+ *     uint64_t         : pfn to send, with XC_POSTCOPY_DEMAND set if the
+ *                        domain is waiting for it, or XC_POSTCOPY_END
+ *
+ * and the sender answers on io_fd with records of
+ *
+ *     uint32_t         : Number of pages, N (1 to MAX_BATCH_SIZE)
+ *     uint32_t         : Padding
+ *     uint64_t[N]      : pfns
+ *     bytes            : N pages of data
+ *
+ * sending demand requests ahead of the others it has read. Every pfn
+ * requested is answered exactly once. The receiver sends XC_POSTCOPY_END
+ * once it has all its pages, and nothing follows it in either direction.
  */
 
 #define XC_SAVE_ID_ENABLE_VERIFY_MODE -1 /* Switch to validation phase. */
@@ -259,6 +372,26 @@
 #define XC_SAVE_ID_HVM_ACCESS_RING_PFN  -16
 #define XC_SAVE_ID_HVM_SHARING_RING_PFN -17
 #define XC_SAVE_ID_TOOLSTACK          -18 /* Optional toolstack specific info */
+#define XC_SAVE_ID_COMPRESSION_CODEC  -19 /* Second stage coder for compressed chunks */
+#define XC_SAVE_ID_PAGE_REFS          -20 /* Zero/duplicate pages of the next batch */
+#define XC_SAVE_ID_STRIPES            -21 /* Number of data fds batches are striped over */
+#define XC_SAVE_ID_STRIPED_BATCH      -22 /* Next batch is the frame with this seq */
+#define XC_SAVE_ID_POSTCOPY           -23 /* Pfns whose contents follow the tail */
+#define XC_SAVE_ID_ENABLE_TAGGED_COMPRESSION -24 /* As -13, tagged page format */
+
+struct xc_page_ref {
+    uint32_t index;             /* position in the following PFN array */
+    uint32_t pad;
+    uint64_t src;               /* XC_PAGE_REF_ZERO or source pfn */
+};
+#define XC_PAGE_REF_ZERO (~0ULL)
+
+/* Sequence number of the frame that closes a data fd */
+#define XC_STRIPE_END (~0U)
+
+/* Post-copy page requests */
+#define XC_POSTCOPY_DEMAND (1ULL << 63)
+#define XC_POSTCOPY_END    (~0ULL)
 
 /*
 ** We process save/restore/migrate in batches of pages; the below
@@ -0,0 +1,12 @@
+#define SBINDIR "/usr/local/sbin"
+#define BINDIR "/usr/local/bin"
+#define LIBEXEC "/usr/local/lib/xen/bin"
+#define LIBDIR "/usr/local/lib"
+#define SHAREDIR "/usr/local/share"
+#define PRIVATE_BINDIR "/usr/local/lib/xen/bin"
+#define XENFIRMWAREDIR "/usr/local/lib/xen/boot"
+#define XEN_CONFIG_DIR "/etc/xen"
+#define XEN_SCRIPT_DIR "/etc/xen/scripts"
+#define XEN_LOCK_DIR "/var/lock"
+#define XEN_RUN_DIR "/var/run/xen"
+#define XEN_PAGING_DIR "/var/lib/xen/xenpaging"
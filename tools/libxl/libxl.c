@@ -762,8 +762,9 @@ static void domain_suspend_cb(libxl__egc *egc,
 
 }
 
-int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
-                         const libxl_asyncop_how *ao_how)
+static int domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd,
+                          const int *data_fds, int nr_data_fds, int flags,
+                          const libxl_asyncop_how *ao_how)
 {
     AO_CREATE(ctx, domid, ao_how);
     int rc;
@@ -782,6 +783,14 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
 
     dss->domid = domid;
     dss->fd = fd;
+    if (nr_data_fds > 0) {
+        int *fds;
+
+        GCNEW_ARRAY(fds, nr_data_fds);
+        memcpy(fds, data_fds, nr_data_fds * sizeof(*fds));
+        dss->data_fds = fds;
+        dss->nr_data_fds = nr_data_fds;
+    }
     dss->type = type;
     dss->live = flags & LIBXL_SUSPEND_LIVE;
     dss->debug = flags & LIBXL_SUSPEND_DEBUG;
@@ -793,6 +802,20 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
     return AO_ABORT(rc);
 }
 
+int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
+                         const libxl_asyncop_how *ao_how)
+{
+    return domain_suspend(ctx, domid, fd, NULL, 0, flags, ao_how);
+}
+
+int libxl_domain_suspend_striped(libxl_ctx *ctx, uint32_t domid, int fd,
+                                 const int *data_fds, int nr_data_fds,
+                                 int flags, const libxl_asyncop_how *ao_how)
+{
+    return domain_suspend(ctx, domid, fd, data_fds, nr_data_fds, flags,
+                          ao_how);
+}
+
 int libxl_domain_pause(libxl_ctx *ctx, uint32_t domid)
 {
     int ret;
@@ -336,6 +336,16 @@
  */
 #define LIBXL_HAVE_DOMINFO_OUTSTANDING_MEMKB 1
 
+/*
+ * LIBXL_HAVE_STRIPED_MIGRATION
+ *
+ * If this is defined, libxl_domain_suspend_striped and
+ * libxl_domain_create_restore_striped are available. They take extra
+ * connections to the other end, over which guest memory is sent in
+ * parallel with the main stream.
+ */
+#define LIBXL_HAVE_STRIPED_MIGRATION 1
+
 /* Functions annotated with LIBXL_EXTERNAL_CALLERS_ONLY may not be
  * called from within libxl itself. Callers outside libxl, who
  * do not #include libxl_internal.h, are fine. */
@@ -567,6 +577,16 @@ int libxl_domain_create_restore(libxl_ctx *ctx, libxl_domain_config *d_config,
    * console is available and can be connected to.
    */
 
+/* As libxl_domain_create_restore, with the receiving ends of the
+ * data_fds given to libxl_domain_suspend_striped by the sender. */
+int libxl_domain_create_restore_striped(libxl_ctx *ctx,
+                                        libxl_domain_config *d_config,
+                                        uint32_t *domid, int restore_fd,
+                                        const int *data_fds, int nr_data_fds,
+                                        const libxl_asyncop_how *ao_how,
+                                        const libxl_asyncprogress_how *aop_console_how)
+                                        LIBXL_EXTERNAL_CALLERS_ONLY;
+
 void libxl_domain_config_init(libxl_domain_config *d_config);
 void libxl_domain_config_dispose(libxl_domain_config *d_config);
 
@@ -577,6 +597,15 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd,
 #define LIBXL_SUSPEND_DEBUG 1
 #define LIBXL_SUSPEND_LIVE 2
 
+/* As libxl_domain_suspend, but guest memory is striped over data_fds
+ * as well; the receiver must be given as many. fd still carries the
+ * rest of the stream. */
+int libxl_domain_suspend_striped(libxl_ctx *ctx, uint32_t domid, int fd,
+                                 const int *data_fds, int nr_data_fds,
+                                 int flags, /* LIBXL_SUSPEND_* */
+                                 const libxl_asyncop_how *ao_how)
+                                 LIBXL_EXTERNAL_CALLERS_ONLY;
+
 /* @param suspend_cancel [from xenctrl.h:xc_domain_resume( @param fast )]
  *   If this parameter is true, use co-operative resume. The guest
  *   must support this.
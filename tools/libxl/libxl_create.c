@@ -1223,8 +1223,9 @@ static void domain_create_cb(libxl__egc *egc,
                              int rc, uint32_t domid);
 
 static int do_domain_create(libxl_ctx *ctx, libxl_domain_config *d_config,
-                            uint32_t *domid,
-                            int restore_fd, const libxl_asyncop_how *ao_how,
+                            uint32_t *domid, int restore_fd,
+                            const int *data_fds, int nr_data_fds,
+                            const libxl_asyncop_how *ao_how,
                             const libxl_asyncprogress_how *aop_console_how)
 {
     AO_CREATE(ctx, 0, ao_how);
@@ -1234,6 +1235,14 @@ static int do_domain_create(libxl_ctx *ctx, libxl_domain_config *d_config,
     cdcs->dcs.ao = ao;
     cdcs->dcs.guest_config = d_config;
     cdcs->dcs.restore_fd = restore_fd;
+    if (nr_data_fds > 0) {
+        int *fds;
+
+        GCNEW_ARRAY(fds, nr_data_fds);
+        memcpy(fds, data_fds, nr_data_fds * sizeof(*fds));
+        cdcs->dcs.data_fds = fds;
+        cdcs->dcs.nr_data_fds = nr_data_fds;
+    }
     cdcs->dcs.callback = domain_create_cb;
     libxl__ao_progress_gethow(&cdcs->dcs.aop_console_how, aop_console_how);
     cdcs->domid_out = domid;
@@ -1261,7 +1270,7 @@ int libxl_domain_create_new(libxl_ctx *ctx, libxl_domain_config *d_config,
                             const libxl_asyncop_how *ao_how,
                             const libxl_asyncprogress_how *aop_console_how)
 {
-    return do_domain_create(ctx, d_config, domid, -1,
+    return do_domain_create(ctx, d_config, domid, -1, NULL, 0,
                             ao_how, aop_console_how);
 }
 
@@ -1270,10 +1279,21 @@ int libxl_domain_create_restore(libxl_ctx *ctx, libxl_domain_config *d_config,
                                 const libxl_asyncop_how *ao_how,
                             const libxl_asyncprogress_how *aop_console_how)
 {
-    return do_domain_create(ctx, d_config, domid, restore_fd,
+    return do_domain_create(ctx, d_config, domid, restore_fd, NULL, 0,
                             ao_how, aop_console_how);
 }
 
+int libxl_domain_create_restore_striped(libxl_ctx *ctx,
+                                        libxl_domain_config *d_config,
+                                        uint32_t *domid, int restore_fd,
+                                        const int *data_fds, int nr_data_fds,
+                                        const libxl_asyncop_how *ao_how,
+                                        const libxl_asyncprogress_how *aop_console_how)
+{
+    return do_domain_create(ctx, d_config, domid, restore_fd,
+                            data_fds, nr_data_fds, ao_how, aop_console_how);
+}
+
 /*
  * Local variables:
  * mode: C
@@ -2249,6 +2249,8 @@ struct libxl__domain_suspend_state {
 
     uint32_t domid;
     int fd;
+    const int *data_fds; /* page batches are striped over these */
+    int nr_data_fds;
     libxl_domain_type type;
     int live;
     int debug;
@@ -2510,6 +2512,8 @@ struct libxl__domain_create_state {
     libxl__ao *ao;
     libxl_domain_config *guest_config;
     int restore_fd;
+    const int *data_fds; /* see libxl_domain_create_restore_striped */
+    int nr_data_fds;
     libxl__domain_create_cb *callback;
     libxl_asyncprogress_how aop_console_how;
     /* private to domain_create */
@@ -54,7 +54,7 @@ void libxl__xc_domain_restore(libxl__egc *egc, libxl__domain_create_state *dcs,
     unsigned cbflags = libxl__srm_callout_enumcallbacks_restore
         (&dcs->shs.callbacks.restore.a);
 
-    const unsigned long argnums[] = {
+    const unsigned long fixed_argnums[] = {
         domid,
         state->store_port,
         state->store_domid, state->console_port,
@@ -62,6 +62,17 @@ void libxl__xc_domain_restore(libxl__egc *egc, libxl__domain_create_state *dcs,
         hvm, pae, superpages, no_incr_generationid,
         cbflags,
     };
+    /* followed by the number of data fds and the fds themselves */
+    const int nr_fixed = ARRAY_SIZE(fixed_argnums);
+    const int num_argnums = nr_fixed + 1 + dcs->nr_data_fds;
+    unsigned long *argnums;
+    int i;
+
+    GCNEW_ARRAY(argnums, num_argnums);
+    memcpy(argnums, fixed_argnums, sizeof(fixed_argnums));
+    argnums[nr_fixed] = dcs->nr_data_fds;
+    for (i = 0; i < dcs->nr_data_fds; i++)
+        argnums[nr_fixed + 1 + i] = dcs->data_fds[i];
 
     dcs->shs.ao = ao;
     dcs->shs.domid = domid;
@@ -71,15 +82,16 @@ void libxl__xc_domain_restore(libxl__egc *egc, libxl__domain_create_state *dcs,
     dcs->shs.need_results = 1;
     dcs->shs.toolstack_data_file = 0;
 
-    run_helper(egc, &dcs->shs, "--restore-domain", restore_fd, 0,0,
-               argnums, ARRAY_SIZE(argnums));
+    run_helper(egc, &dcs->shs, "--restore-domain", restore_fd,
+               dcs->data_fds, dcs->nr_data_fds,
+               argnums, num_argnums);
 }
 
 void libxl__xc_domain_save(libxl__egc *egc, libxl__domain_suspend_state *dss,
                            unsigned long vm_generationid_addr)
 {
     STATE_AO_GC(dss->ao);
-    int r, rc, toolstack_data_fd = -1;
+    int r, rc, i, toolstack_data_fd = -1;
     uint32_t toolstack_data_len = 0;
 
     /* Resources we need to free */
@@ -107,11 +119,26 @@ void libxl__xc_domain_save(libxl__egc *egc, libxl__domain_suspend_state *dss,
         if (r) { rc = ERROR_FAIL; goto out; }
     }
 
-    const unsigned long argnums[] = {
-        dss->domid, 0, 0, dss->xcflags, dss->hvm, vm_generationid_addr,
+    const unsigned long fixed_argnums[] = {
+        dss->domid, 0, 0, 0, dss->xcflags, dss->hvm, vm_generationid_addr,
         toolstack_data_fd, toolstack_data_len,
         cbflags,
     };
+    /* followed by the number of data fds and the fds themselves */
+    const int nr_fixed = ARRAY_SIZE(fixed_argnums);
+    const int num_argnums = nr_fixed + 1 + dss->nr_data_fds;
+    unsigned long *argnums;
+    int *preserve_fds;
+
+    GCNEW_ARRAY(argnums, num_argnums);
+    GCNEW_ARRAY(preserve_fds, 1 + dss->nr_data_fds);
+    memcpy(argnums, fixed_argnums, sizeof(fixed_argnums));
+    argnums[nr_fixed] = dss->nr_data_fds;
+    preserve_fds[0] = toolstack_data_fd;
+    for (i = 0; i < dss->nr_data_fds; i++) {
+        argnums[nr_fixed + 1 + i] = dss->data_fds[i];
+        preserve_fds[1 + i] = dss->data_fds[i];
+    }
 
     dss->shs.ao = ao;
     dss->shs.domid = dss->domid;
@@ -123,8 +150,8 @@ void libxl__xc_domain_save(libxl__egc *egc, libxl__domain_suspend_state *dss,
     free(toolstack_data_buf);
 
     run_helper(egc, &dss->shs, "--save-domain", dss->fd,
-               &toolstack_data_fd, 1,
-               argnums, ARRAY_SIZE(argnums));
+               preserve_fds, 1 + dss->nr_data_fds,
+               argnums, num_argnums);
     return;
 
  out:
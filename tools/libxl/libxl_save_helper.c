@@ -208,7 +208,7 @@ static struct restore_callbacks helper_restore_callbacks;
 
 int main(int argc, char **argv)
 {
-    int r;
+    int r, i;
 
 #define NEXTARG (++argv, assert(*argv), *argv)
 
@@ -221,12 +221,17 @@ int main(int argc, char **argv)
         uint32_t dom =             strtoul(NEXTARG,0,10);
         uint32_t max_iters =       strtoul(NEXTARG,0,10);
         uint32_t max_factor =      strtoul(NEXTARG,0,10);
+        uint32_t downtime_ms =     strtoul(NEXTARG,0,10);
         uint32_t flags =           strtoul(NEXTARG,0,10);
         int hvm =                  atoi(NEXTARG);
         unsigned long genidad =    strtoul(NEXTARG,0,10);
         toolstack_save_fd  =       atoi(NEXTARG);
         toolstack_save_len =       strtoul(NEXTARG,0,10);
         unsigned cbflags =         strtoul(NEXTARG,0,10);
+        unsigned nr_data_fds =     strtoul(NEXTARG,0,10);
+        int data_fds[nr_data_fds ?: 1];
+        for (i = 0; i < nr_data_fds; i++)
+            data_fds[i] =          atoi(NEXTARG);
         assert(!*++argv);
 
         if (toolstack_save_fd >= 0)
@@ -236,7 +241,8 @@ int main(int argc, char **argv)
 
         startup("save");
         r = xc_domain_save(xch, io_fd, dom, max_iters, max_factor, flags,
-                           &helper_save_callbacks, hvm, genidad);
+                           &helper_save_callbacks, hvm, genidad,
+                           downtime_ms, data_fds, nr_data_fds);
         complete(r);
 
     } else if (!strcmp(mode,"--restore-domain")) {
@@ -252,6 +258,10 @@ int main(int argc, char **argv)
         int superpages =           strtoul(NEXTARG,0,10);
         int no_incr_genidad =      strtoul(NEXTARG,0,10);
         unsigned cbflags =         strtoul(NEXTARG,0,10);
+        unsigned nr_data_fds =     strtoul(NEXTARG,0,10);
+        int data_fds[nr_data_fds ?: 1];
+        for (i = 0; i < nr_data_fds; i++)
+            data_fds[i] =          atoi(NEXTARG);
         assert(!*++argv);
 
         helper_setcallbacks_restore(&helper_restore_callbacks, cbflags);
@@ -265,7 +275,8 @@ int main(int argc, char **argv)
                               store_domid, console_evtchn, &console_mfn,
                               console_domid, hvm, pae, superpages,
                               no_incr_genidad, 0, &genidad,
-                              &helper_restore_callbacks);
+                              &helper_restore_callbacks,
+                              data_fds, nr_data_fds);
         helper_stub_restore_results(store_mfn,console_mfn,genidad,0);
         complete(r);
 
@@ -47,21 +47,46 @@ int libxl__xs_writev_perms(libxl__gc *gc, xs_transaction_t t,
                            unsigned int num_perms)
 {
     libxl_ctx *ctx = libxl__gc_owner(gc);
+    struct xs_multi_op *ops;
     char *path;
-    int i;
+    int i, n = 0;
 
     if (!kvs)
         return 0;
 
+    for (i = 0; kvs[i] != NULL; i += 2)
+        n += perms ? 2 : 1;
+    GCNEW_ARRAY(ops, n);
+
+    n = 0;
     for (i = 0; kvs[i] != NULL; i += 2) {
         path = libxl__sprintf(gc, "%s/%s", dir, kvs[i]);
         if (path && kvs[i + 1]) {
-            int length = strlen(kvs[i + 1]);
-            xs_write(ctx->xsh, t, path, kvs[i + 1], length);
-            if (perms)
-                xs_set_permissions(ctx->xsh, t, path, perms, num_perms);
+            ops[n].type = XS_WRITE;
+            ops[n].path = path;
+            ops[n].data = kvs[i + 1];
+            ops[n].len = strlen(kvs[i + 1]);
+            n++;
+            if (perms) {
+                ops[n].type = XS_SET_PERMS;
+                ops[n].path = path;
+                ops[n].perms = perms;
+                ops[n].num_perms = num_perms;
+                n++;
+            }
         }
     }
+
+    /* All in one request if xenstored can, else one at a time. */
+    if (xs_multi(ctx->xsh, t, ops, n))
+        return 0;
+
+    for (i = 0; i < n; i++) {
+        if (ops[i].type == XS_WRITE)
+            xs_write(ctx->xsh, t, ops[i].path, ops[i].data, ops[i].len);
+        else
+            xs_set_permissions(ctx->xsh, t, ops[i].path, perms, num_perms);
+    }
     return 0;
 }
 
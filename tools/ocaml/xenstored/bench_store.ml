@@ -0,0 +1,54 @@
+(*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; version 2.1 only. with the special
+ * exception on linking described in file LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *)
+
+(* Store operations in a directory with many children, as /local/domain
+ * and backend directories get during boot storms: "make bench". *)
+
+let nr_children = 10000
+
+let time name n f =
+	let t0 = Unix.gettimeofday () in
+	f ();
+	let t1 = Unix.gettimeofday () in
+	Printf.printf "%-20s %10.2f us/op\n%!" name
+	              ((t1 -. t0) *. 1e6 /. float_of_int n)
+
+let () =
+	let n = nr_children in
+	let store = Store.create () in
+	let perm = Perms.Connection.create 0 in
+	let dir = Store.Path.of_string "/local/domain" in
+	let child i = dir @ [ string_of_int i ] in
+	Store.mkdir store perm (Store.Path.of_string "/local");
+	Store.mkdir store perm dir;
+
+	time "write (create)" n (fun () ->
+		for i = 0 to n - 1 do Store.write store perm (child i) "1" done);
+	time "write (replace)" n (fun () ->
+		for i = 0 to n - 1 do Store.write store perm (child i) "2" done);
+	time "read" n (fun () ->
+		for i = 0 to n - 1 do ignore (Store.read store perm (child i)) done);
+	time "exists" n (fun () ->
+		for i = 0 to n - 1 do ignore (Store.path_exists store (child i)) done);
+	time "ls" 100 (fun () ->
+		for i = 1 to 100 do ignore (Store.ls store perm dir) done);
+
+	(* as a transaction would, against a copy *)
+	let tstore = Store.copy store in
+	time "write (transaction)" n (fun () ->
+		for i = 0 to n - 1 do Store.write tstore perm (child i) "3" done);
+	assert (Store.read store perm (child 0) = "2");
+
+	time "rm" n (fun () ->
+		for i = 0 to n - 1 do Store.rm store perm (child i) done);
+	assert (Store.ls store perm dir = []);
+	assert (List.length (Store.ls tstore perm dir) = n)
@@ -234,6 +234,8 @@ let string_of_access_type = function
 	| Xenbus.Xb.Op.Setperms          -> "setperms "
 	| Xenbus.Xb.Op.Restrict          -> "restrict "
 	| Xenbus.Xb.Op.Set_target        -> "settarget"
+	| Xenbus.Xb.Op.Reset_watches     -> "rwatches "
+	| Xenbus.Xb.Op.Multi             -> "multi    "
 
 	| Xenbus.Xb.Op.Error             -> "error    "
 	| Xenbus.Xb.Op.Watchevent        -> "w event  "
@@ -250,6 +250,54 @@ let do_setperms con t domains cons data =
 		in
 	Transaction.setperms t (Connection.get_perm con) path perms
 
+(* The operations of a multi, each a whole packet of its own. *)
+let split_multi data =
+	let hdrlen = Xenbus.Partial.header_size () in
+	let len = String.length data in
+	let rec split off ops =
+		if off = len then
+			List.rev ops
+		else if len - off < hdrlen then
+			raise Invalid_Cmd_Args
+		else (
+			let _, _, ty, dlen = Xenbus.Partial.header_of_string_internal
+				(String.sub data off hdrlen) in
+			if dlen > len - off - hdrlen then
+				raise Invalid_Cmd_Args;
+			let op = Xenbus.Xb.Op.of_cval ty
+			and opdata = String.sub data (off + hdrlen) dlen in
+			split (off + hdrlen + dlen) ((op, opdata) :: ops)
+		) in
+	split 0 []
+
+(* Run each operation in turn, stopping at the first to fail.  Outside a
+   transaction they get one of their own, so either all of them happen or
+   none does.  The reply holds each one's reply, as a packet. *)
+let do_multi con t domains cons data =
+	let ops = split_multi data in
+	let internal = Transaction.get_id t = Transaction.none in
+	let t = if internal then Transaction.make_internal (Transaction.get_store t) else t in
+	let do_op (ty, data) =
+		let reply =
+			match ty with
+			| Xenbus.Xb.Op.Read     -> do_read con t domains cons data
+			| Xenbus.Xb.Op.Write    -> do_write con t domains cons data; "OK\000"
+			| Xenbus.Xb.Op.Mkdir    -> do_mkdir con t domains cons data; "OK\000"
+			| Xenbus.Xb.Op.Rm       -> do_rm con t domains cons data; "OK\000"
+			| Xenbus.Xb.Op.Setperms -> do_setperms con t domains cons data; "OK\000"
+			| _                     -> raise Invalid_Cmd_Args
+			in
+		Xenbus.Xb.Packet.to_string (Xenbus.Xb.Packet.create 0 0 ty reply) in
+	let replies = String.concat "" (List.map do_op ops) in
+	if String.length replies > Xenbus.Partial.xenstore_payload_max then
+		raise Quota.Data_too_big;
+	if internal then (
+		if not (Transaction.commit ~con:(Connection.get_domstr con) t) then
+			raise Transaction_again;
+		process_watch (List.rev (Transaction.get_ops t)) cons
+	);
+	replies
+
 let do_error con t domains cons data =
 	raise Define.Unknown_operation
 
@@ -324,6 +372,7 @@ let function_of_type ty =
 	| Xenbus.Xb.Op.Resume            -> reply_ack do_resume
 	| Xenbus.Xb.Op.Set_target        -> reply_ack do_set_target
 	| Xenbus.Xb.Op.Restrict          -> reply_ack do_restrict
+	| Xenbus.Xb.Op.Multi             -> reply_data do_multi
 	| Xenbus.Xb.Op.Invalid           -> reply_ack do_error
 	| _                              -> reply_ack do_error
 
@@ -16,24 +16,38 @@
  *)
 open Stdext
 
+module SymbolMap = Map.Make(Symbol)
+
 module Node = struct
 
+(* Children are indexed by name, so that finding, replacing or removing
+ * one does not mean walking past all the others: /local/domain and
+ * backend directories can have thousands. The map is immutable, so older
+ * roots (held by transactions) are left untouched. order remembers when
+ * each child was added, for listing them the way they always have been. *)
 type t = {
 	name: Symbol.t;
 	perms: Perms.Node.t;
 	value: string;
-	children: t list;
+	order: int;
+	next_order: int;
+	children: t SymbolMap.t;
 }
 
 let create _name _perms _value =
-	{ name = Symbol.of_string _name; perms = _perms; value = _value; children = []; }
+	{ name = Symbol.of_string _name; perms = _perms; value = _value;
+	  order = 0; next_order = 0; children = SymbolMap.empty; }
 
 let get_owner node = Perms.Node.get_owner node.perms
-let get_children node = node.children
 let get_value node = node.value
 let get_perms node = node.perms
 let get_name node = Symbol.to_string node.name
 
+(* children, oldest first *)
+let get_children node =
+	let l = SymbolMap.fold (fun _ c accu -> c :: accu) node.children [] in
+	List.sort (fun c1 c2 -> compare c1.order c2.order) l
+
 let set_value node nvalue = 
 	if node.value = nvalue
 	then node
@@ -42,38 +56,39 @@ let set_value node nvalue =
 let set_perms node nperms = { node with perms = nperms }
 
 let add_child node child =
-	{ node with children = child :: node.children }
+	let child = { child with order = node.next_order } in
+	{ node with children = SymbolMap.add child.name child node.children;
+	            next_order = node.next_order + 1 }
 
 let exists node childname =
 	let childname = Symbol.of_string childname in
-	List.exists (fun n -> n.name = childname) node.children
+	SymbolMap.mem childname node.children
 
 let find node childname =
 	let childname = Symbol.of_string childname in
-	List.find (fun n -> n.name = childname) node.children
+	SymbolMap.find childname node.children
 
 let replace_child node child nchild =
-	(* this is the on-steroid version of the filter one-replace one *)
-	let rec replace_one_in_list l =
-		match l with
-		| []                               -> []
-		| h :: tl when h.name = child.name -> nchild :: tl
-		| h :: tl                          -> h :: replace_one_in_list tl
-		in
-	{ node with children = (replace_one_in_list node.children) }
+	(* nchild takes child's place; keep it physically equal when nothing
+	 * changed, as transaction coalescing compares nodes with == *)
+	let nchild =
+		if nchild.order = child.order
+		then nchild
+		else { nchild with order = child.order } in
+	let children =
+		if nchild.name = child.name
+		then node.children
+		else SymbolMap.remove child.name node.children in
+	{ node with children = SymbolMap.add nchild.name nchild children }
 
 let del_childname node childname =
 	let sym = Symbol.of_string childname in
-	let rec delete_one_in_list l =
-		match l with
-		| []                        -> raise Not_found
-		| h :: tl when h.name = sym -> tl
-		| h :: tl                   -> h :: delete_one_in_list tl
-		in
-	{ node with children = (delete_one_in_list node.children) }
+	if not (SymbolMap.mem sym node.children) then
+		raise Not_found;
+	{ node with children = SymbolMap.remove sym node.children }
 
 let del_all_children node =
-	{ node with children = [] }
+	{ node with children = SymbolMap.empty }
 
 (* check if the current node can be accessed by the current connection with rperm permissions *)
 let check_perm node connection request =
@@ -87,7 +102,7 @@ let check_owner node connection =
 		raise Define.Permission_denied;
 	end
 
-let rec recurse fct node = fct node; List.iter (recurse fct) node.children
+let rec recurse fct node = fct node; SymbolMap.iter (fun _ c -> recurse fct c) node.children
 
 let unpack node = (Symbol.to_string node.name, node.perms, node.value)
 
@@ -315,9 +330,9 @@ let ls store perm path =
 			let do_ls node name =
 				let cnode = Node.find node name in
 				Node.check_perm cnode perm Perms.READ;
-				cnode.Node.children in
+				Node.get_children cnode in
 			Path.apply store.root path do_ls in
-	List.rev (List.map (fun n -> Symbol.to_string n.Node.name) children)
+	List.map (fun n -> Symbol.to_string n.Node.name) children
 
 let getperms store perm path =
 	if path = [] then
@@ -345,7 +360,7 @@ let path_exists store path =
 let traversal root_node f =
 	let rec _traversal path node =
 		f path node;
-		List.iter (_traversal (path @ [ Symbol.to_string node.Node.name ])) node.Node.children
+		List.iter (_traversal (path @ [ Symbol.to_string node.Node.name ])) (Node.get_children node)
 		in
 	_traversal [] root_node
 		
@@ -50,6 +50,8 @@ let of_string name =
 let to_string i =
 	(Hashtbl.find int_string_tbl i).data
 
+let compare (i: t) (j: t) = compare i j
+
 let mark_all_as_unused () =
 	Hashtbl.iter (fun _ v -> v.garbage <- true) int_string_tbl
 
@@ -29,6 +29,10 @@ val of_string : string -> t
 val to_string : t -> string
 (** Convert a symbol into a string. *)
 
+val compare : t -> t -> int
+(** Total order on symbols, so that they can be used as map keys. It has
+    nothing to do with the order of the strings. *)
+
 (** {6 Garbage Collection} *)
 
 (** Symbols need to be regulary garbage collected. The following steps should be followed:
@@ -89,6 +89,17 @@ let make id store =
 		write_lowpath = None;
 	}
 
+(* A transaction with no id of its own, for running several operations
+   as one: nothing else can run before it is committed. *)
+let make_internal store =
+	{
+		ty = Full(none, Store.get_root store, store);
+		store = Store.copy store;
+		ops = [];
+		read_lowpath = None;
+		write_lowpath = None;
+	}
+
 let get_id t = match t.ty with No -> none | Full (id, _, _) -> id
 let get_store t = t.store
 let get_ops t = t.ops
@@ -207,7 +207,7 @@ int checkpoint_start(checkpoint_state* s, int fd,
     callbacks->switch_qemu_logdirty = noop_switch_logdirty;
 
     rc = xc_domain_save(s->xch, fd, s->domid, 0, 0, flags, callbacks, hvm,
-                        vm_generationid_addr);
+                        vm_generationid_addr, 0, NULL, 0);
 
     if (hvm)
        switch_qemu_logdirty(s, 0);
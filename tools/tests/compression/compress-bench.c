@@ -0,0 +1,204 @@
+/*
+ * compress-bench.c
+ *
+ * Microbenchmark for the checkpoint delta compressor. Compresses
+ * synthetic sparse-dirty and fully-dirty pages with each difference
+ * kernel supported by the cpu, and checks that every kernel produces
+ * the same stream as the scalar one. The scalar stream is also run
+ * through the second stage chunk coder and decoded again.
+ *
+ * Runs without a hypervisor: only xc_compression_* is exercised.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "xenctrl.h"
+
+#define PAGE_SIZE       4096
+#define NR_PAGES        4096
+#define ROUNDS          8
+/* worst case: every page delta compressed with all words changed */
+#define COMPBUF_SIZE    ((size_t)ROUNDS * NR_PAGES * (PAGE_SIZE + 9))
+
+static const char *kernels[] = { "scalar", "sse2", "avx2" };
+
+struct workload {
+    const char *name;
+    /* number of 32-bit words dirtied per page per round, 0 == all */
+    unsigned int dirty_words;
+};
+
+static const struct workload workloads[] = {
+    { "sparse-dirty", 8 },
+    { "half-dirty", 512 },
+    { "fully-dirty", 0 },
+};
+
+/*
+ * Code the whole stream as one chunk, check that it decodes back and
+ * return the overall ratio, or a negative value on failure.
+ */
+static double run_codec(int codec, const char *in, unsigned long in_len,
+                        char *coded, char *decoded)
+{
+    unsigned long coded_len;
+
+    if ( xc_compression_encode_chunk(NULL, codec, in, in_len,
+                                     coded, &coded_len) ||
+         xc_compression_decode_chunk(NULL, codec, coded, coded_len,
+                                     decoded, in_len) ||
+         memcmp(in, decoded, in_len) )
+        return -1;
+
+    return (double)NR_PAGES * ROUNDS * PAGE_SIZE / coded_len;
+}
+
+static uint64_t now_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void dirty_pages(char *mem, const struct workload *w, unsigned int seed)
+{
+    unsigned int p, i;
+    uint32_t *page;
+
+    srand(seed);
+    for ( p = 0; p < NR_PAGES; p++ )
+    {
+        page = (uint32_t *)(mem + (size_t)p * PAGE_SIZE);
+        if ( !w->dirty_words )
+            for ( i = 0; i < PAGE_SIZE / 4; i++ )
+                page[i] = rand();
+        else
+            for ( i = 0; i < w->dirty_words; i++ )
+                page[rand() % (PAGE_SIZE / 4)] = rand();
+    }
+}
+
+/*
+ * Run ROUNDS compression rounds of the workload and return the total
+ * number of microseconds spent in xc_compression_compress_pages. The
+ * concatenated stream is left in out/out_len.
+ */
+static long run(const struct workload *w, char *mem, char *out,
+                unsigned long *out_len)
+{
+    comp_ctx *ctx = xc_compression_create_context(NULL, NR_PAGES, 0);
+    unsigned long len, total = 0;
+    uint64_t t, elapsed = 0;
+    unsigned int r, p;
+    int rc;
+
+    if ( !ctx )
+        return -1;
+
+    memset(mem, 0, (size_t)NR_PAGES * PAGE_SIZE);
+    for ( r = 0; r < ROUNDS; r++ )
+    {
+        /* Round 0 primes the cache with full pages. */
+        if ( r )
+            dirty_pages(mem, w, r);
+
+        for ( p = 0; p < NR_PAGES; p++ )
+            xc_compression_add_page(NULL, ctx, mem + (size_t)p * PAGE_SIZE,
+                                    p, 0);
+
+        t = now_us();
+        do {
+            rc = xc_compression_compress_pages(NULL, ctx, out + total,
+                                               COMPBUF_SIZE - total, &len);
+            total += len;
+        } while ( rc == -1 );
+        if ( r )
+            elapsed += now_us() - t;
+
+        xc_compression_reset_pagebuf(NULL, ctx);
+    }
+
+    xc_compression_free_context(NULL, ctx);
+    *out_len = total;
+
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    char *mem, *ref, *out, *dec;
+    unsigned long ref_len, out_len;
+    unsigned int i, k;
+    double ratio, mb = (double)NR_PAGES * (ROUNDS - 1) * PAGE_SIZE / (1 << 20);
+    long us;
+    int rc = 0;
+
+    mem = malloc((size_t)NR_PAGES * PAGE_SIZE);
+    ref = malloc(COMPBUF_SIZE);
+    out = malloc(COMPBUF_SIZE);
+    dec = malloc(COMPBUF_SIZE);
+    if ( !mem || !ref || !out || !dec )
+    {
+        fprintf(stderr, "failed to allocate buffers\n");
+        return 1;
+    }
+
+    for ( i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++ )
+    {
+        for ( k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++ )
+        {
+            if ( xc_compression_set_kernel(NULL, kernels[k]) )
+            {
+                printf("%-14s %-7s not supported\n",
+                       workloads[i].name, kernels[k]);
+                continue;
+            }
+
+            us = run(&workloads[i], mem, k ? out : ref,
+                     k ? &out_len : &ref_len);
+            if ( us < 0 )
+            {
+                fprintf(stderr, "failed to create compression context\n");
+                return 1;
+            }
+            if ( !us )
+                us = 1;
+
+            printf("%-14s %-7s %8.1f MB/s  ratio %5.2f", workloads[i].name,
+                   kernels[k], mb / us * 1000000,
+                   (double)NR_PAGES * ROUNDS * PAGE_SIZE /
+                   (k ? out_len : ref_len));
+
+            if ( k && (out_len != ref_len || memcmp(out, ref, ref_len)) )
+            {
+                printf("  MISMATCH");
+                rc = 1;
+            }
+            printf("\n");
+
+            if ( k )
+                continue;
+            ratio = run_codec(XC_COMPRESSION_CODEC_ZLIB, ref, ref_len,
+                              out, dec);
+            if ( ratio < 0 )
+            {
+                printf("%-14s +zlib   CODEC MISMATCH\n", workloads[i].name);
+                rc = 1;
+            }
+            else
+                printf("%-14s +zlib                ratio %5.2f\n",
+                       workloads[i].name, ratio);
+        }
+    }
+
+    free(mem);
+    free(ref);
+    free(out);
+    free(dec);
+
+    return rc;
+}
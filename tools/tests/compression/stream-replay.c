@@ -0,0 +1,480 @@
+/*
+ * stream-replay.c
+ *
+ * Offline replay of the compressed migration stream. Builds a synthetic
+ * guest memory image, then runs a number of rounds in which a dirty-page
+ * trace is generated and the dirty pages are pushed through the sender
+ * side (xc_compression_add_page/compress_pages and the chunk coder) into
+ * chunks, which the receiver side decodes and applies with
+ * xc_compression_uncompress_page to its own copy of memory. After every
+ * round the receiver's copy must match the guest's.
+ *
+ * Round 0 sends the whole image to a receiver whose memory starts out
+ * zeroed, as the first iteration of a save does. Zero pages are sent as
+ * references and dropped from the delta cache, again as the save code
+ * does.
+ *
+ * The trace is shaped by:
+ *   -d  percentage of memory dirtied per round
+ *   -l  locality: percentage of dirtied pages that fall in the hot set
+ *       (the first -H percent of memory)
+ *   -w  32-bit words written per dirtied page (0 == all of them)
+ *   -e  write entropy: percentage of written words that get a random
+ *       value, the rest get a small increment of the old one
+ *   -z  percentage of dirtied pages that are cleared instead
+ *
+ * Runs without a hypervisor: only xc_compression_* is exercised.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "xenctrl.h"
+
+#define PAGE_SIZE       4096
+#define WORDS_PER_PAGE  (PAGE_SIZE / 4)
+/* on-wire size of a zero page reference (struct xc_page_ref) */
+#define PAGE_REF_SIZE   16
+/* per chunk: marker, compressed length and, if coded, decoded length */
+#define CHUNK_HDR_SIZE  (sizeof(int) + 2 * sizeof(unsigned long))
+
+struct params {
+    unsigned long nr_pages;
+    unsigned int rounds;
+    unsigned int dirty_pct;
+    unsigned int hot_pct;
+    unsigned int locality_pct;
+    unsigned int words;
+    unsigned int entropy_pct;
+    unsigned int zero_pct;
+    unsigned long chunk_size;
+    unsigned long cache_mb;
+    unsigned int threads;
+    unsigned int seed;
+    const char *codec;
+    const char *kernel;
+};
+
+struct totals {
+    unsigned long pages;        /* pages sent, including references */
+    unsigned long refs;
+    uint64_t raw_bytes;
+    uint64_t wire_bytes;
+    uint64_t chunks;
+    uint64_t send_us;
+    uint64_t recv_us;
+};
+
+struct stream {
+    comp_ctx *ctx;
+    int codec;
+    char *compbuf;              /* compress_pages output */
+    char *wire;                 /* coded chunk as it would be sent */
+    char *decoded;              /* chunk after the receiver decoded it */
+
+    /* pfns whose data is in the chunks, in the order they were added */
+    unsigned long *order;
+    unsigned long nr_order, next;
+};
+
+static uint64_t now_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static unsigned int rnd(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 1) & 0x7fffffff;
+}
+
+static int is_zero(const uint32_t *page)
+{
+    unsigned int i;
+
+    for ( i = 0; i < WORDS_PER_PAGE; i++ )
+        if ( page[i] )
+            return 0;
+    return 1;
+}
+
+/*
+ * Initial image: an eighth of memory is zero, the rest is a mix of
+ * random words and words from a small set of values, in the ratio given
+ * by the entropy.
+ */
+static void fill_memory(const struct params *p, uint32_t *mem,
+                        unsigned int *seed)
+{
+    unsigned long i, n = p->nr_pages * WORDS_PER_PAGE;
+
+    memset(mem, 0, n * 4);
+    for ( i = n / 8; i < n; i++ )
+        mem[i] = (rnd(seed) % 100 < p->entropy_pct) ?
+            rnd(seed) : (rnd(seed) % 16) * 0x01010101u;
+}
+
+static void dirty_page(const struct params *p, uint32_t *page,
+                       unsigned int *seed)
+{
+    unsigned int i, w, n = p->words ? p->words : WORDS_PER_PAGE;
+
+    if ( rnd(seed) % 100 < p->zero_pct )
+    {
+        memset(page, 0, PAGE_SIZE);
+        return;
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+        w = p->words ? rnd(seed) % WORDS_PER_PAGE : i;
+        if ( rnd(seed) % 100 < p->entropy_pct )
+            page[w] = rnd(seed);
+        else
+            page[w] += 1 + rnd(seed) % 4;
+    }
+}
+
+/* Generate this round's trace: dirty the pages and mark them in dirty. */
+static void make_trace(const struct params *p, uint32_t *mem,
+                       unsigned char *dirty, unsigned int *seed)
+{
+    unsigned long i, pfn, n = p->nr_pages * p->dirty_pct / 100;
+    unsigned long hot = p->nr_pages * p->hot_pct / 100;
+
+    if ( !hot )
+        hot = 1;
+    memset(dirty, 0, p->nr_pages);
+    for ( i = 0; i < n; i++ )
+    {
+        if ( rnd(seed) % 100 < p->locality_pct )
+            pfn = rnd(seed) % hot;
+        else
+            pfn = rnd(seed) % p->nr_pages;
+        dirty_page(p, mem + pfn * WORDS_PER_PAGE, seed);
+        dirty[pfn] = 1;
+    }
+}
+
+/*
+ * Receiver side of one chunk: decode it and apply its pages, in the
+ * order they were added, to the receiver's memory.
+ */
+static int recv_chunk(struct stream *s, uint32_t *rmem, unsigned long wire_len,
+                      unsigned long len, struct totals *t)
+{
+    unsigned long pos = 0;
+    char *chunk = s->wire;
+    uint64_t start = now_us();
+
+    if ( s->codec != XC_COMPRESSION_CODEC_NONE )
+    {
+        if ( xc_compression_decode_chunk(NULL, s->codec, s->wire, wire_len,
+                                         s->decoded, len) )
+        {
+            fprintf(stderr, "failed to decode chunk\n");
+            return -1;
+        }
+        chunk = s->decoded;
+    }
+
+    while ( pos < len )
+    {
+        if ( s->next == s->nr_order )
+        {
+            fprintf(stderr, "chunk holds more pages than were sent\n");
+            return -1;
+        }
+        if ( xc_compression_uncompress_page(
+                 NULL, chunk, len, &pos,
+                 (char *)(rmem + s->order[s->next++] * WORDS_PER_PAGE)) )
+        {
+            fprintf(stderr, "failed to uncompress page\n");
+            return -1;
+        }
+    }
+
+    t->recv_us += now_us() - start;
+    return 0;
+}
+
+/*
+ * Sender side: compress everything in the page buffer into chunks of at
+ * most chunk_size bytes and hand each to the receiver.
+ */
+static int flush_chunks(const struct params *p, struct stream *s,
+                        uint32_t *rmem, struct totals *t)
+{
+    unsigned long len, wire_len;
+    uint64_t start;
+    int rc;
+
+    for ( ; ; )
+    {
+        start = now_us();
+        rc = xc_compression_compress_pages(NULL, s->ctx, s->compbuf,
+                                           p->chunk_size, &len);
+        if ( !rc )
+        {
+            t->send_us += now_us() - start;
+            return 0;
+        }
+
+        wire_len = len;
+        if ( s->codec == XC_COMPRESSION_CODEC_NONE )
+            memcpy(s->wire, s->compbuf, len);
+        else if ( xc_compression_encode_chunk(NULL, s->codec, s->compbuf,
+                                              len, s->wire, &wire_len) )
+        {
+            fprintf(stderr, "failed to encode chunk\n");
+            return -1;
+        }
+        t->send_us += now_us() - start;
+        t->wire_bytes += CHUNK_HDR_SIZE + wire_len;
+        t->chunks++;
+
+        if ( recv_chunk(s, rmem, wire_len, len, t) )
+            return -1;
+    }
+}
+
+static int send_round(const struct params *p, struct stream *s,
+                      uint32_t *mem, uint32_t *rmem,
+                      const unsigned char *dirty, struct totals *t)
+{
+    unsigned long pfn;
+    uint64_t start;
+    int rc;
+
+    s->nr_order = s->next = 0;
+    for ( pfn = 0; pfn < p->nr_pages; pfn++ )
+    {
+        if ( !dirty[pfn] )
+            continue;
+        t->pages++;
+        t->raw_bytes += PAGE_SIZE;
+
+        start = now_us();
+        if ( is_zero(mem + pfn * WORDS_PER_PAGE) )
+        {
+            xc_compression_invalidate_page(NULL, s->ctx, pfn);
+            t->send_us += now_us() - start;
+            memset(rmem + pfn * WORDS_PER_PAGE, 0, PAGE_SIZE);
+            t->wire_bytes += PAGE_REF_SIZE;
+            t->refs++;
+            continue;
+        }
+
+        rc = xc_compression_add_page(NULL, s->ctx,
+                                     (char *)(mem + pfn * WORDS_PER_PAGE),
+                                     pfn, 0);
+        t->send_us += now_us() - start;
+        s->order[s->nr_order++] = pfn;
+        if ( rc == -2 )
+        {
+            fprintf(stderr, "failed to add pfn %lu\n", pfn);
+            return -1;
+        }
+        if ( rc == -1 && flush_chunks(p, s, rmem, t) )
+            return -1;
+    }
+
+    if ( flush_chunks(p, s, rmem, t) )
+        return -1;
+    if ( s->next != s->nr_order )
+    {
+        fprintf(stderr, "%lu pages sent but %lu received\n",
+                s->nr_order, s->next);
+        return -1;
+    }
+
+    return 0;
+}
+
+static double mb_per_s(uint64_t bytes, uint64_t us)
+{
+    return (double)bytes / (1 << 20) / (us ? us : 1) * 1000000;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -p pages     guest size in pages (default 16384)\n"
+            "  -r rounds    dirty rounds after the full one (default 8)\n"
+            "  -d pct       memory dirtied per round (default 10)\n"
+            "  -H pct       size of the hot set (default 10)\n"
+            "  -l pct       dirtied pages that fall in the hot set"
+            " (default 80)\n"
+            "  -w words     words written per dirtied page, 0 == all"
+            " (default 32)\n"
+            "  -e pct       written words that get random values"
+            " (default 25)\n"
+            "  -z pct       dirtied pages that are cleared (default 2)\n"
+            "  -c codec     chunk codec, none or zlib (default none)\n"
+            "  -k kernel    difference kernel (default: fastest)\n"
+            "  -t threads   compression threads (default 1)\n"
+            "  -b kbytes    chunk size (default 1024)\n"
+            "  -C mbytes    delta cache size (default 256)\n"
+            "  -s seed      trace seed (default 1)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct params p = {
+        .nr_pages = 16384, .rounds = 8, .dirty_pct = 10, .hot_pct = 10,
+        .locality_pct = 80, .words = 32, .entropy_pct = 25, .zero_pct = 2,
+        .chunk_size = 1024 << 10, .cache_mb = 256, .threads = 1, .seed = 1,
+        .codec = "none",
+    };
+    struct stream s = { 0 };
+    struct totals t = { 0 }, rt;
+    xc_compression_stats_t cs;
+    uint32_t *mem, *rmem;
+    unsigned char *dirty;
+    unsigned int r, seed;
+    int opt, rc = 1;
+
+    while ( (opt = getopt(argc, argv, "p:r:d:H:l:w:e:z:c:k:t:b:C:s:")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'p': p.nr_pages = strtoul(optarg, NULL, 0); break;
+        case 'r': p.rounds = atoi(optarg); break;
+        case 'd': p.dirty_pct = atoi(optarg); break;
+        case 'H': p.hot_pct = atoi(optarg); break;
+        case 'l': p.locality_pct = atoi(optarg); break;
+        case 'w': p.words = atoi(optarg); break;
+        case 'e': p.entropy_pct = atoi(optarg); break;
+        case 'z': p.zero_pct = atoi(optarg); break;
+        case 'c': p.codec = optarg; break;
+        case 'k': p.kernel = optarg; break;
+        case 't': p.threads = atoi(optarg); break;
+        case 'b': p.chunk_size = strtoul(optarg, NULL, 0) << 10; break;
+        case 'C': p.cache_mb = strtoul(optarg, NULL, 0); break;
+        case 's': p.seed = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    /* compress_pages needs room for at least one full page per call */
+    if ( !p.nr_pages || p.words > WORDS_PER_PAGE ||
+         p.chunk_size < 2 * PAGE_SIZE )
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    s.codec = xc_compression_codec_id(p.codec);
+    if ( s.codec < 0 )
+    {
+        fprintf(stderr, "unknown codec %s\n", p.codec);
+        return 2;
+    }
+
+    mem = malloc(p.nr_pages * PAGE_SIZE);
+    rmem = malloc(p.nr_pages * PAGE_SIZE);
+    dirty = malloc(p.nr_pages);
+    s.order = malloc(p.nr_pages * sizeof(*s.order));
+    s.compbuf = malloc(p.chunk_size);
+    s.wire = malloc(p.chunk_size);
+    s.decoded = malloc(p.chunk_size);
+    if ( !mem || !rmem || !dirty || !s.order || !s.compbuf || !s.wire ||
+         !s.decoded )
+    {
+        fprintf(stderr, "failed to allocate buffers\n");
+        goto out;
+    }
+
+    s.ctx = xc_compression_create_context(NULL, p.nr_pages,
+                                          p.cache_mb << 20);
+    if ( !s.ctx )
+    {
+        fprintf(stderr, "failed to create compression context\n");
+        goto out;
+    }
+    if ( xc_compression_set_kernel(NULL, p.kernel) )
+    {
+        fprintf(stderr, "kernel %s not supported\n", p.kernel);
+        goto out;
+    }
+    if ( p.threads > 1 && xc_compression_set_threads(NULL, s.ctx, p.threads) )
+        fprintf(stderr, "no compression threads, running single threaded\n");
+
+    printf("%lu pages, %u rounds, dirty %u%%, hot set %u%%, locality %u%%, "
+           "words %u, entropy %u%%, zero %u%%\n"
+           "kernel %s, codec %s, %u threads, %lukB chunks, %luMB cache\n",
+           p.nr_pages, p.rounds, p.dirty_pct, p.hot_pct, p.locality_pct,
+           p.words, p.entropy_pct, p.zero_pct,
+           xc_compression_get_kernel(NULL), p.codec, p.threads,
+           p.chunk_size >> 10, p.cache_mb);
+
+    seed = p.seed;
+    fill_memory(&p, mem, &seed);
+
+    memset(rmem, 0, p.nr_pages * PAGE_SIZE);
+
+    for ( r = 0; r <= p.rounds; r++ )
+    {
+        rt = t;
+        if ( r )
+            make_trace(&p, mem, dirty, &seed);
+        else
+            memset(dirty, 1, p.nr_pages);
+        if ( send_round(&p, &s, mem, rmem, dirty, &t) )
+        {
+            fprintf(stderr, "round %u failed\n", r);
+            goto out;
+        }
+        if ( memcmp(mem, rmem, p.nr_pages * PAGE_SIZE) )
+        {
+            printf("round %u: MISMATCH\n", r);
+            goto out;
+        }
+
+        printf("round %2u: %6lu pages %5lu refs  ratio %6.2f  "
+               "send %8.1f MB/s  recv %8.1f MB/s\n", r,
+               t.pages - rt.pages, t.refs - rt.refs,
+               (double)(t.raw_bytes - rt.raw_bytes) /
+               ((t.wire_bytes - rt.wire_bytes) ? : 1),
+               mb_per_s(t.raw_bytes - rt.raw_bytes, t.send_us - rt.send_us),
+               mb_per_s(t.raw_bytes - rt.raw_bytes, t.recv_us - rt.recv_us));
+    }
+
+    xc_compression_get_stats(NULL, s.ctx, &cs);
+    printf("total:    %6lu pages %5lu refs  ratio %6.2f  "
+           "send %8.1f MB/s  recv %8.1f MB/s\n"
+           "          %" PRIu64 " chunks, %" PRIu64 " cache hits, "
+           "%" PRIu64 " misses\n"
+           "          pages: %" PRIu64 " same, %" PRIu64 " delta, "
+           "%" PRIu64 " zero, %" PRIu64 " rle, %" PRIu64 " raw\n",
+           t.pages, t.refs, (double)t.raw_bytes / (t.wire_bytes ? : 1),
+           mb_per_s(t.raw_bytes, t.send_us), mb_per_s(t.raw_bytes, t.recv_us),
+           t.chunks, cs.cache_hits, cs.cache_misses,
+           cs.same_pages, cs.delta_pages, cs.zero_pages, cs.rle_pages,
+           cs.raw_pages);
+    rc = 0;
+
+ out:
+    if ( s.ctx )
+        xc_compression_free_context(NULL, s.ctx);
+    free(mem);
+    free(rmem);
+    free(dirty);
+    free(s.order);
+    free(s.compbuf);
+    free(s.wire);
+    free(s.decoded);
+
+    return rc;
+}
@@ -11,25 +11,47 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <xenctrl.h>
 #include <xenguest.h>
 
+static xen_pfn_t *postcopy_pfns;
+static unsigned long nr_postcopy;
+
+static int postcopy_take_pfns(xen_pfn_t *pfns, unsigned long nr, void *data)
+{
+    postcopy_pfns = pfns;
+    nr_postcopy = nr;
+    return 0;
+}
+
+/* The domain may be unpaused once this is printed */
+static int postcopy_ready(void *data)
+{
+    printf("postcopy-ready\n");
+    fflush(stdout);
+    return 0;
+}
+
 int
 main(int argc, char **argv)
 {
     unsigned int domid, store_evtchn, console_evtchn;
-    unsigned int hvm, pae, apic, lflags, checkpointed;
+    unsigned int hvm, pae, apic, lflags, checkpointed, postcopy;
     xc_interface *xch;
     int io_fd, ret;
     int superpages;
     unsigned long store_mfn = 0, console_mfn = 0;
     xentoollog_level lvl;
     xentoollog_logger *l;
+    struct restore_callbacks callbacks;
+    struct postcopy_callbacks pc_callbacks;
 
-    if ( !( argc >= 8 && argc <= 10) )
+    if ( !( argc >= 8 && argc <= 11) )
         errx(1, "usage: %s iofd domid store_evtchn "
-             "console_evtchn hvm pae apic [superpages [checkpointed]]", argv[0]);
+             "console_evtchn hvm pae apic [superpages [checkpointed "
+             "[postcopy]]]", argv[0]);
 
     lvl = XTL_DETAIL;
     lflags = XTL_STDIOSTREAM_SHOW_PID | XTL_STDIOSTREAM_HIDE_PROGRESS;
@@ -53,10 +75,18 @@ main(int argc, char **argv)
         checkpointed = atoi(argv[9]);
     else
         checkpointed = 0;
+    if ( argc >= 11 )
+        postcopy = atoi(argv[10]);
+    else
+        postcopy = 0;
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    if ( postcopy )
+        callbacks.postcopy_pfns = postcopy_take_pfns;
 
     ret = xc_domain_restore(xch, io_fd, domid, store_evtchn, &store_mfn, 0,
                             console_evtchn, &console_mfn, 0, hvm, pae, superpages,
-                            0, checkpointed, NULL, NULL);
+                            0, checkpointed, NULL, &callbacks, NULL, 0);
 
     if ( ret == 0 )
     {
@@ -66,6 +96,17 @@ main(int argc, char **argv)
 	fflush(stdout);
     }
 
+    /* Serve the domain's faults until the sender has sent everything */
+    if ( ret == 0 && nr_postcopy )
+    {
+        memset(&pc_callbacks, 0, sizeof(pc_callbacks));
+        pc_callbacks.ready = postcopy_ready;
+        ret = xc_domain_postcopy_restore(xch, io_fd, io_fd, domid,
+                                         postcopy_pfns, nr_postcopy,
+                                         &pc_callbacks);
+    }
+    free(postcopy_pfns);
+
     xc_interface_close(xch);
 
     return ret;
@@ -86,6 +86,22 @@ static int suspend(void* data)
     return compat_suspend();
 }
 
+/**
+ * With XCFLAGS_POSTCOPY the pages left behind are served once the
+ * device model record follows the stream: ask for it through stdout and
+ * wait for the acknowledgement on stdin, as compat_suspend does.
+ */
+static int postcopy_begin(void)
+{
+    char ans[30];
+
+    printf("postcopy\n");
+    fflush(stdout);
+
+    return (fgets(ans, sizeof(ans), stdin) != NULL &&
+            !strncmp(ans, "done\n", 5));
+}
+
 /* For HVM guests, there are two sources of dirty pages: the Xen shadow
  * log-dirty bitmap, which we get with a hypercall, and qemu's version.
  * The protocol for getting page-dirtying data from qemu uses a
@@ -166,20 +182,23 @@ static int switch_qemu_logdirty(int domid, unsigned int enable, void *data)
 int
 main(int argc, char **argv)
 {
-    unsigned int maxit, max_f, lflags;
+    unsigned int maxit, max_f, downtime_ms = 0, lflags;
     int io_fd, ret, port;
     struct save_callbacks callbacks;
     xentoollog_level lvl;
     xentoollog_logger *l;
 
-    if (argc != 6)
-        errx(1, "usage: %s iofd domid maxit maxf flags", argv[0]);
+    if (argc != 6 && argc != 7)
+        errx(1, "usage: %s iofd domid maxit maxf flags [downtime_ms]",
+             argv[0]);
 
     io_fd = atoi(argv[1]);
     si.domid = atoi(argv[2]);
     maxit = atoi(argv[3]);
     max_f = atoi(argv[4]);
     si.flags = atoi(argv[5]);
+    if (argc == 7)
+        downtime_ms = atoi(argv[6]);
 
     si.suspend_evtchn = -1;
 
@@ -213,7 +232,15 @@ main(int argc, char **argv)
     callbacks.suspend = suspend;
     callbacks.switch_qemu_logdirty = switch_qemu_logdirty;
     ret = xc_domain_save(si.xch, io_fd, si.domid, maxit, max_f, si.flags, 
-                         &callbacks, !!(si.flags & XCFLAGS_HVM), 0);
+                         &callbacks, !!(si.flags & XCFLAGS_HVM), 0,
+                         downtime_ms, NULL, 0);
+
+    if (ret == 0 && (si.flags & XCFLAGS_POSTCOPY))
+    {
+        if (!postcopy_begin())
+            errx(1, "no device model record before the post-copy phase");
+        ret = xc_domain_postcopy_save(si.xch, io_fd, io_fd, si.domid);
+    }
 
     if (si.suspend_evtchn > 0)
 	 xc_suspend_evtchn_release(si.xch, si.xce, si.domid, si.suspend_evtchn);
@@ -146,6 +146,32 @@ bool xs_set_permissions(struct xs_handle *h, xs_transaction_t t,
 			const char *path, struct xs_permissions *perms,
 			unsigned int num_perms);
 
+/* One operation for xs_multi(): XS_READ, XS_WRITE, XS_MKDIR, XS_RM or
+ * XS_SET_PERMS, with what the matching call above would take.
+ */
+struct xs_multi_op {
+	enum xsd_sockmsg_type type;
+	const char *path;
+	/* XS_WRITE */
+	const void *data;
+	unsigned int len;
+	/* XS_SET_PERMS */
+	struct xs_permissions *perms;
+	unsigned int num_perms;
+	/* XS_READ: filled in as by xs_read(), call free() after use. */
+	void *value;
+	unsigned int value_len;
+};
+
+/* Do several operations in one request, in order.  Outside a
+ * transaction either all of them happen or none does; within one, they
+ * stop at the first to fail.
+ * Returns false on failure: errno is ENOSYS if xenstored cannot do
+ * this, or E2BIG if they do not fit in one request.
+ */
+bool xs_multi(struct xs_handle *h, xs_transaction_t t,
+	      struct xs_multi_op *ops, unsigned int num_ops);
+
 /* Watch a node for changes (poll on fd to detect, or call read_watch()).
  * When the node (or any child) changes, fd will become readable.
  * Token is returned when watch is read, to allow matching.
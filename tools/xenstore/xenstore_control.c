@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,15 +9,19 @@
 int main(int argc, char **argv)
 {
   struct xs_handle * xsh;
+  char *reply;
 
   if (argc < 2 ||
-      strcmp(argv[1], "check"))
+      (strcmp(argv[1], "check") && strcmp(argv[1], "watches") &&
+       strcmp(argv[1], "snapshot")))
   {
     fprintf(stderr,
             "Usage:\n"
             "\n"
             "       %s check\n"
-            "\n", argv[0]);
+            "       %s watches\n"
+            "       %s snapshot\n"
+            "\n", argv[0], argv[0], argv[0]);
     return 2;
   }
 
@@ -27,7 +32,15 @@ int main(int argc, char **argv)
     return 1;
   }
 
-  xs_debug_command(xsh, argv[1], NULL, 0);
+  reply = xs_debug_command(xsh, argv[1], NULL, 0);
+  if (reply == NULL) {
+    fprintf(stderr, "%s failed: %s\n", argv[1], strerror(errno));
+    xs_daemon_close(xsh);
+    return 1;
+  }
+  if (!strcmp(argv[1], "watches"))
+    fputs(reply, stdout);
+  free(reply);
 
   xs_daemon_close(xsh);
 
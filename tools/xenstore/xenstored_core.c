@@ -47,6 +47,7 @@
 #include "xenstore_lib.h"
 #include "xenstored_core.h"
 #include "xenstored_watch.h"
+#include "xenstored_store.h"
 #include "xenstored_transaction.h"
 #include "xenstored_domain.h"
 #include "xenctrl.h"
@@ -70,43 +71,15 @@ static bool remove_local = true;
 static int reopen_log_pipe[2];
 static int reopen_log_pipe0_pollfd_idx = -1;
 static char *tracefile = NULL;
-static TDB_CONTEXT *tdb_ctx = NULL;
 
 static void corrupt(struct connection *conn, const char *fmt, ...);
 static void check_store(void);
 
-#define log(...)							\
-	do {								\
-		char *s = talloc_asprintf(NULL, __VA_ARGS__);		\
-		trace("%s\n", s);					\
-		syslog(LOG_ERR, "%s",  s);				\
-		talloc_free(s);						\
-	} while (0)
-
-
 int quota_nb_entry_per_domain = 1000;
 int quota_nb_watch_per_domain = 128;
 int quota_max_entry_size = 2048; /* 2K */
 int quota_max_transaction = 10;
 
-TDB_CONTEXT *tdb_context(struct connection *conn)
-{
-	/* conn = NULL used in manual_node at setup. */
-	if (!conn || !conn->transaction)
-		return tdb_ctx;
-	return tdb_transaction_context(conn->transaction);
-}
-
-bool replace_tdb(const char *newname, TDB_CONTEXT *newtdb)
-{
-	if (!(tdb_ctx->flags & TDB_INTERNAL))
-		if (rename(newname, xs_daemon_tdb()) != 0)
-			return false;
-	tdb_close(tdb_ctx);
-	tdb_ctx = talloc_steal(talloc_autofree_context(), newtdb);
-	return true;
-}
-
 static char *sockmsg_string(enum xsd_sockmsg_type type)
 {
 	switch (type) {
@@ -131,6 +104,7 @@ static char *sockmsg_string(enum xsd_sockmsg_type type)
 	case XS_RESUME: return "RESUME";
 	case XS_SET_TARGET: return "SET_TARGET";
 	case XS_RESET_WATCHES: return "RESET_WATCHES";
+	case XS_MULTI: return "MULTI";
 	default:
 		return "**UNKNOWN**";
 	}
@@ -299,6 +273,8 @@ static int destroy_conn(void *_conn)
         if (conn->target)
                 talloc_unlink(conn, conn->target);
 	list_del(&conn->list);
+	/* Our domain fires @releaseDomain as it goes: not to us. */
+	conn_delete_all_watches(conn);
 	trace_destroy(conn, "connection");
 	return 0;
 }
@@ -395,39 +371,32 @@ bool is_child(const char *child, const char *parent)
 /* If it fails, returns NULL and sets errno. */
 static struct node *read_node(struct connection *conn, const char *name)
 {
-	TDB_DATA key, data;
-	uint32_t *p;
+	TDB_DATA data;
+	struct xs_tdb_record_hdr *hdr;
 	struct node *node;
-	TDB_CONTEXT * context = tdb_context(conn);
-
-	key.dptr = (void *)name;
-	key.dsize = strlen(name);
-	data = tdb_fetch(context, key);
 
-	if (data.dptr == NULL) {
-		if (tdb_error(context) == TDB_ERR_NOEXIST)
-			errno = ENOENT;
-		else {
-			log("TDB error on read: %s", tdb_errorstr(context));
-			errno = EIO;
-		}
+	/* conn = NULL used in manual_node at setup. */
+	if (conn && conn->transaction)
+		data = transaction_fetch(conn->transaction, name);
+	else
+		data = store_fetch(name);
+	if (data.dptr == NULL)
 		return NULL;
-	}
 
 	node = talloc(name, struct node);
 	node->name = talloc_strdup(node, name);
 	node->parent = NULL;
-	node->tdb = tdb_context(conn);
+	node->trans = conn ? conn->transaction : NULL;
 	talloc_steal(node, data.dptr);
 
 	/* Datalen, childlen, number of permissions */
-	p = (uint32_t *)data.dptr;
-	node->num_perms = p[0];
-	node->datalen = p[1];
-	node->childlen = p[2];
+	hdr = (void *)data.dptr;
+	node->num_perms = hdr->num_perms;
+	node->datalen = hdr->datalen;
+	node->childlen = hdr->childlen;
 
 	/* Permissions are struct xs_permissions. */
-	node->perms = (void *)&p[3];
+	node->perms = hdr->perms;
 	/* Data is binary blob (usually ascii, no nul). */
 	node->data = node->perms + node->num_perms;
 	/* Children is strings, nul separated. */
@@ -440,16 +409,13 @@ static bool write_node(struct connection *conn, const struct node *node)
 {
 	/*
 	 * conn will be null when this is called from manual_node.
-	 * tdb_context copes with this.
 	 */
 
-	TDB_DATA key, data;
+	TDB_DATA data;
+	struct xs_tdb_record_hdr *hdr;
 	void *p;
 
-	key.dptr = (void *)node->name;
-	key.dsize = strlen(node->name);
-
-	data.dsize = 3*sizeof(uint32_t)
+	data.dsize = sizeof(*hdr)
 		+ node->num_perms*sizeof(node->perms[0])
 		+ node->datalen + node->childlen;
 
@@ -457,10 +423,13 @@ static bool write_node(struct connection *conn, const struct node *node)
 		goto error;
 
 	data.dptr = talloc_size(node, data.dsize);
-	((uint32_t *)data.dptr)[0] = node->num_perms;
-	((uint32_t *)data.dptr)[1] = node->datalen;
-	((uint32_t *)data.dptr)[2] = node->childlen;
-	p = data.dptr + 3 * sizeof(uint32_t);
+	hdr = (void *)data.dptr;
+	hdr->generation = generation;
+	hdr->num_perms = node->num_perms;
+	hdr->datalen = node->datalen;
+	hdr->childlen = node->childlen;
+	hdr->pad = 0;
+	p = hdr->perms;
 
 	memcpy(p, node->perms, node->num_perms*sizeof(node->perms[0]));
 	p += node->num_perms*sizeof(node->perms[0]);
@@ -468,11 +437,15 @@ static bool write_node(struct connection *conn, const struct node *node)
 	p += node->datalen;
 	memcpy(p, node->children, node->childlen);
 
-	/* TDB should set errno, but doesn't even set ecode AFAICT. */
-	if (tdb_store(tdb_context(conn), key, data, TDB_REPLACE) != 0) {
-		corrupt(conn, "Write of %s failed", key.dptr);
+	/* Transactions give their nodes a generation when they commit. */
+	if (conn && conn->transaction)
+		return transaction_store(conn->transaction, node->name, data);
+
+	if (!store_store(node->name, data)) {
+		corrupt(conn, "Write of %s failed", node->name);
 		goto error;
 	}
+	generation++;
 	return true;
  error:
 	errno = ENOSPC;
@@ -622,11 +595,58 @@ unsigned int get_strings(struct buffered_data *data,
 	return i;
 }
 
+struct multi_replies
+{
+	/* Each reply, header then payload, one after another. */
+	char *buffer;
+	unsigned int used;
+
+	/* Where the last one starts. */
+	unsigned int last;
+
+	/* Set if one could not be added. */
+	int err;
+};
+
+static void add_multi_reply(struct connection *conn,
+			    enum xsd_sockmsg_type type,
+			    const void *data, unsigned int len)
+{
+	struct multi_replies *multi = conn->multi;
+	struct xsd_sockmsg hdr;
+	char *buffer;
+
+	if (multi->err)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.type = type;
+	hdr.len = len;
+
+	buffer = talloc_realloc(multi, multi->buffer, char,
+				multi->used + sizeof(hdr) + len);
+	if (!buffer) {
+		multi->err = ENOMEM;
+		return;
+	}
+	multi->buffer = buffer;
+	multi->last = multi->used;
+	memcpy(multi->buffer + multi->used, &hdr, sizeof(hdr));
+	memcpy(multi->buffer + multi->used + sizeof(hdr), data, len);
+	multi->used += sizeof(hdr) + len;
+}
+
 void send_reply(struct connection *conn, enum xsd_sockmsg_type type,
 		const void *data, unsigned int len)
 {
 	struct buffered_data *bdata;
 
+	/* Replies to an XS_MULTI's operations go into its own reply. */
+	if (conn->multi && type != XS_WATCH_EVENT) {
+		add_multi_reply(conn, type, data, len);
+		return;
+	}
+
 	if ( len > XENSTORE_PAYLOAD_MAX ) {
 		send_error(conn, E2BIG);
 		return;
@@ -784,12 +804,12 @@ static void do_read(struct connection *conn, const char *name)
 
 static void delete_node_single(struct connection *conn, struct node *node)
 {
-	TDB_DATA key;
-
-	key.dptr = (void *)node->name;
-	key.dsize = strlen(node->name);
-
-	if (tdb_delete(tdb_context(conn), key) != 0) {
+	if (conn && conn->transaction) {
+		if (!transaction_delete(conn->transaction, node->name)) {
+			corrupt(conn, "Could not delete '%s'", node->name);
+			return;
+		}
+	} else if (!store_delete(node->name)) {
 		corrupt(conn, "Could not delete '%s'", node->name);
 		return;
 	}
@@ -830,7 +850,7 @@ static struct node *construct_node(struct connection *conn, const char *name)
 
 	/* Allocate node */
 	node = talloc(name, struct node);
-	node->tdb = tdb_context(conn);
+	node->trans = conn ? conn->transaction : NULL;
 	node->name = talloc_strdup(node, name);
 
 	/* Inherit permissions, except unprivileged domains own what they create */
@@ -851,15 +871,14 @@ static struct node *construct_node(struct connection *conn, const char *name)
 static int destroy_node(void *_node)
 {
 	struct node *node = _node;
-	TDB_DATA key;
 
 	if (streq(node->name, "/"))
 		corrupt(NULL, "Destroying root node!");
 
-	key.dptr = (void *)node->name;
-	key.dsize = strlen(node->name);
-
-	tdb_delete(node->tdb, key);
+	if (node->trans)
+		transaction_delete(node->trans, node->name);
+	else
+		store_delete(node->name);
 	return 0;
 }
 
@@ -1182,9 +1201,153 @@ static void do_debug(struct connection *conn, struct buffered_data *in)
 	if (streq(in->buffer, "check"))
 		check_store();
 
+	if (streq(in->buffer, "snapshot")) {
+		if (!store_snapshot()) {
+			send_error(conn, errno);
+			return;
+		}
+	}
+
+	if (streq(in->buffer, "watches")) {
+		char *stats = watch_stats_string(in);
+
+		if (!stats) {
+			send_error(conn, ENOMEM);
+			return;
+		}
+		send_reply(conn, XS_DEBUG, stats, strlen(stats) + 1);
+		return;
+	}
+
 	send_ack(conn, XS_DEBUG);
 }
 
+/* Run one operation of an XS_MULTI: false if it is not one we allow. */
+static bool do_multi_op(struct connection *conn, struct buffered_data *op)
+{
+	switch (op->hdr.msg.type) {
+	case XS_READ:
+		do_read(conn, onearg(op));
+		break;
+
+	case XS_WRITE:
+		do_write(conn, op);
+		break;
+
+	case XS_MKDIR:
+		do_mkdir(conn, onearg(op));
+		break;
+
+	case XS_RM:
+		do_rm(conn, onearg(op));
+		break;
+
+	case XS_SET_PERMS:
+		do_set_perms(conn, op);
+		break;
+
+	default:
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Run each operation in turn, stopping at the first to fail.  Outside
+ * a transaction they get one of their own, so either all of them
+ * happen or none does.
+ */
+static void do_multi(struct connection *conn, struct buffered_data *in)
+{
+	struct transaction *trans = NULL;
+	struct multi_replies *multi;
+	struct buffered_data *op;
+	struct xsd_sockmsg hdr, *last;
+	unsigned int off;
+	int err = 0;
+
+	multi = talloc_zero(in, struct multi_replies);
+	if (!multi) {
+		send_error(conn, ENOMEM);
+		return;
+	}
+
+	if (!conn->transaction) {
+		trans = transaction_start_internal(in);
+		if (!trans) {
+			send_error(conn, ENOMEM);
+			return;
+		}
+		conn->transaction = trans;
+	}
+
+	conn->multi = multi;
+	for (off = 0; off < in->used; off += sizeof(hdr) + hdr.len) {
+		if (in->used - off < sizeof(hdr)) {
+			err = EINVAL;
+			break;
+		}
+		memcpy(&hdr, in->buffer + off, sizeof(hdr));
+		if (hdr.len > in->used - off - sizeof(hdr)) {
+			err = EINVAL;
+			break;
+		}
+
+		/* Handlers hang things off what they are given. */
+		op = new_buffer(in);
+		if (op)
+			op->buffer = talloc_array(op, char, hdr.len + 1);
+		if (!op || !op->buffer) {
+			err = ENOMEM;
+			break;
+		}
+		memcpy(op->buffer, in->buffer + off + sizeof(hdr), hdr.len);
+		op->used = hdr.len;
+		op->hdr.msg = hdr;
+		op->hdr.msg.req_id = in->hdr.msg.req_id;
+		op->hdr.msg.tx_id = in->hdr.msg.tx_id;
+		op->inhdr = false;
+
+		if (!do_multi_op(conn, op))
+			err = EINVAL;
+		else
+			err = multi->err;
+		talloc_free(op);
+		if (err)
+			break;
+
+		last = (struct xsd_sockmsg *)(multi->buffer + multi->last);
+		if (last->type == XS_ERROR)
+			break;
+	}
+	conn->multi = NULL;
+
+	if (!err && multi->used > XENSTORE_PAYLOAD_MAX)
+		err = E2BIG;
+	if (err) {
+		send_error(conn, err);
+		return;
+	}
+
+	/* The first operation to fail gives the error for all of them. */
+	last = (struct xsd_sockmsg *)(multi->buffer + multi->last);
+	if (multi->used && last->type == XS_ERROR) {
+		send_reply(conn, XS_ERROR, last + 1, last->len);
+		return;
+	}
+
+	if (trans) {
+		conn->transaction = NULL;
+		err = transaction_end_internal(conn, trans);
+		if (err) {
+			send_error(conn, err);
+			return;
+		}
+	}
+
+	send_reply(conn, XS_MULTI, multi->buffer, multi->used);
+}
+
 /* Process "in" for conn: "in" will vanish after this conversation, so
  * we can talloc off it for temporary variables.  May free "conn".
  */
@@ -1278,6 +1441,10 @@ static void process_message(struct connection *conn, struct buffered_data *in)
 		do_reset_watches(conn);
 		break;
 
+	case XS_MULTI:
+		do_multi(conn, in);
+		break;
+
 	default:
 		eprintf("Client unknown operation %i", in->hdr.msg.type);
 		send_error(conn, ENOSYS);
@@ -1468,13 +1635,7 @@ static void manual_node(const char *name, const char *child)
 
 static void setup_structure(void)
 {
-	char *tdbname;
-	tdbname = talloc_strdup(talloc_autofree_context(), xs_daemon_tdb());
-
-	if (!(tdb_flags & TDB_INTERNAL))
-		tdb_ctx = tdb_open(tdbname, 0, tdb_flags, O_RDWR, 0);
-
-	if (tdb_ctx) {
+	if (store_open(xs_daemon_tdb(), tdb_flags)) {
 		/* XXX When we make xenstored able to restart, this will have
 		   to become cleverer, checking for existing domains and not
 		   removing the corresponding entries, but for now xenstored
@@ -1503,11 +1664,6 @@ static void setup_structure(void)
 		talloc_free(tlocal);
 	}
 	else {
-		tdb_ctx = tdb_open(tdbname, 7919, tdb_flags, O_RDWR|O_CREAT,
-				   0640);
-		if (!tdb_ctx)
-			barf_perror("Could not create tdb file %s", tdbname);
-
 		manual_node("/", "tool");
 		manual_node("/tool", "xenstored");
 		manual_node("/tool/xenstored", NULL);
@@ -1631,24 +1787,31 @@ static void check_store_(const char *name, struct hashtable *reachable)
 }
 
 
+struct orphans
+{
+	struct hashtable *reachable;
+	char **names;
+	unsigned int num;
+};
+
 /**
  * Helper to clean_store below.
  */
-static int clean_store_(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
-			void *private)
+static int clean_store_(const char *name, TDB_DATA val, void *private)
 {
-	struct hashtable *reachable = private;
-	char * name = talloc_strndup(NULL, key.dptr, key.dsize);
+	struct orphans *orphans = private;
 
-	if (!hashtable_search(reachable, name)) {
+	if (!hashtable_search(orphans->reachable, (void *)name)) {
 		log("clean_store: '%s' is orphaned!", name);
 		if (recovery) {
-			tdb_delete(tdb, key);
+			orphans->names = talloc_realloc(NULL, orphans->names,
+							char *,
+							orphans->num + 1);
+			orphans->names[orphans->num++] =
+				talloc_strdup(orphans->names, name);
 		}
 	}
 
-	talloc_free(name);
-
 	return 0;
 }
 
@@ -1659,7 +1822,15 @@ static int clean_store_(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
  */
 static void clean_store(struct hashtable *reachable)
 {
-	tdb_traverse(tdb_ctx, &clean_store_, reachable);
+	struct orphans orphans = { reachable, NULL, 0 };
+	unsigned int i;
+
+	store_traverse(&clean_store_, &orphans);
+
+	/* Not while traversing: the in-memory store cannot take it. */
+	for (i = 0; i < orphans.num; i++)
+		store_delete(orphans.names[i]);
+	talloc_free(orphans.names);
 }
 
 
@@ -1774,6 +1945,11 @@ static void usage(void)
 "  --no-recovery       to request that no recovery should be attempted when\n"
 "                      the store is corrupted (debug only),\n"
 "  --internal-db       store database in memory, not on disk\n"
+"  --tdb-store         keep the store in the tdb file, written on every\n"
+"                      change, rather than in memory with snapshots,\n"
+"  --snapshot-interval <secs>\n"
+"                      write out a changed in-memory store every secs\n"
+"                      seconds (default 60), or only on demand if 0,\n"
 "  --preserve-local    to request that /local is preserved on start-up,\n"
 "  --verbose           to request verbose execution.\n");
 }
@@ -1794,6 +1970,8 @@ static struct option options[] = {
 	{ "no-recovery", 0, NULL, 'R' },
 	{ "preserve-local", 0, NULL, 'L' },
 	{ "internal-db", 0, NULL, 'I' },
+	{ "tdb-store", 0, NULL, 'B' },
+	{ "snapshot-interval", 1, NULL, 'i' },
 	{ "verbose", 0, NULL, 'V' },
 	{ "watch-nb", 1, NULL, 'W' },
 	{ NULL, 0, NULL, 0 } };
@@ -1812,7 +1990,7 @@ int main(int argc, char *argv[])
 	const char *pidfile = NULL;
 	int timeout;
 
-	while ((opt = getopt_long(argc, argv, "DE:F:HNPS:t:T:RLVW:", options,
+	while ((opt = getopt_long(argc, argv, "BDE:F:Hi:INPS:t:T:RLVW:", options,
 				  NULL)) != -1) {
 		switch (opt) {
 		case 'D':
@@ -1851,6 +2029,12 @@ int main(int argc, char *argv[])
 		case 'I':
 			tdb_flags = TDB_INTERNAL|TDB_NOLOCK;
 			break;
+		case 'B':
+			store_in_tdb = true;
+			break;
+		case 'i':
+			snapshot_interval = strtol(optarg, NULL, 10);
+			break;
 		case 'V':
 			verbose = true;
 			break;
@@ -1923,6 +2107,13 @@ int main(int argc, char *argv[])
 	/* Main loop. */
 	for (;;) {
 		struct connection *conn, *next;
+		int snapshot_timeout;
+
+		/* Write out the store, if it is time to. */
+		snapshot_timeout = store_periodic();
+		if (snapshot_timeout >= 0 &&
+		    (timeout < 0 || snapshot_timeout < timeout))
+			timeout = snapshot_timeout;
 
 		if (poll(fds, nr_fds, timeout) < 0) {
 			if (errno == EINTR)
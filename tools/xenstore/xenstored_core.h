@@ -27,6 +27,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <errno.h>
+#include <syslog.h>
 #include "xenstore_lib.h"
 #include "list.h"
 #include "tdb.h"
@@ -78,6 +79,9 @@ struct connection
 	/* Transaction context for current request (NULL if none). */
 	struct transaction *transaction;
 
+	/* Replies to the operations of the XS_MULTI being run, if any. */
+	struct multi_replies *multi;
+
 	/* List of in-progress transactions. */
 	struct list_head transaction_list;
 	uint32_t next_transaction_id;
@@ -98,11 +102,22 @@ struct connection
 };
 extern struct list_head connections;
 
+/* A node as stored in the TDB: this, then perms, data and children. */
+struct xs_tdb_record_hdr {
+	/* Store generation of the last change to the node. */
+	uint64_t generation;
+	uint32_t num_perms;
+	uint32_t datalen;
+	uint32_t childlen;
+	uint32_t pad;
+	struct xs_permissions perms[0];
+};
+
 struct node {
 	const char *name;
 
-	/* Database I came from */
-	TDB_CONTEXT *tdb;
+	/* Transaction I came from, NULL if from the store itself */
+	struct transaction *trans;
 
 	/* Parent (optional) */
 	struct node *parent;
@@ -147,15 +162,6 @@ struct node *get_node(struct connection *conn,
 		      const char *name,
 		      enum xs_perm_type perm);
 
-/* Get TDB context for this connection */
-TDB_CONTEXT *tdb_context(struct connection *conn);
-
-/* Destructor for tdbs: required for transaction code */
-int destroy_tdb(void *_tdb);
-
-/* Replace the tdb: required for transaction code */
-bool replace_tdb(const char *newname, TDB_CONTEXT *newtdb);
-
 struct connection *new_connection(connwritefn_t *write, connreadfn_t *read);
 
 
@@ -167,6 +173,16 @@ void trace_create(const void *data, const char *type);
 void trace_destroy(const void *data, const char *type);
 void trace_watch_timeout(const struct connection *conn, const char *node, const char *token);
 void trace(const char *fmt, ...);
+
+/* Trace, and tell syslog: for errors. */
+#define log(...)							\
+	do {								\
+		char *s = talloc_asprintf(NULL, __VA_ARGS__);		\
+		trace("%s\n", s);					\
+		syslog(LOG_ERR, "%s",  s);				\
+		talloc_free(s);						\
+	} while (0)
+
 void dtrace_io(const struct connection *conn, const struct buffered_data *data, int out);
 
 extern int event_fd;
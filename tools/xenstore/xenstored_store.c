@@ -0,0 +1,585 @@
+/*
+    Node store for Xen Store Daemon.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * The store holds one record per node, keyed by its path: see
+ * struct xs_tdb_record_hdr for the layout.
+ *
+ * By default the records live in a hashtable in memory, and the TDB
+ * file is only a snapshot of them: written every snapshot_interval
+ * seconds if anything changed, or when asked to with the "snapshot"
+ * debug command, and read back in at start-up.  A request then costs
+ * a hash lookup and a copy, rather than a trip through TDB's locks
+ * and free lists.  --tdb-store keeps the old behaviour of reading
+ * and writing the TDB file directly.
+ *
+ * Between store_transaction_start() and its end, each change saves
+ * what it replaced in an undo list, so that cancelling can put it
+ * back.  In memory that takes no allocation: replaced data is kept
+ * and deleted records are only hidden until the commit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include "talloc.h"
+#include "list.h"
+#include "hashtable.h"
+#include "xenstored_store.h"
+#include "utils.h"
+
+bool store_in_tdb = false;
+int snapshot_interval = 60;
+
+/* The store itself with --tdb-store. */
+static TDB_CONTEXT *tdb_ctx;
+
+/* Where snapshots go: NULL for --internal-db. */
+static char *tdb_name;
+
+struct undo;
+
+struct record
+{
+	struct list_head list;
+
+	/* Also the key in records. */
+	char *name;
+	TDB_DATA data;
+
+	/* Deleted by the store transaction, which has its undo here. */
+	bool deleted;
+	struct undo *undo;
+};
+
+static struct hashtable *records;
+static LIST_HEAD(record_list);
+
+/* What a store transaction changed, and how to put it back. */
+struct undo
+{
+	struct list_head list;
+
+	/* In memory: the record, and whether it is new or its old data. */
+	struct record *rec;
+	bool added;
+
+	/* With --tdb-store: the record as it was, if it existed. */
+	char *name;
+	bool existed;
+
+	TDB_DATA data;
+};
+
+static bool in_transaction;
+static LIST_HEAD(undo_list);
+static void *undo_ctx;
+
+/* Has the store changed since the last snapshot? */
+static bool dirty;
+static time_t last_snapshot;
+
+static unsigned int hash_from_key_fn(void *k)
+{
+	char *str = k;
+	unsigned int hash = 5381;
+	char c;
+
+	while ((c = *str++))
+		hash = ((hash << 5) + hash) + (unsigned int)c;
+
+	return hash;
+}
+
+static int keys_equal_fn(void *key1, void *key2)
+{
+	return 0 == strcmp((char *)key1, (char *)key2);
+}
+
+static TDB_DATA tdb_key(const char *name)
+{
+	TDB_DATA key;
+
+	key.dptr = (void *)name;
+	key.dsize = strlen(name);
+	return key;
+}
+
+static int tdb_errno(void)
+{
+	if (tdb_error(tdb_ctx) == TDB_ERR_NOEXIST)
+		return ENOENT;
+	log("TDB error: %s", tdb_errorstr(tdb_ctx));
+	return EIO;
+}
+
+static struct undo *add_undo(void)
+{
+	struct undo *u = undo_ctx ? talloc_zero(undo_ctx, struct undo) : NULL;
+
+	if (!u) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	list_add_tail(&u->list, &undo_list);
+	return u;
+}
+
+static void drop_undo(struct undo *u)
+{
+	list_del(&u->list);
+	talloc_free(u);
+}
+
+/* Save what the TDB has for name, before it changes. */
+static bool save_tdb_undo(const char *name)
+{
+	struct undo *u = add_undo();
+	TDB_DATA old;
+
+	if (!u)
+		return false;
+
+	u->name = talloc_strdup(u, name);
+	if (!u->name) {
+		drop_undo(u);
+		errno = ENOMEM;
+		return false;
+	}
+
+	old = tdb_fetch(tdb_ctx, tdb_key(name));
+	if (old.dptr) {
+		u->existed = true;
+		u->data = old;
+		talloc_steal(u, old.dptr);
+	} else if (tdb_error(tdb_ctx) != TDB_ERR_NOEXIST) {
+		errno = tdb_errno();
+		drop_undo(u);
+		return false;
+	}
+
+	return true;
+}
+
+/* Keep what rec holds before the store transaction changes it. */
+static bool save_record_undo(struct record *rec)
+{
+	struct undo *u;
+
+	if (rec->undo)
+		return true;
+
+	u = add_undo();
+	if (!u)
+		return false;
+	u->rec = rec;
+	u->data = rec->data;
+	rec->undo = u;
+
+	return true;
+}
+
+static void remove_record(struct record *rec)
+{
+	/* Frees the key, which is rec->name. */
+	hashtable_remove(records, rec->name);
+	list_del(&rec->list);
+	free(rec->data.dptr);
+	free(rec);
+}
+
+static int load_record(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
+		       void *private)
+{
+	char *name = talloc_strndup(NULL, key.dptr, key.dsize);
+	bool ok = name && store_store(name, val);
+
+	talloc_free(name);
+	return ok ? 0 : -1;
+}
+
+bool store_open(const char *tdbname, int tdb_flags)
+{
+	TDB_CONTEXT *tdb = NULL;
+	char *name;
+	bool existed;
+
+	/* tdb_open() hangs things off the name, so it must be talloc'ed. */
+	name = talloc_strdup(talloc_autofree_context(), tdbname);
+	if (!(tdb_flags & TDB_INTERNAL)) {
+		tdb_name = name;
+		tdb = tdb_open(name, 0, tdb_flags, O_RDWR, 0);
+	}
+	existed = (tdb != NULL);
+
+	if (store_in_tdb) {
+		if (!tdb)
+			tdb = tdb_open(name, 7919, tdb_flags,
+				       O_RDWR|O_CREAT, 0640);
+		if (!tdb)
+			barf_perror("Could not create tdb file %s", tdbname);
+		tdb_ctx = tdb;
+		return existed;
+	}
+
+	records = create_hashtable(7919, hash_from_key_fn, keys_equal_fn);
+	if (!records)
+		barf_perror("Could not create store");
+
+	if (tdb) {
+		if (tdb_traverse(tdb, load_record, NULL) < 0)
+			barf_perror("Could not load tdb file %s", tdbname);
+		tdb_close(tdb);
+	}
+	dirty = false;
+	last_snapshot = time(NULL);
+
+	return existed;
+}
+
+TDB_DATA store_fetch(const char *name)
+{
+	TDB_DATA data = { NULL, 0 };
+	struct record *rec;
+
+	if (tdb_ctx) {
+		data = tdb_fetch(tdb_ctx, tdb_key(name));
+		if (data.dptr)
+			talloc_steal(NULL, data.dptr);
+		else
+			errno = tdb_errno();
+		return data;
+	}
+
+	rec = hashtable_search(records, (void *)name);
+	if (!rec || rec->deleted) {
+		errno = ENOENT;
+		return data;
+	}
+
+	data.dptr = talloc_memdup(NULL, rec->data.dptr, rec->data.dsize);
+	if (!data.dptr) {
+		errno = ENOMEM;
+		return data;
+	}
+	data.dsize = rec->data.dsize;
+
+	return data;
+}
+
+bool store_store(const char *name, TDB_DATA data)
+{
+	struct record *rec;
+	struct undo *u = NULL;
+	void *p;
+
+	if (tdb_ctx) {
+		if (in_transaction && !save_tdb_undo(name))
+			return false;
+		/* TDB should set errno, but doesn't even set ecode AFAICT. */
+		if (tdb_store(tdb_ctx, tdb_key(name), data, TDB_REPLACE) != 0) {
+			errno = ENOSPC;
+			return false;
+		}
+		return true;
+	}
+
+	dirty = true;
+
+	rec = hashtable_search(records, (void *)name);
+	if (rec && !in_transaction && rec->data.dsize == data.dsize) {
+		memcpy(rec->data.dptr, data.dptr, data.dsize);
+		return true;
+	}
+
+	if (in_transaction) {
+		if (rec && !save_record_undo(rec))
+			return false;
+		if (!rec && !(u = add_undo()))
+			return false;
+	}
+
+	p = malloc(data.dsize);
+	if (!p) {
+		errno = ENOMEM;
+		goto fail;
+	}
+	memcpy(p, data.dptr, data.dsize);
+
+	if (!rec) {
+		rec = malloc(sizeof(*rec));
+		if (!rec)
+			goto nomem;
+		rec->name = strdup(name);
+		if (!rec->name)
+			goto nomem;
+		if (!hashtable_insert(records, rec->name, rec)) {
+			free(rec->name);
+			goto nomem;
+		}
+		list_add_tail(&rec->list, &record_list);
+		rec->undo = u;
+		if (u) {
+			u->rec = rec;
+			u->added = true;
+		}
+	} else if (!rec->undo || rec->data.dptr != rec->undo->data.dptr)
+		free(rec->data.dptr);
+
+	rec->data.dptr = p;
+	rec->data.dsize = data.dsize;
+	rec->deleted = false;
+
+	return true;
+ nomem:
+	free(rec);
+	free(p);
+	errno = ENOMEM;
+ fail:
+	if (u)
+		drop_undo(u);
+	return false;
+}
+
+bool store_delete(const char *name)
+{
+	struct record *rec;
+
+	if (tdb_ctx) {
+		if (in_transaction && !save_tdb_undo(name))
+			return false;
+		if (tdb_delete(tdb_ctx, tdb_key(name)) != 0) {
+			errno = tdb_errno();
+			return false;
+		}
+		return true;
+	}
+
+	rec = hashtable_search(records, (void *)name);
+	if (!rec || rec->deleted) {
+		errno = ENOENT;
+		return false;
+	}
+
+	if (in_transaction) {
+		if (!save_record_undo(rec))
+			return false;
+		rec->deleted = true;
+	} else
+		remove_record(rec);
+	dirty = true;
+
+	return true;
+}
+
+struct traverse_args
+{
+	int (*fn)(const char *name, TDB_DATA data, void *priv);
+	void *priv;
+};
+
+static int traverse_tdb(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
+			void *private)
+{
+	struct traverse_args *args = private;
+	char *name = talloc_strndup(NULL, key.dptr, key.dsize);
+	int ret = args->fn(name, val, args->priv);
+
+	talloc_free(name);
+	return ret;
+}
+
+void store_traverse(int (*fn)(const char *name, TDB_DATA data, void *priv),
+		    void *priv)
+{
+	struct traverse_args args = { fn, priv };
+	struct record *rec;
+
+	if (tdb_ctx) {
+		tdb_traverse(tdb_ctx, traverse_tdb, &args);
+		return;
+	}
+
+	list_for_each_entry(rec, &record_list, list)
+		if (!rec->deleted && fn(rec->name, rec->data, priv))
+			break;
+}
+
+void store_transaction_start(void)
+{
+	assert(!in_transaction);
+	undo_ctx = talloc_new(NULL);
+	in_transaction = true;
+}
+
+static void end_transaction(void)
+{
+	INIT_LIST_HEAD(&undo_list);
+	talloc_free(undo_ctx);
+	undo_ctx = NULL;
+	in_transaction = false;
+}
+
+void store_transaction_commit(void)
+{
+	struct undo *u;
+	struct record *rec;
+
+	assert(in_transaction);
+
+	if (!tdb_ctx) {
+		list_for_each_entry(u, &undo_list, list) {
+			rec = u->rec;
+			rec->undo = NULL;
+			if (rec->data.dptr != u->data.dptr)
+				free(u->data.dptr);
+			if (rec->deleted)
+				remove_record(rec);
+		}
+	}
+
+	end_transaction();
+}
+
+void store_transaction_cancel(void)
+{
+	struct undo *u;
+	struct record *rec;
+	int ret;
+
+	assert(in_transaction);
+
+	/* Latest first, so that the TDB ends up as it started. */
+	list_for_each_entry_reverse(u, &undo_list, list) {
+		if (tdb_ctx) {
+			if (u->existed)
+				ret = tdb_store(tdb_ctx, tdb_key(u->name), u->data,
+						TDB_REPLACE);
+			else
+				ret = tdb_delete(tdb_ctx, tdb_key(u->name));
+			if (ret != 0 && (u->existed ||
+					 tdb_error(tdb_ctx) != TDB_ERR_NOEXIST))
+				log("Could not put back %s: %s", u->name,
+				    tdb_errorstr(tdb_ctx));
+			continue;
+		}
+
+		rec = u->rec;
+		if (u->added) {
+			remove_record(rec);
+			continue;
+		}
+		if (rec->data.dptr != u->data.dptr)
+			free(rec->data.dptr);
+		rec->data = u->data;
+		rec->deleted = false;
+		rec->undo = NULL;
+	}
+
+	end_transaction();
+}
+
+bool store_snapshot(void)
+{
+	TDB_CONTEXT *tdb;
+	struct record *rec;
+	char *tmpname;
+	bool ok = true;
+
+	/* --tdb-store is always on disk, --internal-db never. */
+	if (tdb_ctx || !tdb_name)
+		return true;
+
+	last_snapshot = time(NULL);
+
+	/* Write it beside the old one, so that there is always one whole. */
+	tmpname = talloc_asprintf(NULL, "%s.new", tdb_name);
+	unlink(tmpname);
+	tdb = tdb_open(tmpname, 7919, TDB_NOLOCK, O_RDWR|O_CREAT|O_EXCL,
+		       0640);
+	if (!tdb) {
+		log("Could not create snapshot %s: %s", tmpname,
+		    strerror(errno));
+		goto out;
+	}
+
+	list_for_each_entry(rec, &record_list, list) {
+		if (rec->deleted)
+			continue;
+		if (tdb_store(tdb, tdb_key(rec->name), rec->data,
+			      TDB_INSERT) != 0) {
+			log("Could not write %s to snapshot: %s", rec->name,
+			    tdb_errorstr(tdb));
+			ok = false;
+			break;
+		}
+	}
+	tdb_close(tdb);
+
+	if (ok && rename(tmpname, tdb_name) != 0) {
+		log("Could not rename snapshot to %s: %s", tdb_name,
+		    strerror(errno));
+		ok = false;
+	}
+	if (!ok)
+		unlink(tmpname);
+	else
+		dirty = false;
+
+ out:
+	talloc_free(tmpname);
+	if (!tdb || !ok) {
+		errno = EIO;
+		return false;
+	}
+	return true;
+}
+
+int store_periodic(void)
+{
+	time_t now;
+
+	if (!dirty || !tdb_name || snapshot_interval <= 0)
+		return -1;
+
+	now = time(NULL);
+	if (now < last_snapshot)
+		last_snapshot = now;
+	if (now - last_snapshot >= snapshot_interval) {
+		/* Failures are logged: try again next interval. */
+		if (store_snapshot())
+			return -1;
+		now = last_snapshot;
+	}
+
+	return (last_snapshot + snapshot_interval - now) * 1000;
+}
+
+/*
+ * Local variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ * End:
+ */
@@ -0,0 +1,61 @@
+/*
+    Node store for Xen Store Daemon.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XENSTORED_STORE_H
+#define _XENSTORED_STORE_H
+
+#include "xenstored_core.h"
+
+/* Keep the store in the TDB file, rather than in memory with snapshots. */
+extern bool store_in_tdb;
+
+/* Seconds between snapshots of a changed in-memory store: 0 for never. */
+extern int snapshot_interval;
+
+/*
+ * Open the store, with what the TDB file at tdbname holds unless
+ * tdb_flags has TDB_INTERNAL.  Returns false if there was nothing.
+ */
+bool store_open(const char *tdbname, int tdb_flags);
+
+/* Node records, keyed by path.  All return false and set errno on failure. */
+
+/* Returns a talloc'ed copy, off NULL. */
+TDB_DATA store_fetch(const char *name);
+bool store_store(const char *name, TDB_DATA data);
+bool store_delete(const char *name);
+
+/* Call fn for each record: stops early if it returns non-zero. */
+void store_traverse(int (*fn)(const char *name, TDB_DATA data, void *priv),
+		    void *priv);
+
+/*
+ * Make a series of changes all happen or none: after starting, commit
+ * them, or cancel to put back what they replaced.
+ */
+void store_transaction_start(void);
+void store_transaction_commit(void);
+void store_transaction_cancel(void);
+
+/* Write the in-memory store to the TDB file. */
+bool store_snapshot(void);
+
+/* Snapshot if one is due: returns milliseconds until the next, or -1. */
+int store_periodic(void);
+
+#endif /* _XENSTORED_STORE_H */
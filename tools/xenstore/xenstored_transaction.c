@@ -33,9 +33,20 @@
 #include "xenstored_transaction.h"
 #include "xenstored_watch.h"
 #include "xenstored_domain.h"
+#include "xenstored_store.h"
 #include "xenstore_lib.h"
+#include "hashtable.h"
 #include "utils.h"
 
+/*
+ * A transaction works on an overlay of the store: each node it touches is
+ * read from the store once and kept, with the generation it had, and the
+ * transaction's changes only go to its own copies. Committing checks that
+ * none of the nodes touched has changed in the store since, and then
+ * writes the changed ones back, so both ends of a transaction cost in
+ * proportion to what it touched rather than to the size of the store.
+ */
+
 struct changed_node
 {
 	/* List of all changed nodes in the context of this transaction. */
@@ -48,6 +59,25 @@ struct changed_node
 	bool recurse;
 };
 
+struct accessed_node
+{
+	/* List of all nodes accessed in the context of this transaction. */
+	struct list_head list;
+
+	/* The name of the node. */
+	char *node;
+
+	/* Was it in the store when first accessed, and at what generation? */
+	bool existed;
+	uint64_t generation;
+
+	/* Node record as the transaction sees it, dptr NULL if none. */
+	TDB_DATA data;
+
+	/* Has the transaction changed (or deleted) it? */
+	bool modified;
+};
+
 struct changed_domain
 {
 	/* List of all changed domains in the context of this transaction. */
@@ -68,12 +98,9 @@ struct transaction
 	/* Connection-local identifier for this transaction. */
 	uint32_t id;
 
-	/* Generation when transaction started. */
-	unsigned int generation;
-
-	/* TDB to work on, and filename */
-	TDB_CONTEXT *tdb;
-	char *tdb_name;
+	/* Nodes accessed, with a hash of them by name. */
+	struct list_head accessed;
+	struct hashtable *accessed_hash;
 
 	/* List of changed nodes. */
 	struct list_head changes;
@@ -83,12 +110,170 @@ struct transaction
 };
 
 extern int quota_max_transaction;
-static unsigned int generation;
+uint64_t generation;
 
-/* Return tdb context to use for this connection. */
-TDB_CONTEXT *tdb_transaction_context(struct transaction *trans)
+static unsigned int hash_from_key_fn(void *k)
 {
-	return trans->tdb;
+	char *str = k;
+	unsigned int hash = 5381;
+	char c;
+
+	while ((c = *str++))
+		hash = ((hash << 5) + hash) + (unsigned int)c;
+
+	return hash;
+}
+
+static int keys_equal_fn(void *key1, void *key2)
+{
+	return 0 == strcmp((char *)key1, (char *)key2);
+}
+
+/* If it fails, returns NULL and sets errno. */
+static struct accessed_node *get_accessed(struct transaction *trans,
+					  const char *name)
+{
+	struct accessed_node *i;
+	TDB_DATA data;
+	char *k;
+
+	i = hashtable_search(trans->accessed_hash, (void *)name);
+	if (i)
+		return i;
+
+	data = store_fetch(name);
+	if (!data.dptr && errno != ENOENT)
+		return NULL;
+
+	i = talloc_zero(trans, struct accessed_node);
+	k = strdup(name);
+	if (!i || !k) {
+		talloc_free(data.dptr);
+		talloc_free(i);
+		free(k);
+		errno = ENOMEM;
+		return NULL;
+	}
+	i->node = talloc_strdup(i, name);
+	if (data.dptr) {
+		i->existed = true;
+		i->generation = ((struct xs_tdb_record_hdr *)data.dptr)->generation;
+		i->data = data;
+		talloc_steal(i, data.dptr);
+	}
+	if (!i->node || !hashtable_insert(trans->accessed_hash, k, i)) {
+		talloc_free(i);
+		free(k);
+		errno = ENOMEM;
+		return NULL;
+	}
+	list_add_tail(&i->list, &trans->accessed);
+
+	return i;
+}
+
+TDB_DATA transaction_fetch(struct transaction *trans, const char *name)
+{
+	struct accessed_node *i = get_accessed(trans, name);
+	TDB_DATA data = { NULL, 0 };
+
+	if (!i)
+		return data;
+	if (!i->data.dptr) {
+		errno = ENOENT;
+		return data;
+	}
+
+	data.dptr = talloc_memdup(trans, i->data.dptr, i->data.dsize);
+	if (!data.dptr) {
+		errno = ENOMEM;
+		return data;
+	}
+	data.dsize = i->data.dsize;
+
+	return data;
+}
+
+bool transaction_store(struct transaction *trans, const char *name,
+		       TDB_DATA data)
+{
+	struct accessed_node *i = get_accessed(trans, name);
+
+	if (!i)
+		return false;
+
+	talloc_free(i->data.dptr);
+	i->data = data;
+	talloc_steal(i, data.dptr);
+	i->modified = true;
+
+	return true;
+}
+
+bool transaction_delete(struct transaction *trans, const char *name)
+{
+	struct accessed_node *i = get_accessed(trans, name);
+
+	if (!i)
+		return false;
+
+	talloc_free(i->data.dptr);
+	i->data.dptr = NULL;
+	i->data.dsize = 0;
+	i->modified = true;
+
+	return true;
+}
+
+/* Has any node we accessed changed in the store since? */
+static bool transaction_conflicts(struct transaction *trans)
+{
+	struct accessed_node *i;
+	TDB_DATA data;
+	bool conflict;
+
+	list_for_each_entry(i, &trans->accessed, list) {
+		data = store_fetch(i->node);
+		if (!data.dptr)
+			conflict = i->existed || errno != ENOENT;
+		else
+			conflict = !i->existed ||
+				((struct xs_tdb_record_hdr *)data.dptr)->
+				generation != i->generation;
+		talloc_free(data.dptr);
+		if (conflict)
+			return true;
+	}
+
+	return false;
+}
+
+/* Write our changes to the store: all of them, or on failure none. */
+static bool transaction_commit(struct transaction *trans)
+{
+	struct accessed_node *i;
+
+	store_transaction_start();
+	list_for_each_entry(i, &trans->accessed, list) {
+		if (!i->modified)
+			continue;
+
+		if (i->data.dptr) {
+			((struct xs_tdb_record_hdr *)i->data.dptr)->generation =
+				generation++;
+			if (!store_store(i->node, i->data))
+				goto error;
+		} else if (i->existed && !store_delete(i->node))
+			goto error;
+	}
+	store_transaction_commit();
+
+	return true;
+ error:
+	log("Store error on commit of %s: %s", i->node, strerror(errno));
+	store_transaction_cancel();
+	errno = EIO;
+	return false;
 }
 
 /* Callers get a change node (which can fail) and only commit after they've
@@ -97,11 +282,9 @@ void add_change_node(struct transaction *trans, const char *node, bool recurse)
 {
 	struct changed_node *i;
 
-	if (!trans) {
-		/* They're changing the global database. */
-		generation++;
+	/* Changes to the global database are tracked by generation. */
+	if (!trans)
 		return;
-	}
 
 	list_for_each_entry(i, &trans->changes, list)
 		if (streq(i->node, node))
@@ -118,9 +301,8 @@ static int destroy_transaction(void *_transaction)
 	struct transaction *trans = _transaction;
 
 	trace_destroy(trans, "transaction");
-	if (trans->tdb)
-		tdb_close(trans->tdb);
-	unlink(trans->tdb_name);
+	if (trans->accessed_hash)
+		hashtable_destroy(trans->accessed_hash, 0);
 	return 0;
 }
 
@@ -138,6 +320,54 @@ struct transaction *transaction_lookup(struct connection *conn, uint32_t id)
 	return ERR_PTR(-ENOENT);
 }
 
+static struct transaction *transaction_new(const void *ctx)
+{
+	struct transaction *trans;
+
+	trans = talloc(ctx, struct transaction);
+	if (!trans)
+		return NULL;
+	INIT_LIST_HEAD(&trans->list);
+	INIT_LIST_HEAD(&trans->accessed);
+	INIT_LIST_HEAD(&trans->changes);
+	INIT_LIST_HEAD(&trans->changed_domains);
+	trans->id = 0;
+	trans->accessed_hash = create_hashtable(16, hash_from_key_fn,
+						keys_equal_fn);
+	if (!trans->accessed_hash) {
+		talloc_free(trans);
+		return NULL;
+	}
+	/* Make it go if we go away. */
+	talloc_set_destructor(trans, destroy_transaction);
+
+	return trans;
+}
+
+/* Commit trans, firing watches for what changed: returns 0 or an errno. */
+static int transaction_finish(struct connection *conn,
+			      struct transaction *trans)
+{
+	struct changed_node *i;
+	struct changed_domain *d;
+
+	/* Fail only if what we looked at has changed since. */
+	if (transaction_conflicts(trans))
+		return EAGAIN;
+	if (!transaction_commit(trans))
+		return errno;
+
+	/* fix domain entry for each changed domain */
+	list_for_each_entry(d, &trans->changed_domains, list)
+		domain_entry_fix(d->domid, d->nbentry);
+
+	/* Fire off the watches for everything that changed. */
+	list_for_each_entry(i, &trans->changes, list)
+		fire_watches(conn, i->node, i->recurse);
+
+	return 0;
+}
+
 void do_transaction_start(struct connection *conn, struct buffered_data *in)
 {
 	struct transaction *trans, *exists;
@@ -155,19 +385,11 @@ void do_transaction_start(struct connection *conn, struct buffered_data *in)
 	}
 
 	/* Attach transaction to input for autofree until it's complete */
-	trans = talloc(in, struct transaction);
-	INIT_LIST_HEAD(&trans->changes);
-	INIT_LIST_HEAD(&trans->changed_domains);
-	trans->generation = generation;
-	trans->tdb_name = talloc_asprintf(trans, "%s.%p",
-					  xs_daemon_tdb(), trans);
-	trans->tdb = tdb_copy(tdb_context(conn), trans->tdb_name);
-	if (!trans->tdb) {
-		send_error(conn, errno);
+	trans = transaction_new(in);
+	if (!trans) {
+		send_error(conn, ENOMEM);
 		return;
 	}
-	/* Make it close if we go away. */
-	talloc_steal(trans, trans->tdb);
 
 	/* Pick an unused transaction identifier. */
 	do {
@@ -178,7 +400,6 @@ void do_transaction_start(struct connection *conn, struct buffered_data *in)
 	/* Now we own it. */
 	list_add_tail(&trans->list, &conn->transaction_list);
 	talloc_steal(conn, trans);
-	talloc_set_destructor(trans, destroy_transaction);
 	conn->transaction_started++;
 
 	snprintf(id_str, sizeof(id_str), "%u", trans->id);
@@ -187,9 +408,8 @@ void do_transaction_start(struct connection *conn, struct buffered_data *in)
 
 void do_transaction_end(struct connection *conn, const char *arg)
 {
-	struct changed_node *i;
-	struct changed_domain *d;
 	struct transaction *trans;
+	int err;
 
 	if (!arg || (!streq(arg, "T") && !streq(arg, "F"))) {
 		send_error(conn, EINVAL);
@@ -209,30 +429,32 @@ void do_transaction_end(struct connection *conn, const char *arg)
 	talloc_steal(arg, trans);
 
 	if (streq(arg, "T")) {
-		/* FIXME: Merge, rather failing on any change. */
-		if (trans->generation != generation) {
-			send_error(conn, EAGAIN);
-			return;
-		}
-		if (!replace_tdb(trans->tdb_name, trans->tdb)) {
-			send_error(conn, errno);
+		err = transaction_finish(conn, trans);
+		if (err) {
+			send_error(conn, err);
 			return;
 		}
-		/* Don't close this: we won! */
-		trans->tdb = NULL;
-
-		/* fix domain entry for each changed domain */
-		list_for_each_entry(d, &trans->changed_domains, list)
-			domain_entry_fix(d->domid, d->nbentry);
-
-		/* Fire off the watches for everything that changed. */
-		list_for_each_entry(i, &trans->changes, list)
-			fire_watches(conn, i->node, i->recurse);
-		generation++;
 	}
 	send_ack(conn, XS_TRANSACTION_END);
 }
 
+struct transaction *transaction_start_internal(const void *ctx)
+{
+	return transaction_new(ctx);
+}
+
+int transaction_end_internal(struct connection *conn,
+			     struct transaction *trans)
+{
+	int err;
+
+	assert(conn->transaction != trans);
+
+	err = transaction_finish(conn, trans);
+	talloc_free(trans);
+	return err;
+}
+
 void transaction_entry_inc(struct transaction *trans, unsigned int domid)
 {
 	struct changed_domain *d;
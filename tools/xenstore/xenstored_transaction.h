@@ -22,9 +22,22 @@
 
 struct transaction;
 
+/* Generation of the store: bumped for every node written to it. */
+extern uint64_t generation;
+
 void do_transaction_start(struct connection *conn, struct buffered_data *node);
 void do_transaction_end(struct connection *conn, const char *arg);
 
+/*
+ * A transaction with no id, for running several requests as one (see
+ * XS_MULTI): set conn->transaction to it while they run, then clear it
+ * and either talloc_free() it or end it, which commits it and fires
+ * the watches.  Ending returns 0 or an errno, and frees it either way.
+ */
+struct transaction *transaction_start_internal(const void *ctx);
+int transaction_end_internal(struct connection *conn,
+			     struct transaction *trans);
+
 struct transaction *transaction_lookup(struct connection *conn, uint32_t id);
 
 /* inc/dec entry number local to trans while changing a node */
@@ -35,8 +48,13 @@ void transaction_entry_dec(struct transaction *trans, unsigned int domid);
 void add_change_node(struct transaction *trans, const char *node,
                      bool recurse);
 
-/* Return tdb context to use for this connection. */
-TDB_CONTEXT *tdb_transaction_context(struct transaction *trans);
+/* A node's record as this transaction sees it: NULL and errno if none. */
+TDB_DATA transaction_fetch(struct transaction *trans, const char *name);
+
+/* Change a node within the transaction only. */
+bool transaction_store(struct transaction *trans, const char *name,
+		       TDB_DATA data);
+bool transaction_delete(struct transaction *trans, const char *name);
 
 void conn_delete_all_transactions(struct connection *conn);
 
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include "talloc.h"
 #include "list.h"
+#include "hashtable.h"
 #include "xenstored_watch.h"
 #include "xenstore_lib.h"
 #include "utils.h"
@@ -41,13 +42,157 @@ struct watch
 	/* Current outstanding events applying to this watch. */
 	struct list_head events;
 
+	/* Connection which set it. */
+	struct connection *conn;
+
 	/* Is this relative to connnection's implicit path? */
 	const char *relative_path;
 
 	char *token;
 	char *node;
+
+	/* Where this watch hangs in the index, and its place there. */
+	struct watch_node *wnode;
+	struct list_head index;
+};
+
+/*
+ * Index of watched paths.  There is a watch_node for every path that
+ * has a watch on it, and for every ancestor of such a path, so that
+ * the nodes form a tree rooted at "/".  "@" event names hang off the
+ * root, as a watch on "/" has always seen them.  A modification then
+ * looks up each prefix of the changed path (its ancestors) and, for
+ * rm, walks the subtree below it (its descendants), instead of
+ * comparing against every watch of every connection.
+ */
+struct watch_node
+{
+	/* Full path: also the key in watch_index. */
+	char *path;
+	struct watch_node *parent;
+
+	/* Nodes one component below this one. */
+	struct list_head children;
+	struct list_head sibling;
+
+	/* Watches on exactly this path. */
+	struct list_head watches;
 };
 
+static struct hashtable *watch_index;
+static unsigned int watch_nodes, watch_count;
+
+static struct {
+	unsigned long long fires;	/* fire_watches() outside transactions */
+	unsigned long long visited;	/* watches looked at */
+	unsigned long long events;	/* watch events queued */
+	unsigned long long total_us, max_us;
+} watch_stats;
+
+static unsigned int hash_from_key_fn(void *k)
+{
+	char *str = k;
+	unsigned int hash = 5381;
+	char c;
+
+	while ((c = *str++))
+		hash = ((hash << 5) + hash) + (unsigned int)c;
+
+	return hash;
+}
+
+static int keys_equal_fn(void *key1, void *key2)
+{
+	return 0 == strcmp((char *)key1, (char *)key2);
+}
+
+static struct watch_node *watch_node_lookup(const char *path)
+{
+	if (!watch_index)
+		return NULL;
+	return hashtable_search(watch_index, (void *)path);
+}
+
+/* Length of the parent's path: 0 if path is the root. */
+static unsigned int parent_len(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	if (streq(path, "/"))
+		return 0;
+	if (!slash || slash == path)
+		return 1;
+	return slash - path;
+}
+
+/* Find or create the node for path, and those of all its ancestors. */
+static struct watch_node *watch_node_get(const char *path)
+{
+	struct watch_node *wn, *parent = NULL;
+	unsigned int len = parent_len(path);
+	char *ppath;
+
+	wn = watch_node_lookup(path);
+	if (wn)
+		return wn;
+
+	if (len) {
+		ppath = talloc_strndup(NULL, len == 1 ? "/" : path, len);
+		if (!ppath)
+			return NULL;
+		parent = watch_node_get(ppath);
+		talloc_free(ppath);
+		if (!parent)
+			return NULL;
+	}
+
+	if (!watch_index) {
+		watch_index = create_hashtable(64, hash_from_key_fn,
+					       keys_equal_fn);
+		if (!watch_index)
+			return NULL;
+	}
+
+	wn = malloc(sizeof(*wn));
+	if (!wn)
+		return NULL;
+	wn->path = strdup(path);
+	if (!wn->path) {
+		free(wn);
+		return NULL;
+	}
+	if (!hashtable_insert(watch_index, wn->path, wn)) {
+		free(wn->path);
+		free(wn);
+		return NULL;
+	}
+	wn->parent = parent;
+	INIT_LIST_HEAD(&wn->children);
+	INIT_LIST_HEAD(&wn->watches);
+	if (parent)
+		list_add_tail(&wn->sibling, &parent->children);
+	watch_nodes++;
+
+	return wn;
+}
+
+/* Drop nodes which no longer lead to any watch, from wn upwards. */
+static void watch_node_put(struct watch_node *wn)
+{
+	struct watch_node *parent;
+
+	while (wn && list_empty(&wn->watches) && list_empty(&wn->children)) {
+		parent = wn->parent;
+		if (parent)
+			list_del(&wn->sibling);
+		/* Frees the key, which is wn->path. */
+		hashtable_remove(watch_index, wn->path);
+		free(wn);
+		watch_nodes--;
+		wn = parent;
+	}
+}
+
 static void add_event(struct connection *conn,
 		      struct watch *watch,
 		      const char *name)
@@ -84,30 +229,106 @@ static void add_event(struct connection *conn,
 	strcpy(data + strlen(name) + 1, watch->token);
 	send_reply(conn, XS_WATCH_EVENT, data, len);
 	talloc_free(data);
+	watch_stats.events++;
 }
 
-void fire_watches(struct connection *conn, const char *name, bool recurse)
+/* A NULL name tells each watch about its own path. */
+static void fire_node(struct watch_node *wn, const char *name)
 {
-	struct connection *i;
 	struct watch *watch;
 
+	list_for_each_entry(watch, &wn->watches, index) {
+		watch_stats.visited++;
+		add_event(watch->conn, watch, name ? name : watch->node);
+	}
+}
+
+/* Everything strictly below wn is told about its own path going away. */
+static void fire_subtree(struct watch_node *wn)
+{
+	struct watch_node *child;
+
+	list_for_each_entry(child, &wn->children, sibling) {
+		fire_node(child, NULL);
+		fire_subtree(child);
+	}
+}
+
+void fire_watches(struct connection *conn, const char *name, bool recurse)
+{
+	struct watch_node *wn;
+	struct timeval start, end;
+	unsigned long long us;
+	char *prefix;
+	unsigned int len;
+
 	/* During transactions, don't fire watches. */
 	if (conn && conn->transaction)
 		return;
 
-	/* Create an event for each watch. */
-	list_for_each_entry(i, &connections, list) {
-		list_for_each_entry(watch, &i->watches, list) {
-			if (is_child(name, watch->node))
-				add_event(i, watch, name);
-			else if (recurse && is_child(watch->node, name))
-				add_event(i, watch, watch->node);
-		}
+	watch_stats.fires++;
+	if (!watch_count)
+		return;
+
+	gettimeofday(&start, NULL);
+
+	/*
+	 * Watches on name and on each of its ancestors, root first.  A
+	 * missing prefix means nothing is watched below it either.
+	 */
+	prefix = talloc_strdup(NULL, name);
+	if (!prefix)
+		return;
+	len = (name[0] == '/');
+	wn = watch_node_lookup("/");
+	while (wn) {
+		fire_node(wn, name);
+		if (!name[len])
+			break;
+		if (name[len] == '/')
+			len++;
+		while (name[len] && name[len] != '/')
+			len++;
+		prefix[len] = '\0';
+		wn = watch_node_lookup(prefix);
+		prefix[len] = name[len];
 	}
+	talloc_free(prefix);
+
+	/* Watches below name are told about themselves. */
+	if (recurse && wn)
+		fire_subtree(wn);
+
+	gettimeofday(&end, NULL);
+	us = (end.tv_sec - start.tv_sec) * 1000000ULL +
+		end.tv_usec - start.tv_usec;
+	watch_stats.total_us += us;
+	if (us > watch_stats.max_us)
+		watch_stats.max_us = us;
+}
+
+char *watch_stats_string(const void *ctx)
+{
+	return talloc_asprintf(ctx,
+		"watches: %u\n"
+		"watch index nodes: %u\n"
+		"fires: %llu\n"
+		"watches visited: %llu\n"
+		"events queued: %llu\n"
+		"fire time total: %llu us\n"
+		"fire time max: %llu us\n",
+		watch_count, watch_nodes, watch_stats.fires,
+		watch_stats.visited, watch_stats.events,
+		watch_stats.total_us, watch_stats.max_us);
 }
 
 static int destroy_watch(void *_watch)
 {
+	struct watch *watch = _watch;
+
+	list_del(&watch->index);
+	watch_count--;
+	watch_node_put(watch->wnode);
 	trace_destroy(_watch, "watch");
 	return 0;
 }
@@ -154,6 +375,7 @@ void do_watch(struct connection *conn, struct buffered_data *in)
 	}
 
 	watch = talloc(conn, struct watch);
+	watch->conn = conn;
 	watch->node = talloc_strdup(watch, vec[0]);
 	watch->token = talloc_strdup(watch, vec[1]);
 	if (relative)
@@ -163,6 +385,15 @@ void do_watch(struct connection *conn, struct buffered_data *in)
 
 	INIT_LIST_HEAD(&watch->events);
 
+	watch->wnode = watch_node_get(watch->node);
+	if (!watch->wnode) {
+		talloc_free(watch);
+		send_error(conn, ENOMEM);
+		return;
+	}
+	list_add_tail(&watch->index, &watch->wnode->watches);
+	watch_count++;
+
 	domain_watch_inc(conn);
 	list_add_tail(&watch->list, &conn->watches);
 	trace_create(watch, "watch");
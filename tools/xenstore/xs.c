@@ -701,6 +701,120 @@ unwind:
 	return false;
 }
 
+/* Append to an XS_MULTI request: false if it does not fit. */
+static bool multi_append(char *buf, unsigned int *used,
+			 const void *data, unsigned int len)
+{
+	if (len > XENSTORE_PAYLOAD_MAX - *used) {
+		errno = E2BIG;
+		return false;
+	}
+	memcpy(buf + *used, data, len);
+	*used += len;
+	return true;
+}
+
+static void multi_free_values(struct xs_multi_op *ops, unsigned int num_ops)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_ops; i++) {
+		if (ops[i].type == XS_READ) {
+			free_no_errno(ops[i].value);
+			ops[i].value = NULL;
+		}
+	}
+}
+
+/* Do several operations in one request, in order.
+ * Returns false on failure.
+ */
+bool xs_multi(struct xs_handle *h, xs_transaction_t t,
+	      struct xs_multi_op *ops, unsigned int num_ops)
+{
+	char buf[XENSTORE_PAYLOAD_MAX];
+	char perm[MAX_STRLEN(unsigned int)+1];
+	struct xsd_sockmsg msg;
+	struct iovec iovec;
+	unsigned int i, j, start, used = 0, len;
+	char *reply, *p;
+
+	/* Each operation is a whole message of its own. */
+	for (i = 0; i < num_ops; i++) {
+		start = used;
+		memset(&msg, 0, sizeof(msg));
+		if (!multi_append(buf, &used, &msg, sizeof(msg)) ||
+		    !multi_append(buf, &used, ops[i].path,
+				  strlen(ops[i].path) + 1))
+			return false;
+
+		switch (ops[i].type) {
+		case XS_READ:
+			ops[i].value = NULL;
+			break;
+		case XS_MKDIR:
+		case XS_RM:
+			break;
+		case XS_WRITE:
+			if (!multi_append(buf, &used, ops[i].data, ops[i].len))
+				return false;
+			break;
+		case XS_SET_PERMS:
+			for (j = 0; j < ops[i].num_perms; j++) {
+				if (!xs_perm_to_string(&ops[i].perms[j], perm,
+						       sizeof(perm)) ||
+				    !multi_append(buf, &used, perm,
+						  strlen(perm) + 1))
+					return false;
+			}
+			break;
+		default:
+			errno = EINVAL;
+			return false;
+		}
+
+		msg.type = ops[i].type;
+		msg.len = used - start - sizeof(msg);
+		memcpy(buf + start, &msg, sizeof(msg));
+	}
+
+	iovec.iov_base = buf;
+	iovec.iov_len = used;
+	reply = xs_talkv(h, t, XS_MULTI, &iovec, 1, &len);
+	if (!reply)
+		return false;
+
+	/* So is each reply. */
+	for (i = 0, p = reply; i < num_ops; i++) {
+		if (reply + len - p < sizeof(msg))
+			goto bad;
+		memcpy(&msg, p, sizeof(msg));
+		p += sizeof(msg);
+		if (msg.type != ops[i].type || msg.len > reply + len - p)
+			goto bad;
+
+		if (msg.type == XS_READ) {
+			ops[i].value = malloc(msg.len + 1);
+			if (!ops[i].value)
+				goto fail;
+			memcpy(ops[i].value, p, msg.len);
+			((char *)ops[i].value)[msg.len] = '\0';
+			ops[i].value_len = msg.len;
+		}
+		p += msg.len;
+	}
+
+	free(reply);
+	return true;
+
+bad:
+	errno = EBADF;
+fail:
+	multi_free_values(ops, i);
+	free_no_errno(reply);
+	return false;
+}
+
 bool xs_restrict(struct xs_handle *h, unsigned domid)
 {
 	char buf[16];
@@ -11,9 +11,11 @@
 #include "utils.h"
 
 struct record_hdr {
+	uint64_t generation;
 	uint32_t num_perms;
 	uint32_t datalen;
 	uint32_t childlen;
+	uint32_t pad;
 	struct xs_permissions perms[0];
 };
 
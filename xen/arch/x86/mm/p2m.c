@@ -677,6 +677,13 @@ guest_physmap_add_entry(struct domain *d, unsigned long gfn,
             for ( i = 0; i < (1UL << page_order); i++ )
                 set_gpfn_from_mfn(mfn+i, gfn+i);
         }
+        /* New writable pages were never write-protected for log-dirty
+         * mode: record them now, so that the next clean does. */
+        if ( t == p2m_ram_rw && paging_mode_log_dirty(d) )
+        {
+            for ( i = 0; i < (1UL << page_order); i++ )
+                paging_mark_dirty(d, mfn + i);
+        }
     }
     else
     {
@@ -116,11 +116,29 @@ static void paging_free_log_dirty_page(struct domain *d, mfn_t mfn)
     d->arch.paging.free_page(d, mfn_to_page(mfn));
 }
 
+static void paging_free_log_dirty_ring(struct domain *d)
+{
+    uint64_t *ring, *spare;
+
+    paging_lock(d);
+    ring = d->arch.paging.log_dirty.ring;
+    spare = d->arch.paging.log_dirty.ring_spare;
+    d->arch.paging.log_dirty.ring = NULL;
+    d->arch.paging.log_dirty.ring_spare = NULL;
+    d->arch.paging.log_dirty.ring_count = 0;
+    paging_unlock(d);
+
+    xfree(ring);
+    xfree(spare);
+}
+
 void paging_free_log_dirty_bitmap(struct domain *d)
 {
     mfn_t *l4, *l3, *l2;
     int i4, i3, i2;
 
+    paging_free_log_dirty_ring(d);
+
     if ( !mfn_valid(d->arch.paging.log_dirty.top) )
         return;
 
@@ -269,6 +287,15 @@ void paging_mark_dirty(struct domain *d, unsigned long guest_mfn)
                      "marked mfn %" PRI_mfn " (pfn=%lx), dom %d\n",
                      mfn_x(gmfn), pfn, d->domain_id);
         d->arch.paging.log_dirty.dirty_count++;
+
+        if ( d->arch.paging.log_dirty.ring != NULL )
+        {
+            if ( d->arch.paging.log_dirty.ring_count < LOGDIRTY_RING_ENTRIES )
+                d->arch.paging.log_dirty.ring[
+                    d->arch.paging.log_dirty.ring_count++] = pfn;
+            else
+                d->arch.paging.log_dirty.ring_overflow = 1;
+        }
     }
 
 out:
@@ -420,6 +447,19 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
     if ( pages < sc->pages )
         sc->pages = pages;
 
+    if ( clean && d->arch.paging.log_dirty.ring )
+    {
+        unsigned int i, n = 0;
+
+        /* Forget the pfns whose bits were cleared, keep any beyond. */
+        for ( i = 0; i < d->arch.paging.log_dirty.ring_count; i++ )
+            if ( d->arch.paging.log_dirty.ring[i] >= pages )
+                d->arch.paging.log_dirty.ring[n++] =
+                    d->arch.paging.log_dirty.ring[i];
+        d->arch.paging.log_dirty.ring_count = n;
+        d->arch.paging.log_dirty.ring_overflow = 0;
+    }
+
     paging_unlock(d);
 
     if ( clean )
@@ -432,6 +472,9 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
     return rv;
 
  out:
+    /* A clean may have got part way: the ring no longer matches the trie. */
+    if ( clean )
+        d->arch.paging.log_dirty.ring_overflow = 1;
     paging_unlock(d);
     domain_unpause(d);
 
@@ -447,6 +490,159 @@ int paging_log_dirty_op(struct domain *d, struct xen_domctl_shadow_op *sc)
     return rv;
 }
 
+/* Clear a pfn's bit in the log-dirty trie. */
+static void paging_clear_log_dirty_bit(struct domain *d, unsigned long pfn)
+{
+    mfn_t mfn, *l4, *l3, *l2;
+    unsigned long *l1;
+
+    ASSERT(paging_locked_by_me(d));
+
+    mfn = d->arch.paging.log_dirty.top;
+    if ( !mfn_valid(mfn) )
+        return;
+
+    l4 = map_domain_page(mfn_x(mfn));
+    mfn = l4[L4_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l4);
+    if ( !mfn_valid(mfn) )
+        return;
+
+    l3 = map_domain_page(mfn_x(mfn));
+    mfn = l3[L3_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l3);
+    if ( !mfn_valid(mfn) )
+        return;
+
+    l2 = map_domain_page(mfn_x(mfn));
+    mfn = l2[L2_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l2);
+    if ( !mfn_valid(mfn) )
+        return;
+
+    l1 = map_domain_page(mfn_x(mfn));
+    __clear_bit(L1_LOGDIRTY_IDX(pfn), l1);
+    unmap_domain_page(l1);
+}
+
+/* Read the list of pfns dirtied since the last clean, and the stats.  If
+ * the operation is a CLEAN_RING, clear those pages and the stats as well.
+ * Unlike paging_log_dirty_op() the cost is in the number of dirty pages,
+ * not in the size of the guest. */
+static int paging_log_dirty_ring_op(struct domain *d,
+                                    struct xen_domctl_shadow_op *sc)
+{
+    struct log_dirty_domain *ld = &d->arch.paging.log_dirty;
+    uint64_t *ring = NULL, *spare = NULL, *list;
+    unsigned int i, count;
+    int rv = 0, clean = (sc->op == XEN_DOMCTL_SHADOW_OP_CLEAN_RING);
+
+    if ( !paging_mode_log_dirty(d) )
+        return -EINVAL;
+
+    /* Start recording on first use.  Serialised by the domctl lock. */
+    if ( ld->ring == NULL )
+    {
+        ring = xmalloc_array(uint64_t, LOGDIRTY_RING_ENTRIES);
+        spare = xmalloc_array(uint64_t, LOGDIRTY_RING_ENTRIES);
+        if ( ring == NULL || spare == NULL )
+        {
+            xfree(ring);
+            xfree(spare);
+            return -ENOMEM;
+        }
+    }
+
+    /* As for the bitmap, the domain must not write to pages between our
+     * reading the ring and write-protecting them again. */
+    if ( clean )
+        domain_pause(d);
+    paging_lock(d);
+
+    if ( ld->ring == NULL && ring != NULL )
+    {
+        /* Pages dirtied before now are only in the trie. */
+        ld->ring = ring;
+        ld->ring_spare = spare;
+        ld->ring_count = 0;
+        ld->ring_overflow = 1;
+        ring = spare = NULL;
+    }
+
+    PAGING_DEBUG(LOGDIRTY, "log-dirty ring %s: dom %u count=%u%s\n",
+                 (clean) ? "clean" : "peek", d->domain_id, ld->ring_count,
+                 ld->ring_overflow ? " (overflow)" : "");
+
+    sc->stats.fault_count = ld->fault_count;
+    sc->stats.dirty_count = ld->dirty_count;
+
+    if ( unlikely(ld->failed_allocs) )
+    {
+        rv = -ENOMEM;
+        goto out;
+    }
+
+    count = ld->ring_count;
+    if ( ld->ring_overflow || count > sc->pages )
+    {
+        rv = -ENOBUFS;
+        goto out;
+    }
+
+    if ( !guest_handle_is_null(sc->dirty_bitmap) && count != 0 &&
+         copy_to_guest_offset(sc->dirty_bitmap, 0, (uint8_t *)ld->ring,
+                              count * sizeof(uint64_t)) != 0 )
+    {
+        rv = -EFAULT;
+        goto out;
+    }
+    sc->pages = count;
+
+    if ( !clean )
+        goto out;
+
+    ld->fault_count = 0;
+    ld->dirty_count = 0;
+    for ( i = 0; i < count; i++ )
+        paging_clear_log_dirty_bit(d, ld->ring[i]);
+
+    /* Keep the list while we re-protect the pages, without holding the
+     * paging lock over the p2m lock. */
+    list = ld->ring;
+    ld->ring = ld->ring_spare;
+    ld->ring_spare = NULL;
+    ld->ring_count = 0;
+    paging_unlock(d);
+
+    if ( hap_enabled(d) )
+    {
+        /* Only the pages just cleaned can have been made writable since
+         * the last clean; see paging_log_dirty_range(). */
+        for ( i = 0; i < count; i++ )
+            p2m_change_type(d, list[i], p2m_ram_rw, p2m_ram_logdirty);
+        if ( count != 0 )
+            flush_tlb_mask(d->domain_dirty_cpumask);
+    }
+    else
+        ld->clean_dirty_bitmap(d);
+
+    paging_lock(d);
+    if ( ld->ring != NULL )
+        ld->ring_spare = list;
+    else
+        spare = list;
+
+ out:
+    paging_unlock(d);
+    if ( clean )
+        domain_unpause(d);
+
+    xfree(ring);
+    xfree(spare);
+
+    return rv;
+}
+
 void paging_log_dirty_range(struct domain *d,
                            unsigned long begin_pfn,
                            unsigned long nr,
@@ -601,6 +797,10 @@ int paging_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
     case XEN_DOMCTL_SHADOW_OP_CLEAN:
     case XEN_DOMCTL_SHADOW_OP_PEEK:
         return paging_log_dirty_op(d, sc);
+
+    case XEN_DOMCTL_SHADOW_OP_CLEAN_RING:
+    case XEN_DOMCTL_SHADOW_OP_PEEK_RING:
+        return paging_log_dirty_ring_op(d, sc);
     }
 
     /* Here, dispatch domctl to the appropriate paging code */
@@ -168,6 +168,12 @@ struct log_dirty_domain {
     unsigned int   fault_count;
     unsigned int   dirty_count;
 
+    /* pfns newly marked dirty since the last clean, in order */
+    uint64_t      *ring;
+    uint64_t      *ring_spare;    /* swapped in while a clean runs */
+    unsigned int   ring_count;
+    bool_t         ring_overflow; /* ring is incomplete: use the trie */
+
     /* functions which are paging mode specific */
     int            (*enable_log_dirty   )(struct domain *d);
     int            (*disable_log_dirty  )(struct domain *d);
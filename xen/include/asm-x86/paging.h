@@ -179,6 +179,13 @@ int paging_mfn_is_dirty(struct domain *d, mfn_t gmfn);
 #define L4_LOGDIRTY_IDX(pfn) (((pfn) >> (PAGE_SHIFT+3+PAGETABLE_ORDER*2)) & \
                               (LOGDIRTY_NODE_ENTRIES-1))
 
+/*
+ * Log-dirty pfn ring: the pfns newly set in the trie since the last clean,
+ * so that a toolstack chasing a small dirty set need not walk the whole
+ * trie.  When it fills up we stop appending and the next ring op fails.
+ */
+#define LOGDIRTY_RING_ENTRIES (1 << 14)
+
 /* VRAM dirty tracking support */
 struct sh_dirty_vram {
     unsigned long begin_pfn;
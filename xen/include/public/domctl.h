@@ -186,6 +186,16 @@ struct xen_domctl_getpageframeinfo3 {
 #define XEN_DOMCTL_SHADOW_OP_CLEAN       11
  /* Return the bitmap but do not modify internal copy. */
 #define XEN_DOMCTL_SHADOW_OP_PEEK        12
+ /*
+  * As CLEAN and PEEK, but return the pfns dirtied since the last clean as
+  * a list of uint64 in dirty_bitmap, with pages giving its capacity in
+  * entries.  Fail with -ENOBUFS, leaving the log untouched, if the list
+  * is incomplete (more pages were dirtied than Xen keeps track of, or no
+  * full CLEAN has been done since the list was first requested); the
+  * caller should fall back to the bitmap operations.
+  */
+#define XEN_DOMCTL_SHADOW_OP_CLEAN_RING  13
+#define XEN_DOMCTL_SHADOW_OP_PEEK_RING   14
 
 /* Memory allocation accessors. */
 #define XEN_DOMCTL_SHADOW_OP_GET_ALLOCATION   30
@@ -237,7 +247,7 @@ struct xen_domctl_shadow_op {
     /* OP_GET_ALLOCATION / OP_SET_ALLOCATION */
     uint32_t       mb;       /* Shadow memory allocation in MB */
 
-    /* OP_PEEK / OP_CLEAN */
+    /* OP_PEEK / OP_CLEAN / OP_PEEK_RING / OP_CLEAN_RING */
     XEN_GUEST_HANDLE_64(uint8) dirty_bitmap;
     uint64_aligned_t pages; /* Size of buffer. Updated with actual size. */
     struct xen_domctl_shadow_op_stats stats;
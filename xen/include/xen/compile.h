@@ -0,0 +1,27 @@
+#define XEN_COMPILE_DATE	"Fri Oct 16 23:45:33 UTC 2026"
+#define XEN_COMPILE_TIME	"23:45:33"
+#define XEN_COMPILE_BY		""
+#define XEN_COMPILE_DOMAIN	""
+#define XEN_COMPILE_HOST	"vm"
+#define XEN_COMPILER		"gcc (Debian 12.2.0-14+deb12u1) 12.2.0"
+
+#define XEN_VERSION		4
+#define XEN_SUBVERSION		3
+#define XEN_EXTRAVERSION	".2"
+
+#define XEN_CHANGESET		"Fri Oct 16 23:45:25 2026 +0000 git:dbb3a6b"
+#define XEN_BANNER		\
+"\040\137\137\040\040\137\137\040\040\040\040\040\040\040\040\040\040\040" \
+"\040\137\040\040\137\040\040\040\040\137\137\137\137\137\040\040\137\137" \
+"\137\137\040\040\012\040\134\040\134\057\040\057\137\137\137\040\137\040" \
+"\137\137\040\040\040\174\040\174\174\040\174\040\040\174\137\137\137\040" \
+"\057\040\174\137\137\137\040\134\040\012\040\040\134\040\040\057\057\040" \
+"\137\040\134\040\047\137\040\134\040\040\174\040\174\174\040\174\137\040" \
+"\040\040\174\137\040\134\040\040\040\137\137\051\040\174\012\040\040\057" \
+"\040\040\134\040\040\137\137\057\040\174\040\174\040\174\040\174\137\137" \
+"\040\040\040\137\174\040\137\137\137\051\040\174\040\057\040\137\137\057" \
+"\040\012\040\057\137\057\134\137\134\137\137\137\174\137\174\040\174\137" \
+"\174\040\040\040\040\174\137\174\050\137\051\137\137\137\137\050\137\051" \
+"\137\137\137\137\137\174\012\040\040\040\040\040\040\040\040\040\040\040" \
+"\040\040\040\040\040\040\040\040\040\040\040\040\040\040\040\040\040\040" \
+"\040\040\040\040\040\040\040\040\040\040\040\012"